@@ -0,0 +1,470 @@
+// Connor Humiston
+// Resolver Backend Implementation: getaddrinfo & async adapters plus the registry
+#include "backend.h"
+
+#include <string.h>                                 // C string library
+#include <errno.h>                                  // ETIMEDOUT
+#include <time.h>                                   // clock_gettime()
+#include <pthread.h>                                // getaddrinfo helper threads
+
+#include "util.h"                                   // dnslookup_all()
+#include "options.h"                                // backend settings
+#include "dnsasync.h"                               // asynchronous DNS engine
+#include "synthetic.h"                              // synthetic backend
+
+#define GAI_MAX_CALLS           8                   // helper threads per resolver: getaddrinfo calls running at once, abandoned ones included
+
+
+/* getaddrinfo Call Queued for or Running on a Helper Thread (--hedge or --deadline) */
+typedef struct GaiCall
+{
+    struct GaiCall* next;                           // calls the resolver still wants, oldest first
+    struct GaiCall* qnext;                          // calls no helper has taken yet, oldest first
+    void* user;                                     // caller's handle
+    int queued;                                     // still waiting for a helper
+    int done;                                       // helper returned & filled result
+    int cancelled;                                  // nobody wants the answer, the helper frees the call
+    LookupResult result;
+    char hostname[];
+} GaiCall;
+
+/* getaddrinfo State: one blocking lookup at a time, or a few helper threads so lookups can be hedged & abandoned */
+typedef struct GaiState
+{
+    const char* hostname;                           // blocking: submitted name, NULL when idle
+    void* user;                                     // blocking: caller's handle
+    int family;                                     // AF_UNSPEC, AF_INET or AF_INET6
+    int max_addrs;                                  // addresses kept per name
+    int threaded;                                   // 1 to run every lookup on a helper thread
+    pthread_mutex_t lock;                           // threaded: guards the fields below
+    pthread_cond_t done;                            // signalled when a wanted call returns
+    pthread_cond_t work;                            // signalled when a call is queued or the state closes
+    GaiCall* calls;                                 // wanted calls (queued, running or done)
+    GaiCall* todo;                                  // queued calls, taken by the helpers in order
+    GaiCall** todo_end;
+    int queued;                                     // length of todo
+    int live;                                       // length of calls (only the resolver changes it)
+    int threads;                                    // helpers started & not exited, at most GAI_MAX_CALLS
+    int idle;                                       // helpers waiting for a call (the rest are inside getaddrinfo)
+    int closed;                                     // destroyed: helpers exit & the last one frees the state
+} GaiState;
+
+static void* gai_init(const Options* opts)
+{
+    GaiState* s = calloc(1, sizeof(GaiState));
+    if(!s)
+        return NULL;
+    s->family = opts->family;
+    s->max_addrs = opts->all_addrs ? LOOKUP_MAX_ADDRS : 1;
+    s->threaded = opts->hedge > 0 || opts->deadline > 0; // a blocking call could be neither raced nor abandoned
+    s->lock = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+    s->done = (pthread_cond_t) PTHREAD_COND_INITIALIZER;
+    s->work = (pthread_cond_t) PTHREAD_COND_INITIALIZER;
+    s->todo_end = &s->todo;
+    return s;
+}
+
+static void gai_free(GaiState* s)
+{
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->done);
+    pthread_cond_destroy(&s->work);
+    free(s);
+}
+
+/* One getaddrinfo into an ip list, returns UTIL_SUCCESS or UTIL_FAILURE */
+static int gai_lookup(const GaiState* s, const char* hostname, char* ip)
+{
+    UtilAddr addrs[LOOKUP_MAX_ADDRS];               // filled by the lookup, nothing allocated per address
+    int n = dnslookup_all(hostname, s->family, addrs, s->max_addrs);
+    int i;
+
+    ip[0] = '\0';
+    if(n < 1)
+        return UTIL_FAILURE;
+    for(i = 0; i < n; i++)
+        lookup_append(ip, LOOKUP_IP_LENGTH, addrs[i].family, &addrs[i].addr); // LOOKUP_IP_LENGTH fits every address
+    return UTIL_SUCCESS;
+}
+
+/* Takes the oldest queued call off todo (state locked), NULL if there is none */
+static GaiCall* gai_take(GaiState* s)
+{
+    GaiCall* c = s->todo;
+    if(!c)
+        return NULL;
+    if(!(s->todo = c->qnext))
+        s->todo_end = &s->todo;
+    c->queued = 0;
+    s->queued--;
+    return c;
+}
+
+/* Runs a taken call with the state locked on entry & exit, then hands the answer back (or frees an abandoned call) */
+static void gai_run(GaiState* s, GaiCall* c)
+{
+    LookupResult r;
+    pthread_mutex_unlock(&s->lock);
+    r.user = c->user;
+    r.status = gai_lookup(s, c->hostname, r.ip);    // as long as the system resolver takes, abandoned or not
+    pthread_mutex_lock(&s->lock);
+    if(c->cancelled)
+        free(c);
+    else
+    {
+        c->result = r;
+        c->done = 1;
+        pthread_cond_signal(&s->done);
+    }
+}
+
+/* Helper: runs queued calls one at a time until the state is destroyed */
+static void* gai_helper(void* arg)
+{
+    GaiState* s = (GaiState*) arg;
+    GaiCall* c;
+    int last;
+
+    pthread_mutex_lock(&s->lock);
+    while(1)
+    {
+        while(!s->todo && !s->closed)
+        {
+            s->idle++;
+            pthread_cond_wait(&s->work, &s->lock);
+            s->idle--;
+        }
+        if(!(c = gai_take(s)))                      // closed with nothing left to run
+            break;
+        gai_run(s, c);
+    }
+    s->threads--;
+    last = s->threads == 0;
+    pthread_mutex_unlock(&s->lock);
+    if(last)
+        gai_free(s);
+    return NULL;
+}
+
+static int gai_submit(void* state, const char* hostname, void* user)
+{
+    GaiState* s = (GaiState*) state;
+    GaiCall* c;
+    GaiCall** end;
+    pthread_t id;
+    pthread_attr_t attr;
+
+    if(!s->threaded)
+    {
+        if(s->hostname)
+            return BACKEND_FULL;
+        s->hostname = hostname;
+        s->user = user;
+        return 0;
+    }
+    pthread_mutex_lock(&s->lock);
+    if(s->live > 0 && s->queued >= s->idle && s->threads >= GAI_MAX_CALLS)
+    {
+        pthread_mutex_unlock(&s->lock);             // a hedge no helper could start is refused (a first attempt
+                                                    // queues instead, & --deadline logs it TIMEOUT if none frees up)
+        return BACKEND_FULL;
+    }
+    if(!(c = calloc(1, sizeof(*c) + strlen(hostname) + 1)))
+    {
+        pthread_mutex_unlock(&s->lock);
+        return s->live > 0 ? BACKEND_FULL : BACKEND_BADNAME;
+    }
+    c->user = user;
+    strcpy(c->hostname, hostname);                  // the resolver may reuse its slot before an abandoned call returns
+    for(end = &s->calls; *end; end = &(*end)->next)
+        ;
+    *end = c;
+    s->live++;
+    c->queued = 1;
+    *s->todo_end = c;
+    s->todo_end = &c->qnext;
+    s->queued++;
+    if(s->queued <= s->idle)                        // a waiting helper takes it
+        pthread_cond_signal(&s->work);
+    else if(s->threads < GAI_MAX_CALLS)             // every helper is busy: start another
+    {
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if(pthread_create(&id, &attr, gai_helper, s) == 0)
+            s->threads++;
+        else if(s->threads == 0)                    // no thread to spare & none to wait for: look it up here instead
+            gai_run(s, gai_take(s));
+        pthread_attr_destroy(&attr);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+}
+
+/* Blocking: the lookup itself happens here, for as long as the system resolver takes.
+ * Threaded: waits up to timeout_ms for a helper to return */
+static int gai_complete(void* state, int timeout_ms, LookupResult* out, int max)
+{
+    GaiState* s = (GaiState*) state;
+    GaiCall** link;
+    struct timespec deadline;
+    int n = 0;
+
+    if(!s->threaded)
+    {
+        if(!s->hostname || max < 1)
+            return 0;
+        out->user = s->user;
+        out->status = gai_lookup(s, s->hostname, out->ip);
+        s->hostname = NULL;
+        return 1;
+    }
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+    if(deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&s->lock);
+    while(n < max)
+    {
+        for(link = &s->calls; *link && n < max; )   // hand back every returned call
+        {
+            GaiCall* c = *link;
+            if(!c->done)
+            {
+                link = &c->next;
+                continue;
+            }
+            out[n++] = c->result;
+            *link = c->next;
+            s->live--;
+            free(c);
+        }
+        if(n > 0 || s->live == 0 || timeout_ms == 0)
+            break;
+        if(timeout_ms < 0)
+            pthread_cond_wait(&s->done, &s->lock);
+        else if(pthread_cond_timedwait(&s->done, &s->lock, &deadline) == ETIMEDOUT)
+            timeout_ms = 0;                         // one last look, then give up
+    }
+    pthread_mutex_unlock(&s->lock);
+    return n;
+}
+
+/* Drops an unwanted call (state locked): a queued one never runs, a running one is freed by its helper */
+static void gai_abandon(GaiState* s, GaiCall* c)
+{
+    GaiCall** q;
+    if(c->queued)
+    {
+        for(q = &s->todo; *q != c; q = &(*q)->qnext)
+            ;
+        if(!(*q = c->qnext))
+            s->todo_end = q;
+        s->queued--;
+        free(c);
+    }
+    else if(c->done)
+        free(c);
+    else
+        c->cancelled = 1;
+}
+
+/* Threaded only: a running call is left to finish on its own, holding its helper until it does */
+static void gai_cancel(void* state, void* user)
+{
+    GaiState* s = (GaiState*) state;
+    GaiCall** link;
+
+    if(!s->threaded)
+        return;
+    pthread_mutex_lock(&s->lock);
+    for(link = &s->calls; *link; link = &(*link)->next)
+    {
+        GaiCall* c = *link;
+        if(c->user != user)
+            continue;
+        *link = c->next;
+        s->live--;
+        gai_abandon(s, c);
+        break;
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+static int gai_pending(void* state)
+{
+    GaiState* s = (GaiState*) state;
+    return s->threaded ? s->live : s->hostname != NULL;
+}
+
+static int gai_capacity(const Options* opts)
+{
+    (void) opts;
+    return 1;
+}
+
+static void gai_destroy(void* state)
+{
+    GaiState* s = (GaiState*) state;
+    int last;
+
+    pthread_mutex_lock(&s->lock);
+    while(s->calls)                                 // abandon whatever is still queued or running
+    {
+        GaiCall* c = s->calls;
+        s->calls = c->next;
+        gai_abandon(s, c);
+    }
+    s->closed = 1;
+    pthread_cond_broadcast(&s->work);               // idle helpers exit, busy ones once getaddrinfo returns
+    last = s->threads == 0;
+    pthread_mutex_unlock(&s->lock);
+    if(last)
+        gai_free(s);
+}
+
+static const Backend gai_backend =
+{
+    "getaddrinfo", gai_init, gai_submit, gai_complete, gai_cancel, gai_pending, gai_capacity, gai_destroy
+};
+
+
+/* async Adapter: the epoll engine in dnsasync.c */
+static void* async_init(const Options* opts)
+{
+    int cap = opts->async_inflight;
+    if(opts->hedge > 0)                             // room for a hedge per name
+        cap = cap * 2 < MAX_ASYNC_INFLIGHT ? cap * 2 : MAX_ASYNC_INFLIGHT;
+    return dnsasync_create(&opts->server, opts->serverlen, cap, opts->dns_timeout_ms, opts->dns_retries,
+                           opts->family, opts->all_addrs ? LOOKUP_MAX_ADDRS : 1);
+}
+
+static int async_submit(void* state, const char* hostname, void* user)
+{
+    switch(dnsasync_submit((AsyncEngine*) state, hostname, user))
+    {
+        case 0:
+            return 0;
+        case DNSASYNC_FULL:
+            return BACKEND_FULL;
+        default:
+            return BACKEND_BADNAME;
+    }
+}
+
+static int async_complete(void* state, int timeout_ms, LookupResult* out, int max)
+{
+    return dnsasync_poll((AsyncEngine*) state, timeout_ms, out, max);
+}
+
+static void async_cancel(void* state, void* user)
+{
+    dnsasync_cancel((AsyncEngine*) state, user);
+}
+
+static int async_pending(void* state)
+{
+    return ((AsyncEngine*) state)->pending;
+}
+
+static int async_capacity(const Options* opts)
+{
+    return opts->async_inflight;
+}
+
+static void async_destroy(void* state)
+{
+    dnsasync_destroy((AsyncEngine*) state);
+}
+
+static const Backend async_backend =
+{
+    "async", async_init, async_submit, async_complete, async_cancel, async_pending, async_capacity, async_destroy
+};
+
+
+/* Registry */
+static const Backend* const backends[] =
+{
+    &gai_backend,                                   // default
+    &async_backend,
+    &synthetic_backend
+};
+
+/* Looks up a backend by name, NULL if unknown */
+const Backend* backend_find(const char* name)
+{
+    size_t i;
+    for(i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+    {
+        if(strcmp(backends[i]->name, name) == 0)
+            return backends[i];
+    }
+    return NULL;
+}
+
+/* Comma separated list of the backend names, for usage messages */
+const char* backend_names(void)
+{
+    static char list[128];                          // built from the registry once, so a new engine is listed too
+    size_t i, len = 0;
+    if(list[0] == '\0')
+    {
+        for(i = 0; i < sizeof(backends) / sizeof(backends[0]) && len < sizeof(list); i++)
+            len += (size_t) snprintf(list + len, sizeof(list) - len, "%s%s", i ? ", " : "", backends[i]->name);
+    }
+    return list;
+}
+
+/* Log word for a status without an address: NOT_RESOLVED, TIMEOUT or INVALID */
+const char* lookup_status_name(int status)
+{
+    if(status == LOOKUP_TIMEOUT)
+        return "TIMEOUT";
+    return status == LOOKUP_INVALID ? "INVALID" : "NOT_RESOLVED";
+}
+
+/* Appends an address (4 or 16 bytes in network order) to the ip list of size bytes, returns -1 if it doesn't fit */
+int lookup_append(char* ip, size_t size, int family, const void* addr)
+{
+    size_t len = strlen(ip);
+    if(len > 0)
+    {
+        if(len + 2 >= size)
+            return -1;
+        memcpy(ip + len, ", ", 3);                  // same separator as the "hostname, ip" log line
+        len += 2;
+    }
+    if(!inet_ntop(family, addr, ip + len, (socklen_t) (size - len)))
+    {
+        ip[len > 0 ? len - 2 : 0] = '\0';          // drop the separator again
+        return -1;
+    }
+    return 0;
+}
+
+/* Parses the first address of an ip list into family & addr (16 bytes), returns the rest of the list or NULL at its end */
+const char* lookup_next(const char* ip, int* family, void* addr)
+{
+    char one[INET6_ADDRSTRLEN];
+    size_t n = strcspn(ip, ",");
+
+    if(n == 0 || n >= sizeof(one))
+        return NULL;
+    memcpy(one, ip, n);
+    one[n] = '\0';
+    memset(addr, 0, sizeof(struct in6_addr));
+    if(inet_pton(AF_INET, one, addr) == 1)
+        *family = AF_INET;
+    else if(inet_pton(AF_INET6, one, addr) == 1)
+        *family = AF_INET6;
+    else
+        return NULL;
+    ip += n;
+    while(*ip == ',' || *ip == ' ')
+        ip++;
+    return ip;
+}
@@ -0,0 +1,60 @@
+// Connor Humiston
+// Resolver Backend Interface Header
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <arpa/inet.h>                              // INET6_ADDRSTRLEN
+
+/* submit() failures */
+#define BACKEND_FULL            -1                  // no room, call complete() first
+#define BACKEND_BADNAME         -2                  // name can never resolve, answer NOT_RESOLVED now
+
+/* LookupResult status besides UTIL_SUCCESS & UTIL_FAILURE */
+#define LOOKUP_TIMEOUT          -2                  // gave up at the --deadline, logged as TIMEOUT & never cached
+#define LOOKUP_INVALID          -3                  // failed the requester's checks, logged as INVALID without a lookup
+
+#define LOOKUP_MAX_ADDRS        8                   // addresses kept per name with --all-addrs
+#define LOOKUP_IP_LENGTH        (LOOKUP_MAX_ADDRS * (INET6_ADDRSTRLEN + 2)) // "ip, ip, ..." list w/ null terminator
+
+struct Options;                                     // options.h includes this header
+
+
+/* Finished Lookup */
+typedef struct LookupResult
+{
+    void* user;                                     // handle given to submit()
+    int status;                                     // UTIL_SUCCESS, UTIL_FAILURE or LOOKUP_TIMEOUT
+    char ip[LOOKUP_IP_LENGTH];                      // ", " separated addresses on success
+} LookupResult;
+
+/* Resolver Backend: each resolver thread gets its own state from init() */
+typedef struct Backend
+{
+    const char* name;                               // --engine value
+    void* (*init)(const struct Options* opts);      // per-thread state, NULL on failure
+    int (*submit)(void* state, const char* hostname, void* user); // 0 if accepted, BACKEND_FULL or BACKEND_BADNAME
+    int (*complete)(void* state, int timeout_ms, LookupResult* out, int max); // waits up to timeout_ms, returns # results
+    void (*cancel)(void* state, void* user);        // drops a submitted lookup, complete() never returns it
+    int (*pending)(void* state);                    // lookups submitted but not yet completed
+    int (*capacity)(const struct Options* opts);    // most names a thread may have pending (hedges get room on top)
+    void (*destroy)(void* state);                   // frees the state (pending lookups are dropped)
+} Backend;
+
+
+/* Looks up a backend by name, NULL if unknown */
+const Backend* backend_find(const char* name);
+
+/* Comma separated list of the backend names, for usage messages */
+const char* backend_names(void);
+
+/* Log word for a status without an address: NOT_RESOLVED, TIMEOUT or INVALID */
+const char* lookup_status_name(int status);
+
+/* Appends an address (4 or 16 bytes in network order) to the ip list of size bytes, returns -1 if it doesn't fit */
+int lookup_append(char* ip, size_t size, int family, const void* addr);
+
+/* Parses the first address of an ip list into family & addr (16 bytes), returns the rest of the list or NULL at its end */
+const char* lookup_next(const char* ip, int* family, void* addr);
+
+#endif
@@ -0,0 +1,65 @@
+#!/bin/sh
+# Connor Humiston
+# End-to-End Benchmark: whole runs of multi-lookup against the synthetic resolver over a generated corpus,
+# one JSON line per run (the run's final --metrics report plus its settings)
+#
+# usage: sh bench/e2e.sh [--label=TEXT] [--scale=F] [--runs=N] [--dir=DIR]
+#   run from the directory holding multi-lookup & gencorpus (make bench does both)
+
+label=""
+scale=1
+runs=1
+dir=""
+for a in "$@"; do
+    case "$a" in
+        --label=*) label="${a#--label=}" ;;
+        --scale=*) scale="${a#--scale=}" ;;
+        --runs=*) runs="${a#--runs=}" ;;
+        --dir=*) dir="${a#--dir=}" ;;
+        *) echo "usage: sh bench/e2e.sh [--label=TEXT] [--scale=F] [--runs=N] [--dir=DIR]" >&2; exit 1 ;;
+    esac
+done
+for tool in ./multi-lookup ./gencorpus; do
+    if [ ! -x "$tool" ]; then
+        echo "$tool not found: run make multi-lookup gencorpus first" >&2
+        exit 1
+    fi
+done
+
+names=$(awk -v s="$scale" 'BEGIN { n = int(100000 * s); print (n < 1000 ? 1000 : n) }')
+if [ -z "$dir" ]; then
+    dir=$(mktemp -d "${TMPDIR:-/tmp}/e2e.XXXXXX") || exit 1
+    trap 'rm -rf "$dir"' EXIT
+fi
+
+# Corpus: 30% repeats (cache hits) over 8 files of Zipf-skewed sizes, the same names on every machine
+./gencorpus --names="$names" --dup=0.3 --files=8 --skew=1 --seed=1 "$dir/corpus" || exit 1
+
+# Configurations: name, then multi-lookup options & thread counts
+run_config()
+{
+    config="$1"
+    shift
+    i=1
+    while [ "$i" -le "$runs" ]; do
+        rm -f "$dir/metrics.json" "$dir/serviced.txt" "$dir/resolved.txt"
+        if ! ./multi-lookup --metrics="$dir/metrics.json" "$@" "$dir/serviced.txt" "$dir/resolved.txt" \
+                "$dir"/corpus/names*.txt > /dev/null 2> "$dir/stderr.txt"; then
+            echo "$config failed:" >&2
+            cat "$dir/stderr.txt" >&2
+            exit 1
+        fi
+        printf '{"bench":"e2e","label":"%s","config":"%s","run":%d,"options":"%s","metrics":%s}\n' \
+            "$label" "$config" "$i" "$*" "$(tail -n 1 "$dir/metrics.json")"
+        i=$((i + 1))
+    done
+}
+
+run_config overhead       --engine=synthetic --synth-latency=fixed:0 4 4
+run_config overhead_sync  --engine=synthetic --synth-latency=fixed:0 --io=sync 4 4
+run_config binary_log     --engine=synthetic --synth-latency=fixed:0 --log-format=binary 4 4
+run_config blocking       --engine=synthetic --synth-latency=fixed:0.1 4 10
+run_config inflight       --engine=synthetic --synth-latency=fixed:1 --synth-inflight=64 4 4
+run_config lognormal_tail --engine=synthetic --synth-latency=lognormal:2:1.2 --synth-inflight=64 4 4
+run_config hedged_tail    --engine=synthetic --synth-latency=lognormal:2:1.2 --synth-inflight=64 --hedge=95 4 4
+run_config adaptive_pool  --engine=synthetic --synth-latency=fixed:0.1 --max-resolvers=32 4 4
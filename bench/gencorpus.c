@@ -0,0 +1,162 @@
+// Connor Humiston
+// Synthetic Hostname Corpus Generator: input files with a chosen size, duplicate ratio & file-size skew
+#include <stdio.h>                                  // standard i/o
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <stdint.h>                                 // fixed width integer types
+#include <string.h>                                 // C string library
+#include <math.h>                                   // pow()
+#include <errno.h>                                  // EEXIST
+#include <sys/stat.h>                               // mkdir()
+
+#define GEN_MAX_FILES           10000
+#define GEN_DEFAULT_NAMES       1000000
+#define GEN_DEFAULT_FILES       8
+
+
+/* Generator Settings */
+typedef struct GenOpts
+{
+    long names;                                     // lines in all files together
+    double dup;                                     // fraction of lines repeating an earlier name
+    int files;
+    double skew;                                    // file i gets a share proportional to 1 / (i + 1)^skew
+    uint64_t seed;
+    const char* dir;
+} GenOpts;
+
+/* splitmix64: name i is always built from mix(seed + i), so no name has to be kept */
+static uint64_t mix(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+/* Writes unique name id into out ("label[.label].nID.suffix"), returns its length */
+static int make_name(uint64_t seed, long id, char* out)
+{
+    static const char* suffixes[] = {"com", "net", "org", "io", "edu", "co.uk", "de", "example.com",
+                                     "cdn.example.net", "cloudfront.net", "github.io", "gov"};
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    uint64_t r = mix(seed + (uint64_t) id);
+    int labels = 1 + (int) (r & 1), len = 0, l, i;
+    r >>= 1;
+    for(l = 0; l < labels; l++)                     // 3 to 14 characters per label
+    {
+        int n = 3 + (int) (r % 12);
+        r = mix(r);
+        for(i = 0; i < n; i++)
+        {
+            out[len++] = chars[r % (sizeof(chars) - 1)];
+            r /= sizeof(chars) - 1;
+            if(r < 64)
+                r = mix(r + (uint64_t) id);
+        }
+        out[len++] = '.';
+    }
+    len += sprintf(out + len, "n%ld.%s", id, suffixes[r % (sizeof(suffixes) / sizeof(suffixes[0]))]);
+    return len;                                     // the id keeps every unique name distinct
+}
+
+/* Parses --name=value settings, returns 0 or -1 */
+static int parse(GenOpts* o, int argc, char* argv[])
+{
+    unsigned long seed = 1;
+    int i;
+    o->names = GEN_DEFAULT_NAMES;
+    o->dup = 0;
+    o->files = GEN_DEFAULT_FILES;
+    o->skew = 0;
+    o->dir = NULL;
+    for(i = 1; i < argc; i++)
+    {
+        const char* a = argv[i];
+        if(sscanf(a, "--names=%ld", &o->names) == 1 || sscanf(a, "--dup=%lf", &o->dup) == 1 ||
+           sscanf(a, "--files=%d", &o->files) == 1 || sscanf(a, "--skew=%lf", &o->skew) == 1 ||
+           sscanf(a, "--seed=%lu", &seed) == 1)
+            continue;
+        if(a[0] == '-' || o->dir)
+            return -1;
+        o->dir = a;
+    }
+    o->seed = seed;
+    if(!o->dir || o->names < 1 || o->dup < 0 || o->dup >= 1 || o->files < 1 || o->files > GEN_MAX_FILES || o->skew < 0)
+        return -1;
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    GenOpts o;
+    double total = 0;
+    long* share;
+    long given = 0, unique = 0, dups = 0;
+    unsigned long long bytes = 0;
+    uint64_t r;
+    int f;
+
+    if(parse(&o, argc, argv) != 0)
+    {
+        fprintf(stderr, "usage: gencorpus [--names=N] [--dup=RATIO] [--files=N] [--skew=S] [--seed=N] DIR\n");
+        fprintf(stderr, "  writes DIR/names0.txt ... one hostname per line; a fraction RATIO of the lines repeat an\n");
+        fprintf(stderr, "  earlier name & file i holds a share of the lines proportional to 1/(i+1)^S (0: equal)\n");
+        return EXIT_FAILURE;
+    }
+    if(mkdir(o.dir, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Unable to create \"%s\".\n", o.dir);
+        return EXIT_FAILURE;
+    }
+
+    // File Sizes: Zipf-Like Shares, the Rounding Left Over Goes to the First File
+    share = malloc(sizeof(long) * o.files);
+    if(!share)
+        return EXIT_FAILURE;
+    for(f = 0; f < o.files; f++)
+        total += 1.0 / pow(f + 1, o.skew);
+    for(f = 0; f < o.files; f++)
+    {
+        share[f] = (long) (o.names * (1.0 / pow(f + 1, o.skew)) / total);
+        given += share[f];
+    }
+    share[0] += o.names - given;
+
+    // Names: New Ones in Order, Repeats Drawn Uniformly from Those Already Written
+    r = mix(o.seed ^ 0xD1B54A32D192ED03ull);
+    for(f = 0; f < o.files; f++)
+    {
+        char path[4096], name[128];
+        FILE* fp;
+        long i;
+        snprintf(path, sizeof(path), "%s/names%d.txt", o.dir, f);
+        if(!(fp = fopen(path, "w")))
+        {
+            fprintf(stderr, "Unable to write \"%s\".\n", path);
+            return EXIT_FAILURE;
+        }
+        for(i = 0; i < share[f]; i++)
+        {
+            long id;
+            int len;
+            r = mix(r);
+            if(unique > 0 && (double) (r >> 11) / (double) (1ull << 53) < o.dup)
+            {
+                id = (long) (mix(r) % (uint64_t) unique);
+                dups++;
+            }
+            else
+                id = unique++;
+            len = make_name(o.seed << 32, id, name);
+            name[len++] = '\n';
+            fwrite(name, 1, len, fp);
+            bytes += len;
+        }
+        fclose(fp);
+    }
+    printf("{\"bench\":\"corpus\",\"dir\":\"%s\",\"names\":%ld,\"unique\":%ld,\"duplicates\":%ld,\"files\":%d,"
+           "\"largest_file\":%ld,\"smallest_file\":%ld,\"bytes\":%llu,\"seed\":%lu}\n",
+           o.dir, o.names, unique, dups, o.files, share[0], share[o.files - 1], bytes, (unsigned long) o.seed);
+    free(share);
+    return 0;
+}
@@ -0,0 +1,182 @@
+// Connor Humiston
+// Hostname Pass Microbenchmark: bytes per cycle of hostname_normalize() for each implementation
+#include <stdio.h>                                  // standard i/o
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <string.h>                                 // C string library
+#include <ctype.h>                                  // tolower()
+#include <time.h>                                   // clock_gettime()
+#if defined(__x86_64__)
+#include <x86intrin.h>                              // __rdtsc()
+#endif
+
+#include "hostname.h"                               // the pass being measured
+
+#define BENCH_NAMES             (1 << 20)           // names per set
+#define BENCH_ROUNDS            5                   // passes over a set, the fastest counts
+
+
+/* One Set of Names Packed Back to Back */
+typedef struct NameSet
+{
+    const char* label;
+    char* text;                                     // names, newline separated like an input file
+    size_t* off;                                    // start of each name
+    size_t* len;                                    // bytes in each (newline excluded)
+    size_t bytes;                                   // sum of len
+} NameSet;
+
+static uint64_t rng = 88172645463325252ull;
+
+/* xorshift64 */
+static uint64_t next_rand(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+/* Builds BENCH_NAMES names of minlen to maxlen bytes, mixed case, some with a trailing dot */
+static void make_set(NameSet* s, const char* label, size_t minlen, size_t maxlen)
+{
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-";
+    size_t i, j, pos = 0;
+
+    s->label = label;
+    s->text = malloc(BENCH_NAMES * (maxlen + 2));
+    s->off = malloc(sizeof(size_t) * BENCH_NAMES);
+    s->len = malloc(sizeof(size_t) * BENCH_NAMES);
+    s->bytes = 0;
+    if(!s->text || !s->off || !s->len)
+    {
+        fprintf(stderr, "Unable to allocate the benchmark names.\n");
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < BENCH_NAMES; i++)
+    {
+        size_t n = minlen + next_rand() % (maxlen - minlen + 1);
+        size_t label = 0;                           // bytes in the current label
+        s->off[i] = pos;
+        for(j = 0; j < n; j++)
+        {
+            char c = chars[next_rand() % (sizeof(chars) - 1)];
+            if(j > 0 && j < n - 1 && label > 0 && (label >= 40 || next_rand() % 8 == 0))
+                c = '.';
+            label = c == '.' ? 0 : label + 1;
+            s->text[pos++] = c;
+        }
+        if(next_rand() % 16 == 0)                   // a few fully qualified "name." spellings
+            s->text[pos - 1] = '.';
+        s->len[i] = pos - s->off[i];
+        s->bytes += s->len[i];
+        s->text[pos++] = '\n';
+    }
+}
+
+/* Cycle counter (TSC reference cycles on x86), 0 where there is none */
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* Monotonic clock in nanoseconds */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/* What the requesters & cache did before: strip, lowercase & FNV-1a a byte at a time */
+static uint64_t baseline(const char* in, size_t len, char* out)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i;
+    while(len > 0 && in[len-1] == '.')
+        len--;
+    for(i = 0; i < len; i++)
+    {
+        out[i] = (char) tolower((unsigned char) in[i]);
+        hash = (hash ^ (unsigned char) out[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* Runs one implementation (-1: the baseline) over a set, prints its best round & returns a digest of the output */
+static uint64_t run(const NameSet* s, int impl)
+{
+    char out[512];
+    uint64_t best_cyc = UINT64_MAX, best_ns = UINT64_MAX, digest = 0;
+    int r;
+    size_t i;
+
+    for(r = 0; r < BENCH_ROUNDS; r++)
+    {
+        uint64_t sum = 0;
+        uint64_t t0 = now_ns(), c0 = cycles();
+        for(i = 0; i < BENCH_NAMES; i++)
+        {
+            uint64_t hash;
+            size_t len = s->len[i];
+            if(impl < 0)
+                hash = baseline(s->text + s->off[i], len, out);
+            else
+            {
+                int rc = hostname_normalize(s->text + s->off[i], &len, out, &hash);
+                hash += (uint64_t) rc + len;
+            }
+            sum = sum * 31 + hash;                  // keeps the results live
+        }
+        uint64_t c1 = cycles(), t1 = now_ns();
+        if(c1 - c0 < best_cyc)
+            best_cyc = c1 - c0;
+        if(t1 - t0 < best_ns)
+            best_ns = t1 - t0;
+        digest = sum;
+    }
+    printf("  %-9s %7.2f bytes/cycle %7.2f GB/s %7.1f ns/name\n", impl < 0 ? "baseline" : hostname_impl_name(impl),
+           best_cyc ? (double) s->bytes / (double) best_cyc : 0.0, (double) s->bytes / (double) best_ns,
+           (double) best_ns / BENCH_NAMES);
+    return digest;
+}
+
+int main(void)
+{
+    NameSet sets[2];
+    int auto_impl = hostname_impl();
+    int s, impl;
+
+    make_set(&sets[0], "typical names, 8-40 bytes", 8, 40);
+    make_set(&sets[1], "long names, 120-250 bytes", 120, 250);
+    printf("hostname_normalize(): %d names per set, best of %d rounds, cycles are TSC reference cycles\n",
+           BENCH_NAMES, BENCH_ROUNDS);
+    for(s = 0; s < 2; s++)
+    {
+        uint64_t expect = 0;
+        printf("%s (%.1f MB):\n", sets[s].label, sets[s].bytes / 1e6);
+        run(&sets[s], -1);
+        for(impl = 0; impl < HOSTNAME_IMPLS; impl++)
+        {
+            if(hostname_use(impl) != 0)
+            {
+                printf("  %-9s not supported here\n", hostname_impl_name(impl));
+                continue;
+            }
+            uint64_t digest = run(&sets[s], impl);
+            if(impl == HOSTNAME_SCALAR)
+                expect = digest;
+            else if(digest != expect)               // every implementation must give the same names, hashes & verdicts
+            {
+                fprintf(stderr, "%s disagrees with scalar on \"%s\".\n", hostname_impl_name(impl), sets[s].label);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    hostname_use(auto_impl);
+    printf("multi-lookup uses %s on this machine\n", hostname_impl_name(auto_impl));
+    return 0;
+}
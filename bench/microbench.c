@@ -0,0 +1,461 @@
+// Connor Humiston
+// Component Microbenchmarks: the shared buffer, the hostname pool & the log writers, one JSON line per result
+#include <stdio.h>                                  // standard i/o
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <string.h>                                 // C string library
+#include <pthread.h>                                // producer & consumer threads
+#include <unistd.h>                                 // unlink()
+#include <sys/stat.h>                               // log file sizes
+
+#include "queue.h"                                  // shared buffer
+#include "slab.h"                                   // hostname pool
+#include "logwriter.h"                              // text log buffers
+#include "resfile.h"                                // binary log records
+#include "metrics.h"                                // histograms & percentiles
+#include "uring.h"                                  // io_uring log writes
+#include "util.h"                                   // UTIL_SUCCESS
+
+#define BENCH_QUEUE_ITEMS       (2 * 1000 * 1000)   // names through the buffer per configuration
+#define BENCH_QUEUE_SIZE        1024                // buffer slots
+#define BENCH_SLAB_OPS          (4 * 1000 * 1000)   // allocations per pool benchmark
+#define BENCH_LOG_RECORDS       (2 * 1000 * 1000)   // records per log benchmark
+#define BENCH_STEP              1024                // operations timed together for the per-operation percentiles
+#define BENCH_MAX_THREADS       16
+#define BENCH_SLOT              255                 // MAX_NAME_LENGTH, the size of a hostname slot
+
+
+/* Settings Shared by Every Benchmark */
+static const char* label = "";                      // tags each result, e.g. the commit measured
+static double scale = 1.0;                          // multiplies every operation count
+static const char* dir = "/tmp";                    // where log benchmarks write
+
+/* One Benchmark Thread */
+typedef struct BenchThread
+{
+    pthread_t id;
+    Buffer* buff;
+    Slab* slab;
+    LogFile* log;
+    pthread_barrier_t* start;                       // every thread & the timer start together
+    int lane;                                       // buffer lane joined
+    int batch;                                      // names per push_many/pop_many
+    int format;                                     // LOG_TEXT or LOG_BINARY
+    int pooled;                                     // 1: slab slots, 0: malloc()
+    long ops;                                       // operations this thread performs (producers & writers)
+    long done;                                      // operations it completed (consumers)
+    Histogram hist;                                 // latency or per-operation time in ns
+} BenchThread;
+
+
+/* Operations a benchmark performs at the current --scale, at least one STEP */
+static long scaled(long n)
+{
+    long s = (long) (n * scale);
+    return s < BENCH_STEP ? BENCH_STEP : s;
+}
+
+/* Prints one result: params is a JSON fragment of the configuration, hist holds ns per operation (or latency) */
+static void report(const char* bench, const char* params, long ops, double seconds, const Histogram* hist,
+                   const char* extra)
+{
+    printf("{\"bench\":\"%s\",\"label\":\"%s\",%s,\"ops\":%ld,\"seconds\":%.6f,\"ops_per_s\":%.1f,"
+           "\"p50_ns\":%.1f,\"p90_ns\":%.1f,\"p99_ns\":%.1f,\"p999_ns\":%.1f,\"max_ns\":%llu%s%s}\n",
+           bench, label, params, ops, seconds, seconds > 0 ? ops / seconds : 0.0, histogram_quantile(hist, 0.5),
+           histogram_quantile(hist, 0.9), histogram_quantile(hist, 0.99), histogram_quantile(hist, 0.999),
+           (unsigned long long) hist->max, extra ? "," : "", extra ? extra : "");
+    fflush(stdout);
+}
+
+/* Starts n threads on fn, returns 0 or -1 */
+static int spawn(BenchThread* t, int n, void* (*fn)(void*))
+{
+    int i;
+    for(i = 0; i < n; i++)
+    {
+        if(pthread_create(&t[i].id, NULL, fn, &t[i]) != 0)
+        {
+            fprintf(stderr, "Unable to start a benchmark thread.\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/* Queue Producer: pushes its names in batches, each stamped with the time its batch was pushed */
+static void* queue_producer(void* arg)
+{
+    BenchThread* t = arg;
+    Name* names = calloc(t->batch, sizeof(Name));
+    long i = 0;
+    buffer_join_lane(t->buff, t->lane);
+    pthread_barrier_wait(t->start);
+    while(i < t->ops)
+    {
+        int n = t->ops - i < t->batch ? (int) (t->ops - i) : t->batch, k;
+        uint64_t now = metrics_now();
+        for(k = 0; k < n; k++)
+            names[k].hash = now;                    // the consumer turns it into time spent queued
+        buffer_push_many(t->buff, names, n);
+        i += n;
+    }
+    free(names);
+    return NULL;
+}
+
+/* Queue Consumer: pops until the buffer closes, recording how long each name sat in it */
+static void* queue_consumer(void* arg)
+{
+    BenchThread* t = arg;
+    Name* names = calloc(t->batch, sizeof(Name));
+    int n, k;
+    buffer_join_lane(t->buff, t->lane);
+    pthread_barrier_wait(t->start);
+    while((n = buffer_pop_many(t->buff, names, t->batch, NULL)) > 0)
+    {
+        uint64_t now = metrics_now();
+        for(k = 0; k < n; k++)
+            histogram_add(&t->hist, now > names[k].hash ? now - names[k].hash : 0);
+        t->done += n;
+    }
+    free(names);
+    return NULL;
+}
+
+/* Buffer: names per second & push-to-pop latency with producers/consumers threads spread over lanes */
+static void bench_queue(int producers, int consumers, int lanes, int batch)
+{
+    BenchThread* t = calloc(producers + consumers, sizeof(BenchThread));
+    pthread_barrier_t start;
+    Histogram lat;
+    char params[160];
+    long items = scaled(BENCH_QUEUE_ITEMS), done = 0;
+    uint64_t t0;
+    int i;
+
+    memset(&lat, 0, sizeof(lat));
+    Buffer* buff = lanes > 1 ? buffer_create_lanes(BENCH_QUEUE_SIZE, lanes) : buffer_create(BENCH_QUEUE_SIZE);
+    if(!t || !buff)
+    {
+        fprintf(stderr, "Unable to allocate the queue benchmark.\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_barrier_init(&start, NULL, producers + consumers + 1);
+    for(i = 0; i < producers + consumers; i++)
+    {
+        t[i].buff = buff;
+        t[i].start = &start;
+        t[i].batch = batch;
+        t[i].lane = (i < producers ? i : i - producers) % lanes;
+        t[i].ops = i < producers ? items / producers + (i < items % producers) : 0;
+    }
+    if(spawn(t, producers, queue_producer) != 0 || spawn(t + producers, consumers, queue_consumer) != 0)
+        exit(EXIT_FAILURE);
+    pthread_barrier_wait(&start);
+    t0 = metrics_now();
+    for(i = 0; i < producers; i++)
+        pthread_join(t[i].id, NULL);
+    buffer_close(buff);
+    for(i = producers; i < producers + consumers; i++)
+    {
+        pthread_join(t[i].id, NULL);
+        histogram_merge(&lat, &t[i].hist);
+        done += t[i].done;
+    }
+    double secs = (metrics_now() - t0) / 1e9;
+    if(done != items)
+    {
+        fprintf(stderr, "Queue benchmark lost names: %ld of %ld popped.\n", done, items);
+        exit(EXIT_FAILURE);
+    }
+    snprintf(params, sizeof(params), "\"producers\":%d,\"consumers\":%d,\"lanes\":%d,\"batch\":%d,\"size\":%d",
+             producers, consumers, lanes, batch, BENCH_QUEUE_SIZE);
+    report("queue", params, items, secs, &lat, NULL);
+    pthread_barrier_destroy(&start);
+    buffer_destroy(buff);
+    free(t);
+}
+
+
+/* Pool, One Thread: allocates a STEP of slots then frees them, timing each STEP */
+static void bench_alloc_local(int pooled)
+{
+    void* ptrs[BENCH_STEP];
+    Histogram h;
+    Slab* slab = slab_create(BENCH_SLOT);
+    SlabCache* sc = slab ? slab_cache(slab) : NULL;
+    long ops = scaled(BENCH_SLAB_OPS), i;
+    uint64_t t0 = metrics_now();
+    int k;
+
+    if(!sc)
+        exit(EXIT_FAILURE);
+    memset(&h, 0, sizeof(h));
+    for(i = 0; i < ops; i += BENCH_STEP)
+    {
+        uint64_t s0 = metrics_now();
+        for(k = 0; k < BENCH_STEP; k++)
+        {
+            ptrs[k] = pooled ? slab_alloc(sc) : malloc(BENCH_SLOT);
+            ((char*) ptrs[k])[0] = (char) k;        // touch it, like a name being read in
+        }
+        for(k = 0; k < BENCH_STEP; k++)
+        {
+            if(pooled)
+                slab_free(sc, ptrs[k]);
+            else
+                free(ptrs[k]);
+        }
+        histogram_add(&h, (metrics_now() - s0) / BENCH_STEP); // one alloc + free
+    }
+    double secs = (metrics_now() - t0) / 1e9;
+    report("alloc", pooled ? "\"allocator\":\"slab\",\"path\":\"local\"" : "\"allocator\":\"malloc\",\"path\":\"local\"",
+           (ops + BENCH_STEP - 1) / BENCH_STEP * BENCH_STEP, secs, &h, NULL);
+    slab_destroy(slab);
+}
+
+/* Pool Handoff Producer: allocates a slot per name & queues it, like a requester */
+static void* alloc_producer(void* arg)
+{
+    BenchThread* t = arg;
+    SlabCache* sc = t->pooled ? slab_cache(t->slab) : NULL;
+    Name names[32];
+    long i = 0;
+    pthread_barrier_wait(t->start);
+    while(i < t->ops)
+    {
+        int n = t->ops - i < 32 ? (int) (t->ops - i) : 32, k;
+        for(k = 0; k < n; k++)
+        {
+            char* s = t->pooled ? slab_alloc(sc) : malloc(BENCH_SLOT);
+            s[0] = 'a';
+            names[k].str = s;
+            names[k].len = 1;
+            names[k].flags = t->pooled ? NAME_POOLED : 0;
+            names[k].hash = 0;
+        }
+        buffer_push_many(t->buff, names, n);
+        i += n;
+    }
+    if(sc)
+        slab_flush(sc);
+    return NULL;
+}
+
+/* Pool Handoff Consumer: frees every slot it pops, like a resolver, timing each pop's frees */
+static void* alloc_consumer(void* arg)
+{
+    BenchThread* t = arg;
+    SlabCache* sc = t->pooled ? slab_cache(t->slab) : NULL;
+    Name names[32];
+    int n, k;
+    pthread_barrier_wait(t->start);
+    while((n = buffer_pop_many(t->buff, names, 32, NULL)) > 0)
+    {
+        uint64_t s0 = metrics_now();
+        for(k = 0; k < n; k++)
+        {
+            if(t->pooled)
+                slab_free(sc, (char*) names[k].str);
+            else
+                free((char*) names[k].str);
+        }
+        histogram_add(&t->hist, (metrics_now() - s0) / n);
+        t->done += n;
+    }
+    if(sc)
+        slab_flush(sc);                             // hand the last partial batches back
+    return NULL;
+}
+
+/* Pool, Across Threads: slots allocated by producers & freed by consumers (the requester-to-resolver path) */
+static void bench_alloc_handoff(int pooled, int pairs)
+{
+    BenchThread t[2 * BENCH_MAX_THREADS];
+    pthread_barrier_t start;
+    Histogram h;
+    char params[128], extra[96];
+    Slab* slab = slab_create(BENCH_SLOT);
+    Buffer* buff = buffer_create(BENCH_QUEUE_SIZE);
+    long items = scaled(BENCH_SLAB_OPS / 2);
+    uint64_t t0;
+    int i;
+
+    if(!slab || !buff)
+        exit(EXIT_FAILURE);
+    memset(t, 0, sizeof(t));
+    memset(&h, 0, sizeof(h));
+    pthread_barrier_init(&start, NULL, 2 * pairs + 1);
+    for(i = 0; i < 2 * pairs; i++)
+    {
+        t[i].buff = buff;
+        t[i].slab = slab;
+        t[i].start = &start;
+        t[i].pooled = pooled;
+        t[i].ops = i < pairs ? items / pairs + (i < items % pairs) : 0;
+    }
+    if(spawn(t, pairs, alloc_producer) != 0 || spawn(t + pairs, pairs, alloc_consumer) != 0)
+        exit(EXIT_FAILURE);
+    pthread_barrier_wait(&start);
+    t0 = metrics_now();
+    for(i = 0; i < pairs; i++)
+        pthread_join(t[i].id, NULL);
+    buffer_close(buff);
+    for(i = pairs; i < 2 * pairs; i++)
+    {
+        pthread_join(t[i].id, NULL);
+        histogram_merge(&h, &t[i].hist);
+    }
+    double secs = (metrics_now() - t0) / 1e9;
+    snprintf(params, sizeof(params), "\"allocator\":\"%s\",\"path\":\"handoff\",\"producers\":%d,\"consumers\":%d",
+             pooled ? "slab" : "malloc", pairs, pairs);
+    snprintf(extra, sizeof(extra), "\"heap_allocations\":%lu", pooled ? slab_allocations(slab) : (unsigned long) items);
+    report("alloc", params, items, secs, &h, extra);
+    pthread_barrier_destroy(&start);
+    buffer_destroy(buff);
+    slab_destroy(slab);
+}
+
+
+/* Log Writer: formats its share of records into its own buffer, timing each STEP */
+static void* log_writer(void* arg)
+{
+    BenchThread* t = arg;
+    LogBuf lb;
+    char name[64], ip[32];
+    long i;
+    if(logbuf_init(&lb, t->log, DEFAULT_LOG_BUFFER) != 0)
+    {
+        fprintf(stderr, "Unable to allocate a log buffer.\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_barrier_wait(t->start);
+    for(i = 0; i < t->ops; i += BENCH_STEP)
+    {
+        uint64_t s0 = metrics_now();
+        long k;
+        for(k = i; k < i + BENCH_STEP && k < t->ops; k++)
+        {
+            int len = snprintf(name, sizeof(name), "host%ld-%d.example.com", k, t->lane);
+            snprintf(ip, sizeof(ip), "10.%ld.%ld.%ld", (k >> 16) & 255, (k >> 8) & 255, k & 255);
+            if(t->format == LOG_BINARY)
+                resfile_put(&lb, name, (size_t) len, UTIL_SUCCESS, ip);
+            else
+                logbuf_pair(&lb, name, (size_t) len, ip);
+        }
+        histogram_add(&t->hist, (metrics_now() - s0) / (uint64_t) (k - i));
+    }
+    logbuf_destroy(&lb);                            // the last block is written inside the timing
+    return NULL;
+}
+
+/* Logs: records per second & bytes per second of threads writing one resolver log */
+static void bench_log(int format, int io, int threads)
+{
+    BenchThread t[BENCH_MAX_THREADS];
+    pthread_barrier_t start;
+    Histogram h;
+    char path[4096], params[128], extra[96];
+    long records = scaled(BENCH_LOG_RECORDS);
+    struct stat st;
+    uint64_t t0;
+    int i;
+
+    snprintf(path, sizeof(path), "%s/microbench-%d.log", dir, (int) getpid());
+    LogFile* log = logfile_open(path);
+    if(!log || (format == LOG_BINARY && resfile_begin(log) != 0))
+    {
+        fprintf(stderr, "Unable to create \"%s\".\n", path);
+        exit(EXIT_FAILURE);
+    }
+    if(io == IO_URING && logfile_uring(log) != 0)
+    {
+        logfile_close(log);
+        unlink(path);
+        return;
+    }
+    memset(t, 0, sizeof(t));
+    memset(&h, 0, sizeof(h));
+    pthread_barrier_init(&start, NULL, threads + 1);
+    for(i = 0; i < threads; i++)
+    {
+        t[i].log = log;
+        t[i].start = &start;
+        t[i].format = format;
+        t[i].lane = i;
+        t[i].ops = records / threads + (i < records % threads);
+    }
+    if(spawn(t, threads, log_writer) != 0)
+        exit(EXIT_FAILURE);
+    pthread_barrier_wait(&start);
+    t0 = metrics_now();
+    for(i = 0; i < threads; i++)
+    {
+        pthread_join(t[i].id, NULL);
+        histogram_merge(&h, &t[i].hist);
+    }
+    double secs = (metrics_now() - t0) / 1e9;
+    if(format == LOG_BINARY)
+        resfile_finish(log);                        // index, outside the timing
+    fstat(log->fd, &st);
+    snprintf(params, sizeof(params), "\"format\":\"%s\",\"io\":\"%s\",\"threads\":%d,\"buffer\":%d",
+             format == LOG_BINARY ? "binary" : "text", io == IO_URING ? "uring" : "sync", threads, DEFAULT_LOG_BUFFER);
+    snprintf(extra, sizeof(extra), "\"bytes\":%lld,\"mb_per_s\":%.1f", (long long) st.st_size,
+             secs > 0 ? st.st_size / 1e6 / secs : 0.0);
+    report("log", params, records, secs, &h, extra);
+    pthread_barrier_destroy(&start);
+    logfile_close(log);
+    unlink(path);
+}
+
+
+int main(int argc, char* argv[])
+{
+    static const int queues[][4] = {{1, 1, 1, 1}, {1, 1, 1, 32}, {2, 2, 1, 32}, {4, 4, 1, 1}, {4, 4, 1, 32},
+                                    {1, 4, 1, 32}, {4, 1, 1, 32}, {8, 8, 1, 32}, {4, 4, 2, 32}, {4, 4, 4, 32}};
+    const char* only = "queue,alloc,log";
+    int i, f, io;
+
+    for(i = 1; i < argc; i++)
+    {
+        if(strncmp(argv[i], "--label=", 8) == 0)
+            label = argv[i] + 8;
+        else if(strncmp(argv[i], "--dir=", 6) == 0)
+            dir = argv[i] + 6;
+        else if(strncmp(argv[i], "--only=", 7) == 0)
+            only = argv[i] + 7;
+        else if(sscanf(argv[i], "--scale=%lf", &scale) != 1 || scale <= 0)
+        {
+            fprintf(stderr, "usage: microbench [--label=TEXT] [--scale=F] [--only=queue,alloc,log] [--dir=DIR]\n");
+            return EXIT_FAILURE;
+        }
+    }
+    if(strstr(only, "queue"))                       // producers, consumers, lanes, batch
+    {
+        for(i = 0; i < (int) (sizeof(queues) / sizeof(queues[0])); i++)
+            bench_queue(queues[i][0], queues[i][1], queues[i][2], queues[i][3]);
+    }
+    if(strstr(only, "alloc"))
+    {
+        bench_alloc_local(0);
+        bench_alloc_local(1);
+        bench_alloc_handoff(0, 1);
+        bench_alloc_handoff(1, 1);
+        bench_alloc_handoff(0, 4);
+        bench_alloc_handoff(1, 4);
+    }
+    if(strstr(only, "log"))
+    {
+        for(f = LOG_TEXT; f <= LOG_BINARY; f++)
+        {
+            for(io = IO_URING; io <= IO_SYNC; io++)
+            {
+                if(io == IO_URING && !uring_available())
+                    continue;                       // nothing to compare against on this kernel
+                bench_log(f, io, 1);
+                bench_log(f, io, 4);
+            }
+        }
+    }
+    return 0;
+}
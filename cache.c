@@ -0,0 +1,278 @@
+// Connor Humiston
+// Resolution Cache Implementation
+#include "cache.h"
+
+#include <string.h>                                 // C string library
+#include <time.h>                                   // clock_gettime()
+
+
+/* Current monotonic time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* Lowercases the hostname & strips trailing dots into key, returns its hash */
+uint64_t cache_normalize(const char* hostname, char* key)
+{
+    size_t len = strnlen(hostname, CACHE_KEY_LENGTH - 1);
+    uint64_t hash;
+
+    while(len > 0 && hostname[len-1] == '.')        // "example.com." and "example.com" are the same name
+        len--;
+    hash = hostname_fold(hostname, len, key);       // same pass & hash the requesters normalize with
+    key[len] = '\0';
+    return hash;
+}
+
+/* Key & hash for a hostname: a nonzero hash comes from hostname_normalize(), whose output is already the key */
+static const char* cache_key(const char* hostname, uint64_t* hash, char* buf)
+{
+    if(*hash)
+        return hostname;
+    *hash = cache_normalize(hostname, buf);
+    return buf;
+}
+
+/* Shard owning a hash (top bits, so bucket selection uses different bits) */
+static CacheShard* cache_shard(Cache* cache, uint64_t hash)
+{
+    return &cache->shards[hash >> 58];              // 64 shards -> top 6 bits
+}
+
+/* Finds the entry for key in a locked shard, NULL if absent */
+static CacheEntry* shard_find(CacheShard* shard, uint64_t hash, const char* key)
+{
+    CacheEntry* e;
+    for(e = shard->table[hash & (shard->nbuckets - 1)]; e; e = e->next)
+    {
+        if(e->hash == hash && strcmp(e->name, key) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+/* Doubles a locked shard's bucket array once chains get long */
+static void shard_grow(CacheShard* shard)
+{
+    size_t nb = shard->nbuckets * 2;
+    CacheEntry** table = calloc(nb, sizeof(CacheEntry*));
+    size_t i;
+    if(!table)                                      // keep the old table, it still works, just slower
+        return;
+    for(i = 0; i < shard->nbuckets; i++)
+    {
+        CacheEntry* e = shard->table[i];
+        while(e)
+        {
+            CacheEntry* next = e->next;
+            e->next = table[e->hash & (nb - 1)];    // rehash into the larger table
+            table[e->hash & (nb - 1)] = e;
+            e = next;
+        }
+    }
+    free(shard->table);
+    shard->table = table;
+    shard->nbuckets = nb;
+}
+
+/* Frees a full, locked shard's expired answers; if that leaves less than 1/CACHE_EVICT_FRACTION of the limit free,
+ * fresh answers go too, from the bucket the last eviction stopped at. Pending entries have owners & always stay */
+static void shard_evict(Cache* cache, CacheShard* shard)
+{
+    size_t goal = cache->shard_max - cache->shard_max / CACHE_EVICT_FRACTION;
+    double t = now();
+    size_t b, visited;
+    int pass;
+
+    for(pass = 0; pass < 2 && shard->count > goal; pass++) // each full sweep buys shard_max / 8 inserts
+    {
+        for(visited = 0; visited < shard->nbuckets && shard->count > goal; visited++)
+        {
+            CacheEntry** link;
+            b = pass ? shard->hand : visited;
+            link = &shard->table[b];
+            while(*link && shard->count > goal)
+            {
+                CacheEntry* e = *link;
+                if(!e->pending && (pass || e->expires <= t))
+                {
+                    *link = e->next;
+                    free(e);
+                    shard->count--;
+                }
+                else
+                    link = &e->next;
+            }
+            if(pass)
+                shard->hand = (shard->hand + 1) & (shard->nbuckets - 1);
+        }
+    }
+}
+
+/* Allocates an empty cache whose answers (up to iplen bytes of addresses) live for ttl seconds & that holds about
+ * max_entries names (0: no limit), NULL on failure */
+Cache* cache_create(double ttl, size_t iplen, size_t max_entries)
+{
+    Cache* cache;
+    int i;
+
+    if(posix_memalign((void**) &cache, CACHE_LINE, sizeof(*cache)) != 0)
+        return NULL;
+    cache->ttl = ttl;
+    cache->iplen = iplen;
+    cache->shard_max = max_entries ? (max_entries + CACHE_SHARDS - 1) / CACHE_SHARDS : 0;
+    if(cache->shard_max > 0 && cache->shard_max < CACHE_EVICT_FRACTION)
+        cache->shard_max = CACHE_EVICT_FRACTION;    // every eviction frees at least one entry
+    for(i = 0; i < CACHE_SHARDS; i++)
+    {
+        CacheShard* shard = &cache->shards[i];
+        shard->lock = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+        shard->done = (pthread_cond_t) PTHREAD_COND_INITIALIZER;
+        shard->nbuckets = CACHE_INIT_BUCKETS;
+        shard->count = 0;
+        shard->hand = 0;
+        shard->table = calloc(CACHE_INIT_BUCKETS, sizeof(CacheEntry*));
+        if(!shard->table)
+        {
+            cache->shards[i].nbuckets = 0;          // only free the shards set up so far
+            while(i-- > 0)
+                free(cache->shards[i].table);
+            free(cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+/* Frees every entry & the cache itself */
+void cache_destroy(Cache* cache)
+{
+    size_t b;
+    int i;
+    for(i = 0; i < CACHE_SHARDS; i++)
+    {
+        CacheShard* shard = &cache->shards[i];
+        for(b = 0; b < shard->nbuckets; b++)
+        {
+            CacheEntry* e = shard->table[b];
+            while(e)
+            {
+                CacheEntry* next = e->next;
+                free(e);
+                e = next;
+            }
+        }
+        free(shard->table);
+        pthread_mutex_destroy(&shard->lock);
+        pthread_cond_destroy(&shard->done);
+    }
+    free(cache);
+}
+
+/* Looks the hostname up: on HIT/COALESCED fills status & ip, on MISS the caller must resolve it;
+ * with wait == 0 an in-flight lookup returns CACHE_BUSY instead of blocking (hash: see cache.h) */
+int cache_acquire(Cache* cache, const char* hostname, uint64_t hash, int* status, char* ip, int maxSize, int wait)
+{
+    char buf[CACHE_KEY_LENGTH];                     // normalized hostname, unless the caller's already is
+    const char* key = cache_key(hostname, &hash, buf);
+    CacheShard* shard = cache_shard(cache, hash);
+    CacheEntry* e;
+    int outcome = CACHE_HIT;
+
+    pthread_mutex_lock(&shard->lock);
+    e = shard_find(shard, hash, key);
+    while(e && e->pending)                          // someone is already resolving it: wait for their answer
+    {
+        if(!wait)                                   // caller has lookups of its own in flight, it can't block
+        {
+            pthread_mutex_unlock(&shard->lock);
+            return CACHE_BUSY;
+        }
+        outcome = CACHE_COALESCED;
+        pthread_cond_wait(&shard->done, &shard->lock);
+        e = shard_find(shard, hash, key);           // re-find, the entry may have been replaced
+    }
+    if(e && e->expires > now())                     // fresh answer
+    {
+        *status = e->status;
+        strncpy(ip, e->ip, maxSize);
+        ip[maxSize-1] = '\0';
+        pthread_mutex_unlock(&shard->lock);
+        return outcome;
+    }
+    if(!e)                                          // first time seen: insert a pending placeholder
+    {
+        size_t keylen = strlen(key) + 1;
+        if(cache->shard_max > 0 && shard->count >= cache->shard_max)
+            shard_evict(cache, shard);              // long-running modes: remote clients pick the names
+        e = malloc(sizeof(*e) + keylen + cache->iplen); // one allocation: a single address needs no more than before
+        if(!e)
+        {
+            pthread_mutex_unlock(&shard->lock);     // no room to coalesce, just let the caller resolve it
+            return CACHE_MISS;
+        }
+        e->hash = hash;
+        memcpy(e->name, key, keylen);
+        e->ip = e->name + keylen;
+        e->ip[0] = '\0';
+        e->next = shard->table[hash & (shard->nbuckets - 1)];
+        shard->table[hash & (shard->nbuckets - 1)] = e;
+        if(++shard->count > shard->nbuckets * 2)
+            shard_grow(shard);
+    }
+    e->pending = 1;                                 // new or stale: this caller owns the lookup now
+    pthread_mutex_unlock(&shard->lock);
+    return CACHE_MISS;
+}
+
+/* Copies a fresh answer without ever claiming the lookup, returns CACHE_HIT or CACHE_MISS */
+int cache_peek(Cache* cache, const char* hostname, int* status, char* ip, int maxSize)
+{
+    char key[CACHE_KEY_LENGTH];
+    uint64_t hash = cache_normalize(hostname, key);
+    CacheShard* shard = cache_shard(cache, hash);
+    CacheEntry* e;
+    int outcome = CACHE_MISS;
+
+    pthread_mutex_lock(&shard->lock);
+    e = shard_find(shard, hash, key);
+    if(e && !e->pending && e->expires > now())      // a pending or stale entry is left for a resolver
+    {
+        *status = e->status;
+        strncpy(ip, e->ip, maxSize);
+        ip[maxSize-1] = '\0';
+        outcome = CACHE_HIT;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return outcome;
+}
+
+/* Stores the result of a MISS & wakes the threads coalesced onto it (hash: see cache.h) */
+void cache_complete(Cache* cache, const char* hostname, uint64_t hash, int status, const char* ip)
+{
+    char buf[CACHE_KEY_LENGTH];
+    const char* key = cache_key(hostname, &hash, buf);
+    CacheShard* shard = cache_shard(cache, hash);
+    CacheEntry* e;
+
+    pthread_mutex_lock(&shard->lock);
+    e = shard_find(shard, hash, key);
+    if(e)                                           // absent only if the placeholder could not be allocated
+    {
+        e->status = status;
+        if(status == UTIL_SUCCESS)
+        {
+            strncpy(e->ip, ip, cache->iplen);
+            e->ip[cache->iplen-1] = '\0';
+        }
+        else
+            e->ip[0] = '\0';
+        e->expires = status == LOOKUP_TIMEOUT ? 0 : now() + cache->ttl; // a timeout says nothing about the name: stale at once
+        e->pending = 0;
+        pthread_cond_broadcast(&shard->done);       // waiters re-check their own names
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
@@ -0,0 +1,81 @@
+// Connor Humiston
+// Resolution Cache Header
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <stdint.h>                                 // fixed width integer types
+#include <pthread.h>                                // thread library
+
+#include "util.h"                                   // UTIL_SUCCESS/UTIL_FAILURE & INET6_ADDRSTRLEN
+#include "queue.h"                                  // CACHE_LINE
+#include "backend.h"                                // LOOKUP_TIMEOUT
+#include "hostname.h"                               // hostname_fold()
+
+#define CACHE_SHARDS            64                  // independently locked slices of the table
+#define CACHE_INIT_BUCKETS      64                  // starting buckets per shard (power of two)
+#define CACHE_KEY_LENGTH        255                 // longest normalized hostname w/ null terminator
+#define CACHE_EVICT_FRACTION    8                   // a full shard frees 1/8 of its limit at a time
+
+/* Outcomes of cache_acquire() */
+#define CACHE_HIT               0                   // answer was cached, no lookup needed
+#define CACHE_MISS              1                   // caller now owns the lookup & must call cache_complete()
+#define CACHE_COALESCED         2                   // waited on another thread's identical lookup
+#define CACHE_BUSY              3                   // another thread is looking it up & wait was 0
+
+
+/* Cached Hostname: either a finished answer or a lookup still in flight */
+typedef struct CacheEntry
+{
+    struct CacheEntry* next;                        // bucket chain
+    uint64_t hash;                                  // hash of the normalized name
+    int pending;                                    // 1 while the owning resolver is still looking it up
+    int status;                                     // UTIL_SUCCESS, UTIL_FAILURE (NOT_RESOLVED) or LOOKUP_TIMEOUT
+    double expires;                                 // monotonic time the answer goes stale
+    char* ip;                                       // resolved address(es), iplen bytes stored after the name
+    char name[];                                    // normalized hostname (key)
+} CacheEntry;
+
+/* One Independently Locked Hash Table */
+typedef struct CacheShard
+{
+    pthread_mutex_t lock;                           // protects the table & its entries
+    pthread_cond_t done;                            // broadcast when a pending lookup completes
+    CacheEntry** table;                             // bucket heads
+    size_t nbuckets;                                // number of buckets (power of two)
+    size_t count;                                   // entries stored
+    size_t hand;                                    // bucket the next eviction of fresh entries starts at
+} __attribute__((aligned(CACHE_LINE))) CacheShard;
+
+/* Sharded Cache with In-Flight Coalescing */
+typedef struct Cache
+{
+    double ttl;                                     // seconds answers are kept
+    size_t iplen;                                   // room kept per entry for its address list
+    size_t shard_max;                               // entries per shard before older ones are evicted (0: no limit)
+    CacheShard shards[CACHE_SHARDS];                // sharded tables
+} Cache;
+
+
+/* Lowercases the hostname & strips trailing dots into key (CACHE_KEY_LENGTH bytes), returns its hash */
+uint64_t cache_normalize(const char* hostname, char* key);
+
+/* Allocates an empty cache whose answers (up to iplen bytes of addresses) live for ttl seconds & that holds about
+ * max_entries names (0: no limit), NULL on failure */
+Cache* cache_create(double ttl, size_t iplen, size_t max_entries);
+
+/* Frees every entry & the cache itself */
+void cache_destroy(Cache* cache);
+
+/* Looks the hostname up: on HIT/COALESCED fills status & ip, on MISS the caller must resolve it;
+ * with wait == 0 an in-flight lookup returns CACHE_BUSY instead of blocking.
+ * hash is the requester's hostname_normalize() hash of an already normalized name, or 0 to normalize it here */
+int cache_acquire(Cache* cache, const char* hostname, uint64_t hash, int* status, char* ip, int maxSize, int wait);
+
+/* Copies a fresh answer without ever claiming the lookup, returns CACHE_HIT or CACHE_MISS */
+int cache_peek(Cache* cache, const char* hostname, int* status, char* ip, int maxSize);
+
+/* Stores the result of a MISS & wakes the threads coalesced onto it (hash as for cache_acquire()) */
+void cache_complete(Cache* cache, const char* hostname, uint64_t hash, int status, const char* ip);
+
+#endif
@@ -0,0 +1,355 @@
+// Connor Humiston
+// Checkpoint & Resume Implementation
+#include "checkpoint.h"
+
+#include <stdio.h>                                  // standard i/o
+#include <string.h>                                 // C string library
+#include <errno.h>                                  // EINTR, ETIMEDOUT, ENOENT
+#include <time.h>                                   // time(), nanosleep()
+#include <fcntl.h>                                  // open()
+#include <unistd.h>                                 // read(), write(), fsync(), fdatasync()
+#include <libgen.h>                                 // dirname()
+#include <sys/stat.h>                               // fstat()
+
+
+/* FNV-1a over len bytes */
+static uint32_t body_check(const unsigned char* p, size_t len)
+{
+    uint32_t hash = 2166136261U;
+    size_t i;
+    for(i = 0; i < len; i++)
+        hash = (hash ^ p[i]) * 16777619U;
+    return hash;
+}
+
+/* Bytes a file entry takes, name included & padded to 8 */
+static size_t file_size(size_t namelen)
+{
+    return (sizeof(CheckFile) + namelen + 7) & ~(size_t) 7;
+}
+
+/* Writes all len bytes, returns -1 on failure */
+static int write_all(int fd, const void* buf, size_t len)
+{
+    const char* p = buf;
+    while(len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t) n;
+    }
+    return 0;
+}
+
+/* fsyncs the directory holding path so a rename or unlink in it survives a crash, returns -1 on failure */
+static int sync_dir(const char* path)
+{
+    char* copy = strdup(path);
+    int dir, rc = 0;
+    if(!copy)
+        return -1;
+    dir = open(dirname(copy), O_RDONLY | O_CLOEXEC);
+    free(copy);
+    if(dir >= 0)
+    {
+        if(fsync(dir) != 0)
+            rc = -1;
+        close(dir);
+    }
+    return rc;
+}
+
+/* Reads the checkpoint at path, returns 0 or -1 if it is missing, torn or not a checkpoint */
+int checkpoint_load(const char* path, CheckState* st)
+{
+    struct stat sb;
+    CheckHeader h;
+    unsigned char* body = NULL;
+    size_t len = 0, off = 0, got = 0;
+    uint32_t i;
+    int fd, ok;
+
+    memset(st, 0, sizeof(*st));
+    if((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return -1;
+    ok = fstat(fd, &sb) == 0 && (size_t) sb.st_size >= sizeof(h) && read(fd, &h, sizeof(h)) == sizeof(h) &&
+         memcmp(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic)) == 0 && h.version == CHECKPOINT_VERSION;
+    if(ok)
+    {
+        len = (size_t) sb.st_size - sizeof(h);
+        ok = (body = malloc(len > 0 ? len : 1)) != NULL;
+    }
+    while(ok && got < len)
+    {
+        ssize_t n = read(fd, body + got, len - got);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            ok = 0;
+        else
+            got += (size_t) n;
+    }
+    close(fd);
+    ok = ok && body_check(body, len) == h.check;    // a torn or foreign file is never trusted
+    if(ok)
+    {
+        st->nfiles = (int) h.nfiles;
+        st->names = calloc(h.nfiles > 0 ? h.nfiles : 1, sizeof(char*));
+        st->sizes = malloc(sizeof(off_t) * (h.nfiles > 0 ? h.nfiles : 1));
+        st->units = malloc(sizeof(WorkUnit) * (h.nunits > 0 ? h.nunits : 1));
+        ok = st->names && st->sizes && st->units;
+    }
+    for(i = 0; ok && i < h.nfiles; i++)
+    {
+        CheckFile f;
+        if(len - off < sizeof(f))
+            ok = 0;
+        else
+        {
+            memcpy(&f, body + off, sizeof(f));
+            if(len - off < file_size(f.namelen) || !(st->names[i] = malloc(f.namelen + 1)))
+                ok = 0;
+            else
+            {
+                memcpy(st->names[i], body + off + sizeof(f), f.namelen);
+                st->names[i][f.namelen] = '\0';
+                st->sizes[i] = (off_t) f.size;
+                off += file_size(f.namelen);
+            }
+        }
+    }
+    ok = ok && len - off == sizeof(CheckUnit) * (size_t) h.nunits;
+    for(i = 0; ok && i < h.nunits; i++)
+    {
+        CheckUnit u;
+        memcpy(&u, body + off + sizeof(u) * i, sizeof(u));
+        st->units[i].file = (int) u.file;
+        st->units[i].start = (off_t) u.start;
+        st->units[i].end = (off_t) u.end;
+    }
+    free(body);
+    if(!ok)
+    {
+        checkpoint_free(st);
+        return -1;
+    }
+    st->nunits = (int) h.nunits;
+    st->format = (int) h.format;
+    st->reqlog_size = (off_t) h.reqlog_size;
+    st->reslog_size = (off_t) h.reslog_size;
+    st->results = h.results;
+    return 0;
+}
+
+/* Frees what checkpoint_load() allocated */
+void checkpoint_free(CheckState* st)
+{
+    int i;
+    for(i = 0; st->names && i < st->nfiles; i++)
+        free(st->names[i]);
+    free(st->names);
+    free(st->sizes);
+    free(st->units);
+    memset(st, 0, sizeof(*st));
+}
+
+/* Returns 0 if names are the files, at the same sizes, the checkpoint was taken of */
+int checkpoint_matches(const CheckState* st, char** names, int n)
+{
+    struct stat sb;
+    int i;
+    if(st->nfiles != n)
+        return -1;
+    for(i = 0; i < n; i++)
+    {
+        if(strcmp(st->names[i], names[i]) != 0 || stat(names[i], &sb) != 0 || sb.st_size != st->sizes[i])
+            return -1;
+    }
+    return 0;
+}
+
+/* Sets up checkpoints of a run every interval seconds, NULL on failure */
+Checkpoint* checkpoint_create(const char* path, int interval, int format, Sched* s, LogFile* reqlog, LogFile* reslog)
+{
+    Checkpoint* ck = calloc(1, sizeof(*ck));
+    if(!ck)
+        return NULL;
+    if(!(ck->tmp = malloc(strlen(path) + sizeof(".tmp"))))
+    {
+        free(ck);
+        return NULL;
+    }
+    sprintf(ck->tmp, "%s.tmp", path);
+    ck->path = path;
+    ck->interval = interval;
+    ck->format = format;
+    ck->sched = s;
+    ck->reqlog = reqlog;
+    ck->reslog = reslog;
+    pthread_mutex_init(&ck->lock, NULL);
+    pthread_cond_init(&ck->wake, NULL);
+    return ck;
+}
+
+/* Syncs the logs & writes a checkpoint now (requesters parked or not started yet), returns -1 on failure */
+int checkpoint_save(Checkpoint* ck)
+{
+    const Sched* s = ck->sched;
+    struct stat req, res;
+    CheckHeader h;
+    WorkUnit* units;
+    unsigned char* body;
+    size_t len = 0, off = 0;
+    int i, n, fd, rc = 0;
+
+    // Everything the Checkpoint Counts Must be on Disk Before It Is
+    if(fdatasync(ck->reqlog->fd) != 0 || fdatasync(ck->reslog->fd) != 0 ||
+       fstat(ck->reqlog->fd, &req) != 0 || fstat(ck->reslog->fd, &res) != 0)
+        return -1;
+    if((n = sched_snapshot(ck->sched, &units)) < 0)
+        return -1;
+    for(i = 0; i < s->nfiles; i++)
+        len += file_size(strlen(s->files[i].name));
+    len += sizeof(CheckUnit) * (size_t) n;
+    if(!(body = calloc(1, len > 0 ? len : 1)))
+    {
+        free(units);
+        return -1;
+    }
+    for(i = 0; i < s->nfiles; i++)
+    {
+        CheckFile f = {(int64_t) s->files[i].size, (uint32_t) strlen(s->files[i].name), 0};
+        memcpy(body + off, &f, sizeof(f));
+        memcpy(body + off + sizeof(f), s->files[i].name, f.namelen);
+        off += file_size(f.namelen);
+    }
+    for(i = 0; i < n; i++, off += sizeof(CheckUnit))
+    {
+        CheckUnit u = {(uint32_t) units[i].file, 0, (int64_t) units[i].start, (int64_t) units[i].end};
+        memcpy(body + off, &u, sizeof(u));
+    }
+    free(units);
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic));
+    h.version = CHECKPOINT_VERSION;
+    h.check = body_check(body, len);
+    h.nfiles = (uint32_t) s->nfiles;
+    h.nunits = (uint32_t) n;
+    h.format = (uint32_t) ck->format;
+    h.reqlog_size = (uint64_t) req.st_size;
+    h.reslog_size = (uint64_t) res.st_size;
+    h.results = __atomic_load_n(&ck->reslog->flushed, __ATOMIC_ACQUIRE);
+    h.written = (int64_t) time(NULL);
+
+    // Write Beside the Old One & Swap, So a Crash Leaves One or the Other Whole
+    fd = open(ck->tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0 || write_all(fd, &h, sizeof(h)) != 0 || write_all(fd, body, len) != 0 || fsync(fd) != 0 ||
+       rename(ck->tmp, ck->path) != 0 || sync_dir(ck->path) != 0)
+    {
+        unlink(ck->tmp);
+        rc = -1;
+    }
+    if(fd >= 0)
+        close(fd);
+    free(body);
+    return rc;
+}
+
+/* Parks the requesters, waits for every name they queued to be logged, saves & lets them go on */
+static void checkpoint_take(Checkpoint* ck)
+{
+    struct timespec poll = {0, CHECKPOINT_DRAIN_POLL_MS * 1000000L};
+    uint64_t t0 = pool_clock_ns();
+    double ms;
+    int rc;
+
+    sched_pause(ck->sched);                         // requesters flush their logs & batches before parking
+    __atomic_store_n(&ck->draining, 1, __ATOMIC_SEQ_CST);
+    respool_interrupt(ck->pool);                    // resolvers asleep on an empty queue flush too
+    while(__atomic_load_n(&ck->reslog->flushed, __ATOMIC_ACQUIRE) < __atomic_load_n(&ck->reqlog->flushed, __ATOMIC_ACQUIRE))
+        nanosleep(&poll, NULL);
+    __atomic_store_n(&ck->draining, 0, __ATOMIC_SEQ_CST);
+    rc = checkpoint_save(ck);
+    sched_resume(ck->sched);
+
+    ms = (pool_clock_ns() - t0) / 1e6;
+    if(ms > ck->longest)
+        ck->longest = ms;
+    if(rc != 0)
+        fprintf(stderr, "Error writing checkpoint \"%s\".\n", ck->path);
+    else
+    {
+        ck->taken++;
+        printf("checkpoint: %lu names logged, requesters paused %.1f ms\n",
+               (unsigned long) __atomic_load_n(&ck->reslog->flushed, __ATOMIC_RELAXED), ms);
+    }
+}
+
+/* Checkpoint thread: one checkpoint per interval until told to stop */
+static void* checkpoint_thread(void* arg)
+{
+    Checkpoint* ck = (Checkpoint*) arg;
+    struct timespec deadline;
+
+    pthread_mutex_lock(&ck->lock);
+    while(!ck->stop)
+    {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += ck->interval;
+        if(pthread_cond_timedwait(&ck->wake, &ck->lock, &deadline) == ETIMEDOUT && !ck->stop)
+        {
+            pthread_mutex_unlock(&ck->lock);        // stopping waits for a checkpoint in progress
+            checkpoint_take(ck);
+            pthread_mutex_lock(&ck->lock);
+        }
+    }
+    pthread_mutex_unlock(&ck->lock);
+    return NULL;
+}
+
+/* Starts the thread taking a checkpoint every interval, returns 0 or -1 */
+int checkpoint_start(Checkpoint* ck, ResPool* pool)
+{
+    ck->pool = pool;
+    if(pthread_create(&ck->thread, NULL, checkpoint_thread, ck) != 0)
+        return -1;
+    ck->started = 1;
+    return 0;
+}
+
+/* Stops the thread (call once the requesters are joined, before the buffer closes) */
+void checkpoint_stop(Checkpoint* ck)
+{
+    if(!ck->started)
+        return;
+    pthread_mutex_lock(&ck->lock);
+    ck->stop = 1;
+    pthread_cond_signal(&ck->wake);
+    pthread_mutex_unlock(&ck->lock);
+    pthread_join(ck->thread, NULL);
+    ck->started = 0;
+}
+
+/* Syncs the finished logs & deletes the checkpoint, returns -1 on failure */
+int checkpoint_remove(Checkpoint* ck)
+{
+    if(fdatasync(ck->reqlog->fd) != 0 || fdatasync(ck->reslog->fd) != 0) // a crash must not outlive both
+        return -1;
+    if(unlink(ck->path) != 0 && errno != ENOENT)
+        return -1;
+    return sync_dir(ck->path);
+}
+
+/* Frees the checkpoint state */
+void checkpoint_destroy(Checkpoint* ck)
+{
+    pthread_mutex_destroy(&ck->lock);
+    pthread_cond_destroy(&ck->wake);
+    free(ck->tmp);
+    free(ck);
+}
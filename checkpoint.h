@@ -0,0 +1,124 @@
+// Connor Humiston
+// Checkpoint & Resume Header
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <stdint.h>                                 // fixed width integer types
+#include <pthread.h>                                // checkpoint thread
+#include <sys/types.h>                              // off_t
+
+#include "filesched.h"                              // ranges left to read & the requester barrier
+#include "logwriter.h"                              // log sizes & record counts
+#include "respool.h"                                // waking idle resolvers to flush
+
+#define CHECKPOINT_MAGIC        "MLCHKPT1"          // first 8 bytes of a checkpoint file
+#define CHECKPOINT_VERSION      1
+#define DEFAULT_CHECKPOINT_INTERVAL 60              // seconds between checkpoints
+#define MAX_CHECKPOINT_INTERVAL 86400
+#define CHECKPOINT_DRAIN_POLL_MS 1                  // how often a checkpoint looks at the resolver log count
+
+
+/* File Header, followed by nfiles CheckFile entries & nunits CheckUnit entries */
+typedef struct CheckHeader
+{
+    char magic[8];                                  // CHECKPOINT_MAGIC
+    uint32_t version;                               // CHECKPOINT_VERSION
+    uint32_t check;                                 // FNV-1a of everything after the header
+    uint32_t nfiles;
+    uint32_t nunits;
+    uint32_t format;                                // resolver log format of the run
+    uint32_t pad;
+    uint64_t reqlog_size;                           // bytes of the requester log the checkpoint covers
+    uint64_t reslog_size;                           // ... & of the resolver log
+    uint64_t results;                               // names in each of them (every logged name has its result)
+    int64_t written;                                // wall clock second
+} CheckHeader;
+
+/* Input File: its name follows, padded to 8 bytes */
+typedef struct CheckFile
+{
+    int64_t size;                                   // bytes when the run started, a resume refuses a changed file
+    uint32_t namelen;
+    uint32_t pad;
+} CheckFile;
+
+/* Range Not Read Yet */
+typedef struct CheckUnit
+{
+    uint32_t file;                                  // index into the files
+    uint32_t pad;
+    int64_t start;                                  // first line not logged
+    int64_t end;
+} CheckUnit;
+
+/* Checkpoint Read Back for --resume */
+typedef struct CheckState
+{
+    int nfiles;
+    char** names;                                   // input files in command line order
+    off_t* sizes;
+    int nunits;
+    WorkUnit* units;                                // ranges still to read
+    int format;
+    off_t reqlog_size;
+    off_t reslog_size;
+    uint64_t results;
+} CheckState;
+
+/* Periodic Checkpoints of a Run Reading Data Files */
+typedef struct Checkpoint
+{
+    const char* path;                               // checkpoint file
+    char* tmp;                                      // path + ".tmp", renamed over it once synced
+    int interval;                                   // seconds between checkpoints
+    int format;                                     // resolver log format
+    Sched* sched;                                   // ranges & the requester barrier
+    LogFile* reqlog;
+    LogFile* reslog;
+    ResPool* pool;                                  // resolvers woken to flush (NULL until started)
+    int draining;                                   // resolvers flush before sleeping while set (atomic)
+    pthread_t thread;
+    int started;
+    int stop;                                       // tells the thread to finish, under lock
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    unsigned long taken;                            // checkpoints written while running
+    double longest;                                 // longest pause in ms
+} Checkpoint;
+
+
+/* Reads the checkpoint at path, returns 0 or -1 if it is missing, torn or not a checkpoint */
+int checkpoint_load(const char* path, CheckState* st);
+
+/* Frees what checkpoint_load() allocated */
+void checkpoint_free(CheckState* st);
+
+/* Returns 0 if names are the files, at the same sizes, the checkpoint was taken of */
+int checkpoint_matches(const CheckState* st, char** names, int n);
+
+/* Sets up checkpoints of a run every interval seconds, NULL on failure */
+Checkpoint* checkpoint_create(const char* path, int interval, int format, Sched* s, LogFile* reqlog, LogFile* reslog);
+
+/* Syncs the logs & writes a checkpoint now (requesters parked or not started yet), returns -1 on failure */
+int checkpoint_save(Checkpoint* ck);
+
+/* Starts the thread taking a checkpoint every interval, returns 0 or -1 */
+int checkpoint_start(Checkpoint* ck, ResPool* pool);
+
+/* Stops the thread (call once the requesters are joined, before the buffer closes) */
+void checkpoint_stop(Checkpoint* ck);
+
+/* Syncs the finished logs & deletes the checkpoint, returns -1 on failure */
+int checkpoint_remove(Checkpoint* ck);
+
+/* Frees the checkpoint state */
+void checkpoint_destroy(Checkpoint* ck);
+
+/* Nonzero while a checkpoint waits for every queued name's result to reach the log */
+static inline int checkpoint_draining(const Checkpoint* ck)
+{
+    return ck && __atomic_load_n(&ck->draining, __ATOMIC_SEQ_CST);
+}
+
+#endif
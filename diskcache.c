@@ -0,0 +1,565 @@
+// Connor Humiston
+// Persistent Cache File Implementation
+#include "diskcache.h"
+
+#include <stdio.h>                                  // standard i/o
+#include <string.h>                                 // C string library
+#include <errno.h>                                  // ENOENT
+#include <time.h>                                   // time(), clock_gettime()
+#include <fcntl.h>                                  // open()
+#include <unistd.h>                                 // write(), fsync(), ftruncate()
+#include <libgen.h>                                 // dirname()
+#include <sys/mman.h>                               // mmap(), msync()
+#include <sys/stat.h>                               // fstat()
+#include <sys/file.h>                               // flock()
+
+
+/* Hash of a normalized name as stored in a slot (0 is reserved for empty slots) */
+static uint64_t disk_hash(const char* hostname, char* key)
+{
+    uint64_t hash = cache_normalize(hostname, key);
+    return hash ? hash : 1;
+}
+
+/* Bytes a log record for a keylen name takes, padded so the next record stays aligned */
+static size_t record_size(size_t keylen)
+{
+    return (sizeof(DiskRecord) + keylen + 7) & ~(size_t) 7;
+}
+
+/* FNV-1a over everything in the record after the check field */
+static uint32_t record_check(const DiskRecord* r, size_t size)
+{
+    const unsigned char* p = (const unsigned char*) r + sizeof(r->check);
+    uint32_t hash = 2166136261U;
+    size_t i;
+    for(i = 0; i < size - sizeof(r->check); i++)
+        hash = (hash ^ p[i]) * 16777619U;
+    return hash;
+}
+
+/* Fills a slot's answer fields from a lookup result, returns -1 if ip isn't an address */
+static int slot_encode(DiskSlot* s, int status, const char* ip, uint32_t ttl)
+{
+    memset(s, 0, sizeof(*s));
+    s->resolved = (int64_t) time(NULL);
+    s->ttl = ttl;
+    if(status != UTIL_SUCCESS)
+        return 0;                                   // failures are remembered too, without an address
+    s->status = 1;
+    if(inet_pton(AF_INET, ip, s->addr) == 1)
+        s->family = 4;
+    else if(inet_pton(AF_INET6, ip, s->addr) == 1)
+        s->family = 6;
+    else
+        return -1;
+    return 0;
+}
+
+/* Copies a slot's answer out, returns CACHE_HIT or CACHE_MISS once it has expired */
+static int slot_decode(const DiskSlot* s, int* status, char* ip, int maxSize)
+{
+    if(s->resolved + (int64_t) s->ttl <= (int64_t) time(NULL))
+        return CACHE_MISS;
+    *status = s->status ? UTIL_SUCCESS : UTIL_FAILURE;
+    ip[0] = '\0';
+    if(s->status && !inet_ntop(s->family == 6 ? AF_INET6 : AF_INET, s->addr, ip, (socklen_t) maxSize))
+        return CACHE_MISS;
+    return CACHE_HIT;
+}
+
+/* Finds key in the mapped table, NULL if absent */
+static const DiskSlot* table_find(const DiskCache* dc, uint64_t hash, const char* key, size_t keylen)
+{
+    uint64_t mask, i;
+    if(!dc->head)
+        return NULL;
+    mask = dc->head->nslots - 1;
+    for(i = hash & mask; dc->slots[i].hash != 0; i = (i + 1) & mask) // the table is never full
+    {
+        const DiskSlot* s = &dc->slots[i];
+        if(s->hash == hash && s->keylen == keylen && memcmp(dc->heap + s->key, key, keylen) == 0)
+            return s;
+    }
+    return NULL;
+}
+
+/* Stores an answer in a table being written, keeping the newer one on a duplicate; returns 1 if a slot was used */
+static int table_put(DiskSlot* slots, uint64_t mask, char* heap, uint64_t* heapsize,
+                     uint64_t hash, const char* key, size_t keylen, const DiskSlot* src)
+{
+    uint64_t i;
+    for(i = hash & mask; slots[i].hash != 0; i = (i + 1) & mask)
+    {
+        DiskSlot* s = &slots[i];
+        if(s->hash == hash && s->keylen == keylen && memcmp(heap + s->key, key, keylen) == 0)
+        {
+            if(src->resolved > s->resolved)         // keep the slot's name, take the newer answer
+            {
+                uint64_t off = s->key;
+                *s = *src;
+                s->hash = hash;
+                s->key = off;
+                s->keylen = (uint8_t) keylen;
+            }
+            return 0;
+        }
+    }
+    slots[i] = *src;
+    slots[i].hash = hash;
+    slots[i].key = *heapsize;
+    slots[i].keylen = (uint8_t) keylen;
+    memcpy(heap + *heapsize, key, keylen);
+    *heapsize += keylen;
+    return 1;
+}
+
+/* Finds key among the logged answers, NULL if absent */
+static DiskEntry* overlay_find(const DiskCache* dc, uint64_t hash, const char* key)
+{
+    DiskEntry* e;
+    for(e = dc->overlay[hash & (dc->nbuckets - 1)]; e; e = e->next)
+    {
+        if(e->hash == hash && strcmp(e->name, key) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+/* Doubles the overlay's bucket array once chains get long */
+static void overlay_grow(DiskCache* dc)
+{
+    size_t nb = dc->nbuckets * 2;
+    DiskEntry** table = calloc(nb, sizeof(DiskEntry*));
+    size_t i;
+    if(!table)                                      // keep the old table, it still works, just slower
+        return;
+    for(i = 0; i < dc->nbuckets; i++)
+    {
+        DiskEntry* e = dc->overlay[i];
+        while(e)
+        {
+            DiskEntry* next = e->next;
+            e->next = table[e->hash & (nb - 1)];
+            table[e->hash & (nb - 1)] = e;
+            e = next;
+        }
+    }
+    free(dc->overlay);
+    dc->overlay = table;
+    dc->nbuckets = nb;
+}
+
+/* Applies one logged answer to the overlay (a later record for the same name wins), returns -1 if out of memory */
+static int overlay_apply(DiskCache* dc, const DiskRecord* r)
+{
+    char key[CACHE_KEY_LENGTH];
+    char name[CACHE_KEY_LENGTH];
+    uint64_t hash;
+    DiskEntry* e;
+
+    memcpy(name, r->name, r->keylen);               // names are logged normalized, this only terminates it
+    name[r->keylen] = '\0';
+    hash = disk_hash(name, key);
+    e = overlay_find(dc, hash, key);
+    if(!e)
+    {
+        e = malloc(sizeof(*e) + strlen(key) + 1);
+        if(!e)
+            return -1;
+        e->hash = hash;
+        strcpy(e->name, key);
+        e->next = dc->overlay[hash & (dc->nbuckets - 1)];
+        dc->overlay[hash & (dc->nbuckets - 1)] = e;
+        if(++dc->logged > dc->nbuckets * 2)
+            overlay_grow(dc);
+    }
+    memset(&e->slot, 0, sizeof(e->slot));
+    e->slot.resolved = r->resolved;
+    e->slot.ttl = r->ttl;
+    e->slot.keylen = r->keylen;
+    e->slot.status = r->status;
+    e->slot.family = r->family;
+    memcpy(e->slot.addr, r->addr, sizeof(e->slot.addr));
+    return 0;
+}
+
+/* Replays the log from offset from into the overlay & cuts off a torn tail, returns -1 on failure */
+static int log_replay(DiskCache* dc, off_t from)
+{
+    struct stat st;
+    const char* map;
+    size_t pos = (size_t) from;
+    size_t size;
+
+    if(fstat(dc->logfd, &st) != 0)
+        return -1;
+    size = (size_t) st.st_size;
+    if(size <= pos)
+        return 0;
+    map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, dc->logfd, 0);
+    if(map == MAP_FAILED)
+        return -1;
+    madvise((void*) map, size, MADV_SEQUENTIAL);
+    while(pos + sizeof(DiskRecord) <= size)
+    {
+        const DiskRecord* r = (const DiskRecord*) (map + pos);
+        size_t len = record_size(r->keylen);
+        if(r->keylen == 0 || pos + len > size || record_check(r, len) != r->check)
+            break;                                  // a crash cut this record short: everything before it is good
+        if(overlay_apply(dc, r) != 0)
+        {
+            munmap((void*) map, size);
+            return -1;
+        }
+        pos += len;
+    }
+    munmap((void*) map, size);
+    if(pos < size && ftruncate(dc->logfd, (off_t) pos) != 0) // so new records follow the last good one
+        return -1;
+    return 0;
+}
+
+/* Maps an existing table read-only, returns 0 (also when there is none yet) or -1 if it is unusable */
+static int table_map(DiskCache* dc)
+{
+    struct stat st;
+    const DiskHeader* h;
+    void* map;
+    int fd = open(dc->path, O_RDONLY | O_CLOEXEC);
+
+    if(fd < 0)
+        return errno == ENOENT ? 0 : -1;            // first run: the table is written on close
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if(st.st_size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+    if((size_t) st.st_size < sizeof(DiskHeader))
+    {
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);                                      // the mapping keeps the file alive
+    if(map == MAP_FAILED)
+        return -1;
+    h = map;
+    if(memcmp(h->magic, DISKCACHE_MAGIC, sizeof(h->magic)) != 0 || h->version != DISKCACHE_VERSION ||
+       h->slotsize != sizeof(DiskSlot) || h->nslots == 0 || (h->nslots & (h->nslots - 1)) != 0 ||
+       h->count >= h->nslots || h->nslots > ((uint64_t) st.st_size - sizeof(*h)) / sizeof(DiskSlot) ||
+       sizeof(*h) + h->nslots * sizeof(DiskSlot) + h->heapsize > (uint64_t) st.st_size)
+    {
+        fprintf(stderr, "\"%s\" is not a usable cache file.\n", dc->path);
+        munmap(map, (size_t) st.st_size);
+        return -1;
+    }
+    madvise(map, (size_t) st.st_size, MADV_RANDOM); // lookups touch one slot & one name, read-ahead would be wasted
+    dc->head = h;
+    dc->slots = (const DiskSlot*) (h + 1);
+    dc->heap = (const char*) (dc->slots + h->nslots);
+    dc->mapsize = (size_t) st.st_size;
+    return 0;
+}
+
+/* Locks the log, maps the table & replays the log into the overlay, returns -1 on failure */
+static int diskcache_load(DiskCache* dc)
+{
+    char* logpath = malloc(strlen(dc->path) + sizeof(".log"));
+    struct stat st;
+
+    if(!logpath)
+        return -1;
+    sprintf(logpath, "%s.log", dc->path);
+    dc->logfd = open(logpath, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    free(logpath);
+    if(dc->logfd < 0)
+        return -1;
+    if(flock(dc->logfd, LOCK_EX | LOCK_NB) != 0)    // a second run would interleave its records & compactions
+    {
+        fprintf(stderr, "Cache file \"%s\" is in use by another run.\n", dc->path);
+        return -1;
+    }
+    if(table_map(dc) != 0 || fstat(dc->logfd, &st) != 0)
+        return -1;
+
+    // Size the Overlay for Every Record the Log Could Hold
+    dc->nbuckets = 64;
+    while(dc->nbuckets < (size_t) st.st_size / sizeof(DiskRecord))
+        dc->nbuckets <<= 1;
+    if(!(dc->overlay = calloc(dc->nbuckets, sizeof(DiskEntry*))) || log_replay(dc, 0) != 0)
+        return -1;
+    dc->logstart = lseek(dc->logfd, 0, SEEK_END);
+    return 0;
+}
+
+/* Maps the table at path & replays its log, answers stored from now on live ttl seconds; NULL on failure */
+DiskCache* diskcache_open(const char* path, uint32_t ttl)
+{
+    struct timespec t0, t1;
+    DiskCache* dc = calloc(1, sizeof(*dc));
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if(!dc)
+        return NULL;
+    dc->ttl = ttl;
+    dc->logfd = -1;
+    dc->lock = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+    dc->path = strdup(path);
+    dc->buf = malloc(DISKCACHE_LOG_BUFFER);
+    if(!dc->path || !dc->buf || diskcache_load(dc) != 0)
+    {
+        diskcache_destroy(dc);
+        return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    dc->openms = (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) / 1000000.0;
+    return dc;
+}
+
+/* Copies a still valid answer into status & ip, returns CACHE_HIT or CACHE_MISS */
+int diskcache_lookup(DiskCache* dc, const char* hostname, int* status, char* ip, int maxSize)
+{
+    char key[CACHE_KEY_LENGTH];
+    uint64_t hash = disk_hash(hostname, key);
+    const DiskEntry* e = overlay_find(dc, hash, key); // logged answers are newer than the table's
+    const DiskSlot* s = table_find(dc, hash, key, strlen(key));
+
+    if(e && (!s || e->slot.resolved >= s->resolved))
+        s = &e->slot;
+    if(!s || slot_decode(s, status, ip, maxSize) != CACHE_HIT)
+        return CACHE_MISS;
+    __atomic_fetch_add(&dc->hits, 1, __ATOMIC_RELAXED);
+    return CACHE_HIT;
+}
+
+/* Writes the buffered records to the log, caller holds dc->lock */
+static void log_flush(DiskCache* dc)
+{
+    size_t off = 0;
+    while(off < dc->buflen)                         // O_APPEND: every write lands at the end of the log
+    {
+        ssize_t n = write(dc->logfd, dc->buf + off, dc->buflen - off);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+        {
+            fprintf(stderr, "Unable to write the cache log: %s.\n", strerror(errno));
+            break;                                  // those answers are simply looked up again next run
+        }
+        off += (size_t) n;
+    }
+    dc->buflen = 0;
+}
+
+/* Appends a fresh answer to the log (buffered, safe from any thread) */
+void diskcache_store(DiskCache* dc, const char* hostname, int status, const char* ip)
+{
+    char key[CACHE_KEY_LENGTH];
+    DiskSlot s;
+    DiskRecord* r;
+    size_t keylen, len;
+
+    cache_normalize(hostname, key);
+    keylen = strlen(key);
+    if(keylen == 0 || slot_encode(&s, status, ip, dc->ttl) != 0)
+        return;
+    len = record_size(keylen);
+    pthread_mutex_lock(&dc->lock);
+    if(dc->buflen + len > DISKCACHE_LOG_BUFFER)
+        log_flush(dc);
+    r = (DiskRecord*) (dc->buf + dc->buflen);
+    memset(r, 0, len);                              // padding is covered by the check too
+    r->ttl = s.ttl;
+    r->resolved = s.resolved;
+    r->keylen = (uint8_t) keylen;
+    r->status = s.status;
+    r->family = s.family;
+    memcpy(r->addr, s.addr, sizeof(r->addr));
+    memcpy(r->name, key, keylen);
+    r->check = record_check(r, len);
+    dc->buflen += len;
+    dc->stored++;
+    pthread_mutex_unlock(&dc->lock);
+}
+
+/* Flushes a file & the directory entry naming it, returns -1 on failure */
+static int sync_path(int fd, const char* path)
+{
+    char* copy = strdup(path);
+    int dir, rc = fsync(fd);
+    if(!copy)
+        return -1;
+    dir = open(dirname(copy), O_RDONLY | O_CLOEXEC);
+    free(copy);
+    if(dir >= 0)
+    {
+        if(fsync(dir) != 0)
+            rc = -1;
+        close(dir);
+    }
+    return rc;
+}
+
+/* Writes the live answers of the table & overlay to a new table & swaps it in, returns -1 on failure */
+static int table_rewrite(DiskCache* dc)
+{
+    int64_t now = (int64_t) time(NULL);
+    uint64_t live = 0, heapmax = 0, nslots = DISKCACHE_MIN_SLOTS, heapsize = 0, count = 0, i;
+    size_t b, size;
+    char* tmp = malloc(strlen(dc->path) + sizeof(".tmp"));
+    DiskHeader* h;
+    DiskSlot* slots;
+    char* heap;
+    void* map;
+    int fd;
+
+    if(!tmp)
+        return -1;
+    sprintf(tmp, "%s.tmp", dc->path);
+
+    // Size the New Table for the Answers Still Valid
+    for(b = 0; b < dc->nbuckets; b++)
+    {
+        DiskEntry* e;
+        for(e = dc->overlay[b]; e; e = e->next)
+        {
+            if(e->slot.resolved + (int64_t) e->slot.ttl > now)
+            {
+                live++;
+                heapmax += e->slot.keylen;
+            }
+        }
+    }
+    for(i = 0; dc->head && i < dc->head->nslots; i++)
+    {
+        const DiskSlot* s = &dc->slots[i];
+        if(s->hash != 0 && s->resolved + (int64_t) s->ttl > now)
+        {
+            live++;
+            heapmax += s->keylen;
+        }
+    }
+    while(nslots < live + live / 2)                 // at most 2/3 full keeps probe sequences short
+        nslots <<= 1;
+    size = sizeof(*h) + nslots * sizeof(DiskSlot) + heapmax;
+
+    // Fill a Sparse File through a Shared Mapping (untouched slots stay holes of zeros)
+    fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0 || ftruncate(fd, (off_t) size) != 0 ||
+       (map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        if(fd >= 0)
+            close(fd);
+        unlink(tmp);
+        free(tmp);
+        return -1;
+    }
+    h = map;
+    slots = (DiskSlot*) (h + 1);
+    heap = (char*) (slots + nslots);
+    for(b = 0; b < dc->nbuckets; b++)               // logged answers first, they are usually the newer ones
+    {
+        DiskEntry* e;
+        for(e = dc->overlay[b]; e; e = e->next)
+        {
+            if(e->slot.resolved + (int64_t) e->slot.ttl > now)
+                count += table_put(slots, nslots - 1, heap, &heapsize, e->hash, e->name, e->slot.keylen, &e->slot);
+        }
+    }
+    for(i = 0; dc->head && i < dc->head->nslots; i++)
+    {
+        const DiskSlot* s = &dc->slots[i];
+        if(s->hash != 0 && s->resolved + (int64_t) s->ttl > now)
+            count += table_put(slots, nslots - 1, heap, &heapsize, s->hash, dc->heap + s->key, s->keylen, s);
+    }
+    memcpy(h->magic, DISKCACHE_MAGIC, sizeof(h->magic));
+    h->version = DISKCACHE_VERSION;
+    h->slotsize = sizeof(DiskSlot);
+    h->nslots = nslots;
+    h->count = count;
+    h->heapsize = heapsize;
+    h->written = now;
+    size = sizeof(*h) + nslots * sizeof(DiskSlot) + heapsize;
+    if(msync(map, size, MS_SYNC) != 0 || munmap(map, sizeof(*h) + nslots * sizeof(DiskSlot) + heapmax) != 0 ||
+       ftruncate(fd, (off_t) size) != 0 || fsync(fd) != 0)
+    {
+        close(fd);
+        unlink(tmp);
+        free(tmp);
+        return -1;
+    }
+    close(fd);
+
+    // Swap it In: a crash leaves either the old table or the new one, & the log replays onto both
+    if(rename(tmp, dc->path) != 0)
+    {
+        unlink(tmp);
+        free(tmp);
+        return -1;
+    }
+    free(tmp);
+    fd = open(dc->path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0 || sync_path(fd, dc->path) != 0)
+    {
+        if(fd >= 0)
+            close(fd);
+        return -1;
+    }
+    close(fd);
+    if(ftruncate(dc->logfd, 0) != 0 || fsync(dc->logfd) != 0) // the table now holds every logged answer
+        return -1;
+    dc->compacted = count;
+    return 0;
+}
+
+/* Flushes the log & rewrites the table once the log has grown large enough, returns -1 on failure */
+int diskcache_sync(DiskCache* dc)
+{
+    size_t threshold = DISKCACHE_COMPACT_MIN;
+    if(dc->head && dc->head->count >> DISKCACHE_COMPACT_SHIFT > threshold)
+        threshold = dc->head->count >> DISKCACHE_COMPACT_SHIFT;
+    pthread_mutex_lock(&dc->lock);
+    log_flush(dc);
+    pthread_mutex_unlock(&dc->lock);
+    if(fsync(dc->logfd) != 0)
+        return -1;
+    if(dc->logged + dc->stored < threshold)         // rewriting is O(table), so only once the replay gets costly
+        return 0;
+    if(log_replay(dc, dc->logstart) != 0 || table_rewrite(dc) != 0)
+    {
+        fprintf(stderr, "Unable to rewrite the cache file \"%s\", its log is kept.\n", dc->path);
+        return -1;
+    }
+    return 0;
+}
+
+/* Unmaps the table, releases the log & frees everything (unsynced records are lost) */
+void diskcache_destroy(DiskCache* dc)
+{
+    size_t b;
+    if(dc->logfd >= 0)
+        close(dc->logfd);                           // releases the lock
+    for(b = 0; dc->overlay && b < dc->nbuckets; b++)
+    {
+        DiskEntry* e = dc->overlay[b];
+        while(e)
+        {
+            DiskEntry* next = e->next;
+            free(e);
+            e = next;
+        }
+    }
+    if(dc->head)
+        munmap((void*) dc->head, dc->mapsize);
+    pthread_mutex_destroy(&dc->lock);
+    free(dc->overlay);
+    free(dc->buf);
+    free(dc->path);
+    free(dc);
+}
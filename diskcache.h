@@ -0,0 +1,110 @@
+// Connor Humiston
+// Persistent Cache File Header
+#ifndef DISKCACHE_H
+#define DISKCACHE_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <stdint.h>                                 // fixed width integer types
+#include <pthread.h>                                // thread library
+#include <sys/types.h>                              // off_t
+
+#include "cache.h"                                  // CACHE_KEY_LENGTH & key normalization
+
+#define DISKCACHE_MAGIC         "MLCACHE1"          // first 8 bytes of a table file
+#define DISKCACHE_VERSION       2                   // 2: hostname_fold() hashes (1 used FNV-1a)
+#define DISKCACHE_MIN_SLOTS     1024                // smallest table written (power of two)
+#define DISKCACHE_LOG_BUFFER    65536               // bytes of records gathered before one write() to the log
+#define DISKCACHE_COMPACT_MIN   4096                // log records that always justify rewriting the table at exit
+#define DISKCACHE_COMPACT_SHIFT 4                   // ... as do more than 1/16th of the table's entries
+
+
+/* Table File Header: the table is usable straight from the mapping, nothing is parsed */
+typedef struct DiskHeader
+{
+    char magic[8];                                  // DISKCACHE_MAGIC
+    uint32_t version;                               // DISKCACHE_VERSION
+    uint32_t slotsize;                              // sizeof(DiskSlot) of the writer
+    uint64_t nslots;                                // slots after the header (power of two)
+    uint64_t count;                                 // slots in use
+    uint64_t heapsize;                              // bytes of names after the slots
+    int64_t written;                                // wall clock second the table was compacted
+    uint8_t reserved[16];                           // pads the header to a cache line
+} DiskHeader;
+
+/* Table Slot: open addressing with linear probing, names live in the heap after the slots */
+typedef struct DiskSlot
+{
+    uint64_t hash;                                  // cache_normalize() hash, 0 marks an empty slot
+    uint64_t key;                                   // heap offset of the normalized name
+    int64_t resolved;                               // wall clock second of the lookup
+    uint32_t ttl;                                   // seconds the answer stays valid
+    uint8_t keylen;                                 // bytes in the name (no terminator)
+    uint8_t status;                                 // 1 resolved, 0 NOT_RESOLVED
+    uint8_t family;                                 // 4 or 6, 0 without an address
+    uint8_t pad;
+    uint8_t addr[16];                               // address in network byte order
+} DiskSlot;
+
+/* Log Record: answers appended since the last compaction, replayed on open */
+typedef struct DiskRecord
+{
+    uint32_t check;                                 // FNV-1a of the rest of the record, a torn tail fails it
+    uint32_t ttl;
+    int64_t resolved;
+    uint8_t keylen;
+    uint8_t status;
+    uint8_t family;
+    uint8_t pad[5];
+    uint8_t addr[16];
+    char name[];                                    // keylen bytes, the record is padded to 8 bytes
+} DiskRecord;
+
+/* Logged Answer Kept in Memory Until the Next Compaction */
+typedef struct DiskEntry
+{
+    struct DiskEntry* next;                         // bucket chain
+    uint64_t hash;
+    DiskSlot slot;                                  // same fields as a table slot (key unused)
+    char name[];                                    // normalized name, null terminated
+} DiskEntry;
+
+/* Cache File: read-only mapped table + in-memory replay of the append log */
+typedef struct DiskCache
+{
+    char* path;                                     // table file, the log is path + ".log"
+    const DiskHeader* head;                         // mapped table (NULL when there is none yet)
+    const DiskSlot* slots;
+    const char* heap;
+    size_t mapsize;
+    uint32_t ttl;                                   // lifetime given to new answers
+    DiskEntry** overlay;                            // logged answers by hash (read-only while resolvers run)
+    size_t nbuckets;                                // overlay buckets (power of two)
+    size_t logged;                                  // overlay entries
+    int logfd;                                      // append log, also holds the exclusive lock
+    off_t logstart;                                 // where this run's records begin
+    pthread_mutex_t lock;                           // protects the record buffer & counters below
+    size_t buflen;
+    char* buf;                                      // records not yet written to the log
+    unsigned long stored;                           // records appended this run
+    unsigned long hits;                             // answers served (atomic)
+    unsigned long compacted;                        // entries in the rewritten table, 0 if not rewritten
+    double openms;                                  // time spent mapping & replaying in diskcache_open()
+} DiskCache;
+
+
+/* Maps the table at path & replays its log, answers stored from now on live ttl seconds; NULL on failure */
+DiskCache* diskcache_open(const char* path, uint32_t ttl);
+
+/* Copies a still valid answer into status & ip, returns CACHE_HIT or CACHE_MISS */
+int diskcache_lookup(DiskCache* dc, const char* hostname, int* status, char* ip, int maxSize);
+
+/* Appends a fresh answer to the log (buffered, safe from any thread) */
+void diskcache_store(DiskCache* dc, const char* hostname, int status, const char* ip);
+
+/* Flushes the log & rewrites the table once the log has grown large enough, returns -1 on failure */
+int diskcache_sync(DiskCache* dc);
+
+/* Unmaps the table, releases the log & frees everything (unsynced records are lost) */
+void diskcache_destroy(DiskCache* dc);
+
+#endif
@@ -0,0 +1,382 @@
+// Connor Humiston
+// Asynchronous DNS Engine Implementation
+#include "dnsasync.h"
+
+#include <stdio.h>                                  // standard i/o
+#include <string.h>                                 // C string library
+#include <unistd.h>                                 // close()
+#include <fcntl.h>                                  // O_NONBLOCK
+#include <time.h>                                   // clock_gettime()
+#include <sys/epoll.h>                              // epoll_create1(), epoll_wait()
+#include <sys/random.h>                             // getrandom()
+
+#include "util.h"                                   // UTIL_SUCCESS/UTIL_FAILURE
+
+#define RESOLV_CONF             "/etc/resolv.conf"
+
+
+/* Current monotonic time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* xorshift64* step, good enough to make IDs & ports unpredictable per query */
+static uint64_t next_rand(AsyncEngine* e)
+{
+    e->rng ^= e->rng >> 12;
+    e->rng ^= e->rng << 25;
+    e->rng ^= e->rng >> 27;
+    return e->rng * 2685821657736338717ULL;
+}
+
+/* Unlinks a query from the timeout list */
+static void list_remove(AsyncEngine* e, AsyncQuery* q)
+{
+    if(q->prev)
+        q->prev->next = q->next;
+    else
+        e->head = q->next;
+    if(q->next)
+        q->next->prev = q->prev;
+    else
+        e->tail = q->prev;
+    q->prev = q->next = NULL;
+}
+
+/* Appends a query to the timeout list (deadlines are monotonic so the list stays sorted) */
+static void list_append(AsyncEngine* e, AsyncQuery* q)
+{
+    q->prev = e->tail;
+    q->next = NULL;
+    if(e->tail)
+        e->tail->next = q;
+    else
+        e->head = q;
+    e->tail = q;
+}
+
+/* Sends (or resends) a query from a random socket with a fresh random ID */
+static void send_query(AsyncEngine* e, AsyncQuery* q)
+{
+    uint16_t id;
+    do                                              // IDs must be unique among our outstanding queries
+        id = (uint16_t) next_rand(e);
+    while(e->byid[id] != 0);
+    if(q->tries > 0)
+        e->byid[q->id] = 0;                         // forget the previous attempt's ID
+    q->id = id;
+    e->byid[id] = (uint16_t) (q - e->slots + 1);
+    q->packet[0] = (uint8_t) (id >> 8);
+    q->packet[1] = (uint8_t) id;
+    q->sock = (int) (next_rand(e) % DNSASYNC_SOCKETS);
+    q->tries++;
+    q->deadline = now() + e->timeout_ms / 1000.0;
+    // A failed send (e.g. EAGAIN) is simply retried when the deadline passes
+    sendto(e->socks[q->sock], q->packet, q->len, 0, (struct sockaddr*) &e->server, e->serverlen);
+}
+
+/* Puts a query's slot back on the free list (later answers to its ID are ignored) */
+static void release(AsyncEngine* e, AsyncQuery* q)
+{
+    list_remove(e, q);
+    e->byid[q->id] = 0;
+    q->next = e->free;                              // back onto the free list
+    e->free = q;
+    e->pending--;
+}
+
+/* Releases a finished query's slot & records its result (the first max_addrs of naddrs addresses) */
+static void finish(AsyncEngine* e, AsyncQuery* q, LookupResult* out, int status, const DnsAddr* addrs, int naddrs)
+{
+    int i;
+    out->user = q->user;
+    out->status = status;
+    out->ip[0] = '\0';
+    for(i = 0; status == UTIL_SUCCESS && i < naddrs && i < e->max_addrs; i++)
+        lookup_append(out->ip, sizeof(out->ip), addrs[i].family, &addrs[i].addr);
+    if(status == UTIL_SUCCESS && out->ip[0] == '\0')
+        out->status = UTIL_FAILURE;
+    release(e, q);
+}
+
+/* Returns 1 if addr is the configured nameserver */
+static int from_server(AsyncEngine* e, const struct sockaddr_storage* addr)
+{
+    if(addr->ss_family != e->server.ss_family)
+        return 0;
+    if(addr->ss_family == AF_INET)
+    {
+        const struct sockaddr_in* a = (const struct sockaddr_in*) addr;
+        const struct sockaddr_in* b = (const struct sockaddr_in*) &e->server;
+        return a->sin_port == b->sin_port && a->sin_addr.s_addr == b->sin_addr.s_addr;
+    }
+    const struct sockaddr_in6* a = (const struct sockaddr_in6*) addr;
+    const struct sockaddr_in6* b = (const struct sockaddr_in6*) &e->server;
+    return a->sin6_port == b->sin6_port && memcmp(&a->sin6_addr, &b->sin6_addr, sizeof(a->sin6_addr)) == 0;
+}
+
+/* Drains one readable socket, completing matching queries into out, returns results added */
+static int read_socket(AsyncEngine* e, int sock, LookupResult* out, int max)
+{
+    uint8_t msg[DNS_MAX_UDP];
+    struct sockaddr_storage from;
+    DnsReply reply;
+    int n = 0;
+
+    while(n < max)
+    {
+        socklen_t fromlen = sizeof(from);
+        ssize_t len = recvfrom(e->socks[sock], msg, sizeof(msg), 0, (struct sockaddr*) &from, &fromlen);
+        if(len < 0)                                 // EAGAIN: socket drained
+            break;
+        if(!from_server(e, &from) || dnswire_parse_reply(msg, (size_t) len, &reply) != 0)
+            continue;                               // spoofed, stray or garbled: ignore it
+        uint16_t slot = e->byid[reply.id];
+        if(slot == 0)
+            continue;                               // late answer to a query already finished or resent
+        AsyncQuery* q = &e->slots[slot - 1];
+        if(q->sock != sock || reply.qtype != e->qtype || !dnswire_name_equal(reply.qname, q->name))
+            continue;                               // must arrive on the port & for the question we sent
+        if(reply.rcode == DNS_RCODE_SERVFAIL && q->tries <= e->retries)
+            continue;                               // upstream hiccup: retransmit on timeout
+        if(reply.rcode == DNS_RCODE_NOERROR && reply.naddrs > 0) // a truncated reply's whole records count too
+            finish(e, q, &out[n++], UTIL_SUCCESS, reply.addrs, reply.naddrs);
+        else                                        // also TC with no address: UDP won't do better
+            finish(e, q, &out[n++], UTIL_FAILURE, NULL, 0);
+    }
+    return n;
+}
+
+/* Retransmits or fails queries whose deadline passed, returns results added */
+static int expire(AsyncEngine* e, LookupResult* out, int max)
+{
+    double t = now();
+    int n = 0;
+    while(e->head && e->head->deadline <= t && n < max)
+    {
+        AsyncQuery* q = e->head;
+        if(q->tries <= e->retries)
+        {
+            list_remove(e, q);
+            send_query(e, q);
+            list_append(e, q);                      // new deadline is the latest
+        }
+        else
+            finish(e, q, &out[n++], UTIL_FAILURE, NULL, 0);
+    }
+    return n;
+}
+
+/* Parses "ip", "ip:port" or "[ipv6]:port" into addr, returns 0 or -1 */
+static int parse_address(const char* spec, struct sockaddr_storage* addr, socklen_t* len)
+{
+    int port = DNSASYNC_DEFAULT_PORT;
+
+    // Split Address & Port
+    const char* colon = strrchr(spec, ':');
+    size_t n = strlen(spec);
+    if(spec[0] == '[')                              // [v6] or [v6]:port
+    {
+        const char* close = strchr(spec, ']');
+        if(!close)
+            return -1;
+        n = (size_t) (close - spec - 1);
+        colon = close[1] == ':' ? close + 1 : NULL;
+        spec++;
+    }
+    else if(colon && strchr(spec, ':') != colon)    // bare IPv6 without a port
+        colon = NULL;
+    else if(colon)
+        n = (size_t) (colon - spec);
+    if(colon && ((port = atoi(colon + 1)) <= 0 || port > 65535))
+        return -1;
+    if(n >= INET6_ADDRSTRLEN)
+        return -1;
+    char ip[INET6_ADDRSTRLEN];
+    memcpy(ip, spec, n);
+    ip[n] = '\0';
+
+    // Build the Socket Address
+    memset(addr, 0, sizeof(*addr));
+    struct sockaddr_in* v4 = (struct sockaddr_in*) addr;
+    struct sockaddr_in6* v6 = (struct sockaddr_in6*) addr;
+    if(inet_pton(AF_INET, ip, &v4->sin_addr) == 1)
+    {
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons((uint16_t) port);
+        *len = sizeof(*v4);
+    }
+    else if(inet_pton(AF_INET6, ip, &v6->sin6_addr) == 1)
+    {
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = htons((uint16_t) port);
+        *len = sizeof(*v6);
+    }
+    else
+        return -1;
+    return 0;
+}
+
+/* Parses "ip", "ip:port" or "[ipv6]:port"; NULL spec uses the first usable nameserver in /etc/resolv.conf */
+int dnsasync_parse_server(const char* spec, struct sockaddr_storage* addr, socklen_t* len)
+{
+    char host[INET6_ADDRSTRLEN + 16];               // room to notice a scope or anything else too long
+    char def[sizeof(host) + 2];
+    char line[256];
+    FILE* fp;
+
+    if(spec)
+        return parse_address(spec, addr, len);
+    if((fp = fopen(RESOLV_CONF, "r")))              // default: the system's first nameserver we can send to
+    {
+        while(fgets(line, sizeof(line), fp))
+        {
+            if(sscanf(line, " nameserver %61s", host) != 1)
+                continue;
+            if(strchr(host, ':'))                   // bracket IPv6 so its colons aren't read as a port
+                snprintf(def, sizeof(def), "[%s]", host);
+            else
+                snprintf(def, sizeof(def), "%s", host);
+            if(parse_address(def, addr, len) == 0)  // a scoped (fe80::1%eth0) or garbled entry is skipped
+            {
+                fclose(fp);
+                return 0;
+            }
+        }
+        fclose(fp);
+    }
+    return parse_address("127.0.0.1", addr, len);   // like the C library with no usable nameserver line
+}
+
+/* Opens an engine talking to server asking for family's addresses (AAAA for AF_INET6, else A), NULL on failure */
+AsyncEngine* dnsasync_create(const struct sockaddr_storage* server, socklen_t len, int cap, int timeout_ms, int retries,
+                             int family, int max_addrs)
+{
+    AsyncEngine* e = calloc(1, sizeof(*e));
+    int i;
+
+    if(!e)
+        return NULL;
+    e->slots = calloc(cap, sizeof(AsyncQuery));
+    e->epfd = epoll_create1(EPOLL_CLOEXEC);
+    for(i = 0; i < DNSASYNC_SOCKETS; i++)
+        e->socks[i] = -1;
+    if(!e->slots || e->epfd < 0)
+    {
+        dnsasync_destroy(e);
+        return NULL;
+    }
+    memcpy(&e->server, server, len);
+    e->serverlen = len;
+    e->cap = cap;
+    e->timeout_ms = timeout_ms;
+    e->retries = retries;
+    e->qtype = family == AF_INET6 ? DNS_TYPE_AAAA : DNS_TYPE_A; // one question per query: "any" asks for A as before
+    e->max_addrs = max_addrs;
+    if(getrandom(&e->rng, sizeof(e->rng), 0) != sizeof(e->rng) || e->rng == 0)
+        e->rng = (uint64_t) now() * 0x9E3779B97F4A7C15ULL + (uintptr_t) e;
+    for(i = cap - 1; i >= 0; i--)                   // chain every slot onto the free list
+    {
+        e->slots[i].next = e->free;
+        e->free = &e->slots[i];
+    }
+
+    // Sockets: binding to port 0 gives each one a kernel-randomized ephemeral port
+    for(i = 0; i < DNSASYNC_SOCKETS; i++)
+    {
+        struct epoll_event ev;
+        e->socks[i] = socket(server->ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(e->socks[i] < 0)
+        {
+            dnsasync_destroy(e);
+            return NULL;
+        }
+        ev.events = EPOLLIN;
+        ev.data.u32 = (uint32_t) i;
+        if(epoll_ctl(e->epfd, EPOLL_CTL_ADD, e->socks[i], &ev) != 0)
+        {
+            dnsasync_destroy(e);
+            return NULL;
+        }
+    }
+    return e;
+}
+
+/* Closes the sockets & frees the engine (outstanding queries are dropped) */
+void dnsasync_destroy(AsyncEngine* engine)
+{
+    int i;
+    for(i = 0; i < DNSASYNC_SOCKETS; i++)
+    {
+        if(engine->socks[i] >= 0)
+            close(engine->socks[i]);
+    }
+    if(engine->epfd >= 0)
+        close(engine->epfd);
+    free(engine->slots);
+    free(engine);
+}
+
+/* Sends a query for hostname, returns 0 if queued, DNSASYNC_FULL or DNSASYNC_BADNAME */
+int dnsasync_submit(AsyncEngine* engine, const char* hostname, void* user)
+{
+    AsyncQuery* q = engine->free;
+    int len;
+
+    if(!q)
+        return DNSASYNC_FULL;
+    if((len = dnswire_build_query(q->packet, sizeof(q->packet), 0, hostname, engine->qtype)) < 0)
+        return DNSASYNC_BADNAME;
+    engine->free = q->next;
+    q->len = (uint16_t) len;
+    q->user = user;
+    q->tries = 0;
+    strncpy(q->name, hostname, sizeof(q->name));
+    q->name[sizeof(q->name)-1] = '\0';
+    send_query(engine, q);
+    list_append(engine, q);
+    engine->pending++;
+    return 0;
+}
+
+/* Waits up to timeout_ms for answers/timeouts, fills at most max results & returns how many */
+int dnsasync_poll(AsyncEngine* engine, int timeout_ms, LookupResult* out, int max)
+{
+    struct epoll_event evs[DNSASYNC_SOCKETS];
+    int n = expire(engine, out, max);
+    int nev, i;
+
+    if(n >= max)
+        return n;
+    if(n > 0)
+        timeout_ms = 0;                             // already have results, don't sleep
+    else if(engine->head)                           // wake up in time for the oldest deadline
+    {
+        int until = (int) ((engine->head->deadline - now()) * 1000.0) + 1;
+        if(until < timeout_ms || timeout_ms < 0)
+            timeout_ms = until < 0 ? 0 : until;
+    }
+    nev = epoll_wait(engine->epfd, evs, DNSASYNC_SOCKETS, timeout_ms);
+    for(i = 0; i < nev && n < max; i++)
+        n += read_socket(engine, (int) evs[i].data.u32, out + n, max - n);
+    if(n < max)
+        n += expire(engine, out + n, max - n);
+    return n;
+}
+
+/* Drops the query submitted with user, its answer is never returned */
+void dnsasync_cancel(AsyncEngine* engine, void* user)
+{
+    AsyncQuery* q;
+    for(q = engine->head; q; q = q->next)           // only hedge losers & timeouts are cancelled, a walk is fine
+    {
+        if(q->user == user)
+        {
+            release(engine, q);
+            return;
+        }
+    }
+}
@@ -0,0 +1,82 @@
+// Connor Humiston
+// Asynchronous DNS Engine Header
+#ifndef DNSASYNC_H
+#define DNSASYNC_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <stdint.h>                                 // fixed width integer types
+#include <sys/socket.h>                             // struct sockaddr_storage
+#include <arpa/inet.h>                              // INET6_ADDRSTRLEN
+
+#include "dnswire.h"                                // query encoding & reply decoding
+#include "backend.h"                                // LookupResult
+
+#define DNSASYNC_SOCKETS        8                   // UDP sockets per engine, each on its own random port
+#define DNSASYNC_DEFAULT_PORT   53
+#define DEFAULT_ASYNC_INFLIGHT  1024                // outstanding queries per resolver thread
+#define MAX_ASYNC_INFLIGHT      65535               // IDs are 16 bits
+#define DEFAULT_DNS_TIMEOUT_MS  2000                // wait per attempt before retransmitting
+#define DEFAULT_DNS_RETRIES     2                   // retransmissions before NOT_RESOLVED
+
+/* dnsasync_submit() failures */
+#define DNSASYNC_FULL           -1                  // no free slot, poll for completions first
+#define DNSASYNC_BADNAME        -2                  // name cannot be encoded, it will never resolve
+
+
+/* In-Flight Query (one slot per outstanding hostname) */
+typedef struct AsyncQuery
+{
+    struct AsyncQuery* prev;                        // neighbours in the timeout list (or free list)
+    struct AsyncQuery* next;
+    void* user;                                     // caller's handle, returned with the result
+    double deadline;                                // monotonic time this attempt times out
+    int sock;                                       // index of the socket the query went out on
+    int tries;                                      // attempts so far
+    uint16_t id;                                    // random transaction ID
+    uint16_t len;                                   // encoded query length
+    uint8_t packet[DNS_MAX_QUERY];                  // encoded query, kept for retransmission
+    char name[DNS_MAX_NAME + 1];                    // hostname, checked against the reply's question
+} AsyncQuery;
+
+/* Per-Thread Engine: non-blocking UDP sockets multiplexed with epoll */
+typedef struct AsyncEngine
+{
+    int epfd;                                       // epoll instance watching the sockets
+    int socks[DNSASYNC_SOCKETS];                    // non-blocking UDP sockets
+    struct sockaddr_storage server;                 // upstream nameserver
+    socklen_t serverlen;
+    int timeout_ms;                                 // per attempt timeout
+    int retries;                                    // retransmissions allowed
+    int cap;                                        // maximum outstanding queries
+    uint16_t qtype;                                 // DNS_TYPE_A or DNS_TYPE_AAAA, asked for every name
+    int max_addrs;                                  // answers kept per name
+    int pending;                                    // outstanding queries
+    uint64_t rng;                                   // xorshift state for IDs & socket choice
+    AsyncQuery* slots;                              // cap query slots
+    AsyncQuery* free;                               // unused slots
+    AsyncQuery* head;                               // oldest deadline (timeouts are checked from here)
+    AsyncQuery* tail;                               // newest deadline
+    uint16_t byid[65536];                           // slot index + 1 for each ID in use, 0 if free
+} AsyncEngine;
+
+
+/* Parses "ip", "ip:port" or "[ipv6]:port"; NULL spec uses the first usable nameserver in /etc/resolv.conf */
+int dnsasync_parse_server(const char* spec, struct sockaddr_storage* addr, socklen_t* len);
+
+/* Opens an engine talking to server asking for family's addresses (AAAA for AF_INET6, else A), NULL on failure */
+AsyncEngine* dnsasync_create(const struct sockaddr_storage* server, socklen_t len, int cap, int timeout_ms, int retries,
+                             int family, int max_addrs);
+
+/* Closes the sockets & frees the engine (outstanding queries are dropped) */
+void dnsasync_destroy(AsyncEngine* engine);
+
+/* Sends a query for hostname, returns 0 if queued, DNSASYNC_FULL or DNSASYNC_BADNAME */
+int dnsasync_submit(AsyncEngine* engine, const char* hostname, void* user);
+
+/* Drops the query submitted with user, its answer is never returned */
+void dnsasync_cancel(AsyncEngine* engine, void* user);
+
+/* Waits up to timeout_ms for answers/timeouts, fills at most max results & returns how many */
+int dnsasync_poll(AsyncEngine* engine, int timeout_ms, LookupResult* out, int max);
+
+#endif
@@ -0,0 +1,227 @@
+// Connor Humiston
+// DNS Wire Format Implementation
+#include "dnswire.h"
+
+#include <string.h>                                 // C string library
+#include <strings.h>                                // strncasecmp()
+#include <ctype.h>                                  // tolower()
+#include <sys/socket.h>                             // AF_INET/AF_INET6
+
+#define DNS_MAX_POINTERS        16                  // compression pointers followed before giving up
+
+
+/* Reads a big-endian 16 bit value */
+static uint16_t get16(const uint8_t* p)
+{
+    return (uint16_t) ((p[0] << 8) | p[1]);
+}
+
+/* Writes a big-endian 16 bit value */
+static void put16(uint8_t* p, uint16_t v)
+{
+    p[0] = (uint8_t) (v >> 8);
+    p[1] = (uint8_t) v;
+}
+
+/* Decodes the (possibly compressed) name at off into out, returns the offset just past it or -1;
+ * sets *odd (if given) when a label held a '.' or a null byte, which the dotted form can't show */
+static int read_name(const uint8_t* msg, size_t len, size_t off, char* out, size_t size, int* odd)
+{
+    size_t pos = off;                               // where we are reading labels
+    size_t used = 0;                                // characters written to out
+    int end = -1;                                   // offset after the name in the original position
+    int jumps = 0;
+
+    while(1)
+    {
+        if(pos >= len)
+            return -1;
+        uint8_t c = msg[pos];
+        if((c & 0xC0) == 0xC0)                      // compression pointer
+        {
+            if(pos + 1 >= len || ++jumps > DNS_MAX_POINTERS)
+                return -1;
+            if(end < 0)
+                end = (int) pos + 2;
+            pos = ((c & 0x3F) << 8) | msg[pos+1];
+            continue;
+        }
+        if(c & 0xC0)                                // reserved label types
+            return -1;
+        pos++;
+        if(c == 0)                                  // root label ends the name
+            break;
+        if(pos + c > len || used + c + 2 > size)
+            return -1;
+        if(used > 0)
+            out[used++] = '.';
+        while(c--)
+        {
+            if(odd && (msg[pos] == '.' || msg[pos] == '\0'))
+                *odd = 1;
+            out[used++] = (char) tolower(msg[pos++]);
+        }
+    }
+    if(size > 0)
+        out[used] = '\0';
+    return end < 0 ? (int) pos : end;
+}
+
+/* Encodes a recursive query for name, returns its length or -1 if the name is malformed/too long */
+int dnswire_build_query(uint8_t* buf, size_t size, uint16_t id, const char* name, uint16_t qtype)
+{
+    size_t pos = DNS_HEADER_SIZE;
+    const char* label = name;
+
+    if(size < DNS_MAX_QUERY)
+        return -1;
+    memset(buf, 0, DNS_HEADER_SIZE);
+    put16(buf, id);
+    put16(buf + 2, DNS_FLAG_RD);                    // ask the upstream to recurse for us
+    put16(buf + 4, 1);                              // one question
+    while(*label)                                   // encode each dot separated label
+    {
+        const char* dot = strchr(label, '.');
+        size_t n = dot ? (size_t) (dot - label) : strlen(label);
+        if(n == 0 || n > 63 || pos + n + 1 > DNS_HEADER_SIZE + DNS_MAX_NAME - 1)
+            return -1;                              // empty label ("a..b"), long label or long name
+        buf[pos++] = (uint8_t) n;
+        memcpy(buf + pos, label, n);
+        pos += n;
+        label += n + (dot ? 1 : 0);
+    }
+    if(pos == DNS_HEADER_SIZE)                      // empty name
+        return -1;
+    buf[pos++] = 0;                                 // root label
+    put16(buf + pos, qtype);
+    put16(buf + pos + 2, DNS_CLASS_IN);
+    return (int) pos + 4;
+}
+
+/* Decodes a response, returns 0 on success or -1 if the message is malformed (a truncated one keeps its whole answers) */
+int dnswire_parse_reply(const uint8_t* msg, size_t len, DnsReply* reply)
+{
+    char rname[DNS_MAX_NAME + 1];                   // owner name of each answer (unused)
+    int off, i;
+
+    if(len < DNS_HEADER_SIZE)
+        return -1;
+    reply->id = get16(msg);
+    reply->flags = get16(msg + 2);
+    reply->rcode = reply->flags & 0x000F;
+    reply->naddrs = 0;
+    if(!(reply->flags & DNS_FLAG_QR) || get16(msg + 4) != 1) // must be a response to a single question
+        return -1;
+    int ancount = get16(msg + 6);
+
+    // Question
+    off = read_name(msg, len, DNS_HEADER_SIZE, reply->qname, sizeof(reply->qname), NULL);
+    if(off < 0 || (size_t) off + 4 > len)
+        return -1;
+    reply->qtype = get16(msg + off);
+    off += 4;
+
+    // Answers: keep the records of the asked type, skip CNAMEs & everything else
+    int cut = (reply->flags & DNS_FLAG_TC) ? 0 : -1; // a truncated reply may end mid-record: keep what came whole
+    for(i = 0; i < ancount; i++)
+    {
+        off = read_name(msg, len, off, rname, sizeof(rname), NULL);
+        if(off < 0 || (size_t) off + 10 > len)
+            return cut;
+        uint16_t type = get16(msg + off);
+        uint16_t class = get16(msg + off + 2);
+        uint16_t rdlen = get16(msg + off + 8);
+        off += 10;
+        if((size_t) off + rdlen > len)
+            return cut;
+        if(class == DNS_CLASS_IN && reply->naddrs < DNS_MAX_ADDRS)
+        {
+            DnsAddr* a = &reply->addrs[reply->naddrs];
+            if(type == DNS_TYPE_A && rdlen == 4)
+            {
+                a->family = AF_INET;
+                memset(&a->addr, 0, sizeof(a->addr));
+                memcpy(&a->addr, msg + off, 4);
+                reply->naddrs++;
+            }
+            else if(type == DNS_TYPE_AAAA && rdlen == 16)
+            {
+                a->family = AF_INET6;
+                memcpy(&a->addr, msg + off, 16);
+                reply->naddrs++;
+            }
+        }
+        off += rdlen;
+    }
+    return 0;
+}
+
+/* Decodes a query with exactly one question, returns 0 or -1 if it is malformed or a response */
+int dnswire_parse_query(const uint8_t* msg, size_t len, DnsQuery* query)
+{
+    int off;
+
+    if(len < DNS_HEADER_SIZE)
+        return -1;
+    query->id = get16(msg);
+    query->flags = get16(msg + 2);
+    if((query->flags & DNS_FLAG_QR) || get16(msg + 4) != 1) // never answer responses (reflection loops)
+        return -1;
+    query->oddname = 0;
+    off = read_name(msg, len, DNS_HEADER_SIZE, query->qname, sizeof(query->qname), &query->oddname);
+    if(off < 0 || (size_t) off + 4 > len)
+        return -1;
+    query->qtype = get16(msg + off);
+    query->qclass = get16(msg + off + 2);
+    query->end = (size_t) off + 4;                  // any EDNS/additional records after this are dropped
+    return 0;
+}
+
+/* Appends a 16 bit then a 32 bit value */
+static void put32(uint8_t* p, uint32_t v)
+{
+    put16(p, (uint16_t) (v >> 16));
+    put16(p + 2, (uint16_t) v);
+}
+
+/* Encodes the answer to query (whose raw bytes are msg) with naddrs records of ttl seconds, returns its length or -1 */
+int dnswire_build_answer(uint8_t* buf, size_t size, const uint8_t* msg, const DnsQuery* query,
+                         int rcode, const DnsAddr* addrs, int naddrs, uint32_t ttl)
+{
+    size_t pos = query->end;
+    int i, n = 0;
+
+    if(size < query->end || query->end > DNS_MAX_UDP)
+        return -1;
+    memcpy(buf, msg, query->end);                   // header & question exactly as asked
+    put16(buf + 2, DNS_FLAG_QR | DNS_FLAG_RA | (query->flags & (DNS_OPCODE_MASK | DNS_FLAG_RD)) | (rcode & 0x000F));
+    put16(buf + 8, 0);                              // no authority
+    put16(buf + 10, 0);                             // or additional records
+    for(i = 0; i < naddrs; i++)
+    {
+        size_t rdlen = addrs[i].family == AF_INET ? 4 : 16;
+        if(pos + 12 + rdlen > size || pos + 12 + rdlen > DNS_MAX_UDP)
+            break;                                  // keep what fits in a classic UDP answer
+        put16(buf + pos, 0xC000 | DNS_HEADER_SIZE); // pointer to the question's name
+        put16(buf + pos + 2, addrs[i].family == AF_INET ? DNS_TYPE_A : DNS_TYPE_AAAA);
+        put16(buf + pos + 4, DNS_CLASS_IN);
+        put32(buf + pos + 6, ttl);
+        put16(buf + pos + 10, (uint16_t) rdlen);
+        memcpy(buf + pos + 12, &addrs[i].addr, rdlen);
+        pos += 12 + rdlen;
+        n++;
+    }
+    put16(buf + 6, (uint16_t) n);
+    return (int) pos;
+}
+
+/* Compares two dotted names ignoring case and a trailing dot, returns 1 if equal */
+int dnswire_name_equal(const char* a, const char* b)
+{
+    size_t la = strlen(a), lb = strlen(b);
+    if(la > 0 && a[la-1] == '.')
+        la--;
+    if(lb > 0 && b[lb-1] == '.')
+        lb--;
+    return la == lb && strncasecmp(a, b, la) == 0;
+}
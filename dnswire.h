@@ -0,0 +1,83 @@
+// Connor Humiston
+// DNS Wire Format Header
+#ifndef DNSWIRE_H
+#define DNSWIRE_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <stdint.h>                                 // fixed width integer types
+#include <netinet/in.h>                             // struct in6_addr
+
+#define DNS_HEADER_SIZE         12                  // fixed message header
+#define DNS_MAX_NAME            255                 // longest encoded name (RFC 1035)
+#define DNS_MAX_QUERY           (DNS_HEADER_SIZE + DNS_MAX_NAME + 4) // header + qname + qtype/qclass
+#define DNS_MAX_UDP             512                 // classic UDP payload limit
+#define DNS_MAX_ADDRS           8                   // addresses kept from one response
+
+#define DNS_TYPE_A              1
+#define DNS_TYPE_CNAME          5
+#define DNS_TYPE_AAAA           28
+#define DNS_CLASS_IN            1
+
+#define DNS_RCODE_NOERROR       0
+#define DNS_RCODE_FORMERR       1
+#define DNS_RCODE_SERVFAIL      2
+#define DNS_RCODE_NXDOMAIN      3
+#define DNS_RCODE_NOTIMP        4
+
+#define DNS_FLAG_QR             0x8000              // message is a response
+#define DNS_FLAG_TC             0x0200              // response was truncated
+#define DNS_FLAG_RD             0x0100              // recursion desired
+#define DNS_FLAG_RA             0x0080              // recursion available
+#define DNS_OPCODE_MASK         0x7800              // 0 is a standard query
+
+
+/* Address Found in a Response */
+typedef struct DnsAddr
+{
+    int family;                                     // AF_INET or AF_INET6
+    struct in6_addr addr;                           // 4 or 16 significant bytes
+} DnsAddr;
+
+/* Decoded Response: header fields, the question & the A/AAAA answers */
+typedef struct DnsReply
+{
+    uint16_t id;                                    // transaction ID
+    uint16_t flags;                                 // QR/OPCODE/AA/TC/RD/RA bits
+    int rcode;                                      // response code
+    char qname[DNS_MAX_NAME + 1];                   // question name, dotted, lowercase
+    uint16_t qtype;                                 // question type
+    int naddrs;                                     // addresses found in the answer section
+    DnsAddr addrs[DNS_MAX_ADDRS];                   // answers matching the question type
+} DnsReply;
+
+
+/* Decoded Query: the single question & where it ends */
+typedef struct DnsQuery
+{
+    uint16_t id;                                    // transaction ID
+    uint16_t flags;                                 // OPCODE/RD bits are echoed back
+    char qname[DNS_MAX_NAME + 1];                   // question name, dotted, lowercase
+    int oddname;                                    // a label held '.' or a null byte: qname isn't the name asked
+    uint16_t qtype;                                 // question type
+    uint16_t qclass;                                // question class
+    size_t end;                                     // bytes of header + question (echoed in the answer)
+} DnsQuery;
+
+
+/* Encodes a recursive query for name, returns its length or -1 if the name is malformed/too long */
+int dnswire_build_query(uint8_t* buf, size_t size, uint16_t id, const char* name, uint16_t qtype);
+
+/* Decodes a response, returns 0 on success or -1 if the message is malformed (a truncated one keeps its whole answers) */
+int dnswire_parse_reply(const uint8_t* msg, size_t len, DnsReply* reply);
+
+/* Decodes a query with exactly one question, returns 0 or -1 if it is malformed or a response */
+int dnswire_parse_query(const uint8_t* msg, size_t len, DnsQuery* query);
+
+/* Encodes the answer to query (whose raw bytes are msg) with naddrs records of ttl seconds, returns its length or -1 */
+int dnswire_build_answer(uint8_t* buf, size_t size, const uint8_t* msg, const DnsQuery* query,
+                         int rcode, const DnsAddr* addrs, int naddrs, uint32_t ttl);
+
+/* Compares two dotted names ignoring case and a trailing dot, returns 1 if equal */
+int dnswire_name_equal(const char* a, const char* b);
+
+#endif
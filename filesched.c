@@ -0,0 +1,331 @@
+// Connor Humiston
+// Work-Stealing File Scheduler Implementation
+#include "filesched.h"
+
+#include <string.h>                                 // memmove()
+#include <sys/stat.h>                               // stat()
+
+
+/* Appends a unit at the owner's end, returns -1 if the deque can't grow */
+static int deque_push(WorkDeque* d, const WorkUnit* unit)
+{
+    pthread_mutex_lock(&d->lock);
+    if(d->tail == d->cap)
+    {
+        if(d->head > 0)                             // thieves emptied the front: slide down instead of growing
+        {
+            memmove(d->units, d->units + d->head, sizeof(WorkUnit) * (d->tail - d->head));
+            d->tail -= d->head;
+            d->head = 0;
+        }
+        else
+        {
+            WorkUnit* units = realloc(d->units, sizeof(WorkUnit) * d->cap * 2);
+            if(!units)
+            {
+                pthread_mutex_unlock(&d->lock);
+                return -1;
+            }
+            d->units = units;
+            d->cap *= 2;
+        }
+    }
+    d->units[d->tail++] = *unit;
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+}
+
+/* Takes the newest unit (owner) or the oldest one (thief), returns -1 if the deque is empty */
+static int deque_take(WorkDeque* d, WorkUnit* unit, int oldest)
+{
+    int rc = -1;
+    pthread_mutex_lock(&d->lock);
+    if(d->tail > d->head)
+    {
+        *unit = oldest ? d->units[d->head++] : d->units[--d->tail];
+        if(d->head == d->tail)
+            d->head = d->tail = 0;
+        rc = 0;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return rc;
+}
+
+/* Halves a unit until its front fits the split size, queueing the back halves where thieves can take them */
+static void sched_split(Sched* s, int self, WorkUnit* unit)
+{
+    int pushed = 0;
+    while(unit->end - unit->start > s->split)
+    {
+        WorkUnit back = *unit;
+        back.start = unit->start + (unit->end - unit->start) / 2;
+        __atomic_fetch_add(&s->files[unit->file].parts, 1, __ATOMIC_RELAXED); // counted before a thief can finish it
+        __atomic_fetch_add(&s->pending, 1, __ATOMIC_RELAXED);
+        if(deque_push(&s->deques[self], &back) != 0)
+        {
+            __atomic_fetch_sub(&s->files[unit->file].parts, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_sub(&s->pending, 1, __ATOMIC_RELAXED);
+            break;                                  // no room to split, read the rest ourselves
+        }
+        unit->end = back.start;
+        pushed++;
+    }
+    if(pushed > 0)
+    {
+        pthread_mutex_lock(&s->idlelock);
+        s->gen++;
+        pthread_cond_broadcast(&s->work);           // idle requesters have something to steal now
+        pthread_mutex_unlock(&s->idlelock);
+    }
+}
+
+/* Larger units first */
+static int unit_cmp(const void* a, const void* b)
+{
+    off_t x = ((const WorkUnit*) a)->end - ((const WorkUnit*) a)->start;
+    off_t y = ((const WorkUnit*) b)->end - ((const WorkUnit*) b)->start;
+    return (x < y) - (x > y);
+}
+
+/* Sizes the files & deals the units (whole files when units is NULL) out biggest first to the least loaded
+ * deque, returns -1 on failure or if a unit lies outside its file */
+static int sched_deal(Sched* s, char** names, const WorkUnit* units, int nunits, off_t* load)
+{
+    WorkUnit* order;                                // units, largest first
+    int i, j, rc = 0;
+    for(i = 0; i < s->nfiles; i++)
+    {
+        struct stat st;
+        if(stat(names[i], &st) != 0)
+            return -1;
+        s->files[i].name = names[i];
+        s->files[i].size = st.st_size;
+        s->files[i].parts = 0;
+    }
+    if(!units)
+        nunits = s->nfiles;                         // the whole file is one range until it is split
+    if(!(order = malloc(sizeof(WorkUnit) * (nunits > 0 ? nunits : 1))))
+        return -1;
+    for(i = 0; i < nunits; i++)
+    {
+        WorkUnit whole = {i, 0, s->files[i].size};
+        order[i] = units ? units[i] : whole;
+        if(order[i].file < 0 || order[i].file >= s->nfiles || order[i].start < 0 ||
+           order[i].start > order[i].end || order[i].end > s->files[order[i].file].size)
+            rc = -1;
+        else
+            s->files[order[i].file].parts++;
+    }
+    qsort(order, nunits, sizeof(WorkUnit), unit_cmp);
+    for(i = 0; i < nunits && rc == 0; i++)          // the biggest go first, each to the deque with the fewest bytes so far
+    {
+        int least = 0;
+        for(j = 1; j < s->nworkers; j++)
+        {
+            if(load[j] < load[least])
+                least = j;
+        }
+        load[least] += order[i].end - order[i].start;
+        rc = deque_push(&s->deques[least], &order[i]);
+    }
+    s->pending = nunits;                            // one per unit dealt
+    free(order);
+    return rc;
+}
+
+/* Sizes the files & deals them out biggest first to the least loaded of nworkers deques, or deals out the
+ * nunits ranges a checkpoint left instead when units isn't NULL; NULL on failure */
+Sched* sched_create(char** names, int n, int nworkers, off_t split, const WorkUnit* units, int nunits)
+{
+    Sched* s;
+    off_t* load;                                    // bytes dealt to each deque
+    int ok, i;
+
+    if(nworkers < 1)
+        nworkers = 1;
+    s = calloc(1, sizeof(*s) + sizeof(WorkDeque) * nworkers);
+    if(!s)
+        return NULL;
+    s->nfiles = n;
+    s->nworkers = nworkers;
+    s->split = split;
+    s->idlelock = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+    s->work = (pthread_cond_t) PTHREAD_COND_INITIALIZER;
+    s->barrier = (pthread_cond_t) PTHREAD_COND_INITIALIZER;
+    s->files = calloc(n > 0 ? n : 1, sizeof(SchedFile));
+    load = calloc(nworkers, sizeof(off_t));
+    ok = s->files && load;
+    for(i = 0; i < nworkers; i++)
+    {
+        WorkDeque* d = &s->deques[i];
+        d->lock = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+        d->cap = SCHED_MIN_DEQUE;
+        if(!(d->units = malloc(sizeof(WorkUnit) * SCHED_MIN_DEQUE)))
+            ok = 0;
+    }
+    if(ok && sched_deal(s, names, units, nunits, load) != 0)
+        ok = 0;
+    free(load);
+    if(!ok)
+    {
+        sched_destroy(s);
+        return NULL;
+    }
+    return s;
+}
+
+/* Frees the scheduler */
+void sched_destroy(Sched* s)
+{
+    int i;
+    for(i = 0; i < s->nworkers; i++)
+    {
+        free(s->deques[i].units);
+        pthread_mutex_destroy(&s->deques[i].lock);
+    }
+    pthread_mutex_destroy(&s->idlelock);
+    pthread_cond_destroy(&s->work);
+    pthread_cond_destroy(&s->barrier);
+    free(s->files);
+    free(s);
+}
+
+/* Hands the calling requester its own deque, returns its index */
+int sched_join(Sched* s)
+{
+    pthread_mutex_lock(&s->idlelock);
+    s->busy++;                                      // a checkpoint waits for it to park from now on
+    pthread_mutex_unlock(&s->idlelock);
+    return __atomic_fetch_add(&s->joined, 1, __ATOMIC_RELAXED) % s->nworkers;
+}
+
+/* Parks a busy requester until the checkpoint resumes, with idlelock held */
+static void sched_wait_resume(Sched* s)
+{
+    s->parked++;
+    pthread_cond_broadcast(&s->barrier);
+    while(s->pause)
+        pthread_cond_wait(&s->barrier, &s->idlelock);
+    s->parked--;
+}
+
+/* Records the unit requester self is about to read, for checkpoints */
+static void sched_hold(Sched* s, int self, const WorkUnit* unit)
+{
+    pthread_mutex_lock(&s->idlelock);
+    s->deques[self].held = *unit;
+    s->deques[self].holding = 1;
+    pthread_mutex_unlock(&s->idlelock);
+}
+
+/* Next unit for requester self (its own, else stolen, else waits for a split); -1 once every file is read */
+int sched_next(Sched* s, int self, WorkUnit* unit)
+{
+    int i, done;
+    while(1)
+    {
+        pthread_mutex_lock(&s->idlelock);
+        if(s->pause)                                // deques must hold still while a checkpoint copies them
+            sched_wait_resume(s);
+        unsigned gen = s->gen;                      // anything queued after this is noticed by the wait below
+        pthread_mutex_unlock(&s->idlelock);
+
+        // Own Work First (newest, so reads stay sequential), then the Oldest & Largest of Someone Else's
+        if(deque_take(&s->deques[self], unit, 0) == 0)
+        {
+            sched_split(s, self, unit);
+            sched_hold(s, self, unit);
+            return 0;
+        }
+        for(i = 1; i < s->nworkers; i++)
+        {
+            if(deque_take(&s->deques[(self + i) % s->nworkers], unit, 1) == 0)
+            {
+                s->deques[self].steals++;           // only the owner writes its own counter
+                sched_split(s, self, unit);         // keep halves here so others can steal from us in turn
+                sched_hold(s, self, unit);
+                return 0;
+            }
+        }
+
+        // Nothing Queued: wait for a split to queue more, or for the last unit being read to finish
+        pthread_mutex_lock(&s->idlelock);
+        s->busy--;                                  // idle requesters hold nothing a checkpoint needs
+        pthread_cond_broadcast(&s->barrier);
+        while(__atomic_load_n(&s->pending, __ATOMIC_ACQUIRE) > 0 && s->gen == gen)
+            pthread_cond_wait(&s->work, &s->idlelock);
+        done = __atomic_load_n(&s->pending, __ATOMIC_ACQUIRE) == 0;
+        if(!done)
+            s->busy++;
+        pthread_mutex_unlock(&s->idlelock);
+        if(done)
+            return -1;
+    }
+}
+
+/* Marks a unit read, returns 1 if it was the last unfinished range of its file */
+int sched_done(Sched* s, int self, const WorkUnit* unit)
+{
+    pthread_mutex_lock(&s->idlelock);
+    s->deques[self].holding = 0;
+    pthread_mutex_unlock(&s->idlelock);
+    int last = __atomic_sub_fetch(&s->files[unit->file].parts, 1, __ATOMIC_ACQ_REL) == 0;
+    if(__atomic_sub_fetch(&s->pending, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        pthread_mutex_lock(&s->idlelock);
+        pthread_cond_broadcast(&s->work);           // every file is read: release the idle requesters
+        pthread_mutex_unlock(&s->idlelock);
+    }
+    return last;
+}
+
+/* Parks requester self with its unit read up to (not including) the line at pos, until sched_resume() */
+void sched_park(Sched* s, int self, off_t pos)
+{
+    pthread_mutex_lock(&s->idlelock);
+    s->deques[self].held.start = pos;
+    sched_wait_resume(s);
+    pthread_mutex_unlock(&s->idlelock);
+}
+
+/* Asks requesters to park & waits until every busy one has (idle ones can't take work until sched_resume()) */
+void sched_pause(Sched* s)
+{
+    pthread_mutex_lock(&s->idlelock);
+    __atomic_store_n(&s->pause, 1, __ATOMIC_RELAXED);
+    while(s->parked < s->busy)
+        pthread_cond_wait(&s->barrier, &s->idlelock);
+    pthread_mutex_unlock(&s->idlelock);
+}
+
+/* Releases parked requesters */
+void sched_resume(Sched* s)
+{
+    pthread_mutex_lock(&s->idlelock);
+    __atomic_store_n(&s->pause, 0, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&s->barrier);
+    pthread_mutex_unlock(&s->idlelock);
+}
+
+/* Copies the ranges not read yet (queued & the unread rest of held ones) into a new array, sets *units;
+ * only while paused or before requesters start. Returns the count or -1 on failure */
+int sched_snapshot(Sched* s, WorkUnit** units)
+{
+    int i, j, n = 0;
+    for(i = 0; i < s->nworkers; i++)
+        n += s->deques[i].tail - s->deques[i].head + s->deques[i].holding;
+    if(!(*units = malloc(sizeof(WorkUnit) * (n > 0 ? n : 1))))
+        return -1;
+    n = 0;
+    for(i = 0; i < s->nworkers; i++)
+    {
+        WorkDeque* d = &s->deques[i];
+        pthread_mutex_lock(&d->lock);
+        for(j = d->head; j < d->tail; j++)
+            (*units)[n++] = d->units[j];
+        pthread_mutex_unlock(&d->lock);
+        if(d->holding && d->held.start < d->held.end)
+            (*units)[n++] = d->held;
+    }
+    return n;
+}
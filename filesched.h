@@ -0,0 +1,99 @@
+// Connor Humiston
+// Work-Stealing File Scheduler Header
+#ifndef FILESCHED_H
+#define FILESCHED_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <pthread.h>                                // deque & idle locks
+#include <sys/types.h>                              // off_t
+
+#include "queue.h"                                  // CACHE_LINE
+
+#define SCHED_MIN_DEQUE         8                   // starting capacity of a requester's deque
+
+
+/* Byte Range of One Input File: starts & ends anywhere, lines are owned by the range they start in */
+typedef struct WorkUnit
+{
+    int file;                                       // index into Sched.files
+    off_t start;                                    // first byte a line may start at
+    off_t end;                                      // lines starting here or later belong to the next range
+} WorkUnit;
+
+/* Input File Being Read */
+typedef struct SchedFile
+{
+    const char* name;                               // file name
+    off_t size;                                     // bytes when the scheduler was built
+    int parts;                                      // ranges of it not finished yet (atomic)
+} SchedFile;
+
+/* One Requester's Deque: the owner works at the tail, thieves take from the head */
+typedef struct WorkDeque
+{
+    pthread_mutex_t lock;                           // units move rarely (once per split), so a lock is cheap
+    WorkUnit* units;                                // units[head..tail) are queued
+    int head;
+    int tail;
+    int cap;
+    int steals;                                     // units this requester took from others
+    WorkUnit held;                                  // unit being read, start moved up to where it parked
+    int holding;                                    // held is valid
+} __attribute__((aligned(CACHE_LINE))) WorkDeque;
+
+/* Scheduler: every requester owns a deque of units & steals when its own runs dry */
+typedef struct Sched
+{
+    int nfiles;
+    SchedFile* files;
+    int nworkers;                                   // deques (one per requester)
+    int joined;                                     // deques handed out by sched_join() (atomic)
+    off_t split;                                    // units above this size are halved before reading
+    pthread_mutex_t idlelock;                       // guards gen, busy & parked, idle requesters sleep on it
+    pthread_cond_t work;                            // broadcast when a unit is queued or the last one finishes
+    int pending;                                    // units queued or being read (atomic)
+    unsigned gen;                                   // bumped on every change idle requesters wait for
+    int pause;                                      // a checkpoint wants every requester parked (atomic)
+    int busy;                                       // requesters not idle, under idlelock
+    int parked;                                     // busy requesters parked for a checkpoint, under idlelock
+    pthread_cond_t barrier;                         // broadcast when parked, busy or pause change
+    WorkDeque deques[];
+} Sched;
+
+
+/* Sizes the files & deals them out biggest first to the least loaded of nworkers deques, or deals out the
+ * nunits ranges a checkpoint left instead when units isn't NULL; NULL on failure */
+Sched* sched_create(char** names, int n, int nworkers, off_t split, const WorkUnit* units, int nunits);
+
+/* Frees the scheduler */
+void sched_destroy(Sched* s);
+
+/* Hands the calling requester its own deque, returns its index */
+int sched_join(Sched* s);
+
+/* Next unit for requester self (its own, else stolen, else waits for a split); -1 once every file is read */
+int sched_next(Sched* s, int self, WorkUnit* unit);
+
+/* Marks a unit read, returns 1 if it was the last unfinished range of its file */
+int sched_done(Sched* s, int self, const WorkUnit* unit);
+
+/* Nonzero while a checkpoint waits for requesters to park (checked once per line) */
+static inline int sched_paused(const Sched* s)
+{
+    return __atomic_load_n(&s->pause, __ATOMIC_RELAXED);
+}
+
+/* Parks requester self with its unit read up to (not including) the line at pos, until sched_resume() */
+void sched_park(Sched* s, int self, off_t pos);
+
+/* Asks requesters to park & waits until every busy one has (idle ones can't take work until sched_resume()) */
+void sched_pause(Sched* s);
+
+/* Releases parked requesters */
+void sched_resume(Sched* s);
+
+/* Copies the ranges not read yet (queued & the unread rest of held ones) into a new array, sets *units;
+ * only while paused or before requesters start. Returns the count or -1 on failure */
+int sched_snapshot(Sched* s, WorkUnit** units);
+
+#endif
@@ -0,0 +1,164 @@
+// Connor Humiston
+// Hedged & Deadline-Bounded Lookups Implementation
+#include "hedge.h"
+
+#include <string.h>                                 // memcpy()
+
+
+/* qsort() order for latencies */
+static int compare_ns(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+/* Adds an answer's latency & recomputes the hedge delay every HEDGE_REFRESH samples */
+static void hedge_sample(Hedger* h, uint64_t ns)
+{
+    uint64_t sorted[HEDGE_WINDOW];
+
+    h->window[h->wpos] = ns;
+    h->wpos = (h->wpos + 1) % HEDGE_WINDOW;
+    if(h->nsamples < HEDGE_WINDOW)
+        h->nsamples++;
+    if(++h->fresh < HEDGE_REFRESH || h->nsamples < HEDGE_MIN_SAMPLES)
+        return;
+    h->fresh = 0;
+    memcpy(sorted, h->window, sizeof(uint64_t) * h->nsamples); // a 256 entry sort every 32 answers is noise next to a lookup
+    qsort(sorted, h->nsamples, sizeof(uint64_t), compare_ns);
+    h->delay_ns = sorted[(h->nsamples - 1) * h->percentile / 100];
+    if(h->delay_ns < HEDGE_FLOOR_NS)
+        h->delay_ns = HEDGE_FLOOR_NS;
+}
+
+/* Tracks up to cap lookups, hedging past percentile (0: never) & timing out after deadline_ms (0: never) */
+Hedger* hedge_create(int cap, int percentile, int deadline_ms)
+{
+    Hedger* h = calloc(1, sizeof(*h) + sizeof(HedgeLookup) * cap);
+    int i;
+
+    if(!h)
+        return NULL;
+    h->percentile = percentile;
+    h->deadline_ns = (uint64_t) deadline_ms * 1000000ull;
+    h->head = h->tail = -1;
+    for(i = 0; i < cap; i++)                        // the handles never move, so they're set once
+    {
+        h->lookups[i].attempts[0].lookup = h->lookups[i].attempts[1].lookup = &h->lookups[i];
+        h->lookups[i].attempts[1].hedge = 1;
+    }
+    return h;
+}
+
+/* Frees the tracker */
+void hedge_destroy(Hedger* h)
+{
+    free(h);
+}
+
+/* Starts tracking hostname in slot, returns the first attempt's backend handle */
+void* hedge_start(Hedger* h, int slot, char* hostname, uint64_t now)
+{
+    HedgeLookup* l = &h->lookups[slot];
+    l->hostname = hostname;
+    l->sent = now;
+    l->live = 1;
+    l->hedged = 0;
+    l->prev = h->tail;                              // submit times only grow, so appending keeps the list sorted
+    l->next = -1;
+    if(h->tail >= 0)
+        h->lookups[h->tail].next = slot;
+    else
+        h->head = slot;
+    h->tail = slot;
+    return &l->attempts[0];
+}
+
+/* Stops tracking a lookup (its attempts must be cancelled or answered) */
+void hedge_drop(Hedger* h, HedgeLookup* l)
+{
+    if(l->prev >= 0)
+        h->lookups[l->prev].next = l->next;
+    else
+        h->head = l->next;
+    if(l->next >= 0)
+        h->lookups[l->next].prev = l->prev;
+    else
+        h->tail = l->prev;
+    l->prev = l->next = -1;
+}
+
+/* First answer for a lookup: times it & stops tracking it, returns the lookup (other attempts may be live)
+ * or NULL if this attempt was no longer wanted */
+HedgeLookup* hedge_answer(Hedger* h, HedgeAttempt* a, uint64_t now)
+{
+    HedgeLookup* l = a->lookup;
+    if(!(l->live & (1 << a->hedge)))                // both attempts answered in the same batch: the first one won
+        return NULL;
+    l->live &= ~(1 << a->hedge);
+    if(h->percentile > 0)
+        hedge_sample(h, now - l->sent);
+    hedge_drop(h, l);
+    return l;
+}
+
+/* Records whether a hedge attempt was accepted by the backend */
+void hedge_sent(HedgeLookup* l, int accepted)
+{
+    l->hedged = 1;                                  // a refused hedge isn't retried, the first attempt may still answer
+    if(accepted)
+        l->live |= 2;
+}
+
+/* Oldest lookup needing action, NULL if none: *expired is 1 if it passed the deadline, else it needs a hedge */
+HedgeLookup* hedge_due(Hedger* h, uint64_t now, int* expired)
+{
+    int i;
+    for(i = h->head; i >= 0; i = h->lookups[i].next)
+    {
+        HedgeLookup* l = &h->lookups[i];
+        uint64_t age = now - l->sent;
+        if(h->deadline_ns && age >= h->deadline_ns)
+        {
+            *expired = 1;
+            return l;
+        }
+        if(!h->delay_ns || age < h->delay_ns)       // everything after it is younger still
+            return NULL;
+        if(!l->hedged)
+        {
+            *expired = 0;
+            return l;
+        }
+    }
+    return NULL;
+}
+
+/* Shortens wait_ms so the caller wakes for the next hedge or deadline */
+int hedge_wait(Hedger* h, uint64_t now, int wait_ms)
+{
+    uint64_t due = UINT64_MAX;
+    int i;
+
+    if(h->head < 0)
+        return wait_ms;
+    if(h->deadline_ns)
+        due = h->lookups[h->head].sent + h->deadline_ns;
+    for(i = h->head; h->delay_ns && i >= 0; i = h->lookups[i].next)
+    {
+        if(!h->lookups[i].hedged)                   // oldest name not hedged yet is the next one to hedge
+        {
+            if(h->lookups[i].sent + h->delay_ns < due)
+                due = h->lookups[i].sent + h->delay_ns;
+            break;
+        }
+    }
+    if(due == UINT64_MAX)
+        return wait_ms;
+    if(due <= now)
+        return 0;
+    if(wait_ms < 0 || (due - now) / 1000000 + 1 < (uint64_t) wait_ms)
+        return (int) ((due - now) / 1000000 + 1);
+    return wait_ms;
+}
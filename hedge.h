@@ -0,0 +1,77 @@
+// Connor Humiston
+// Hedged & Deadline-Bounded Lookups Header
+#ifndef HEDGE_H
+#define HEDGE_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <stdint.h>                                 // fixed width integer types
+
+#define HEDGE_WINDOW            256                 // recent lookup latencies the percentile is taken over
+#define HEDGE_REFRESH           32                  // new samples between recomputing the hedge delay
+#define HEDGE_MIN_SAMPLES       32                  // lookups timed before the first hedge is sent
+#define HEDGE_FLOOR_NS          1000000ull          // never hedge a lookup younger than 1 ms
+#define MAX_HEDGE_PERCENTILE    99
+#define MAX_DEADLINE            600000              // upper bound on --deadline (10 minutes)
+
+
+/* One Attempt at a Lookup: its address is the handle the backend hands back */
+typedef struct HedgeAttempt
+{
+    struct HedgeLookup* lookup;                     // name it is for
+    int hedge;                                      // 0 for the first attempt, 1 for the hedge
+} HedgeAttempt;
+
+/* Name a Resolver is Looking Up */
+typedef struct HedgeLookup
+{
+    char* hostname;                                 // resolver slot holding the name
+    uint64_t sent;                                  // first attempt's submit time
+    int prev;                                       // neighbours in submit order (-1 at the ends)
+    int next;
+    int live;                                       // bit per attempt still with the backend
+    int hedged;                                     // 1 once a hedge was tried (sent or refused)
+    HedgeAttempt attempts[2];
+} HedgeLookup;
+
+/* Per-Resolver Tracker: in-flight names oldest first & a window of recent latencies */
+typedef struct Hedger
+{
+    int percentile;                                 // hedge lookups slower than this percentile, 0 never
+    uint64_t deadline_ns;                           // lookups older than this time out, 0 never
+    uint64_t delay_ns;                              // current hedge delay, 0 until enough samples
+    uint64_t window[HEDGE_WINDOW];                  // latest answer latencies (ring)
+    int nsamples;                                   // samples in the window
+    int fresh;                                      // samples since delay_ns was computed
+    int wpos;                                       // next window slot written
+    int head;                                       // oldest lookup in flight, -1 when none
+    int tail;                                       // newest
+    HedgeLookup lookups[];                          // one per resolver name slot
+} Hedger;
+
+
+/* Tracks up to cap lookups, hedging past percentile (0: never) & timing out after deadline_ms (0: never) */
+Hedger* hedge_create(int cap, int percentile, int deadline_ms);
+
+/* Frees the tracker */
+void hedge_destroy(Hedger* h);
+
+/* Starts tracking hostname in slot, returns the first attempt's backend handle */
+void* hedge_start(Hedger* h, int slot, char* hostname, uint64_t now);
+
+/* Stops tracking a lookup (its attempts must be cancelled or answered) */
+void hedge_drop(Hedger* h, HedgeLookup* l);
+
+/* First answer for a lookup: times it & stops tracking it, returns the lookup (other attempts may be live)
+ * or NULL if this attempt was no longer wanted */
+HedgeLookup* hedge_answer(Hedger* h, HedgeAttempt* a, uint64_t now);
+
+/* Records whether a hedge attempt was accepted by the backend */
+void hedge_sent(HedgeLookup* l, int accepted);
+
+/* Oldest lookup needing action, NULL if none: *expired is 1 if it passed the deadline, else it needs a hedge */
+HedgeLookup* hedge_due(Hedger* h, uint64_t now, int* expired);
+
+/* Shortens wait_ms so the caller wakes for the next hedge or deadline */
+int hedge_wait(Hedger* h, uint64_t now, int wait_ms);
+
+#endif
@@ -0,0 +1,332 @@
+// Connor Humiston
+// Hostname Normalization Implementation
+#include "hostname.h"
+
+#include <string.h>                                 // memcpy(), memmove()
+
+#if defined(__x86_64__)
+#include <immintrin.h>                              // SSE2 & AVX2 intrinsics
+#define HOSTNAME_X86            1
+#endif
+
+#define HASH_SEED0              0x243F6A8885A308D3ull // lane seeds (pi digits)
+#define HASH_SEED1              0x13198A2E03707344ull
+#define HASH_MUL                0x9E3779B97F4A7C15ull
+
+
+/* Pass State Carried from Block to Block, kept in registers by each implementation */
+typedef struct Fold
+{
+    uint64_t h[2];                                  // even & odd 8 byte words hash in separate lanes, so multiplies overlap
+    size_t label;                                   // offset the current label starts at
+    int bad;                                        // nonzero once a character or a label failed
+} Fold;
+
+/* Folds len bytes of in into out, sets *bad from the checks & returns the finished hash */
+typedef uint64_t (*FoldFn)(const char* in, size_t len, char* out, int* bad);
+
+static int chosen = -1;                             // implementation in use, picked on first call
+
+
+/* Mixes an 8 byte word of the folded name (little endian, zero padded) into its lane: even words go to lane 0,
+ * odd ones to lane 1 (a constant at every call, so both lanes stay in registers) */
+static inline void hash_word(Fold* f, int lane, uint64_t w)
+{
+    uint64_t h = (f->h[lane] ^ w) * HASH_MUL;
+    f->h[lane] = (h << 31) | (h >> 33);
+}
+
+/* Checks the labels ended by the dots in mask (bit i is byte base + i, at most 32 bytes per mask): only the first
+ * label of a block can be too long, so one test covers it, one more catches two dots in a row & no loop is needed */
+static inline void check_dots(Fold* f, size_t base, uint64_t dots)
+{
+    if(dots)
+    {
+        size_t first = base + (size_t) __builtin_ctzll(dots);
+        f->bad |= (first - f->label - 1 >= HOSTNAME_MAX_LABEL) | ((dots & (dots >> 1)) != 0); // empty labels wrap around
+        f->label = base + 64 - (size_t) __builtin_clzll(dots);
+    }
+}
+
+/* Starting state */
+static inline Fold fold_start(void)
+{
+    Fold f = {{HASH_SEED0, HASH_SEED1}, 0, 0};
+    return f;
+}
+
+/* Checks the last label, which ends at the end of the name, & finishes the hash */
+static inline uint64_t fold_finish(const Fold* f, size_t len, int* bad)
+{
+    uint64_t h = f->h[0] ^ ((f->h[1] << 17) | (f->h[1] >> 47)) ^ len;
+    *bad = f->bad | (len - f->label - 1 >= HOSTNAME_MAX_LABEL);
+    h ^= h >> 33;                                   // murmur3 finalizer: shards use the top bits, buckets the bottom
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+/* Bitmap of the characters a folded name may hold: a-z 0-9 - _ . (a lookup instead of compares, which the
+ * compiler turns into a branch that mispredicts on every letter/digit switch) */
+static const uint64_t allowed[4] =
+{
+    (1ull << '-') | (1ull << '.') | (0x3FFull << '0'),
+    (1ull << ('_' - 64)) | (0x3FFFFFFull << ('a' - 64)),
+    0, 0
+};
+
+/* Any CPU: a byte at a time like the old loop but with no branches in it, then hashed 8 bytes at a time */
+static uint64_t fold_scalar(const char* in, size_t len, char* out, int* bad)
+{
+    Fold f = fold_start();                          // a local: the char stores below cannot alias it
+    uint64_t w;
+    size_t i;
+    for(i = 0; i < len; i++)
+    {
+        unsigned c = (unsigned char) in[i];
+        size_t dot;
+        c |= (unsigned) (c - 'A' < 26u) << 5;
+        dot = c == '.';
+        f.bad |= !((allowed[c >> 6] >> (c & 63)) & 1);
+        f.bad |= dot & (i - f.label - 1 >= HOSTNAME_MAX_LABEL); // empty labels wrap around
+        f.label = dot ? i + 1 : f.label;
+        out[i] = (char) c;
+    }
+    for(i = 0; i + 16 <= len; i += 16)
+    {
+        memcpy(&w, out + i, 8);
+        hash_word(&f, 0, w);
+        memcpy(&w, out + i + 8, 8);
+        hash_word(&f, 1, w);
+    }
+    if(i + 8 <= len)
+    {
+        memcpy(&w, out + i, 8);
+        hash_word(&f, 0, w);
+        i += 8;
+    }
+    if(i < len)                                     // zero padded last word, in the lane its index gives it
+    {
+        w = 0;
+        for(size_t j = len; j-- > i; )
+            w = (w << 8) | (unsigned char) out[j];
+        hash_word(&f, (i / 8) & 1, w);
+    }
+    return fold_finish(&f, len, bad);
+}
+
+#ifdef HOSTNAME_X86
+/* Folds the 16 bytes in c, of which the first n (< 16 only for the last block) are the name's, & returns them */
+static inline __m128i block_sse2(__m128i c, size_t base, size_t n, Fold* f)
+{
+    const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('Z' + 1)));
+    const __m128i l = _mm_or_si128(c, _mm_and_si128(upper, _mm_set1_epi8(0x20))); // bytes >= 0x80 are negative: never upper
+    const __m128i dot = _mm_cmpeq_epi8(l, _mm_set1_epi8('.'));
+    __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(l, _mm_set1_epi8('z' + 1)));
+    uint32_t lanes = n >= 16 ? 0xFFFFu : (1u << n) - 1;
+
+    ok = _mm_or_si128(ok, _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(l, _mm_set1_epi8('9' + 1))));
+    ok = _mm_or_si128(ok, _mm_or_si128(_mm_cmpeq_epi8(l, _mm_set1_epi8('-')), _mm_cmpeq_epi8(l, _mm_set1_epi8('_'))));
+    ok = _mm_or_si128(ok, dot);
+    f->bad |= (~(uint32_t) _mm_movemask_epi8(ok) & lanes) != 0;
+    check_dots(f, base, (uint32_t) _mm_movemask_epi8(dot) & lanes);
+    hash_word(f, 0, (uint64_t) _mm_cvtsi128_si64(l)); // blocks start 16 byte aligned: words 2k & 2k + 1
+    if(n > 8)
+        hash_word(f, 1, (uint64_t) _mm_cvtsi128_si64(_mm_unpackhi_epi64(l, l)));
+    return l;
+}
+
+/* Loads the last n < 16 bytes of a name zero padded: straight from in when the 16 bytes stay inside its page (so
+ * the read cannot fault, as libc's string functions do), through a padded copy otherwise */
+static inline __m128i load_tail(const char* in, size_t n)
+{
+    static const char keep[32] = {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
+    if(((uintptr_t) in & 4095) <= 4096 - 16)
+        return _mm_and_si128(_mm_loadu_si128((const __m128i*) in), _mm_loadu_si128((const __m128i*) (keep + 16 - n)));
+    char pad[16] = {0};
+    memcpy(pad, in, n);
+    return _mm_loadu_si128((const __m128i*) pad);
+}
+
+/* Stores the low n < 8 bytes of w (little endian) */
+static inline void store_word(char* out, uint64_t w, size_t n)
+{
+    if(n & 4)
+    {
+        uint32_t x = (uint32_t) w;
+        memcpy(out, &x, 4);
+        out += 4;
+        w >>= 32;
+    }
+    if(n & 2)
+    {
+        uint16_t x = (uint16_t) w;
+        memcpy(out, &x, 2);
+        out += 2;
+        w >>= 16;
+    }
+    if(n & 1)
+        *out = (char) w;
+}
+
+/* Stores the first n < 16 bytes of v from general registers (a vector spilled & reloaded at an odd offset would
+ * stall store forwarding), so nothing past the name is written */
+static inline void store_tail(char* out, __m128i v, size_t n)
+{
+    uint64_t lo = (uint64_t) _mm_cvtsi128_si64(v);
+    if(n >= 8)
+    {
+        memcpy(out, &lo, 8);
+        store_word(out + 8, (uint64_t) _mm_cvtsi128_si64(_mm_unpackhi_epi64(v, v)), n - 8);
+    }
+    else
+        store_word(out, lo, n);
+}
+
+/* 16 byte blocks from start on, the tail masked so nothing past len is used */
+static inline __attribute__((always_inline)) void blocks_sse2(const char* in, char* out, size_t start, size_t len, Fold* f)
+{
+    size_t i;
+    for(i = start; i + 16 <= len; i += 16)
+        _mm_storeu_si128((__m128i*) (out + i), block_sse2(_mm_loadu_si128((const __m128i*) (in + i)), i, 16, f));
+    if(i < len)
+        store_tail(out + i, block_sse2(load_tail(in + i, len - i), i, len - i, f), len - i);
+}
+
+/* SSE2: 16 bytes per step */
+static uint64_t fold_sse2(const char* in, size_t len, char* out, int* bad)
+{
+    Fold f = fold_start();
+    blocks_sse2(in, out, 0, len, &f);
+    return fold_finish(&f, len, bad);
+}
+
+/* AVX2: 32 bytes per step, whatever is left over goes through the SSE2 blocks */
+__attribute__((target("avx2")))
+static uint64_t fold_avx2(const char* in, size_t len, char* out, int* bad)
+{
+    Fold f = fold_start();
+    size_t i;
+    for(i = 0; i + 32 <= len; i += 32)
+    {
+        const __m256i c = _mm256_loadu_si256((const __m256i*) (in + i));
+        const __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('A' - 1)),
+                                               _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), c));
+        const __m256i l = _mm256_or_si256(c, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+        const __m256i dot = _mm256_cmpeq_epi8(l, _mm256_set1_epi8('.'));
+        __m256i ok = _mm256_and_si256(_mm256_cmpgt_epi8(l, _mm256_set1_epi8('a' - 1)),
+                                      _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), l));
+        ok = _mm256_or_si256(ok, _mm256_and_si256(_mm256_cmpgt_epi8(l, _mm256_set1_epi8('0' - 1)),
+                                                  _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), l)));
+        ok = _mm256_or_si256(ok, _mm256_or_si256(_mm256_cmpeq_epi8(l, _mm256_set1_epi8('-')),
+                                                 _mm256_cmpeq_epi8(l, _mm256_set1_epi8('_'))));
+        ok = _mm256_or_si256(ok, dot);
+        f.bad |= (uint32_t) _mm256_movemask_epi8(ok) != 0xFFFFFFFFu;
+        check_dots(&f, i, (uint32_t) _mm256_movemask_epi8(dot));
+        _mm256_storeu_si256((__m256i*) (out + i), l);
+        __m128i lo = _mm256_castsi256_si128(l);
+        __m128i hi = _mm256_extracti128_si256(l, 1);
+        hash_word(&f, 0, (uint64_t) _mm_cvtsi128_si64(lo));
+        hash_word(&f, 1, (uint64_t) _mm_cvtsi128_si64(_mm_unpackhi_epi64(lo, lo)));
+        hash_word(&f, 0, (uint64_t) _mm_cvtsi128_si64(hi));
+        hash_word(&f, 1, (uint64_t) _mm_cvtsi128_si64(_mm_unpackhi_epi64(hi, hi)));
+    }
+    blocks_sse2(in, out, i, len, &f);
+    return fold_finish(&f, len, bad);
+}
+
+static const FoldFn folds[HOSTNAME_IMPLS] = {fold_scalar, fold_sse2, fold_avx2};
+#else
+static const FoldFn folds[HOSTNAME_IMPLS] = {fold_scalar, NULL, NULL};
+#endif
+
+/* Returns 1 if this CPU & build can run an implementation */
+static int supported(int impl)
+{
+    if(impl < 0 || impl >= HOSTNAME_IMPLS || !folds[impl])
+        return 0;
+#ifdef HOSTNAME_X86
+    if(impl == HOSTNAME_AVX2)
+    {
+        __builtin_cpu_init();                       // may run before the constructors that normally do it
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return 1;
+}
+
+/* Returns 1 for the whitespace trimmed off either end (one compare & a bit test, no branches) */
+static inline int is_space(char c)
+{
+    unsigned u = (unsigned char) c;
+    return u <= ' ' && ((1ull << u) & ((1ull << ' ') | (1ull << '\t') | (1ull << '\r') | (1ull << '\n') | (1ull << '\v') | (1ull << '\f')));
+}
+
+/* Trims, lowercases & checks the name in one pass, returns HOSTNAME_OK, HOSTNAME_BLANK or HOSTNAME_INVALID */
+int hostname_normalize(const char* in, size_t* len, char* out, uint64_t* hash)
+{
+    size_t n = *len;
+    size_t trimmed;
+    int bad;
+
+    while(n > 0 && is_space(in[n-1]))
+        n--;
+    while(n > 0 && is_space(*in))
+    {
+        in++;
+        n--;
+    }
+    trimmed = n;
+    while(n > 0 && in[n-1] == '.')                  // "example.com." and "example.com" are the same name
+        n--;
+    if(n == 0)                                      // blank, or nothing but dots
+    {
+        memmove(out, in, trimmed);
+        *len = trimmed;
+        *hash = folds[hostname_impl()](out, 0, out, &bad);
+        return trimmed == 0 ? HOSTNAME_BLANK : HOSTNAME_INVALID;
+    }
+    *hash = folds[hostname_impl()](in, n, out, &bad); // in may be out + a few bytes: blocks are read before written
+    *len = n;
+    if(bad || n > HOSTNAME_MAX_LENGTH)
+        return HOSTNAME_INVALID;
+    return HOSTNAME_OK;
+}
+
+/* Lowercases len bytes into out (may be in) & returns the same hash, with no checks (cache keys) */
+uint64_t hostname_fold(const char* in, size_t len, char* out)
+{
+    int bad;
+    return folds[hostname_impl()](in, len, out, &bad);
+}
+
+/* Implementation in use: the widest the CPU supports unless hostname_use() chose another */
+int hostname_impl(void)
+{
+    int impl = __atomic_load_n(&chosen, __ATOMIC_RELAXED);
+    if(impl < 0)                                    // racing first callers all pick the same one
+    {
+        for(impl = HOSTNAME_IMPLS - 1; !supported(impl); impl--)
+            ;
+        __atomic_store_n(&chosen, impl, __ATOMIC_RELAXED);
+    }
+    return impl;
+}
+
+/* Forces an implementation (benchmarks), returns 0 or -1 if this CPU/build lacks it */
+int hostname_use(int impl)
+{
+    if(!supported(impl))
+        return -1;
+    __atomic_store_n(&chosen, impl, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* Name of an implementation for reports */
+const char* hostname_impl_name(int impl)
+{
+    static const char* const names[HOSTNAME_IMPLS] = {"scalar", "sse2", "avx2"};
+    return impl >= 0 && impl < HOSTNAME_IMPLS ? names[impl] : "unknown";
+}
@@ -0,0 +1,41 @@
+// Connor Humiston
+// Hostname Normalization Header
+#ifndef HOSTNAME_H
+#define HOSTNAME_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <stdint.h>                                 // fixed width integer types
+
+#define HOSTNAME_MAX_LENGTH     253                 // longest valid name (trailing dot not counted)
+#define HOSTNAME_MAX_LABEL      63                  // longest label between dots
+
+/* hostname_normalize() outcomes */
+#define HOSTNAME_OK             0
+#define HOSTNAME_BLANK          1                   // nothing but whitespace: the line is skipped
+#define HOSTNAME_INVALID        2                   // can never resolve: logged as INVALID without a lookup
+
+/* Implementations, widest first when picked automatically */
+#define HOSTNAME_SCALAR         0                   // 8 bytes per step, any CPU
+#define HOSTNAME_SSE2           1                   // 16 bytes per step, every x86-64
+#define HOSTNAME_AVX2           2                   // 32 bytes per step, when the CPU has it
+#define HOSTNAME_IMPLS          3
+
+
+/* Trims whitespace & trailing dots from the *len bytes at in, lowercases them into out (may be in) & checks
+ * the characters, label lengths & total length in the same pass; sets *len & *hash (of the normalized name),
+ * returns HOSTNAME_OK, HOSTNAME_BLANK or HOSTNAME_INVALID */
+int hostname_normalize(const char* in, size_t* len, char* out, uint64_t* hash);
+
+/* Lowercases len bytes into out (may be in) & returns the same hash, with no checks (cache keys) */
+uint64_t hostname_fold(const char* in, size_t len, char* out);
+
+/* Implementation in use: the widest the CPU supports unless hostname_use() chose another */
+int hostname_impl(void);
+
+/* Forces an implementation (benchmarks), returns 0 or -1 if this CPU/build lacks it */
+int hostname_use(int impl);
+
+/* Name of an implementation for reports */
+const char* hostname_impl_name(int impl);
+
+#endif
@@ -0,0 +1,139 @@
+// Connor Humiston
+// Memory-Mapped Input Implementation
+#include "ingest.h"
+
+#include <stdio.h>                                  // standard i/o
+#include <string.h>                                 // memchr()
+#include <fcntl.h>                                  // open()
+#include <unistd.h>                                 // close()
+#include <sys/mman.h>                               // mmap(), madvise()
+#include <sys/stat.h>                               // fstat()
+
+
+/* Maps one file read-only, returns 0 or -1 on failure */
+static int map_file(MappedFile* mf, const char* name)
+{
+    struct stat st;
+    int fd = open(name, O_RDONLY | O_CLOEXEC);
+    mf->name = name;
+    mf->base = NULL;
+    mf->size = 0;
+    if(fd < 0)
+        return -1;
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if(st.st_size > 0)                              // empty files can't be mapped & have no names anyway
+    {
+        void* p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p == MAP_FAILED)
+        {
+            close(fd);
+            return -1;
+        }
+        madvise(p, (size_t) st.st_size, MADV_SEQUENTIAL); // read-ahead hint, each chunk is scanned front to back
+        mf->base = p;
+        mf->size = (size_t) st.st_size;
+    }
+    close(fd);                                      // the mapping keeps the file alive
+    return 0;
+}
+
+/* Maps the files & splits them into chunks of about chunk_size bytes, NULL on failure */
+Ingest* ingest_create(char** names, int n, size_t chunk_size)
+{
+    Ingest* in = calloc(1, sizeof(*in));
+    int cap = 0;                                    // chunks allocated
+    int i;
+
+    if(!in || !(in->files = calloc(n > 0 ? n : 1, sizeof(MappedFile))))
+    {
+        free(in);
+        return NULL;
+    }
+    for(i = 0; i < n; i++)
+    {
+        MappedFile* mf = &in->files[i];
+        size_t start = 0;
+        if(map_file(mf, names[i]) != 0)
+        {
+            fprintf(stderr, "Unable to map input file \"%s\".\n", names[i]);
+            in->nfiles = i;
+            ingest_destroy(in);
+            return NULL;
+        }
+        in->nfiles = i + 1;
+        while(start < mf->size)                     // cut at the first newline past each nominal boundary
+        {
+            size_t end = mf->size;
+            if(mf->size - start > chunk_size)
+            {
+                const char* nl = memchr(mf->base + start + chunk_size, '\n', mf->size - start - chunk_size);
+                if(nl)
+                    end = (size_t) (nl - mf->base) + 1;
+            }
+            if(in->nchunks == cap)
+            {
+                Chunk* grown = realloc(in->chunks, sizeof(Chunk) * (cap ? cap * 2 : 64));
+                if(!grown)
+                {
+                    ingest_destroy(in);
+                    return NULL;
+                }
+                in->chunks = grown;
+                cap = cap ? cap * 2 : 64;
+            }
+            in->chunks[in->nchunks].file = i;
+            in->chunks[in->nchunks].start = start;
+            in->chunks[in->nchunks].end = end;
+            in->nchunks++;
+            start = end;
+        }
+    }
+    in->next = 0;
+    return in;
+}
+
+/* Unmaps every file (names handed out become invalid) & frees the ingest */
+void ingest_destroy(Ingest* in)
+{
+    int i;
+    for(i = 0; i < in->nfiles; i++)
+    {
+        if(in->files[i].base)
+            munmap((void*) in->files[i].base, in->files[i].size);
+    }
+    free(in->files);
+    free(in->chunks);
+    free(in);
+}
+
+/* Claims the next unprocessed chunk, NULL once all have been handed out */
+const Chunk* ingest_claim(Ingest* in)
+{
+    int c = __atomic_fetch_add(&in->next, 1, __ATOMIC_RELAXED);
+    return c < in->nchunks ? &in->chunks[c] : NULL;
+}
+
+/* Slices the line at *pos into name (no copy, not null terminated), advances *pos; returns -1 at chunk end */
+int ingest_next_name(const Ingest* in, const Chunk* chunk, size_t* pos, Name* name)
+{
+    const char* base = in->files[chunk->file].base;
+    size_t start = *pos;
+    size_t len;
+
+    if(start >= chunk->end)
+        return -1;
+    const char* nl = memchr(base + start, '\n', chunk->end - start);
+    len = nl ? (size_t) (nl - base) - start : chunk->end - start;
+    *pos = start + len + (nl ? 1 : 0);
+    if(len > 0 && base[start+len-1] == '\r')        // tolerate CRLF files
+        len--;
+    name->str = base + start;
+    name->len = (uint32_t) len;
+    name->flags = 0;                                // points into the mapping, nothing to free
+    name->hash = 0;                                 // the requester normalizes it
+    return 0;
+}
@@ -0,0 +1,54 @@
+// Connor Humiston
+// Memory-Mapped Input Header
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+
+#include "queue.h"                                  // Name slices
+
+#define DEFAULT_CHUNK_SIZE      (1024 * 1024)       // nominal bytes per work chunk
+#define MIN_CHUNK_SIZE          4096
+#define MAX_CHUNK_SIZE          (1024L * 1024 * 1024)
+
+
+/* Input File Mapped Read-Only */
+typedef struct MappedFile
+{
+    const char* name;                               // file name
+    const char* base;                               // start of the mapping (NULL for empty files)
+    size_t size;                                    // bytes mapped
+} MappedFile;
+
+/* Newline-Aligned Byte Range of One File */
+typedef struct Chunk
+{
+    int file;                                       // index into Ingest.files
+    size_t start;                                   // first byte (start of a line)
+    size_t end;                                     // one past the last byte (just after a newline or EOF)
+} Chunk;
+
+/* Every Input File Split into Chunks any Requester can Claim */
+typedef struct Ingest
+{
+    int nfiles;
+    MappedFile* files;
+    int nchunks;
+    Chunk* chunks;
+    int next;                                       // next unclaimed chunk (atomic)
+} Ingest;
+
+
+/* Maps the files & splits them into chunks of about chunk_size bytes, NULL on failure */
+Ingest* ingest_create(char** names, int n, size_t chunk_size);
+
+/* Unmaps every file (names handed out become invalid) & frees the ingest */
+void ingest_destroy(Ingest* in);
+
+/* Claims the next unprocessed chunk, NULL once all have been handed out */
+const Chunk* ingest_claim(Ingest* in);
+
+/* Slices the line at *pos into name (no copy, not null terminated), advances *pos; returns -1 at chunk end */
+int ingest_next_name(const Ingest* in, const Chunk* chunk, size_t* pos, Name* name);
+
+#endif
@@ -0,0 +1,266 @@
+// Connor Humiston
+// Buffered Log Writer Implementation
+#include "logwriter.h"
+#include "metrics.h"                                // write() timing
+#include "uring.h"                                  // asynchronous block writes
+
+#include <stdio.h>                                  // standard i/o
+#include <string.h>                                 // C string library
+#include <errno.h>                                  // EINTR
+#include <fcntl.h>                                  // open()
+#include <unistd.h>                                 // write(), close(), ftruncate()
+#include <sys/stat.h>                               // fstat()
+
+/* Blocks of One Thread's Buffer: one is filled while the others are written */
+struct LogRing
+{
+    Uring ring;
+    char* mem;                                      // LOG_URING_DEPTH blocks of the buffer size (registered)
+    int cur;                                        // block the LogBuf formats into
+    int inflight;                                   // writes submitted & not reaped
+    size_t len[LOG_URING_DEPTH];                    // bytes being written from each block, 0 when free
+    size_t records[LOG_URING_DEPTH];                // records in them, counted once written
+};
+
+
+/* Creates/truncates the log ("-" writes to stdout), NULL on failure */
+LogFile* logfile_open(const char* name)
+{
+    LogFile* log = malloc(sizeof(*log));
+    if(!log)
+        return NULL;
+    if(strcmp(name, "-") == 0)
+        log->fd = dup(STDOUT_FILENO);               // closed like any other log
+    else
+        log->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if(log->fd < 0)
+    {
+        free(log);
+        return NULL;
+    }
+    log->name = name;
+    log->header = 0;                                // plain text lines until a format frames them
+    log->seal = NULL;
+    log->flushed = 0;
+    log->uring = 0;
+    return log;
+}
+
+/* Reopens a log a checkpoint covered size bytes & records of, cutting off anything written after it;
+ * NULL on failure or if the log is shorter */
+LogFile* logfile_resume(const char* name, off_t size, uint64_t records)
+{
+    struct stat st;
+    LogFile* log = malloc(sizeof(*log));
+    if(!log)
+        return NULL;
+    log->fd = open(name, O_WRONLY | O_APPEND | O_CLOEXEC); // no O_CREAT: the log must be the one checkpointed
+    if(log->fd < 0 || fstat(log->fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < size ||
+       ftruncate(log->fd, size) != 0)               // blocks written after the checkpoint are redone
+    {
+        if(log->fd >= 0)
+            close(log->fd);
+        free(log);
+        return NULL;
+    }
+    log->name = name;
+    log->header = 0;
+    log->seal = NULL;
+    log->flushed = records;
+    log->uring = 0;
+    return log;
+}
+
+/* Writes the buffers opened on log from now on through io_uring, returns 0 or -1 if log isn't a regular file */
+int logfile_uring(LogFile* log)
+{
+    struct stat st;
+    if(fstat(log->fd, &st) != 0 || !S_ISREG(st.st_mode)) // a pipe or terminal keeps its blocks in order with write()
+        return -1;
+    log->uring = 1;
+    return 0;
+}
+
+/* Closes the log & frees it */
+void logfile_close(LogFile* log)
+{
+    close(log->fd);
+    free(log);
+}
+
+/* Sets up LOG_URING_DEPTH registered blocks of cap bytes & a ring to write them, NULL if io_uring can't be used */
+static struct LogRing* logring_create(size_t cap)
+{
+    struct LogRing* lr = calloc(1, sizeof(*lr));
+    struct iovec iov[LOG_URING_DEPTH];
+    int i;
+    if(!lr)
+        return NULL;
+    if(posix_memalign((void**) &lr->mem, 4096, cap * LOG_URING_DEPTH) != 0 || uring_init(&lr->ring, LOG_URING_DEPTH) != 0)
+    {
+        free(lr->mem);
+        free(lr);
+        return NULL;
+    }
+    for(i = 0; i < LOG_URING_DEPTH; i++)
+    {
+        iov[i].iov_base = lr->mem + cap * i;
+        iov[i].iov_len = cap;
+    }
+    uring_register(&lr->ring, iov, LOG_URING_DEPTH); // WRITE_FIXED when it works, plain WRITE when it doesn't
+    return lr;
+}
+
+/* Allocates a thread's buffer for log, returns 0 or -1 on failure */
+int logbuf_init(LogBuf* lb, LogFile* log, size_t cap)
+{
+    lb->log = log;
+    lb->len = log->header;                          // room for the block header, filled at flush time
+    lb->cap = cap;
+    lb->records = 0;
+    lb->ring = log->uring ? logring_create(cap) : NULL; // falls back to write() if this thread can't have a ring
+    lb->buf = lb->ring ? lb->ring->mem : malloc(cap);
+    return lb->buf ? 0 : -1;
+}
+
+/* Writes buf[off..len) with write() calls, returns the bytes written in all */
+static size_t log_write(LogFile* log, const char* buf, size_t off, size_t len)
+{
+    while(off < len)                                // one call unless interrupted or the disk is full
+    {
+        ssize_t n = write(log->fd, buf + off, len - off);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+        {
+            fprintf(stderr, "Error writing to the log file \"%s\".\n", log->name);
+            break;
+        }
+        off += (size_t) n;
+    }
+    return off;
+}
+
+/* Takes one finished block write (waiting for it when wait is set) & counts its records, returns 1 or 0 */
+static int logring_reap(LogBuf* lb, int wait)
+{
+    struct LogRing* lr = lb->ring;
+    uint64_t i;
+    int res;
+    size_t off;
+    if(lr->inflight == 0 || !uring_reap(&lr->ring, &i, &res, wait))
+        return 0;
+    lr->inflight--;
+    if(res < 0)
+    {
+        fprintf(stderr, "Error writing to the log file \"%s\".\n", lb->log->name);
+        off = 0;
+    }
+    else                                            // short only when the disk is full: write() reports it
+        off = log_write(lb->log, lr->mem + lb->cap * i, (size_t) res, lr->len[i]);
+    metrics_count(METRIC_LOG_BYTES, off);
+    __atomic_fetch_add(&lb->log->flushed, lr->records[i], __ATOMIC_RELEASE); // a checkpoint waits on these counts
+    lr->len[i] = 0;
+    return 1;
+}
+
+/* Hands the current block to the kernel (waiting for every write when drain is set, in the same system call)
+ * & moves on to the next free one (io_uring buffers) */
+static void logring_submit(LogBuf* lb, int drain)
+{
+    struct LogRing* lr = lb->ring;
+    int i = lr->cur;
+    lr->len[i] = lb->len;
+    lr->records[i] = lb->records;
+    if(uring_prep(&lr->ring, 1, lb->log->fd, lb->buf, (unsigned) lb->len, -1, i, (uint64_t) i) == 0 &&
+       uring_submit(&lr->ring, drain ? (unsigned) lr->inflight + 1 : 0) == 0) // O_APPEND: at the end, like write()
+        lr->inflight++;
+    else                                            // ring refused it: write it here & now
+    {
+        metrics_count(METRIC_LOG_BYTES, log_write(lb->log, lb->buf, 0, lb->len));
+        __atomic_fetch_add(&lb->log->flushed, lb->records, __ATOMIC_RELEASE);
+        lr->len[i] = 0;
+    }
+    while(logring_reap(lb, 0))                      // finished writes, without a system call
+        ;
+    lr->cur = (i + 1) % LOG_URING_DEPTH;
+    while(lr->len[lr->cur] > 0 && logring_reap(lb, 1)) // every block busy: the disk is behind, wait for it
+        ;
+    lb->buf = lr->mem + lb->cap * lr->cur;
+}
+
+/* Seals & writes (or submits, waiting for it when drain is set) the buffered block, leaving the buffer empty */
+static void logbuf_write(LogBuf* lb, int drain)
+{
+    uint64_t t0 = metrics_start();
+    if(lb->log->seal)
+        lb->log->seal(lb->buf, lb->len);
+    if(lb->ring)
+        logring_submit(lb, drain);
+    else
+    {
+        metrics_count(METRIC_LOG_BYTES, log_write(lb->log, lb->buf, 0, lb->len));
+        __atomic_fetch_add(&lb->log->flushed, lb->records, __ATOMIC_RELEASE); // a checkpoint waits on these counts
+    }
+    metrics_stop(METRIC_LOG, t0);
+    lb->len = lb->log->header;
+    lb->records = 0;
+}
+
+/* Writes the buffered lines (sealed as one block when framed) with a single write(), or submits them & waits
+ * for every block still being written */
+void logbuf_flush(LogBuf* lb)
+{
+    if(lb->len > lb->log->header)
+        logbuf_write(lb, 1);                        // one system call, as with write()
+    while(lb->ring && logring_reap(lb, 1))          // flushed means on the file, for checkpoints & the index
+        ;
+}
+
+/* Flushes & frees the buffer */
+void logbuf_destroy(LogBuf* lb)
+{
+    logbuf_flush(lb);
+    if(lb->ring)
+    {
+        uring_exit(&lb->ring->ring);
+        free(lb->ring->mem);
+        free(lb->ring);
+        lb->ring = NULL;
+    }
+    else
+        free(lb->buf);
+    lb->buf = NULL;
+}
+
+/* Returns room for n bytes at the end of the buffer, flushing first if needed */
+char* logbuf_reserve(LogBuf* lb, size_t n)
+{
+    if(lb->len + n > lb->cap)                       // only whole lines are ever flushed, full blocks asynchronously
+        logbuf_write(lb, 0);
+    return lb->buf + lb->len;
+}
+
+/* Appends "name\n" (the requester log record) */
+void logbuf_name(LogBuf* lb, const char* name, size_t len)
+{
+    char* p = logbuf_reserve(lb, len + 1);
+    memcpy(p, name, len);
+    p[len] = '\n';
+    lb->len += len + 1;
+    lb->records++;
+}
+
+/* Appends "name, value\n" (the resolver log record) */
+void logbuf_pair(LogBuf* lb, const char* name, size_t len, const char* value)
+{
+    size_t vlen = strlen(value);
+    char* p = logbuf_reserve(lb, len + vlen + 3);
+    memcpy(p, name, len);
+    p[len] = ',';
+    p[len+1] = ' ';
+    memcpy(p + len + 2, value, vlen);
+    p[len+2+vlen] = '\n';
+    lb->len += len + vlen + 3;
+    lb->records++;
+}
@@ -0,0 +1,71 @@
+// Connor Humiston
+// Buffered Log Writer Header
+#ifndef LOGWRITER_H
+#define LOGWRITER_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <stdint.h>                                 // fixed width integer types
+#include <sys/types.h>                              // off_t
+
+#define DEFAULT_LOG_BUFFER      (64 * 1024)         // bytes buffered per thread per log
+#define MIN_LOG_BUFFER          1024                // must hold the longest line with room to spare
+#define MAX_LOG_BUFFER          (64 * 1024 * 1024)
+#define LOG_URING_DEPTH         4                   // blocks a thread fills while earlier ones are written (io_uring)
+
+
+/* Shared Log File: opened O_APPEND so every write() lands whole at the current end */
+typedef struct LogFile
+{
+    int fd;                                         // output file descriptor
+    const char* name;                               // file name for error messages
+    size_t header;                                  // bytes each flushed block starts with (0 for plain lines)
+    void (*seal)(char* block, size_t len);          // fills that header just before the block is written
+    uint64_t flushed;                               // records written so far, counting earlier runs' when resumed (atomic)
+    int uring;                                      // thread buffers opened from now on write through io_uring
+} LogFile;
+
+/* Per-Thread Log Buffer: records are formatted straight into buf & flushed as whole lines (or blocks) */
+typedef struct LogBuf
+{
+    LogFile* log;                                   // destination
+    char* buf;                                      // preallocated block
+    size_t len;                                     // bytes waiting to be flushed (block header included)
+    size_t cap;                                     // block size
+    size_t records;                                 // records waiting in buf
+    struct LogRing* ring;                           // blocks being written asynchronously (NULL: write())
+} LogBuf;
+
+
+/* Creates/truncates the log ("-" writes to stdout), NULL on failure */
+LogFile* logfile_open(const char* name);
+
+/* Reopens a log a checkpoint covered size bytes & records of, cutting off anything written after it;
+ * NULL on failure or if the log is shorter */
+LogFile* logfile_resume(const char* name, off_t size, uint64_t records);
+
+/* Writes the buffers opened on log from now on through io_uring, returns 0 or -1 if log isn't a regular file */
+int logfile_uring(LogFile* log);
+
+/* Closes the log & frees it */
+void logfile_close(LogFile* log);
+
+/* Allocates a thread's buffer for log, returns 0 or -1 on failure */
+int logbuf_init(LogBuf* lb, LogFile* log, size_t cap);
+
+/* Writes the buffered lines (sealed as one block when framed) with a single write(), or submits them & waits
+ * for every block still being written */
+void logbuf_flush(LogBuf* lb);
+
+/* Flushes & frees the buffer */
+void logbuf_destroy(LogBuf* lb);
+
+/* Returns room for n bytes at the end of the buffer, flushing first if needed */
+char* logbuf_reserve(LogBuf* lb, size_t n);
+
+/* Appends "name\n" (the requester log record) */
+void logbuf_name(LogBuf* lb, const char* name, size_t len);
+
+/* Appends "name, value\n" (the resolver log record) */
+void logbuf_pair(LogBuf* lb, const char* name, size_t len, const char* value);
+
+#endif
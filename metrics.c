@@ -0,0 +1,333 @@
+// Connor Humiston
+// Runtime Metrics Implementation
+#include "metrics.h"
+
+#include <stdio.h>                                  // reports
+#include <string.h>                                 // memset(), memcpy()
+#include <errno.h>                                  // ETIMEDOUT
+#include <pthread.h>                                // sampler thread & registry lock
+
+
+__thread Metrics* metrics_local = NULL;
+
+static const char* stage_names[METRIC_STAGES] = {"read", "push_wait", "pop_wait", "lookup", "log_write"};
+
+/* Process-Wide Registry: every thread's counters plus the sampler's own state */
+static struct
+{
+    int enabled;
+    pthread_mutex_t lock;                           // guards list & stop
+    pthread_cond_t wake;                            // ends the sampler's sleep early
+    Metrics* list;                                  // every attached thread
+    Metrics retired;                                // sum of the threads that detached (respawned resolvers)
+    const char* path;                               // report destination ("-" is stdout)
+    int format;                                     // METRICS_JSON or METRICS_PROMETHEUS
+    int interval;                                   // seconds between reports, 0 for only at exit
+    Buffer* buff;                                   // sampled queue
+    Histogram occupancy;                            // items queued at each sample (sampler only)
+    uint64_t start_ns;
+    uint64_t last_ns;                               // time & names_out of the previous report
+    uint64_t last_out;
+    int stop;
+    pthread_t sampler;
+} reg = {.lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER};
+
+
+/* Bucket holding value */
+static int hist_index(uint64_t value)
+{
+    int e;
+    if(value < HIST_SUB)
+        return (int) value;
+    e = 63 - __builtin_clzll(value);                // power of two below value
+    if(e > HIST_MAX_EXP)
+        return HIST_BUCKETS - 1;
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB + (int) ((value >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/* Middle of bucket i's range */
+static double hist_value(int i)
+{
+    int group = i / HIST_SUB, sub = i % HIST_SUB;
+    if(group == 0)
+        return i;
+    int shift = group - 1;
+    return (double) ((uint64_t) (HIST_SUB + sub) << shift) + ((1ull << shift) - 1) / 2.0;
+}
+
+/* Adds value to a histogram (single writer) */
+void histogram_add(Histogram* h, uint64_t value)
+{
+    int i = hist_index(value);
+    __atomic_store_n(&h->buckets[i], h->buckets[i] + 1, __ATOMIC_RELAXED); // the reporter reads concurrently
+    __atomic_store_n(&h->sum, h->sum + value, __ATOMIC_RELAXED);
+    if(value > h->max)
+        __atomic_store_n(&h->max, value, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELAXED);
+}
+
+/* Adds src into dst (reading src racily is fine, every field only grows) */
+void histogram_merge(Histogram* dst, const Histogram* src)
+{
+    int i;
+    for(i = 0; i < HIST_BUCKETS; i++)
+        dst->buckets[i] += __atomic_load_n(&src->buckets[i], __ATOMIC_RELAXED);
+    dst->sum += __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+    dst->count += __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+    if(max > dst->max)
+        dst->max = max;
+}
+
+/* Value below which fraction q of the recorded values fall */
+double histogram_quantile(const Histogram* h, double q)
+{
+    uint64_t total = 0, seen = 0, rank;
+    int i;
+    for(i = 0; i < HIST_BUCKETS; i++)               // bucket totals, count may run ahead of them
+        total += h->buckets[i];
+    if(total == 0)
+        return 0;
+    rank = (uint64_t) (q * (total - 1)) + 1;
+    for(i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += h->buckets[i];
+        if(seen >= rank)
+        {
+            double v = hist_value(i);
+            return v > h->max ? h->max : v;
+        }
+    }
+    return h->max;
+}
+
+/* Sums every thread's metrics */
+static void metrics_collect(Metrics* total)
+{
+    Metrics* m;
+    int i;
+    pthread_mutex_lock(&reg.lock);
+    memcpy(total, &reg.retired, sizeof(*total));    // threads gone since still count
+    for(m = reg.list; m; m = m->next)
+    {
+        for(i = 0; i < METRIC_COUNTERS; i++)
+            total->counters[i] += __atomic_load_n(&m->counters[i], __ATOMIC_RELAXED);
+        for(i = 0; i < METRIC_STAGES; i++)
+            histogram_merge(&total->stages[i], &m->stages[i]);
+    }
+    pthread_mutex_unlock(&reg.lock);
+}
+
+/* Writes one JSON object on a single line */
+static void report_json(FILE* out, const Metrics* t, double uptime, double rate, double recent)
+{
+    static const double qs[4] = {0.5, 0.9, 0.99, 0.999};
+    static const char* qn[4] = {"p50", "p90", "p99", "p999"};
+    int s, q;
+    fprintf(out, "{\"uptime_s\":%.3f,\"names_in\":%llu,\"names_out\":%llu,\"log_bytes\":%llu,"
+                 "\"throughput_per_s\":%.1f,\"recent_throughput_per_s\":%.1f,\"stages\":{",
+            uptime, (unsigned long long) t->counters[METRIC_NAMES_IN], (unsigned long long) t->counters[METRIC_NAMES_OUT],
+            (unsigned long long) t->counters[METRIC_LOG_BYTES], rate, recent);
+    for(s = 0; s < METRIC_STAGES; s++)              // stage times in microseconds
+    {
+        const Histogram* h = &t->stages[s];
+        fprintf(out, "%s\"%s\":{\"count\":%llu,\"mean_us\":%.3f", s ? "," : "", stage_names[s],
+                (unsigned long long) h->count, h->count ? h->sum / 1e3 / h->count : 0.0);
+        for(q = 0; q < 4; q++)
+            fprintf(out, ",\"%s_us\":%.3f", qn[q], histogram_quantile(h, qs[q]) / 1e3);
+        fprintf(out, ",\"max_us\":%.3f}", h->max / 1e3);
+    }
+    fprintf(out, "},\"queue\":{\"capacity\":%zu,\"samples\":%llu,\"mean\":%.2f", reg.buff->size,
+            (unsigned long long) reg.occupancy.count, reg.occupancy.count ? (double) reg.occupancy.sum / reg.occupancy.count : 0.0);
+    for(q = 0; q < 4; q++)
+        fprintf(out, ",\"%s\":%.0f", qn[q], histogram_quantile(&reg.occupancy, qs[q]));
+    fprintf(out, ",\"max\":%llu}}\n", (unsigned long long) reg.occupancy.max);
+}
+
+/* Writes the Prometheus text exposition format */
+static void report_prometheus(FILE* out, const Metrics* t, double uptime, double rate)
+{
+    static const double qs[4] = {0.5, 0.9, 0.99, 0.999};
+    int s, q;
+    fprintf(out, "# TYPE multilookup_uptime_seconds gauge\nmultilookup_uptime_seconds %.3f\n", uptime);
+    fprintf(out, "# TYPE multilookup_names_total counter\n");
+    fprintf(out, "multilookup_names_total{direction=\"in\"} %llu\n", (unsigned long long) t->counters[METRIC_NAMES_IN]);
+    fprintf(out, "multilookup_names_total{direction=\"out\"} %llu\n", (unsigned long long) t->counters[METRIC_NAMES_OUT]);
+    fprintf(out, "# TYPE multilookup_log_bytes_total counter\nmultilookup_log_bytes_total %llu\n",
+            (unsigned long long) t->counters[METRIC_LOG_BYTES]);
+    fprintf(out, "# TYPE multilookup_throughput_per_second gauge\nmultilookup_throughput_per_second %.1f\n", rate);
+    fprintf(out, "# TYPE multilookup_stage_seconds summary\n");
+    for(s = 0; s < METRIC_STAGES; s++)
+    {
+        const Histogram* h = &t->stages[s];
+        for(q = 0; q < 4; q++)
+            fprintf(out, "multilookup_stage_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n", stage_names[s], qs[q], histogram_quantile(h, qs[q]) / 1e9);
+        fprintf(out, "multilookup_stage_seconds_sum{stage=\"%s\"} %.9f\n", stage_names[s], h->sum / 1e9);
+        fprintf(out, "multilookup_stage_seconds_count{stage=\"%s\"} %llu\n", stage_names[s], (unsigned long long) h->count);
+    }
+    fprintf(out, "# TYPE multilookup_queue_occupancy summary\n");
+    for(q = 0; q < 4; q++)
+        fprintf(out, "multilookup_queue_occupancy{quantile=\"%g\"} %.0f\n", qs[q], histogram_quantile(&reg.occupancy, qs[q]));
+    fprintf(out, "multilookup_queue_occupancy_sum %llu\nmultilookup_queue_occupancy_count %llu\n",
+            (unsigned long long) reg.occupancy.sum, (unsigned long long) reg.occupancy.count);
+    fprintf(out, "# TYPE multilookup_queue_capacity gauge\nmultilookup_queue_capacity %zu\n", reg.buff->size);
+}
+
+/* Writes a report: appended JSON lines, or a whole Prometheus file replaced atomically */
+static void metrics_report(void)
+{
+    Metrics* t = malloc(sizeof(*t));                // too big for the stack
+    uint64_t now = metrics_now();
+    double uptime = (now - reg.start_ns) / 1e9;
+    double rate, recent;
+    char tmp[4096];
+    FILE* out;
+
+    if(!t)
+        return;
+    metrics_collect(t);
+    rate = uptime > 0 ? t->counters[METRIC_NAMES_OUT] / uptime : 0;
+    recent = now > reg.last_ns ? (t->counters[METRIC_NAMES_OUT] - reg.last_out) / ((now - reg.last_ns) / 1e9) : 0;
+    reg.last_ns = now;
+    reg.last_out = t->counters[METRIC_NAMES_OUT];
+
+    if(strcmp(reg.path, "-") == 0)
+        out = stdout;
+    else if(reg.format == METRICS_JSON)
+        out = fopen(reg.path, "a");                 // one object per line, a time series across reports
+    else
+    {
+        snprintf(tmp, sizeof(tmp), "%s.tmp", reg.path); // scrapers never see a half-written file
+        out = fopen(tmp, "w");
+    }
+    if(!out)
+    {
+        fprintf(stderr, "Unable to write metrics to \"%s\".\n", reg.path);
+        free(t);
+        return;
+    }
+    if(reg.format == METRICS_JSON)
+        report_json(out, t, uptime, rate, recent);
+    else
+        report_prometheus(out, t, uptime, rate);
+    if(out == stdout)
+        fflush(out);
+    else
+    {
+        fclose(out);
+        if(reg.format == METRICS_PROMETHEUS)
+            rename(tmp, reg.path);
+    }
+    free(t);
+}
+
+/* Samples the queue every METRICS_SAMPLE_MS & reports every interval seconds */
+static void* metrics_sampler(void* arg)
+{
+    struct timespec deadline;
+    uint64_t next = reg.interval ? reg.start_ns + reg.interval * 1000000000ull : 0;
+    (void) arg;
+
+    pthread_mutex_lock(&reg.lock);
+    while(!reg.stop)
+    {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += METRICS_SAMPLE_MS * 1000000L;
+        if(deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        if(pthread_cond_timedwait(&reg.wake, &reg.lock, &deadline) != ETIMEDOUT || reg.stop)
+            continue;
+        histogram_add(&reg.occupancy, buffer_count(reg.buff));
+        if(next && metrics_now() >= next)
+        {
+            pthread_mutex_unlock(&reg.lock);        // collecting takes the lock itself
+            metrics_report();
+            pthread_mutex_lock(&reg.lock);
+            next += reg.interval * 1000000000ull;
+        }
+    }
+    pthread_mutex_unlock(&reg.lock);
+    return NULL;
+}
+
+/* Starts sampling buff & reporting to path ("-" is stdout) every interval seconds (0: only at exit), returns 0 or -1 */
+int metrics_init(const char* path, int format, int interval, Buffer* buff)
+{
+    reg.path = path;
+    reg.format = format;
+    reg.interval = interval;
+    reg.buff = buff;
+    reg.start_ns = reg.last_ns = metrics_now();
+    reg.stop = 0;
+    memset(&reg.retired, 0, sizeof(reg.retired));
+    if(strcmp(path, "-") != 0)
+    {
+        FILE* fp = fopen(path, "w");                // start each run with an empty file
+        if(!fp)
+            return -1;
+        fclose(fp);
+    }
+    if(pthread_create(&reg.sampler, NULL, metrics_sampler, NULL) != 0)
+        return -1;
+    reg.enabled = 1;
+    return 0;
+}
+
+/* Gives the calling thread its own counters (no-op unless metrics_init() succeeded) */
+void metrics_attach(void)
+{
+    Metrics* m;
+    if(!reg.enabled || metrics_local)
+        return;
+    if(!(m = calloc(1, sizeof(*m))))
+        return;                                     // this thread just goes unmeasured
+    pthread_mutex_lock(&reg.lock);
+    m->next = reg.list;
+    reg.list = m;
+    pthread_mutex_unlock(&reg.lock);
+    metrics_local = m;
+}
+
+/* Folds the calling thread's counters into the retired-threads total & frees them (it records nothing after) */
+void metrics_detach(void)
+{
+    Metrics** link;
+    int i;
+    if(!metrics_local)
+        return;
+    pthread_mutex_lock(&reg.lock);
+    for(link = &reg.list; *link != metrics_local; link = &(*link)->next)
+        ;
+    *link = metrics_local->next;
+    for(i = 0; i < METRIC_COUNTERS; i++)
+        reg.retired.counters[i] += metrics_local->counters[i];
+    for(i = 0; i < METRIC_STAGES; i++)
+        histogram_merge(&reg.retired.stages[i], &metrics_local->stages[i]);
+    pthread_mutex_unlock(&reg.lock);
+    free(metrics_local);
+    metrics_local = NULL;
+}
+
+/* Stops the sampler, writes the final report & frees everything (all recording threads must be done) */
+void metrics_finish(void)
+{
+    if(!reg.enabled)
+        return;
+    pthread_mutex_lock(&reg.lock);
+    reg.stop = 1;
+    pthread_cond_signal(&reg.wake);
+    pthread_mutex_unlock(&reg.lock);
+    pthread_join(reg.sampler, NULL);
+    metrics_report();
+    while(reg.list)
+    {
+        Metrics* next = reg.list->next;
+        free(reg.list);
+        reg.list = next;
+    }
+    metrics_local = NULL;
+    reg.enabled = 0;
+}
@@ -0,0 +1,115 @@
+// Connor Humiston
+// Runtime Metrics Header
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <stdint.h>                                 // fixed width integer types
+#include <time.h>                                   // clock_gettime()
+
+#include "queue.h"                                  // occupancy sampling
+
+#define HIST_SUB_BITS           4                   // 16 linear sub-buckets per power of two (~6% error)
+#define HIST_SUB                (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP            40                  // values up to 2^41 ns (~36 minutes)
+#define HIST_BUCKETS            ((HIST_MAX_EXP - HIST_SUB_BITS + 2) * HIST_SUB)
+
+#define METRICS_SAMPLE_MS       10                  // queue occupancy sampling period
+#define MAX_METRICS_INTERVAL    3600
+
+#define METRICS_JSON            0                   // --metrics-format values
+#define METRICS_PROMETHEUS      1
+
+/* Timed Stages */
+#define METRIC_READ             0                   // reading one name from an input
+#define METRIC_PUSH             1                   // producer blocked in buffer_push()
+#define METRIC_POP              2                   // consumer blocked in buffer_pop()
+#define METRIC_LOOKUP           3                   // one backend lookup, submit to answer
+#define METRIC_LOG              4                   // one log buffer write()
+#define METRIC_STAGES           5
+
+/* Counters */
+#define METRIC_NAMES_IN         0                   // names queued for the resolvers
+#define METRIC_NAMES_OUT        1                   // results written
+#define METRIC_LOG_BYTES        2                   // bytes written to both logs
+#define METRIC_COUNTERS         3
+
+
+/* Log-Linear Histogram: exact below 16, then 16 buckets per power of two */
+typedef struct Histogram
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+} Histogram;
+
+/* One Thread's Counters: written only by that thread, read by the reporter */
+typedef struct Metrics
+{
+    struct Metrics* next;                           // registry list
+    uint64_t counters[METRIC_COUNTERS];
+    Histogram stages[METRIC_STAGES];
+} Metrics;
+
+
+/* This thread's metrics, NULL when disabled or not attached */
+extern __thread Metrics* metrics_local;
+
+/* Starts sampling buff & reporting to path ("-" is stdout) every interval seconds (0: only at exit), returns 0 or -1 */
+int metrics_init(const char* path, int format, int interval, Buffer* buff);
+
+/* Gives the calling thread its own counters (no-op unless metrics_init() succeeded) */
+void metrics_attach(void);
+
+/* Folds the calling thread's counters into the retired-threads total & frees them (it records nothing after) */
+void metrics_detach(void);
+
+/* Stops the sampler, writes the final report & frees everything (all recording threads must be done) */
+void metrics_finish(void);
+
+/* Adds value to a histogram (single writer) */
+void histogram_add(Histogram* h, uint64_t value);
+
+/* Adds src into dst (reading src racily is fine, every field only grows) */
+void histogram_merge(Histogram* dst, const Histogram* src);
+
+/* Value below which fraction q of the recorded values fall */
+double histogram_quantile(const Histogram* h, double q);
+
+/* Monotonic clock in nanoseconds */
+static inline uint64_t metrics_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/* Start time for metrics_stop(), 0 (and no clock read) when metrics are off */
+static inline uint64_t metrics_start(void)
+{
+    return metrics_local ? metrics_now() : 0;
+}
+
+/* Records the time since t0 for stage */
+static inline void metrics_stop(int stage, uint64_t t0)
+{
+    if(metrics_local)
+        histogram_add(&metrics_local->stages[stage], metrics_now() - t0);
+}
+
+/* Records an already measured duration for stage */
+static inline void metrics_time(int stage, uint64_t ns)
+{
+    if(metrics_local)
+        histogram_add(&metrics_local->stages[stage], ns);
+}
+
+/* Adds n to a counter */
+static inline void metrics_count(int counter, uint64_t n)
+{
+    if(metrics_local)
+        __atomic_store_n(&metrics_local->counters[counter], metrics_local->counters[counter] + n, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -12,22 +12,58 @@ int main(int argc, char* argv[])
     int requesters = 0;                             // number of requesters
     int resolvers = 0;                              // number of resolvers
     Buffer* buffer;                                 // declare shared bounded buffer
-    FileList* files;                                // list of input files & parameters
+    Cache* cache = NULL;                            // resolution cache shared by the resolvers
+    DiskCache* disk = NULL;                         // answers kept across runs (--cache-file)
+    Ingest* ingest = NULL;                          // mapped input files (--mmap)
+    Slab* names;                                    // hostname slots shared by requesters & resolvers
+    Stream* stream = NULL;                          // streaming source (--stream)
+    Server* server = NULL;                          // DNS server (--serve)
+    pthread_t sigID;                                // waits for SIGTERM/SIGINT in stream & server mode
+    sigset_t sigs;                                  // signals that end a stream
+    ResStats totals = {0, 0, 0, 0, 0, 0, 0};        // resolver counters summed at exit
+    Sched* sched = NULL;                            // file ranges the requesters share & steal
     char** fileslist;                               // list of file names
-    File reqfile;                                   // requester serviced output file
-    File resfile;                                   // resolved output file
+    LogFile* reqlog;                                // requester serviced output file
+    LogFile* reslog;                                // resolved output file
     pthread_t* reqID;                               // requester thread IDs array
-    pthread_t* resID;                               // resolver thread IDs array
+    ResPool* pool;                                  // resolver threads (fixed or adaptive)
+    Checkpoint* ckpt = NULL;                        // periodic progress records (--checkpoint)
+    Topology* topo = NULL;                          // queue lanes & the CPUs their threads run on (--affinity)
+    CheckState saved;                               // the checkpoint a --resume continues from
     struct Req_Packet reqpacket;                    // requester function arguments
     struct Res_Packet respacket;                    // resolver function arguments
     int numfiles;                                   // keeps track of total input files
+    Options opts;                                   // optional --settings
     int r, i;                                       // used to keep track of loops
 
+    // Option Handling
+    if((i = options_parse(&opts, argc, argv)) < 0) // strip leading --options, leaving the positional arguments
+    {
+        printf("usage: ./multi-lookup [options] num_requestors num_resolvers requestor_log resolver_log [data_file ...]\n");
+        options_usage(stdout);
+        exit(EXIT_FAILURE);
+    }
+    argv += i - 1;                                  // argv[1] is now the first positional argument
+    argc -= i - 1;
+    if(opts.read_log)                               // Converter: binary log back to text, the positionals are hostnames
+    {
+        ResultFile* rf = resfile_open(opts.read_log);
+        if(!rf)
+        {
+            fprintf(stderr, "Unable to read \"%s\" as a binary resolver log.\n", opts.read_log);
+            exit(EXIT_FAILURE);
+        }
+        r = resfile_dump(rf, argv + 1, argc - 1, stdout);
+        resfile_close(rf);
+        return r == 0 ? 0 : EXIT_FAILURE;
+    }
+
     // Error Checks
-    if(argc < 6)                                    // Missing arguments: usage synopsis & terminate
+    if(argc < (opts.stream || opts.serve ? 5 : 6))  // Missing arguments: usage synopsis & terminate
     {
-        fprintf(stderr, "Not enough arguments: %d of minimum 5 arguments given.\n", (argc-1));
-        printf("usage: ./multi-lookup num_requestors num_resolvers requestor_log resolver_log [data_file ...]\n");
+        fprintf(stderr, "Not enough arguments: %d of minimum %d arguments given.\n", (argc-1), opts.stream || opts.serve ? 4 : 5);
+        printf("usage: ./multi-lookup [options] num_requestors num_resolvers requestor_log resolver_log [data_file ...]\n");
+        options_usage(stdout);
         exit(EXIT_FAILURE);
     }
     else if(argc > 5 + MAX_INPUT_FILES)             // Arguments out of range (too many): error
@@ -55,71 +91,215 @@ int main(int argc, char* argv[])
             fprintf(stderr, "The number of resolver threads is out of bounds. Choose between 0 and 10 inclusively.\n");
         exit(EXIT_FAILURE);
     }
-    reqfile.name = argv[3];                         // Requester Log
-    reqfile.flock = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
-    reqfile.fp = fopen(argv[3], "w");               // open/create the file & save the file pointer
-    if(!reqfile.fp)                                 // if NULL, unable to open or create file
+    if(opts.max_resolvers && (resolvers < 1 || opts.max_resolvers < resolvers))
     {
-        fprintf(stderr, "Unable to open \"%s\" requestor log.\n", argv[3]);
+        fprintf(stderr, "The adaptive pool needs 1 <= num_resolvers <= --max-resolvers.\n");
         exit(EXIT_FAILURE);
     }
-    resfile.name = argv[4];                         // Resolver Log
-    resfile.flock = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
-    resfile.fp = fopen(argv[4], "w");               // open/create the file & save the file pointer
-    if(!resfile.fp)
+
+    // Long-Running Modes Take No Data Files
+    if((opts.stream || opts.serve) && argc > 5)
     {
-        fprintf(stderr, "Unable to open \"%s\" resolver log.\n", argv[4]);
+        fprintf(stderr, "--stream & --serve can't be combined with data files.\n");
+        exit(EXIT_FAILURE);
+    }
+    if(opts.serve && requesters < 1)
+    {
+        fprintf(stderr, "--serve needs at least one requester (server socket).\n");
         exit(EXIT_FAILURE);
     }
 
     // Prepare Input Files
     numfiles = 0;
-    for(i = 0; i < argc - 5; i++)                   // count number of valid input files
+    fileslist = malloc(sizeof(char*) * (argc - 5 > 0 ? argc - 5 : 1));
+    for(i = 0; i < argc - 5; i++)                   // keep the valid input files
     {                                               // # cl arguments given minus first 5 parameters
         if(access(argv[i+5], F_OK | R_OK) != 0)     // check if the file exists & is readable (fopen willl create the file otherwise)
             fprintf(stderr, "Invalid file: %s.\n", argv[i+5]);
         else
-            numfiles++;                             // increment the number of valid files
+            fileslist[numfiles++] = argv[i+5];      // add the valid file name to the list
     }
-    fileslist = malloc(sizeof(char*) * numfiles);
-    for(i = 0; i < numfiles; i++)
+
+    // Checkpoints Follow Data Files Through the Scheduler into Logs That Can Be Cut Back
+    if(opts.checkpoint && (opts.mmap || opts.stream || opts.serve || strcmp(argv[3], "-") == 0 || strcmp(argv[4], "-") == 0))
+    {
+        fprintf(stderr, "--checkpoint needs data files read without --mmap, --stream or --serve, and logs that are files.\n");
+        exit(EXIT_FAILURE);
+    }
+    if(opts.resume && checkpoint_load(opts.checkpoint, &saved) != 0)
     {
-        fileslist[i] = argv[i+5];                   // add the valid file name to the list
+        fprintf(stderr, "Unable to read the checkpoint \"%s\".\n", opts.checkpoint);
+        exit(EXIT_FAILURE);
+    }
+    if(opts.resume && saved.format != opts.log_format)
+    {
+        fprintf(stderr, "The checkpoint \"%s\" was taken with another --log-format.\n", opts.checkpoint);
+        exit(EXIT_FAILURE);
+    }
+    if(opts.resume && checkpoint_matches(&saved, fileslist, numfiles) != 0)
+    {
+        fprintf(stderr, "The input files aren't the ones checkpointed in \"%s\".\n", opts.checkpoint);
+        exit(EXIT_FAILURE);
     }
 
-    // Build Files List
-    files = malloc(sizeof(*files) + sizeof(File) * numfiles); //allocate memory for the file list structure
-    files->listlock = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER; //initialize default mutex
-    files->tot = numfiles;                          // the total number of files in the list
-    files->curr = 0;                                // list starts at 0
-    files->num_serviced = 0;                        // none serviced yet
-    for(i = 0; i < numfiles; i++)
+    // Pick the I/O Path: io_uring Unless the Kernel Lacks It or --io=sync
+    if(opts.io == IO_URING && !uring_available())
     {
-        File file;                                  // declare a file
-        file.name = fileslist[i];                   // give file structure a name
-        file.fp = fopen(fileslist[i], "r");         // open the file & attach the file pointer
-        file.flock = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER; //intialize default mutex
-        file.serviced = 0;                          // initialize to not serviced yet
-        files->files[i] = file;                     // add the newly created file structure to the list of files
+        fprintf(stderr, "--io=uring: this kernel can't read & write files through io_uring.\n");
+        exit(EXIT_FAILURE);
     }
+    opts.io = opts.io != IO_SYNC && uring_available() ? IO_URING : IO_SYNC;
+
+    // Open the Logs (Resuming: Appending After What the Checkpoint Covers)
+    if(opts.resume)
+        reqlog = logfile_resume(argv[3], saved.reqlog_size, saved.results);
+    else
+        reqlog = logfile_open(argv[3]);             // Requester Log: open/create/truncate, threads append whole blocks
+    if(!reqlog)                                     // if NULL, unable to open or create file
+    {
+        fprintf(stderr, "Unable to open \"%s\" requestor log.\n", argv[3]);
+        exit(EXIT_FAILURE);
+    }
+    if(opts.resume)
+        reslog = logfile_resume(argv[4], saved.reslog_size, saved.results);
+    else
+        reslog = logfile_open(argv[4]);             // Resolver Log
+    if(!reslog || (opts.log_format == LOG_BINARY && resfile_begin(reslog) != 0))
+    {
+        fprintf(stderr, "Unable to open \"%s\" resolver log.\n", argv[4]);
+        exit(EXIT_FAILURE);
+    }
+    if(opts.io == IO_URING)
+    {
+        logfile_uring(reqlog);                      // pipes & terminals stay on write()
+        logfile_uring(reslog);
+    }
+
+    // Open the Stream
+    if(opts.stream && !(stream = stream_open(opts.stream)))
+    {
+        fprintf(stderr, "Unable to open the stream \"%s\".\n", opts.stream);
+        exit(EXIT_FAILURE);
+    }
+
+    // Map Inputs
+    if(opts.mmap && !(ingest = ingest_create(fileslist, numfiles, opts.chunk_size)))
+    {
+        fprintf(stderr, "Unable to map the input files.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Deal the Files Out to the Requesters
+    if(!opts.mmap && !opts.stream && !opts.serve &&
+       !(sched = sched_create(fileslist, numfiles, requesters, opts.chunk_size, opts.resume ? saved.units : NULL,
+                              opts.resume ? saved.nunits : 0)))
+    {
+        fprintf(stderr, "Unable to schedule the input files.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // First Checkpoint: Nothing Read Yet (or Where the Resumed Run Stopped)
+    if(opts.checkpoint && (!(ckpt = checkpoint_create(opts.checkpoint, opts.checkpoint_interval, opts.log_format, sched,
+                                                      reqlog, reslog)) || checkpoint_save(ckpt) != 0))
+    {
+        fprintf(stderr, "Unable to write the checkpoint \"%s\".\n", opts.checkpoint);
+        exit(EXIT_FAILURE);
+    }
+    if(opts.resume)
+    {
+        printf("./multi-lookup: resuming from \"%s\": %lu names already logged, %d ranges left\n",
+               opts.checkpoint, (unsigned long) saved.results, saved.nunits);
+        checkpoint_free(&saved);
+    }
+
+    // Place the Threads: Lanes Never Outnumber Requesters or the Resolvers That Never Retire
+    if(opts.affinity != AFFINITY_NONE && !(topo = topology_create(opts.affinity, requesters, resolvers)))
+    {
+        fprintf(stderr, "Unable to read the CPU topology.\n");
+        exit(EXIT_FAILURE);
+    }
+    if(topo)
+        topology_print(topo, resolvers, stdout);
 
     // Initialize Buffer
-    buffer = malloc(sizeof(*buffer) + sizeof(char*) * ARRAY_SIZE); //allocate dynamic memory block for buffer
-    buffer->size = ARRAY_SIZE;                      // array size of 10
-    buffer->curr = 0;                               // start at 0
-    buffer->bufflock = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
-    buffer->bfull = (pthread_cond_t) PTHREAD_COND_INITIALIZER; //initialize default condition variable
-    buffer->bempty = (pthread_cond_t) PTHREAD_COND_INITIALIZER;
-    buffer->full = 0;                               // buffer is not full at initialization
-    buffer->empty = 1;                              // buffer is empty at initialization
-    buffer->reqsdone = 0;                           // requesters not done at init
+    if(topo)                                        // a ring per lane, its threads steal from the others only when it runs dry
+        buffer = buffer_create_lanes(opts.queue_size, topo->nlanes);
+    else
+        buffer = buffer_create(opts.queue_size);    // lock-free ring, capacity rounded up to a power of two
+    if(!buffer)
+    {
+        fprintf(stderr, "Unable to allocate the shared buffer.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Initialize Hostname Pool
+    names = slab_create(MAX_NAME_LENGTH);           // fixed-size slots, recycled between requesters & resolvers
+    if(!names)
+    {
+        fprintf(stderr, "Unable to allocate the hostname pool.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Initialize Cache
+    if(opts.cache_ttl > 0 && !(cache = cache_create(opts.cache_ttl, opts.all_addrs ? LOOKUP_IP_LENGTH : INET6_ADDRSTRLEN,
+                                                     (size_t) opts.cache_max)))
+    {
+        fprintf(stderr, "Unable to allocate the resolution cache.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Open the Cache File
+    if(opts.cache_file && !(disk = diskcache_open(opts.cache_file, (uint32_t) opts.cache_ttl)))
+    {
+        fprintf(stderr, "Unable to open the cache file \"%s\".\n", opts.cache_file);
+        exit(EXIT_FAILURE);
+    }
+
+    // Bind the Server Sockets
+    if(opts.serve && !(server = server_create(&opts.listen, opts.listenlen, requesters, opts.server_batch,
+                                              (uint32_t) opts.cache_ttl, buffer, cache, names, reqlog, opts.log_buffer)))
+    {
+        fprintf(stderr, "Unable to start the DNS server on \"%s\".\n", opts.serve);
+        exit(EXIT_FAILURE);
+    }
 
     // Create & Run Requester Threads
     reqID = malloc(sizeof(pthread_t) * requesters); // allocate space for the requester IDs array
-    reqpacket.files = files;                        // pass the requesters the input file list
+    reqpacket.sched = sched;                        // pass the requesters the file ranges (NULL for other inputs)
     reqpacket.buff = buffer;                        // pass the shared buffer
-    reqpacket.reqfile = reqfile;                    // pass the output requester serviced file (initialized above)
-    for(r = 0; r < requesters; r++)                 // create the requester threads
+    reqpacket.ingest = ingest;                      // pass the mapped chunks (NULL unless --mmap)
+    reqpacket.names = names;                        // pass the hostname pool
+    reqpacket.stream = stream;                      // pass the stream (NULL unless --stream)
+    reqpacket.server = server;                      // pass the server (NULL unless --serve)
+    reqpacket.topo = topo;                          // pass the lanes (NULL unless --affinity)
+    reqpacket.reqlog = reqlog;                      // pass the output requester serviced file (initialized above)
+    reqpacket.reslog = reslog;                      // names that fail the checks are answered INVALID right away
+    reqpacket.invalid = 0;
+    reqpacket.opts = &opts;                         // log buffer size
+    if(stream || server)                            // run until EOF or SIGTERM/SIGINT
+    {
+        sigemptyset(&sigs);                         // every thread inherits the mask, only sigID takes them
+        sigaddset(&sigs, SIGTERM);
+        sigaddset(&sigs, SIGINT);
+        pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+        signal(SIGPIPE, SIG_IGN);                   // a closed stdout shows up as a log write error instead
+        if(pthread_create(&sigID, NULL, shutdown_waiter, &reqpacket) != 0)
+        {
+            fprintf(stderr, "Error creating the signal thread.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(opts.metrics && metrics_init(opts.metrics, opts.metrics_format, opts.metrics_interval, buffer) != 0)
+    {
+        fprintf(stderr, "Unable to start metrics reporting to \"%s\".\n", opts.metrics);
+        exit(EXIT_FAILURE);
+    }
+    if(server && server_start(server) != 0)         // server workers stand in for the requesters
+    {
+        fprintf(stderr, "Error creating a server thread.\n");
+        exit(EXIT_FAILURE);
+    }
+    for(r = 0; !server && r < requesters; r++)      // create the requester threads
     {                                               // pass a pointer to the argument structure
         if(pthread_create(&reqID[r], NULL, requester, (void*) &reqpacket) != 0)
         {                                           // check the return value for successful creation 
@@ -129,46 +309,109 @@ int main(int argc, char* argv[])
     }
 
     // Create & Run Resolver Threads
-    resID = malloc(sizeof(pthread_t) * resolvers);  // create resolver thread ID storage
     respacket.buff = buffer;                        // attach the bounded buffer
-    respacket.resfile = resfile;                    // pass the output resolved file struct (initialized above)
-    for(r = 0; r < resolvers; r++)
+    respacket.cache = cache;                        // attach the cache (NULL when disabled)
+    respacket.disk = disk;                          // attach the cache file (NULL unless --cache-file)
+    respacket.names = names;                        // attach the hostname pool
+    respacket.server = server;                      // attach the server (NULL unless --serve)
+    respacket.opts = &opts;                         // engine settings
+    respacket.totals = &totals;                     // each resolver adds its counters on exit
+    respacket.reslog = reslog;                      // pass the output resolved file (initialized above)
+    respacket.checkpoint = ckpt;                    // idle resolvers flush when a checkpoint asks (NULL: never)
+    respacket.topo = topo;                          // attach the lanes (NULL unless --affinity)
+    pool = respool_create(resolver, &respacket, buffer, resolvers, opts.max_resolvers, opts.scale_interval);
+    if(!pool || respool_start(pool) != 0)           // adaptive when --max-resolvers is above num_resolvers
     {
-        if(pthread_create(&resID[r], NULL, resolver, (void*) &respacket) != 0) //creates thread using resolver function with resolve parameter
-        {
-            fprintf(stderr, "Error creating a resolver thread.\n");
-            return -1;
-        }
+        fprintf(stderr, "Error creating a resolver thread.\n");
+        return -1;
+    }
+    if(ckpt && checkpoint_start(ckpt, pool) != 0)
+    {
+        fprintf(stderr, "Error creating the checkpoint thread.\n");
+        exit(EXIT_FAILURE);
     }
 
     // Wait for Threads
-    for(r = 0; r < requesters; r++)                 // wait for requesters & print results
+    if(server)
+        server_join(server);                        // returns once a signal stopped the workers
+    for(r = 0; !server && r < requesters; r++)      // wait for requesters & print results
     {
         if(pthread_join(reqID[r], NULL) != 0)       // join the thread & check for error
             fprintf(stderr, "Error joining thread %d.\n", reqID[r]);
     }
-    pthread_mutex_lock(&buffer->bufflock);          // once requesters are done, lock the buffer to update 
-    buffer->reqsdone = 1;                           // indicate that the requesters are done if not indicated already
-    pthread_cond_broadcast(&buffer->bempty);        // signal that the buffer is empty
-    pthread_mutex_unlock(&buffer->bufflock);        // unlock the buffer mutex
-    for(r = 0; r < resolvers; r++)                  // wait for resolvers & print results
+    if(stream || server)
     {
-        if(pthread_join(resID[r], NULL) != 0)       // join the thread & check for error
-            fprintf(stderr, "Error joining thread %d.\n", resID[r]);
+        pthread_kill(sigID, SIGTERM);               // input ended on its own: release the signal thread
+        pthread_join(sigID, NULL);
     }
+    if(ckpt)
+        checkpoint_stop(ckpt);                      // a checkpoint in progress still needs the resolvers running
+    buffer_close(buffer);                           // indicate that the requesters are done & wake sleeping resolvers (they drain what is queued & in flight)
+    respool_join(pool);                             // stop resizing, wait for resolvers & print results
+    metrics_finish();                               // final report once every thread has stopped recording
 
     // Cleanup & Close
-    for(i = 0; i < numfiles; i++)                   // close the input files
+    if(sched)
+        sched_destroy(sched);                       // every range has been read
+    if(stream)
+        stream_close(stream);
+    if(server)
+    {
+        printf("./multi-lookup: served %lu queries (%lu from cache, %lu sent to resolvers, %lu answers, %lu invalid, %lu dropped)\n",
+               server->queries, server->hits, server->misses, server->answered, server->invalid, server->dropped);
+        server_destroy(server);                     // resolvers have answered every waiting client
+    }
+    if(disk)
     {
-        fclose(files->files[i].fp);
+        unsigned long table = disk->head ? (unsigned long) disk->head->count : 0;
+        unsigned long logged = disk->logged;        // the rewrite replays this run's records too
+        int synced = diskcache_sync(disk);          // every resolver has stored its answers
+        printf("./multi-lookup: cache file had %lu entries + %lu logged (opened in %.3f ms), %lu answers reused, %lu stored",
+               table, logged, disk->openms, disk->hits, disk->stored);
+        if(synced == 0 && disk->compacted)
+            printf(", rewritten with %lu entries", disk->compacted);
+        printf("\n");
+        diskcache_destroy(disk);
     }
-    fclose(reqfile.fp);                             // close the output files
-    fclose(resfile.fp);
+    if(ingest)
+        ingest_destroy(ingest);                     // unmap only after the resolvers are done with the slices
+    if(opts.log_format == LOG_BINARY && resfile_finish(reslog) != 0) // every resolver has flushed its last block
+        fprintf(stderr, "Unable to index the resolver log \"%s\".\n", argv[4]);
+    if(ckpt)
+    {
+        if(checkpoint_remove(ckpt) != 0)            // the logs are complete, nothing is left to resume
+            fprintf(stderr, "Unable to remove the checkpoint \"%s\".\n", opts.checkpoint);
+        printf("./multi-lookup: %lu checkpoints written (longest pause %.1f ms)\n", ckpt->taken, ckpt->longest);
+        checkpoint_destroy(ckpt);
+    }
+    logfile_close(reqlog);                          // close the output files (every thread flushed its buffer)
+    logfile_close(reslog);
     free(fileslist);                                // free the preliminary list of file names
-    free(files);                                    // free the structure of files
-    free(buffer);                                   // free the bounded buffer
+    buffer_destroy(buffer);                         // free the bounded buffer
+    topology_destroy(topo);
+    if(cache)
+    {
+        printf("./multi-lookup: resolved %d hostnames (%d cache hits, %d misses, %d coalesced)\n",
+               totals.resolved, totals.hits, totals.misses, totals.coalesced);
+        cache_destroy(cache);                       // free the cached answers
+    }
+    if(opts.hedge > 0 || opts.deadline > 0)
+        printf("./multi-lookup: hedged %d lookups (%d hedges won), %d timed out\n",
+               totals.hedged, totals.hedge_wins, totals.timeouts);
+    if(reqpacket.invalid > 0)
+        printf("./multi-lookup: %d invalid hostnames logged without a lookup\n", reqpacket.invalid);
+    r = totals.hits + totals.misses + totals.coalesced; // every name a resolver answered
+    printf("./multi-lookup: %lu hostname pool allocations for %d names (%.4f per name)\n",
+           slab_allocations(names), r, r ? (double) slab_allocations(names) / r : 0.0);
+    if(opts.io == IO_URING)
+    {
+        unsigned long calls, ops;
+        uring_stats(&calls, &ops);
+        printf("./multi-lookup: io_uring completed %lu reads & log writes in %lu system calls\n", ops, calls);
+    }
+    slab_destroy(names);                            // free every slot block
     free(reqID);                                    // free the requester ID array
-    free(resID);                                    // free the resolver ID array
+    respool_destroy(pool);                          // free the resolver pool
     //pthread_mutex_destroy(&);                     // destroy the mutexes
     clock_gettime(CLOCK_MONOTONIC, &t1);            // stop elapsted time stopwatch
     elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1000000000.0;
@@ -176,173 +419,583 @@ int main(int argc, char* argv[])
     return 0;                                       // return success
 }
 
+/* Queues the batched hostnames for the resolvers, timing how long a full buffer holds the producer up */
+static void requester_flush(PushBatch* b)
+{
+    if(b->len == 0)
+        return;
+    uint64_t t0 = metrics_start();
+    buffer_push_many(b->buff, b->names, b->len);    // as many per CAS as there is room for, sleeps only while the buffer is full
+    metrics_stop(METRIC_PUSH, t0);
+    metrics_count(METRIC_NAMES_IN, b->len);
+    b->len = 0;
+}
+
+/* Adds a hostname to the batch, queueing it once full or once its oldest name has lingered long enough */
+static void requester_push(PushBatch* b, const Name* name)
+{
+    uint64_t now = b->linger_ns && b->len < b->cap - 1 ? pool_clock_ns() : 0; // a clock read only if it can matter
+    if(b->len == 0)
+        b->first_ns = now;
+    b->names[b->len++] = *name;                     // the resolver owns the name once the batch is pushed
+    if(b->len == b->cap || now - b->first_ns >= b->linger_ns)
+        requester_flush(b);
+}
+
+/* Queues the held batch & writes out both log buffers, so everything read so far is counted */
+static void requester_settle(LogBuf* log, PushBatch* b)
+{
+    requester_flush(b);
+    logbuf_flush(log);
+    logbuf_flush(b->results);
+}
+
+/* Lowercases & trims a name read into in (out may be in), checks it & writes it to the requester log;
+ * returns 1 if it should be queued, 0 if it was blank or has gone straight to the resolver log as INVALID */
+static int requester_check(struct Req_Packet* p, LogBuf* log, PushBatch* b, const char* in, size_t* len, char* out,
+                           uint64_t* hash, int cut)
+{
+    int outcome = hostname_normalize(in, len, out, hash); // one vectorized pass over the name
+    if(outcome == HOSTNAME_BLANK)
+        return 0;
+    logbuf_name(log, out, *len);
+    if(outcome == HOSTNAME_OK && !cut)              // a cut line was longer than any name can be
+        return 1;
+    if(p->opts->log_format == LOG_BINARY)           // no resolver slot, no lookup & never cached
+        resfile_put(b->results, out, *len, LOOKUP_INVALID, NULL);
+    else
+        logbuf_pair(b->results, out, *len, lookup_status_name(LOOKUP_INVALID));
+    __atomic_fetch_add(&p->invalid, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
 /* Producer: reads hostnames from file and pushes to the queue & requester log, returns # files serviced */
 void* requester(void* packet)
 {
+    struct Req_Packet* p = (struct Req_Packet*) packet; //cast void* to packet struct
     int serviced = 0;                               // tracker for number of files serviced
-    requester_helper(packet, &serviced);            // begin recursive helper function for servicing files
-    printf("thread %x serviced %d files\n", pthread_self(), serviced);
+    LogBuf log;                                     // this thread's requester log buffer
+    LogBuf results;                                 // this thread's INVALID lines for the resolver log
+    PushBatch batch;                                // names read but not yet queued
+    if(p->topo)                                     // pinned before allocating, so its buffers are local to its CPUs
+        buffer_join_lane(p->buff, topology_join_requester(p->topo));
+    metrics_attach();                               // per-thread counters (no-op without --metrics)
+    batch.buff = p->buff;
+    batch.cap = p->opts->batch;
+    batch.len = 0;
+    batch.linger_ns = (uint64_t) p->opts->linger * 1000000;
+    batch.names = malloc(sizeof(Name) * batch.cap);
+    batch.results = &results;
+    if(!batch.names || logbuf_init(&log, p->reqlog, p->opts->log_buffer) != 0 ||
+       logbuf_init(&results, p->reslog, p->opts->log_buffer) != 0)
+    {
+        fprintf(stderr, "Unable to allocate a requester log buffer.\n");
+        exit(EXIT_FAILURE);
+    }
+    SlabCache* pool = slab_cache(p->names);         // this thread's hostname slots
+    if(!pool)
+    {
+        fprintf(stderr, "Unable to allocate a hostname pool cache.\n");
+        exit(EXIT_FAILURE);
+    }
+    if(p->ingest)
+    {
+        serviced = requester_chunks(p, &log, pool, &batch); // any requester can work on any part of any file
+        requester_flush(&batch);
+        free(batch.names);
+        logbuf_destroy(&log);
+        logbuf_destroy(&results);
+        printf("thread %lx serviced %d chunks\n", (unsigned long) pthread_self(), serviced);
+        return 0;
+    }
+    if(p->stream)
+    {
+        serviced = requester_stream(p, &log, pool, &batch); // one stdin/FIFO, or one socket connection at a time
+        requester_flush(&batch);
+        free(batch.names);
+        logbuf_destroy(&log);
+        logbuf_destroy(&results);
+        printf("thread %lx serviced %d streams\n", (unsigned long) pthread_self(), serviced);
+        return 0;
+    }
+    int self = sched_join(p->sched);                // this thread's deque of file ranges
+    int ranges = 0;                                 // ranges read, including stolen ones
+    WorkUnit unit;
+    Reader in;                                      // blocks read ahead of the lines being parsed
+    if(reader_init(&in, p->opts->io) != 0)
+    {
+        fprintf(stderr, "Unable to allocate a requester read buffer.\n");
+        exit(EXIT_FAILURE);
+    }
+    while(sched_next(p->sched, self, &unit) == 0)   // own ranges first, then steals, until every file is read
+    {
+        requester_range(p, self, &unit, &in, &log, pool, &batch);
+        if(p->opts->checkpoint)                     // a checkpoint can't wait on a requester gone idle with names held
+            requester_settle(&log, &batch);
+        ranges++;
+        serviced += sched_done(p->sched, self, &unit); // a file counts for the thread that finishes its last range
+    }
+    reader_destroy(&in);
+    requester_flush(&batch);                        // queue the last partial batch
+    free(batch.names);
+    logbuf_destroy(&log);                           // flush what is left
+    logbuf_destroy(&results);
+    printf("thread %lx serviced %d files (%d ranges, %d stolen)\n", (unsigned long) pthread_self(),
+           serviced, ranges, p->sched->deques[self].steals);
     return 0;
 }
 
-/* Recursive function that services input files until there are none left to service */
-void* requester_helper(void* packet, int* serviced)
+/* Producer (--mmap): claims chunks of the mapped inputs & pushes zero-copy slices, returns # chunks */
+int requester_chunks(struct Req_Packet* p, LogBuf* log, SlabCache* pool, PushBatch* batch)
 {
-    struct Req_Packet* p = (struct Req_Packet*) packet; //cast void* to packet struct
-    FileList* flist = p->files;                     // collect the argument variables
-    Buffer* buff = p->buff;                         // pointer to the buffer
-    File reqlog = p->reqfile;                       // requester log file structure
+    const Chunk* chunk;                             // byte range currently being read
+    int chunks = 0;                                 // chunks this thread serviced
+    Name name;                                      // slice into the mapping
+    char key[MAX_NAME_LENGTH];                      // normalized name (the mapping is read-only)
 
-    // Base Case: Check Remaining Files
-    pthread_mutex_lock(&flist->listlock);           // lock the list from other threads when grabbing a new file
-    if(flist->num_serviced == flist->tot)           // if there are no more files to read, exit
+    while((chunk = ingest_claim(p->ingest)))        // lock-free claim, several threads may share one big file
     {
-        pthread_mutex_unlock(&flist->listlock);     // unlock before exiting
-        return 0;
+        size_t pos = chunk->start;
+        uint64_t t0 = metrics_start();
+        while(ingest_next_name(p->ingest, chunk, &pos, &name) == 0)
+        {
+            metrics_stop(METRIC_READ, t0);
+            size_t len = name.len < MAX_NAME_LENGTH - 1 ? name.len : MAX_NAME_LENGTH - 1;
+            if(requester_check(p, log, batch, name.str, &len, key, &name.hash, name.len > len))
+            {
+                if(len != name.len || memcmp(key, name.str, len) != 0) // had to be changed: queue a pooled copy
+                {
+                    char* hostname = slab_alloc(pool);
+                    if(!hostname)
+                    {
+                        fprintf(stderr, "Unable to allocate a hostname.\n");
+                        exit(EXIT_FAILURE);
+                    }
+                    memcpy(hostname, key, len);
+                    hostname[len] = '\0';
+                    name.str = hostname;
+                    name.len = (uint32_t) len;
+                    name.flags = NAME_POOLED;
+                }
+                requester_push(batch, &name);       // usually no copy & nothing to free: the mapping outlives the resolvers
+            }
+            t0 = metrics_start();
+        }
+        chunks++;
     }
-    // Find an Unserviced File
-    while(flist->files[flist->curr].serviced)       // loop through file list while files serviced until an unserviced one is found
+    return chunks;
+}
+
+/* Producer (--stream): reads names until EOF or shutdown, returns # connections/streams serviced */
+int requester_stream(struct Req_Packet* p, LogBuf* log, SlabCache* pool, PushBatch* batch)
+{
+    LineReader* rd = malloc(sizeof(*rd));           // too big for the thread's stack
+    int streams = 0;                                // connections (or the one shared stream) read
+    Name line;                                      // slice into the reader's buffer
+
+    if(!rd)
     {
-        if(flist->curr == flist->tot-1)
-            flist->curr = 0;                        // restart the loop if the end is reached
-        else
-            flist->curr++;                          // update the current position in the list
+        fprintf(stderr, "Unable to allocate a stream reader.\n");
+        exit(EXIT_FAILURE);
     }
-    File* currfile = &flist->files[flist->curr];    // grab the current file from the list
-    (*serviced)++;                                  // increment the number of files serviced
-    if(flist->curr == flist->tot-1)                 // update the list after the new file has been chosen
-        flist->curr = 0;
-    else
-        flist->curr++;
-    pthread_mutex_unlock(&flist->listlock);         // release the file list now that file chosen & it has been updated
-
-    // Gather Hostnames & Write to Files/Buffer
-    while(1)
+    while(stream_attach(p->stream, rd) == 0)        // blocks for the next connection, -1 once stopped
     {
-        pthread_mutex_lock(&currfile->flock);       // lock the current file from other threads (obtained every cycle since fgets updates offset)
-        char* hostname = (char*) malloc(sizeof(char) * (MAX_NAME_LENGTH)); //allocate hostname memory
-        // Read the File
-        if(fgets(hostname, MAX_NAME_LENGTH, currfile->fp)) //fgets but doesn't lock the stream w/ return check
+        uint64_t t0 = metrics_start();
+        while(stream_readline(p->stream, rd, &line) == 0)
         {
-            pthread_mutex_unlock(&currfile->flock); // don't forget to unlock the current file
-            hostname[strcspn(hostname, "\r\n")] = 0;  // remove newline by getting span until newline char
-            //printf("Requester Thread - hostname: \"%s\"\n", hostname);
-            // Add Hostname to the Buffer
-            pthread_mutex_lock(&buff->bufflock);    // grab the buffer if available (sleep otherwise)        
-            while(buff->full)                       // if the buffer is full, we (producer must wait)
-            {                                       // block on this condition until buff not full
-                pthread_cond_wait(&buff->bfull, &buff->bufflock); //wait until broadcast that buffer not full
+            metrics_stop(METRIC_READ, t0);          // includes waiting for the writer
+            char* hostname = slab_alloc(pool);      // the reader's buffer is reused, so copy into a slot
+            if(!hostname)
+            {
+                fprintf(stderr, "Unable to allocate a hostname.\n");
+                exit(EXIT_FAILURE);
             }
-            buff->arr[buff->curr] = hostname;       // add the hostname to the buffer if not full and not busy
-            // Update Buffer Parameters
-            if(buff->curr == buff->size - 1)        // if the buffer is now full,
-                buff->full = 1;                     // set the full variable
-            buff->curr++;                           // update the current position
-            if(buff->curr - 1 == 0)                 // check if the buffer was empty before the new hostname
+            size_t len = line.len < MAX_NAME_LENGTH - 1 ? line.len : MAX_NAME_LENGTH - 1;
+            uint64_t hash;
+            memcpy(hostname, line.str, len);
+            if(requester_check(p, log, batch, hostname, &len, hostname, &hash, line.len > len))
             {
-                buff->empty = 0;                    // the buffer is no longer empty
-                pthread_cond_broadcast(&buff->bempty); //tell other threads buffer not empty anymore
+                hostname[len] = '\0';
+                Name name = {hostname, (uint32_t) len, NAME_POOLED, hash};
+                requester_push(batch, &name);       // a full buffer stops us reading, which backs up the writer
             }
-            // Write to the Requester Log
-            pthread_mutex_lock(&reqlog.flock);      // protect the requester log during writing
-            if(fputs(hostname, reqlog.fp) == EOF)   // write the hostname to the requester log
-                fprintf(stderr, "Error writing to the requester log file.\n"); 
-            fputc('\n', reqlog.fp);                 // add a newline after each host name
-            pthread_mutex_unlock(&buff->bufflock);  // release the buffer
-            pthread_mutex_unlock(&reqlog.flock);    // don't forget to unlock the file
-        }
-        else                                        // if fgets is done (the entire file/all hostnames have been read)
-        {  
-            free(hostname);                         // delete unneeded memory
-            if(!currfile->serviced)
+            else
+                slab_free(pool, hostname);
+            if(!stream_buffered(rd))
             {
-                currfile->serviced = 1;             // update that this file has been fully serviced
-                pthread_mutex_unlock(&currfile->flock); //release the current file
-                pthread_mutex_lock(&flist->listlock);
-                flist->num_serviced++;              // increment the number of files this thread serviced
-                pthread_mutex_unlock(&flist->listlock); 
-                // Call the Recursive Function Again
-                requester_helper(packet, serviced++); //recursive call with one more file serviced
+                requester_flush(batch);             // about to wait for input: don't sit on read names
+                logbuf_flush(log);
+                logbuf_flush(batch->results);
             }
-            else                                    // unlikely case at eof and service flag not raised
-                pthread_mutex_unlock(&currfile->flock); // unlock the mutex if done with the file
-            break;                                  // exit the loop after file complete
+            t0 = metrics_start();
         }
+        stream_detach(p->stream, rd);
+        streams++;
     }
-    return 0;
+    free(rd);
+    return streams;
 }
 
-/* Consumer: resolves hostnames from queue and writes to resolver log, returns # hostnames resolved */
-void* resolver(void* packet)
+/* Waits for SIGTERM/SIGINT (blocked in every thread) & stops the stream or server so the pipeline drains */
+void* shutdown_waiter(void* packet)
 {
-    struct Res_Packet* p = (struct Res_Packet*) packet; //cast resolver packet struct from void*
-    Buffer* buff = p->buff;                         // collect the buffer pointer
-    File reslog = p->resfile;                       // resolver log file structure
-    int resolved = 0;                               // track the number of host names that were resolved
+    struct Req_Packet* p = (struct Req_Packet*) packet;
+    sigset_t sigs;
+    int sig;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGTERM);
+    sigaddset(&sigs, SIGINT);
+    sigwait(&sigs, &sig);
+    if(p->stream)
+        stream_stop(p->stream);                     // requesters stop reading; queued & in-flight names still resolve
+    if(p->server)
+        server_stop(p->server);                     // workers stop receiving; queued misses are still answered
+    return NULL;
+}
 
-    // Loop Until the Queue is Empty & Requesters Done
-    while(1)
+/* Producer (data files): reads the lines starting inside one file range & pushes them */
+void requester_range(struct Req_Packet* p, int self, const WorkUnit* unit, Reader* in, LogBuf* log, SlabCache* pool,
+                     PushBatch* batch)
+{
+    const char* fname = p->sched->files[unit->file].name;
+    off_t from = unit->start > 0 ? unit->start - 1 : 0; // the byte before tells if a line runs into the range
+    int cut;                                        // line was longer than a slot
+
+    if(reader_start(in, fname, from, unit->end) != 0) // own descriptor, other threads may read other ranges of it
     {
-        // Bounds/Initial Conditions
-        pthread_mutex_lock(&buff->bufflock);        // lock the buffer for use
-        while(buff->empty && !buff->reqsdone)       // wait while the buffer is empty and requesters are not done yet
+        fprintf(stderr, "Unable to read %s.\n", fname);
+        return;
+    }
+    if(unit->start > 0)                             // a line running into the range belongs to the range before
+        reader_skip(in);
+
+    // Gather Hostnames & Write to Files/Buffer
+    while(in->pos < unit->end)                      // lines starting at unit->end or later are the next range's
+    {
+        if(sched_paused(p->sched))                  // checkpoint: every name read so far must be logged & queued
+        {
+            requester_settle(log, batch);
+            sched_park(p->sched, self, in->pos);    // the range resumes at pos if the run stops here
+        }
+        uint64_t t0 = metrics_start();
+        char* hostname = slab_alloc(pool);          // recycled slot, the heap is only touched when none came back
+        if(!hostname)
         {
-            pthread_cond_wait(&buff->bempty, &buff->bufflock);
+            fprintf(stderr, "Unable to allocate a hostname.\n");
+            exit(EXIT_FAILURE);
         }
-        if(buff->empty && buff->reqsdone)           // if the buffer us empty & requesters done, we are done!
+        // Read the File
+        int got = reader_line(in, hostname, MAX_NAME_LENGTH, &cut); // like fgets, the rest of a long line dropped
+        if(got < 0)                                 // end of the file
         {
-            pthread_mutex_unlock(&buff->bufflock);  // release the mutex before exiting loop
+            slab_free(pool, hostname);              // unused slot goes straight back on this thread's list
             break;
         }
-        // Get Hostname from Buffer
-        char* hostname = buff->arr[buff->curr-1];   // set hostname to the current array position
-        buff->arr[buff->curr-1] = NULL;             // clear the pointer to that position with NULL
-        if(buff->curr == 1)                         // if the current position was 1, the buffer is now empty
+        metrics_stop(METRIC_READ, t0);
+        size_t len = (size_t) got;
+        // Normalize & Check, then Write to the Requester Log
+        uint64_t hash;
+        if(!requester_check(p, log, batch, hostname, &len, hostname, &hash, cut)) // newline & whitespace trimmed too
+        {
+            slab_free(pool, hostname);              // blank, or already logged as INVALID
+            continue;
+        }
+        hostname[len] = '\0';
+        // Add Hostname to the Buffer
+        Name name = {hostname, (uint32_t) len, NAME_POOLED, hash};
+        requester_push(batch, &name);               // queued with the rest of the batch (resolver owns it after)
+    }
+    reader_finish(in);                              // reads ahead past the range come back before the blocks are reused
+}
+
+/* Copies a queued name into a free slot (releasing the queue's copy), returns the null terminated hostname */
+static char* resolver_take(ResWorker* w, const Name* name)
+{
+    char* hostname = w->freenames[--w->nfree];      // callers only take names while they hold fewer than cap
+    size_t len = name->len < MAX_NAME_LENGTH - 1 ? name->len : MAX_NAME_LENGTH - 1;
+    memcpy(hostname, name->str, len);
+    hostname[len] = '\0';
+    w->hashes[(hostname - w->names) / MAX_NAME_LENGTH] = name->hash; // saves the cache normalizing it again
+    if(name->flags & NAME_POOLED)
+        slab_free(w->pool, (char*) name->str);      // batched back to the requester that read it
+    return hostname;
+}
+
+/* Cache hash the requester computed for the name in a slot, 0 if none */
+static uint64_t resolver_hash(ResWorker* w, const char* hostname)
+{
+    return w->hashes[(hostname - w->names) / MAX_NAME_LENGTH];
+}
+
+/* Puts a finished hostname's slot back */
+static void resolver_release(ResWorker* w, char* hostname)
+{
+    w->freenames[w->nfree++] = hostname;
+}
+
+/* Logs a finished hostname, answers any clients waiting on it & frees its slot */
+static void resolver_finish(ResWorker* w, char* hostname, int status, const char* ip)
+{
+    if(w->p->opts->log_format == LOG_BINARY)
+        resfile_put(&w->log, hostname, strlen(hostname), status, ip);
+    else
+        write_result(&w->log, hostname, status, ip);
+    metrics_count(METRIC_NAMES_OUT, 1);
+    if(status == UTIL_SUCCESS)
+        w->st.resolved++;                           // increment the number of successfully resolved host names
+    if(w->p->server)
+        server_complete(w->p->server, hostname, status, ip);
+    resolver_release(w, hostname);
+}
+
+/* Answers a hostname from the cache or submits it to the backend, returns -1 if another thread is resolving it */
+static int resolver_admit(ResWorker* w, char* hostname, int wait, int deferred)
+{
+    Cache* cache = w->p->cache;                     // shared cache, NULL when disabled
+    char ip[MAX_IP_LENGTH];                         // cached address(es)
+    int status;                                     // UTIL_SUCCESS or UTIL_FAILURE
+    int outcome = CACHE_MISS;                       // without a cache every name is a miss
+
+    if(cache)
+        outcome = cache_acquire(cache, hostname, resolver_hash(w, hostname), &status, ip, MAX_IP_LENGTH, wait);
+    if(outcome == CACHE_BUSY)                       // caller parks it & retries after its own answers
+        return -1;
+    if(outcome == CACHE_MISS && w->p->disk && diskcache_lookup(w->p->disk, hostname, &status, ip, MAX_IP_LENGTH) == CACHE_HIT)
+    {
+        outcome = CACHE_HIT;                        // answered by an earlier run, no lookup needed
+        if(cache)
+            cache_complete(cache, hostname, resolver_hash(w, hostname), status, ip); // wakes anyone who coalesced onto this miss
+    }
+    if(outcome == CACHE_MISS)
+    {
+        int slot = (int) ((hostname - w->names) / MAX_NAME_LENGTH);
+        void* user = hedge_start(w->hedge, slot, hostname, pool_clock_ns()); // latency is timed per backend lookup
+        w->st.misses++;
+        if(w->be->submit(w->state, hostname, user) == 0) // the answer comes back through complete()
+            return 0;
+        hedge_drop(w->hedge, &w->hedge->lookups[slot]);
+        status = UTIL_FAILURE;                      // name can't even be queried
+        if(cache)
+            cache_complete(cache, hostname, resolver_hash(w, hostname), status, NULL);
+    }
+    else if(outcome == CACHE_HIT && !deferred)
+        w->st.hits++;
+    else                                            // answered by another thread's lookup
+        w->st.coalesced++;
+    resolver_finish(w, hostname, status, ip);
+    return 0;
+}
+
+/* Cancels every attempt of a lookup the backend still holds */
+static void resolver_cancel(ResWorker* w, HedgeLookup* l)
+{
+    int i;
+    for(i = 0; i < 2; i++)
+    {
+        if(l->live & (1 << i))
+            w->be->cancel(w->state, &l->attempts[i]);
+    }
+    l->live = 0;
+}
+
+/* Races a second attempt against lookups slower than the hedge percentile & gives up on those past the deadline */
+static void resolver_hedge(ResWorker* w)
+{
+    uint64_t now = pool_clock_ns();
+    HedgeLookup* l;
+    int expired;
+
+    while((l = hedge_due(w->hedge, now, &expired)))
+    {
+        if(expired)
+        {
+            resolver_cancel(w, l);
+            hedge_drop(w->hedge, l);
+            w->st.timeouts++;
+            if(w->p->cache)
+                cache_complete(w->p->cache, l->hostname, resolver_hash(w, l->hostname), LOOKUP_TIMEOUT, NULL); // wakes coalesced resolvers, they retry it
+            resolver_finish(w, l->hostname, LOOKUP_TIMEOUT, NULL);
+        }
+        else
         {
-            buff->empty = 1;                        // buffer now empty
+            int accepted = w->be->submit(w->state, l->hostname, &l->attempts[1]) == 0;
+            hedge_sent(l, accepted);                // a full backend just means no hedge for this one
+            w->st.hedged += accepted;
         }
-        buff->curr--;
-        if(buff->curr == buff->size - 1)            // buffer is no longer full now that hostname was popped off
+    }
+}
+
+/* Consumer (pool worker): resolves hostnames from queue and writes to resolver log */
+void* resolver(void* worker)
+{
+    PoolWorker* self = (PoolWorker*) worker;        // retire flag & latency counters
+    struct Res_Packet* p = (struct Res_Packet*) self->pool->packet; //cast resolver packet struct from void*
+    Buffer* buff = p->buff;                         // collect the buffer pointer
+    ResWorker w;                                    // this thread's backend, log & hostname slots
+    LookupResult* results;                          // answers returned by one complete()
+    char** deferred;                                // names another resolver is already looking up
+    int ndeferred = 0;
+    int done = 0;                                   // buffer closed & drained
+    int i, n;
+
+    if(p->topo)                                     // pinned before allocating, so its buffers are local to its CPUs
+        buffer_join_lane(buff, topology_join_resolver(p->topo, (int) (self - self->pool->workers)));
+    metrics_attach();                               // per-thread counters (no-op without --metrics)
+    w.p = p;
+    w.self = self;
+    w.be = p->opts->backend;
+    w.state = w.be->init(p->opts);
+    if(!w.state && w.be != backend_find("getaddrinfo")) // keep going with the blocking path rather than dropping names
+    {
+        fprintf(stderr, "Unable to start the %s engine, falling back to getaddrinfo.\n", w.be->name);
+        w.be = backend_find("getaddrinfo");
+        w.state = w.be->init(p->opts);
+    }
+    w.cap = w.be->capacity(p->opts);                // most names this thread holds at once (1 for getaddrinfo)
+    memset(&w.st, 0, sizeof(w.st));
+    if(!self->local)                                // one cache per pool slot, reused by every thread respawned into it
+        self->local = slab_cache(p->names);         // only frees into it, so it never grows
+    w.pool = (SlabCache*) self->local;
+    w.names = malloc((size_t) w.cap * MAX_NAME_LENGTH); // every name this thread holds lives in one of these
+    w.freenames = malloc(sizeof(char*) * w.cap);
+    w.hashes = malloc(sizeof(uint64_t) * w.cap);
+    w.hedge = hedge_create(w.cap, p->opts->hedge, p->opts->deadline);
+    results = malloc(sizeof(LookupResult) * w.cap);
+    deferred = malloc(sizeof(char*) * w.cap);
+    w.popped = malloc(sizeof(Name) * p->opts->batch);
+    w.npopped = w.next = 0;
+    if(!w.state || !w.pool || !w.names || !w.freenames || !w.hashes || !w.hedge || !results || !deferred || !w.popped || logbuf_init(&w.log, p->reslog, p->opts->log_buffer) != 0)
+    {
+        fprintf(stderr, "Unable to allocate resolver state.\n");
+        exit(EXIT_FAILURE);
+    }
+    for(w.nfree = 0; w.nfree < w.cap; w.nfree++)
+        w.freenames[w.nfree] = w.names + (size_t) w.nfree * MAX_NAME_LENGTH;
+
+    // Loop Until the Queue is Empty, Requesters Done & Nothing in Flight
+    while(!done || w.be->pending(w.state) > 0 || ndeferred > 0 || w.next < w.npopped)
+    {
+        // Retry Names Other Resolvers Were Looking Up
+        for(i = 0; i < ndeferred; )
         {
-            buff->full = 0;                         // not full anymore
-            pthread_cond_broadcast(&buff->bfull);   // alert the other (producer) threads
+            if(resolver_admit(&w, deferred[i], 0, 1) == 0)
+                deferred[i] = deferred[--ndeferred]; // handled, fill the hole with the last one
+            else
+                i++;
         }
-        pthread_mutex_unlock(&buff->bufflock);      // unlock the buffer
-        // Get IP Address
-        char ip[INET6_ADDRSTRLEN];                  // character array to store IP address from dnslookup
-        //printf("Resolver Thread - hostname: \"%s\"\n", hostname);
-        if(dnslookup(hostname, ip, INET6_ADDRSTRLEN) == UTIL_SUCCESS)
+        // Take New Hostnames While There is Room
+        if(!done && __atomic_load_n(&self->retire, __ATOMIC_ACQUIRE))
+            done = 1;                               // pool is shrinking: finish what we hold & exit
+        while(w.nfree > 0)
         {
-            // Construct the Mapping
-            char* mapping = malloc(sizeof(char) * (strlen(hostname) + strlen(ip) + 4)); // string for hostname, IP/n mapping
-            strcpy(mapping, hostname);              // copy the hostname as the first string into the mapping
-            strcat(mapping, ", ");                  // concatenate a comma and a space
-            strcat(mapping, ip);                    // add ip address
-            strcat(mapping, "\n");                  // add newline
-            // Write Mapping to File
-            pthread_mutex_lock(&reslog.flock);      // lock the resolver log from other threads
-            if(fputs(mapping, reslog.fp) == EOF)    // write the mapping to the resolver log
-                fprintf(stderr, "Error writing to the resolver log file.\n"); 
-            pthread_mutex_unlock(&reslog.flock);    // don't forget to unlock the file
-            resolved++;                             // increment the number of successfully resolved host names
-            free(mapping);                          // free the temporary concatenation of strings 
+            if(w.next == w.npopped)                 // batch used up: take the next names from the buffer
+            {
+                if(done)
+                    break;
+                w.next = w.npopped = 0;
+                if(w.be->pending(w.state) == 0 && ndeferred == 0) // idle: sleep on the buffer
+                {
+                    if(checkpoint_draining(p->checkpoint))
+                        logbuf_flush(&w.log);       // a checkpoint is waiting for every answer to be logged
+                    uint64_t t0 = metrics_start();
+                    int popped = buffer_pop_many(buff, w.popped, p->opts->batch, &self->interrupt); // oldest hostnames first, sleeps while the buffer is empty
+                    metrics_stop(METRIC_POP, t0);
+                    if(popped == -2 && !__atomic_load_n(&self->retire, __ATOMIC_ACQUIRE))
+                    {
+                        __atomic_store_n(&self->interrupt, 0, __ATOMIC_SEQ_CST); // woken for a checkpoint: flush & sleep again
+                        continue;
+                    }
+                    if(popped < 0)
+                    {
+                        done = 1;                   // if the buffer is empty & requesters done (or we were retired), we are done!
+                        break;
+                    }
+                    w.npopped = popped;
+                }
+                else if((w.npopped = (int) buffer_trypop_many(buff, w.popped, p->opts->batch)) == 0)
+                    break;                          // nothing queued right now, go collect answers
+            }
+            char* hostname = resolver_take(&w, &w.popped[w.next++]); // names of one batch are handled back to back
+            if(resolver_admit(&w, hostname, 0, 0) != 0)
+                deferred[ndeferred++] = hostname;
         }
-        else                                        // if the lookup was a failure
+        // Collect Answers
+        if(w.be->pending(w.state) > 0)
         {
-            // Construct the Mapping
-            char* mapping = malloc(sizeof(char) * (strlen(hostname) + 16)); // string for hostname, NOT_RESOLVED\n
-            strcpy(mapping, hostname);              // copy the hostname as the first string into the mapping
-            strcat(mapping, ", NOT_RESOLVED\n");    // concatenate a comma, the NOT_RESOLVED keyword & newline
-            // Write Mapping to File
-            pthread_mutex_lock(&reslog.flock);      // lock the resolver log from other threads
-            if(fputs(mapping, reslog.fp) == EOF)    // write the mapping to the resolver log
-                fprintf(stderr, "Error writing to the resolver log file.\n"); 
-            pthread_mutex_unlock(&reslog.flock);    // don't forget to unlock the file
-            free(mapping);                          // free the temporary concatenation of strings
+            int wait = ASYNC_IDLE_POLL_MS;          // bounded so new hostnames are noticed
+            if(w.nfree > 0 && (w.next < w.npopped || buffer_count(buff) > 0))
+                wait = 0;                           // more work is popped or queued & there's room for it
+            else if(ndeferred > 0)
+                wait = 1;
+            resolver_hedge(&w);                     // before waiting, so a due hedge isn't held back
+            wait = hedge_wait(w.hedge, pool_clock_ns(), wait);
+            n = w.be->complete(w.state, wait, results, w.cap);
+            for(i = 0; i < n; i++)
+            {
+                uint64_t now = pool_clock_ns();
+                HedgeAttempt* a = (HedgeAttempt*) results[i].user;
+                HedgeLookup* l = hedge_answer(w.hedge, a, now); // first answer wins, the other attempt is dropped
+                if(!l)
+                    continue;
+                char* hostname = l->hostname;
+                uint64_t took = now - l->sent;
+                resolver_cancel(&w, l);
+                w.st.hedge_wins += a->hedge;
+                respool_record(self, took);
+                metrics_time(METRIC_LOOKUP, took);
+                if(p->cache)
+                    cache_complete(p->cache, hostname, resolver_hash(&w, hostname), results[i].status, results[i].ip); // publish & wake coalesced resolvers
+                if(p->disk)
+                    diskcache_store(p->disk, hostname, results[i].status, results[i].ip); // logged for the next run
+                resolver_finish(&w, hostname, results[i].status, results[i].ip);
+            }
         }
-        free(hostname);                             // free hostname memory
+        else if(ndeferred > 0)                      // nothing of our own in flight, so blocking can't deadlock
+            resolver_admit(&w, deferred[--ndeferred], 1, 1);
+        if(p->opts->stream || p->server)
+            logbuf_flush(&w.log);                   // long-running: emit answers as they complete (one write per pass)
     }
-    printf("thread %x resolved %d hostnames\n", pthread_self(), resolved);
+    w.be->destroy(w.state);
+    slab_flush(w.pool);                             // give back the slots still held in partial batches
+    logbuf_destroy(&w.log);                         // flush what is left
+    free(w.names);
+    free(w.freenames);
+    free(w.hashes);
+    hedge_destroy(w.hedge);
+    free(results);
+    free(deferred);
+    free(w.popped);
+    report_resolver(p, &w.st);
+    metrics_detach();                               // a retired thread's counters join the totals & its block is freed
     return NULL;
 }
 
+/* Prints a resolver's counters & adds them to the totals */
+void report_resolver(struct Res_Packet* p, const ResStats* st)
+{
+    if(p->cache)
+        printf("thread %lx resolved %d hostnames (%d cache hits, %d misses, %d coalesced)\n",
+               (unsigned long) pthread_self(), st->resolved, st->hits, st->misses, st->coalesced);
+    else
+        printf("thread %lx resolved %d hostnames\n", (unsigned long) pthread_self(), st->resolved);
+    if(p->opts->hedge > 0 || p->opts->deadline > 0)
+        printf("thread %lx hedged %d lookups (%d hedges won, %d timed out)\n",
+               (unsigned long) pthread_self(), st->hedged, st->hedge_wins, st->timeouts);
+    __atomic_fetch_add(&p->totals->resolved, st->resolved, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&p->totals->hits, st->hits, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&p->totals->misses, st->misses, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&p->totals->coalesced, st->coalesced, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&p->totals->hedged, st->hedged, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&p->totals->hedge_wins, st->hedge_wins, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&p->totals->timeouts, st->timeouts, __ATOMIC_RELAXED);
+}
+
+/* Writes "hostname, ip", "hostname, NOT_RESOLVED", "hostname, TIMEOUT" or "hostname, INVALID" to the resolver log */
+void write_result(LogBuf* log, const char* hostname, int status, const char* ip)
+{
+    // Format the Mapping Straight into this Thread's Buffer (flushed as whole lines, no lock needed)
+    if(status == UTIL_SUCCESS)
+        logbuf_pair(log, hostname, strlen(hostname), ip);
+    else
+        logbuf_pair(log, hostname, strlen(hostname), lookup_status_name(status));
+}
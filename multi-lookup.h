@@ -11,64 +11,112 @@
 #include <sys/time.h>                               // for gettimeofday()
 #include <unistd.h>                                 // POSIX API
 #include <assert.h>                                 // used for assert macro
+#include <signal.h>                                 // stream shutdown on SIGTERM/SIGINT
 
 #include "util.h"                                   // DNS lookup
+#include "queue.h"                                  // shared lock-free buffer
+#include "options.h"                                // command line options
+#include "cache.h"                                  // resolution cache
+#include "backend.h"                                // resolver backends
+#include "logwriter.h"                              // per-thread buffered logs
+#include "ingest.h"                                 // memory-mapped input
+#include "slab.h"                                   // pooled hostname slots
+#include "respool.h"                                // fixed or adaptive resolver threads
+#include "stream.h"                                 // stdin, FIFO & Unix socket input
+#include "server.h"                                 // UDP DNS server mode
+#include "metrics.h"                                // stage latencies & throughput
+#include "diskcache.h"                              // answers kept across runs
+#include "filesched.h"                              // work-stealing file ranges
+#include "hedge.h"                                  // hedged & deadline-bounded lookups
+#include "resfile.h"                                // binary resolver log
+#include "hostname.h"                               // name normalization & checks
+#include "checkpoint.h"                             // periodic checkpoints & --resume
+#include "reader.h"                                 // read-ahead input
 
-#define ARRAY_SIZE              10                  // number of elements in shared array
 #define MAX_INPUT_FILES         100                 // maximum hostname file arguments
 #define MAX_REQUESTER_THREADS   10                  // max concurrent requestors
 #define MAX_RESOLVER_THREADS    10                  // max concurrent resolvers
 #define MAX_NAME_LENGTH         255                 // max size of hostname w/ null terminator
-#define MAX_IP_LENGTH           INET6_ADDRSTRLEN    // max size IP address util.c will return
+#define MAX_IP_LENGTH           LOOKUP_IP_LENGTH    // max size of the address list a backend returns
+#define ASYNC_IDLE_POLL_MS      5                   // resolvers with lookups pending recheck the buffer this often
 
 
-/* File Data Structure */
-typedef struct File
+/* Names a Requester Has Read but Not Yet Queued */
+typedef struct PushBatch
 {
-    FILE* fp;                                       // input file pointer
-    char* name;                                     // file name
-    pthread_mutex_t flock;                          // input file lock
-    int serviced;                                   // indicates if file has been fully serviced
-} File;
-
-/* Structure organizing list of input files */
-typedef struct FileList 
-{
-    pthread_mutex_t listlock;                       // protects access to list of file
-    int tot;                                        // total number of files in the list
-    int curr;                                       // current file being serviced
-    int num_serviced;                               // number of files serviced so far across all threads
-    File files[];                                   // array of files
-} FileList;
-
-/* Shared Buffer Array */
-typedef struct Buffer 
-{
-    int size;                                       // total buffer size
-    int curr;                                       // current position in the array
-    pthread_mutex_t bufflock;                       // buffer mutex
-    pthread_cond_t bfull;                           // condition for full buffer array, tell other threads
-    pthread_cond_t bempty;                          // condition for empty buffer, tell other threads
-    int full;                                       // indicator for full buffer
-    int empty;                                      // indicator for empty buffer
-    int reqsdone;                                   // indicates when the requester threads are finished
-    char* arr[];                                    // shared buffer array
-} Buffer;
+    Buffer* buff;                                   // where full batches go
+    Name* names;                                    // cap names, oldest first
+    int len;
+    int cap;
+    uint64_t linger_ns;                             // longest the oldest name is held back
+    uint64_t first_ns;                              // when the oldest name was read
+    LogBuf* results;                                // resolver log buffer names that fail the checks go to instead
+} PushBatch;
 
 /* Requester Data Arguments */
 struct Req_Packet
 {
-    FileList* files;                                // pointer to the files list struct
+    Sched* sched;                                   // file ranges every requester draws from (NULL for other inputs)
     Buffer* buff;                                   // pointer to the shared buffer
-    File reqfile;                                   // requester file & parameters
+    Ingest* ingest;                                 // mapped inputs (NULL unless --mmap)
+    Slab* names;                                    // pool the hostnames read with fgets come from
+    Stream* stream;                                 // streaming source (NULL unless --stream)
+    Server* server;                                 // DNS server (NULL unless --serve)
+    Topology* topo;                                 // lanes & CPUs requesters join (NULL unless --affinity)
+    LogFile* reqlog;                                // requester log
+    LogFile* reslog;                                // resolver log, for names logged as INVALID
+    const Options* opts;                            // log buffer size
+    int invalid;                                    // names logged as INVALID (summed atomically)
 };
 
 /* Resolver Data Arguments */
 struct Res_Packet
 {
     Buffer* buff;                                   // pointer to the shared buffer
-    File resfile;                                   // resolver file & parameters
+    Cache* cache;                                   // shared resolution cache (NULL when disabled)
+    DiskCache* disk;                                // previous runs' answers (NULL unless --cache-file)
+    Slab* names;                                    // pool popped hostnames are returned to
+    Server* server;                                 // clients waiting on answers (NULL unless --serve)
+    LogFile* reslog;                                // resolver log
+    Checkpoint* checkpoint;                         // asks idle resolvers to flush their logs (NULL unless --checkpoint)
+    Topology* topo;                                 // lanes & CPUs resolvers join (NULL unless --affinity)
+    const Options* opts;                            // backend settings
+    struct ResStats* totals;                        // counters summed over every resolver
+};
+
+/* Resolver Counters */
+struct ResStats
+{
+    int resolved;                                   // names that got an address
+    int hits;                                       // answered by the cache
+    int misses;                                     // looked up by this thread
+    int coalesced;                                  // answered by another thread's identical lookup
+    int hedged;                                     // lookups raced with a second attempt
+    int hedge_wins;                                 // ... where the second attempt answered first
+    int timeouts;                                   // lookups given up at the deadline
 };
+typedef struct ResStats ResStats;
+
+/* Per-Thread Resolver State */
+typedef struct ResWorker
+{
+    struct Res_Packet* p;                           // shared arguments
+    PoolWorker* self;                               // this thread's pool slot (retire flag & latency counters)
+    const Backend* be;                              // lookup engine
+    void* state;                                    // this thread's backend state
+    int cap;                                        // most names held at once
+    LogBuf log;                                     // this thread's resolver log buffer
+    SlabCache* pool;                                // batches the requesters' slots back to them
+    ResStats st;                                    // how this thread's names were answered
+    char* names;                                    // cap preallocated hostname slots
+    char** freenames;                               // slots not holding a name
+    uint64_t* hashes;                               // requester's cache hash per slot (0: the cache computes it)
+    Hedger* hedge;                                  // lookups in flight per slot: submit times, hedges & deadlines
+    int nfree;
+    Name* popped;                                   // names taken from the buffer in one pop_many
+    int npopped;                                    // names in popped
+    int next;                                       // first of them not yet taken
+} ResWorker;
 
 
 /* Handles input arguments, organizes producers & consumers, and cleans up */
@@ -77,10 +125,26 @@ int main(int arg, char* argv[]);
 /* Producer: reads hostnames from file and pushes to the queue & requester log, returns # files serviced */
 void* requester(void* packet); 
 
-/* Recursive function that services input files until there are none left to service */
-void* requester_helper(void* packet, int* serviced);
+/* Producer (--mmap): claims chunks of the mapped inputs & pushes zero-copy slices, returns # chunks */
+int requester_chunks(struct Req_Packet* p, LogBuf* log, SlabCache* pool, PushBatch* batch);
+
+/* Producer (--stream): reads names until EOF or shutdown, returns # connections/streams serviced */
+int requester_stream(struct Req_Packet* p, LogBuf* log, SlabCache* pool, PushBatch* batch);
+
+/* Waits for SIGTERM/SIGINT & stops the stream or server so the pipeline drains */
+void* shutdown_waiter(void* packet);
+
+/* Producer (data files): reads the lines starting inside one file range & pushes them */
+void requester_range(struct Req_Packet* p, int self, const WorkUnit* unit, Reader* in, LogBuf* log, SlabCache* pool,
+                     PushBatch* batch);
+
+/* Consumer (pool worker): resolves hostnames from queue and writes to resolver log */
+void* resolver(void* worker);
+
+/* Prints a resolver's counters & adds them to the totals */
+void report_resolver(struct Res_Packet* p, const ResStats* st);
 
-/* Consumer: resolves hostnames from queue and writes to resolver log, returns # hostnames resolved */
-void* resolver(void* packet);
+/* Writes "hostname, ip", "hostname, NOT_RESOLVED", "hostname, TIMEOUT" or "hostname, INVALID" to the resolver log */
+void write_result(LogBuf* log, const char* hostname, int status, const char* ip);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,462 @@
+// Connor Humiston
+// Command Line Options Implementation
+#include "options.h"
+
+#include <getopt.h>                                 // getopt_long()
+#include <string.h>                                 // C string library
+
+enum
+{
+    OPT_QUEUE_SIZE = 256,                           // long-only options start past the char range
+    OPT_BATCH,
+    OPT_LINGER,
+    OPT_CACHE_TTL,
+    OPT_CACHE_FILE,
+    OPT_CACHE_MAX,
+    OPT_ENGINE,
+    OPT_NAMESERVER,
+    OPT_ASYNC_INFLIGHT,
+    OPT_DNS_TIMEOUT,
+    OPT_DNS_RETRIES,
+    OPT_HEDGE,
+    OPT_DEADLINE,
+    OPT_FAMILY,
+    OPT_ALL_ADDRS,
+    OPT_SYNTH_LATENCY,
+    OPT_SYNTH_FAIL,
+    OPT_SYNTH_INFLIGHT,
+    OPT_SYNTH_SEED,
+    OPT_LOG_BUFFER,
+    OPT_LOG_FORMAT,
+    OPT_READ_LOG,
+    OPT_MMAP,
+    OPT_CHUNK_SIZE,
+    OPT_MAX_RESOLVERS,
+    OPT_SCALE_INTERVAL,
+    OPT_STREAM,
+    OPT_SERVE,
+    OPT_SERVER_BATCH,
+    OPT_METRICS,
+    OPT_METRICS_FORMAT,
+    OPT_METRICS_INTERVAL,
+    OPT_CHECKPOINT,
+    OPT_CHECKPOINT_INTERVAL,
+    OPT_RESUME,
+    OPT_AFFINITY,
+    OPT_IO
+};
+
+static const struct option long_opts[] =
+{
+    {"queue-size",  required_argument, NULL, OPT_QUEUE_SIZE},
+    {"batch",       required_argument, NULL, OPT_BATCH},
+    {"linger",      required_argument, NULL, OPT_LINGER},
+    {"cache-ttl",   required_argument, NULL, OPT_CACHE_TTL},
+    {"cache-file",  required_argument, NULL, OPT_CACHE_FILE},
+    {"cache-max",   required_argument, NULL, OPT_CACHE_MAX},
+    {"engine",      required_argument, NULL, OPT_ENGINE},
+    {"nameserver",  required_argument, NULL, OPT_NAMESERVER},
+    {"async-inflight", required_argument, NULL, OPT_ASYNC_INFLIGHT},
+    {"dns-timeout", required_argument, NULL, OPT_DNS_TIMEOUT},
+    {"dns-retries", required_argument, NULL, OPT_DNS_RETRIES},
+    {"hedge",       required_argument, NULL, OPT_HEDGE},
+    {"deadline",    required_argument, NULL, OPT_DEADLINE},
+    {"family",      required_argument, NULL, OPT_FAMILY},
+    {"all-addrs",   no_argument,       NULL, OPT_ALL_ADDRS},
+    {"synth-latency", required_argument, NULL, OPT_SYNTH_LATENCY},
+    {"synth-fail",  required_argument, NULL, OPT_SYNTH_FAIL},
+    {"synth-inflight", required_argument, NULL, OPT_SYNTH_INFLIGHT},
+    {"synth-seed",  required_argument, NULL, OPT_SYNTH_SEED},
+    {"log-buffer",  required_argument, NULL, OPT_LOG_BUFFER},
+    {"log-format",  required_argument, NULL, OPT_LOG_FORMAT},
+    {"read-log",    required_argument, NULL, OPT_READ_LOG},
+    {"mmap",        no_argument,       NULL, OPT_MMAP},
+    {"chunk-size",  required_argument, NULL, OPT_CHUNK_SIZE},
+    {"max-resolvers", required_argument, NULL, OPT_MAX_RESOLVERS},
+    {"scale-interval", required_argument, NULL, OPT_SCALE_INTERVAL},
+    {"stream",      required_argument, NULL, OPT_STREAM},
+    {"serve",       required_argument, NULL, OPT_SERVE},
+    {"server-batch", required_argument, NULL, OPT_SERVER_BATCH},
+    {"metrics",     required_argument, NULL, OPT_METRICS},
+    {"metrics-format", required_argument, NULL, OPT_METRICS_FORMAT},
+    {"metrics-interval", required_argument, NULL, OPT_METRICS_INTERVAL},
+    {"checkpoint",  required_argument, NULL, OPT_CHECKPOINT},
+    {"checkpoint-interval", required_argument, NULL, OPT_CHECKPOINT_INTERVAL},
+    {"resume",      no_argument,       NULL, OPT_RESUME},
+    {"affinity",    required_argument, NULL, OPT_AFFINITY},
+    {"io",          required_argument, NULL, OPT_IO},
+    {NULL,          0,                  NULL, 0}
+};
+
+
+/* Parses a positive integer argument within [min, max], returns -1 if malformed */
+static long parse_num(const char* name, const char* arg, long min, long max)
+{
+    char* end;
+    long val = strtol(arg, &end, 10);
+    if(*arg == '\0' || *end != '\0' || val < min || val > max)
+    {
+        fprintf(stderr, "Invalid value \"%s\" for --%s (expected %ld to %ld).\n", arg, name, min, max);
+        return -1;
+    }
+    return val;
+}
+
+/* Fills opts with defaults then parses --options, returns index of first positional or -1 on error */
+int options_parse(Options* opts, int argc, char* argv[])
+{
+    int c;
+    long val;
+
+    // Defaults
+    opts->queue_size = DEFAULT_QUEUE_SIZE;
+    opts->batch = DEFAULT_BATCH;
+    opts->linger = DEFAULT_LINGER;
+    opts->cache_ttl = DEFAULT_CACHE_TTL;
+    opts->cache_file = NULL;
+    opts->cache_max = -1;                           // set below, once the mode is known
+    opts->backend = backend_find("getaddrinfo");    // the system resolver stays the default
+    opts->nameserver = NULL;
+    opts->async_inflight = DEFAULT_ASYNC_INFLIGHT;
+    opts->dns_timeout_ms = DEFAULT_DNS_TIMEOUT_MS;
+    opts->dns_retries = DEFAULT_DNS_RETRIES;
+    opts->hedge = 0;
+    opts->deadline = 0;
+    opts->family = AF_UNSPEC;
+    opts->all_addrs = 0;
+    opts->synth_latency.dist = SYNTH_FIXED;
+    opts->synth_latency.a = opts->synth_latency.b = 0;
+    opts->synth_fail = 0;
+    opts->synth_inflight = DEFAULT_SYNTH_INFLIGHT;
+    opts->synth_seed = 0;
+    opts->log_buffer = DEFAULT_LOG_BUFFER;
+    opts->log_format = LOG_TEXT;
+    opts->read_log = NULL;
+    opts->mmap = 0;
+    opts->chunk_size = DEFAULT_CHUNK_SIZE;
+    opts->max_resolvers = 0;
+    opts->scale_interval = DEFAULT_SCALE_INTERVAL;
+    opts->stream = NULL;
+    opts->serve = NULL;
+    opts->server_batch = DEFAULT_SERVER_BATCH;
+    opts->metrics = NULL;
+    opts->metrics_format = METRICS_JSON;
+    opts->metrics_interval = 0;
+    opts->checkpoint = NULL;
+    opts->checkpoint_interval = DEFAULT_CHECKPOINT_INTERVAL;
+    opts->resume = 0;
+    opts->affinity = AFFINITY_NONE;
+    opts->io = IO_AUTO;
+
+    // Parse
+    opterr = 0;                                     // we report errors ourselves
+    while((c = getopt_long(argc, argv, "+", long_opts, NULL)) != -1) // '+' stops at the first positional
+    {
+        switch(c)
+        {
+            case OPT_QUEUE_SIZE:
+                if((val = parse_num("queue-size", optarg, 1, MAX_QUEUE_SIZE)) < 0)
+                    return -1;
+                opts->queue_size = (size_t) val;    // rounded up to a power of two by buffer_create()
+                break;
+            case OPT_BATCH:
+                if((val = parse_num("batch", optarg, 1, MAX_BATCH)) < 0)
+                    return -1;
+                opts->batch = (int) val;
+                break;
+            case OPT_LINGER:
+                if((val = parse_num("linger", optarg, 0, MAX_LINGER)) < 0)
+                    return -1;
+                opts->linger = (int) val;
+                break;
+            case OPT_CACHE_TTL:
+                if((val = parse_num("cache-ttl", optarg, 0, MAX_CACHE_TTL)) < 0)
+                    return -1;
+                opts->cache_ttl = (int) val;
+                break;
+            case OPT_CACHE_FILE:
+                opts->cache_file = optarg;
+                break;
+            case OPT_CACHE_MAX:
+                if((val = parse_num("cache-max", optarg, 0, MAX_CACHE_MAX)) < 0)
+                    return -1;
+                opts->cache_max = val;
+                break;
+            case OPT_ENGINE:
+                if(!(opts->backend = backend_find(optarg)))
+                {
+                    fprintf(stderr, "Unknown engine \"%s\" (expected %s).\n", optarg, backend_names());
+                    return -1;
+                }
+                break;
+            case OPT_NAMESERVER:
+                opts->nameserver = optarg;          // parsed once every option has been seen
+                break;
+            case OPT_ASYNC_INFLIGHT:
+                if((val = parse_num("async-inflight", optarg, 1, MAX_ASYNC_INFLIGHT)) < 0)
+                    return -1;
+                opts->async_inflight = (int) val;
+                break;
+            case OPT_DNS_TIMEOUT:
+                if((val = parse_num("dns-timeout", optarg, 1, 60000)) < 0)
+                    return -1;
+                opts->dns_timeout_ms = (int) val;
+                break;
+            case OPT_DNS_RETRIES:
+                if((val = parse_num("dns-retries", optarg, 0, 10)) < 0)
+                    return -1;
+                opts->dns_retries = (int) val;
+                break;
+            case OPT_HEDGE:
+                if((val = parse_num("hedge", optarg, 0, MAX_HEDGE_PERCENTILE)) < 0)
+                    return -1;
+                opts->hedge = (int) val;
+                break;
+            case OPT_DEADLINE:
+                if((val = parse_num("deadline", optarg, 0, MAX_DEADLINE)) < 0)
+                    return -1;
+                opts->deadline = (int) val;
+                break;
+            case OPT_FAMILY:
+                if(strcmp(optarg, "any") == 0)
+                    opts->family = AF_UNSPEC;
+                else if(strcmp(optarg, "4") == 0)
+                    opts->family = AF_INET;
+                else if(strcmp(optarg, "6") == 0)
+                    opts->family = AF_INET6;
+                else
+                {
+                    fprintf(stderr, "Unknown address family \"%s\" (expected any, 4 or 6).\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPT_ALL_ADDRS:
+                opts->all_addrs = 1;
+                break;
+            case OPT_SYNTH_LATENCY:
+                if(synthetic_parse_latency(optarg, &opts->synth_latency) != 0)
+                {
+                    fprintf(stderr, "Invalid latency \"%s\" (expected fixed:MS, uniform:MIN:MAX or lognormal:MEDIAN:SIGMA).\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPT_SYNTH_FAIL:
+                if(sscanf(optarg, "%lf", &opts->synth_fail) != 1 || opts->synth_fail < 0 || opts->synth_fail > 1)
+                {
+                    fprintf(stderr, "Invalid value \"%s\" for --synth-fail (expected 0 to 1).\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPT_SYNTH_INFLIGHT:
+                if((val = parse_num("synth-inflight", optarg, 1, MAX_ASYNC_INFLIGHT)) < 0)
+                    return -1;
+                opts->synth_inflight = (int) val;
+                break;
+            case OPT_SYNTH_SEED:
+                if((val = parse_num("synth-seed", optarg, 0, 0x7FFFFFFF)) < 0)
+                    return -1;
+                opts->synth_seed = (unsigned) val;
+                break;
+            case OPT_LOG_BUFFER:
+                if((val = parse_num("log-buffer", optarg, MIN_LOG_BUFFER, MAX_LOG_BUFFER)) < 0)
+                    return -1;
+                opts->log_buffer = (size_t) val;
+                break;
+            case OPT_LOG_FORMAT:
+                if(strcmp(optarg, "text") == 0)
+                    opts->log_format = LOG_TEXT;
+                else if(strcmp(optarg, "binary") == 0)
+                    opts->log_format = LOG_BINARY;
+                else
+                {
+                    fprintf(stderr, "Unknown log format \"%s\" (expected text or binary).\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPT_READ_LOG:
+                opts->read_log = optarg;
+                break;
+            case OPT_MMAP:
+                opts->mmap = 1;
+                break;
+            case OPT_CHUNK_SIZE:
+                if((val = parse_num("chunk-size", optarg, MIN_CHUNK_SIZE, MAX_CHUNK_SIZE)) < 0)
+                    return -1;
+                opts->chunk_size = (size_t) val;
+                break;
+            case OPT_MAX_RESOLVERS:
+                if((val = parse_num("max-resolvers", optarg, 1, MAX_POOL_RESOLVERS)) < 0)
+                    return -1;
+                opts->max_resolvers = (int) val;
+                break;
+            case OPT_SCALE_INTERVAL:
+                if((val = parse_num("scale-interval", optarg, MIN_SCALE_INTERVAL, MAX_SCALE_INTERVAL)) < 0)
+                    return -1;
+                opts->scale_interval = (int) val;
+                break;
+            case OPT_STREAM:
+                opts->stream = optarg;
+                break;
+            case OPT_SERVE:
+                if(server_parse_listen(optarg, &opts->listen, &opts->listenlen) != 0)
+                {
+                    fprintf(stderr, "Invalid listen address \"%s\" for --serve.\n", optarg);
+                    return -1;
+                }
+                opts->serve = optarg;
+                break;
+            case OPT_SERVER_BATCH:
+                if((val = parse_num("server-batch", optarg, 1, MAX_SERVER_BATCH)) < 0)
+                    return -1;
+                opts->server_batch = (int) val;
+                break;
+            case OPT_METRICS:
+                opts->metrics = optarg;
+                break;
+            case OPT_METRICS_FORMAT:
+                if(strcmp(optarg, "json") == 0)
+                    opts->metrics_format = METRICS_JSON;
+                else if(strcmp(optarg, "prometheus") == 0)
+                    opts->metrics_format = METRICS_PROMETHEUS;
+                else
+                {
+                    fprintf(stderr, "Unknown metrics format \"%s\" (expected json or prometheus).\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPT_METRICS_INTERVAL:
+                if((val = parse_num("metrics-interval", optarg, 0, MAX_METRICS_INTERVAL)) < 0)
+                    return -1;
+                opts->metrics_interval = (int) val;
+                break;
+            case OPT_CHECKPOINT:
+                opts->checkpoint = optarg;
+                break;
+            case OPT_CHECKPOINT_INTERVAL:
+                if((val = parse_num("checkpoint-interval", optarg, 1, MAX_CHECKPOINT_INTERVAL)) < 0)
+                    return -1;
+                opts->checkpoint_interval = (int) val;
+                break;
+            case OPT_RESUME:
+                opts->resume = 1;
+                break;
+            case OPT_AFFINITY:
+                if(strcmp(optarg, "none") == 0)
+                    opts->affinity = AFFINITY_NONE;
+                else if(strcmp(optarg, "node") == 0)
+                    opts->affinity = AFFINITY_NODE;
+                else if(strcmp(optarg, "core") == 0)
+                    opts->affinity = AFFINITY_CORE;
+                else
+                {
+                    fprintf(stderr, "Unknown affinity \"%s\" (expected none, node or core).\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPT_IO:
+                if(strcmp(optarg, "auto") == 0)
+                    opts->io = IO_AUTO;
+                else if(strcmp(optarg, "uring") == 0)
+                    opts->io = IO_URING;
+                else if(strcmp(optarg, "sync") == 0)
+                    opts->io = IO_SYNC;
+                else
+                {
+                    fprintf(stderr, "Unknown I/O mode \"%s\" (expected auto, uring or sync).\n", optarg);
+                    return -1;
+                }
+                break;
+            default:
+                fprintf(stderr, "Unknown or incomplete option \"%s\".\n", argv[optind-1]);
+                return -1;
+        }
+    }
+
+    // Combinations That Can't Work: rejected here, before the logs of the last run are truncated
+    if(opts->cache_file && opts->cache_ttl == 0)
+    {
+        fprintf(stderr, "--cache-file needs a --cache-ttl above 0.\n");
+        return -1;
+    }
+    if(opts->cache_file && opts->all_addrs)         // a table slot holds one address, a warm run would log fewer
+    {
+        fprintf(stderr, "--cache-file keeps one address per name and can't be combined with --all-addrs.\n");
+        return -1;
+    }
+    if((opts->stream || opts->serve) && (opts->mmap || (opts->stream && opts->serve)))
+    {
+        fprintf(stderr, "--stream & --serve can't be combined with each other or --mmap.\n");
+        return -1;
+    }
+    if(opts->affinity != AFFINITY_NONE && opts->serve)
+    {
+        fprintf(stderr, "--affinity can't be combined with --serve.\n");
+        return -1;
+    }
+    if(opts->resume && !opts->checkpoint)
+    {
+        fprintf(stderr, "--resume needs the --checkpoint of the run to continue.\n");
+        return -1;
+    }
+
+    // Cache Limit: data files bound the names a batch run sees, remote clients & streams don't
+    if(opts->cache_max < 0)
+        opts->cache_max = opts->serve || opts->stream ? DEFAULT_CACHE_MAX : 0;
+
+    // Nameserver: only the async engine sends to one, the others never read resolv.conf here
+    if(strcmp(opts->backend->name, "async") == 0 &&
+       dnsasync_parse_server(opts->nameserver, &opts->server, &opts->serverlen) != 0)
+    {
+        fprintf(stderr, "Invalid nameserver \"%s\".\n", opts->nameserver ? opts->nameserver : "(resolv.conf)");
+        return -1;
+    }
+    return optind;
+}
+
+/* Prints the option summary after the usage line */
+void options_usage(FILE* out)
+{
+    fprintf(out, "options:\n");
+    fprintf(out, "  --queue-size=N        shared buffer slots, rounded up to a power of two (default %d)\n", DEFAULT_QUEUE_SIZE);
+    fprintf(out, "  --batch=N             names moved per queue operation by requesters & resolvers (default %d)\n", DEFAULT_BATCH);
+    fprintf(out, "  --linger=MS           longest a partly filled requester batch waits before it is queued (default %d)\n", DEFAULT_LINGER);
+    fprintf(out, "  --cache-ttl=SECONDS   keep answers cached this long, 0 disables the cache (default %d)\n", DEFAULT_CACHE_TTL);
+    fprintf(out, "  --cache-file=PATH     keep answers across runs in PATH (+ PATH.log), each valid for --cache-ttl\n");
+    fprintf(out, "  --cache-max=N         names cached before older ones are evicted, 0: no limit (default %d with --serve/--stream, else 0)\n", DEFAULT_CACHE_MAX);
+    fprintf(out, "  --engine=NAME         lookup engine: %s (default getaddrinfo)\n", backend_names());
+    fprintf(out, "  --nameserver=IP[:PORT] upstream for the async engine (default: first usable in /etc/resolv.conf)\n");
+    fprintf(out, "  --async-inflight=N    outstanding async queries per resolver (default %d)\n", DEFAULT_ASYNC_INFLIGHT);
+    fprintf(out, "  --dns-timeout=MS      async timeout per attempt (default %d)\n", DEFAULT_DNS_TIMEOUT_MS);
+    fprintf(out, "  --dns-retries=N       async retransmissions before NOT_RESOLVED (default %d)\n", DEFAULT_DNS_RETRIES);
+    fprintf(out, "  --hedge=PERCENTILE    race a second attempt for lookups slower than this percentile of recent ones\n");
+    fprintf(out, "                        (default 0: never)\n");
+    fprintf(out, "  --deadline=MS         give up on a lookup after MS & log it as TIMEOUT (default 0: never)\n");
+    fprintf(out, "  --family=FAMILY       addresses to look up: any (default), 4 or 6\n");
+    fprintf(out, "  --all-addrs           log every distinct address (up to %d, comma separated) instead of the first\n", LOOKUP_MAX_ADDRS);
+    fprintf(out, "  --synth-latency=SPEC  synthetic delay: fixed:MS, uniform:MIN:MAX or lognormal:MEDIAN:SIGMA (default fixed:0)\n");
+    fprintf(out, "  --synth-fail=RATE     fraction of names the synthetic engine fails, 0 to 1 (default 0)\n");
+    fprintf(out, "  --synth-inflight=N    synthetic lookups pending per resolver (default %d)\n", DEFAULT_SYNTH_INFLIGHT);
+    fprintf(out, "  --synth-seed=N        synthetic latency seed (default 0)\n");
+    fprintf(out, "  --log-buffer=BYTES    per-thread log buffer flushed with one write() (default %d)\n", DEFAULT_LOG_BUFFER);
+    fprintf(out, "  --log-format=FMT      resolver log as text lines (default) or binary: packed records + hostname index\n");
+    fprintf(out, "  --read-log=FILE       print a binary resolver log as text (only the hostnames given, if any) & exit\n");
+    fprintf(out, "  --mmap                map the input files & let every requester claim newline-aligned chunks\n");
+    fprintf(out, "  --chunk-size=BYTES    nominal chunk size with --mmap & the size files are split to for stealing (default %d)\n", DEFAULT_CHUNK_SIZE);
+    fprintf(out, "  --max-resolvers=N     adaptive pool: start num_resolvers & grow/shrink between it and N (up to %d)\n", MAX_POOL_RESOLVERS);
+    fprintf(out, "  --scale-interval=MS   time between adaptive pool decisions (default %d)\n", DEFAULT_SCALE_INTERVAL);
+    fprintf(out, "  --stream=SOURCE       read names until EOF or SIGTERM from - (stdin), a FIFO path or unix:PATH\n");
+    fprintf(out, "                        instead of data files; a log named - is stdout\n");
+    fprintf(out, "  --serve=[ADDR:]PORT   answer DNS queries over UDP (a bare PORT listens on 127.0.0.1);\n");
+    fprintf(out, "                        num_requestors is the number of SO_REUSEPORT sockets\n");
+    fprintf(out, "  --server-batch=N      datagrams per recvmmsg()/sendmmsg() (default %d)\n", DEFAULT_SERVER_BATCH);
+    fprintf(out, "  --metrics=FILE        write stage latency percentiles, throughput & queue depth to FILE (- is stdout)\n");
+    fprintf(out, "  --metrics-format=FMT  json (one object per report, default) or prometheus\n");
+    fprintf(out, "  --metrics-interval=S  also report every S seconds while running (default 0: only at exit)\n");
+    fprintf(out, "  --checkpoint=FILE     record each input file's progress & the logged results in FILE while running\n");
+    fprintf(out, "  --checkpoint-interval=S  seconds between checkpoints (default %d)\n", DEFAULT_CHECKPOINT_INTERVAL);
+    fprintf(out, "  --resume              continue the run --checkpoint describes, appending to its logs\n");
+    fprintf(out, "  --affinity=MODE       none (default), node: a queue lane per NUMA node with its threads kept on it,\n");
+    fprintf(out, "                        or core: a lane per group of cores with every thread pinned to one core\n");
+    fprintf(out, "  --io=MODE             auto (default): read data files & write logs through io_uring when the kernel\n");
+    fprintf(out, "                        has it, uring: the same but refuse to run without it, sync: read()/write()\n");
+}
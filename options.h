@@ -0,0 +1,85 @@
+// Connor Humiston
+// Command Line Options Header
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <stdio.h>                                  // standard i/o
+
+#include "dnsasync.h"                               // async engine defaults
+#include "backend.h"                                // resolver backends
+#include "synthetic.h"                              // synthetic backend settings
+#include "logwriter.h"                              // log buffer sizes
+#include "ingest.h"                                 // chunk sizes
+#include "respool.h"                                // resolver pool bounds
+#include "stream.h"                                 // streaming sources
+#include "server.h"                                 // server batch sizes
+#include "metrics.h"                                // report formats
+#include "hedge.h"                                  // hedge & deadline bounds
+#include "resfile.h"                                // resolver log formats
+#include "checkpoint.h"                             // checkpoint intervals
+#include "topology.h"                               // affinity modes
+#include "uring.h"                                  // I/O modes
+
+#define DEFAULT_QUEUE_SIZE      16                  // slots in the shared buffer (power of two)
+#define MAX_QUEUE_SIZE          (1 << 20)           // upper bound on --queue-size
+#define DEFAULT_CACHE_TTL       300                 // seconds a cached answer stays valid
+#define MAX_CACHE_TTL           (7 * 24 * 3600)     // upper bound on --cache-ttl (a week)
+#define DEFAULT_CACHE_MAX       (1 << 20)           // names cached by --serve & --stream, whose input never ends
+#define MAX_CACHE_MAX           (1L << 30)          // upper bound on --cache-max
+
+
+/* Optional Settings Given Before/Between the Positional Arguments */
+typedef struct Options
+{
+    size_t queue_size;                              // capacity of the shared buffer
+    int batch;                                      // names per push_many/pop_many
+    int linger;                                     // ms a partial requester batch may be held back
+    int cache_ttl;                                  // seconds answers stay cached, 0 disables the cache
+    const char* cache_file;                         // persistent table answers are kept in across runs (NULL: none)
+    long cache_max;                                 // names kept in the cache before older ones are evicted (0: no limit)
+    const Backend* backend;                         // lookup engine used by every resolver
+    const char* nameserver;                         // upstream for the async engine (NULL: resolv.conf)
+    struct sockaddr_storage server;                 // nameserver parsed into an address
+    socklen_t serverlen;
+    int async_inflight;                             // outstanding async queries per resolver thread
+    int dns_timeout_ms;                             // async per attempt timeout
+    int dns_retries;                                // async retransmissions
+    int hedge;                                      // percentile of recent latency after which a lookup is raced, 0: never
+    int deadline;                                   // ms after which a lookup gives up as TIMEOUT, 0: never
+    int family;                                     // AF_UNSPEC, AF_INET or AF_INET6 addresses wanted
+    int all_addrs;                                  // 1 to keep every distinct address, 0 for only the first
+    SynthLatency synth_latency;                     // synthetic latency model
+    double synth_fail;                              // fraction of names the synthetic backend fails
+    int synth_inflight;                             // synthetic lookups pending per resolver thread
+    unsigned synth_seed;                            // synthetic latency stream seed
+    size_t log_buffer;                              // bytes each thread buffers per log before a write()
+    int log_format;                                 // LOG_TEXT or LOG_BINARY resolver log
+    const char* read_log;                           // binary resolver log to print as text instead of running (NULL: run)
+    int mmap;                                       // 1 to map the inputs & hand out zero-copy slices
+    size_t chunk_size;                              // nominal bytes per claimable chunk in mmap mode
+    int max_resolvers;                              // > 0 lets the pool grow from num_resolvers up to this
+    int scale_interval;                             // ms between resolver pool decisions
+    const char* stream;                             // "-", a FIFO path or unix:PATH to read instead of data files
+    const char* serve;                              // PORT or ADDR:PORT to answer DNS queries on (NULL: batch client)
+    struct sockaddr_storage listen;                 // serve parsed into an address
+    socklen_t listenlen;
+    int server_batch;                               // datagrams per recvmmsg()/sendmmsg()
+    const char* metrics;                            // report file ("-" is stdout, NULL disables metrics)
+    int metrics_format;                             // METRICS_JSON or METRICS_PROMETHEUS
+    int metrics_interval;                           // seconds between reports, 0 for only at exit
+    const char* checkpoint;                         // file progress is checkpointed to (NULL: none)
+    int checkpoint_interval;                        // seconds between checkpoints
+    int resume;                                     // 1 to continue the run the checkpoint describes
+    int affinity;                                   // AFFINITY_NONE, AFFINITY_NODE or AFFINITY_CORE
+    int io;                                         // IO_AUTO until main picks IO_URING or IO_SYNC
+} Options;
+
+
+/* Fills opts with defaults then parses --options, returns index of first positional or -1 on error */
+int options_parse(Options* opts, int argc, char* argv[]);
+
+/* Prints the option summary after the usage line */
+void options_usage(FILE* out);
+
+#endif
@@ -0,0 +1,364 @@
+// Connor Humiston
+// Shared Queue Implementation
+#include "queue.h"
+
+#include <limits.h>                                 // INT_MAX for broadcast wakeups
+#include <string.h>                                 // memset()
+#include <unistd.h>                                 // syscall()
+#include <sys/syscall.h>                            // SYS_futex
+#include <linux/futex.h>                            // FUTEX_WAIT/WAKE operations
+
+static __thread int buffer_lane;                    // lane this thread pushes to & pops from first
+
+
+/* Pause instruction hint while spinning on the ring */
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/* Sleeps while *addr still equals val (spurious returns are fine, callers loop) */
+static void futex_wait(uint32_t* addr, uint32_t val)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+/* Wakes up to n threads sleeping on addr */
+static void futex_wake(uint32_t* addr, int n)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+/* Wakes up to n sleepers if anybody registered on the wait point (no syscall otherwise) */
+static void waitpoint_signal(WaitPoint* wp, size_t n)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);        // order the slot publish before reading waiters
+    if(__atomic_load_n(&wp->waiters, __ATOMIC_RELAXED) == 0)
+        return;
+    __atomic_fetch_add(&wp->seq, 1, __ATOMIC_RELEASE);
+    futex_wake(&wp->seq, n < INT_MAX ? (int) n : INT_MAX); // n items need at most n threads, not all
+}
+
+/* Allocates a buffer with capacity rounded up to a power of two, NULL on failure */
+Buffer* buffer_create(size_t size)
+{
+    Buffer* buff;                                   // new ring
+    size_t cap = 2;                                 // power of two capacity (at least 2 slots)
+    size_t i;
+
+    while(cap < size)                               // round the requested size up
+        cap <<= 1;
+    if(posix_memalign((void**) &buff, CACHE_LINE, sizeof(*buff) + sizeof(Slot) * cap) != 0)
+        return NULL;
+    buff->size = cap;
+    buff->mask = cap - 1;
+    buff->nlanes = 0;
+    buff->lanes = NULL;
+    buff->head = 0;                                 // producers and consumers both start at 0
+    buff->tail = 0;
+    buff->notempty.seq = buff->notempty.waiters = 0;
+    buff->notfull.seq = buff->notfull.waiters = 0;
+    buff->reqsdone = 0;                             // requesters not done at init
+    for(i = 0; i < cap; i++)
+    {
+        buff->arr[i].seq = i;                       // every slot is free for its first lap
+        buff->arr[i].data.str = NULL;
+    }
+    return buff;
+}
+
+/* Allocates nlanes rings sharing size between them, NULL on failure */
+Buffer* buffer_create_lanes(size_t size, int nlanes)
+{
+    Buffer* buff;
+    int i;
+    if(posix_memalign((void**) &buff, CACHE_LINE, sizeof(*buff)) != 0)
+        return NULL;
+    memset(buff, 0, sizeof(*buff));
+    if(!(buff->lanes = calloc(nlanes, sizeof(Buffer*))))
+    {
+        free(buff);
+        return NULL;
+    }
+    buff->nlanes = nlanes;
+    for(i = 0; i < nlanes; i++)                     // each ring on its own lines, none shared between lanes
+    {
+        if(!(buff->lanes[i] = buffer_create((size + nlanes - 1) / nlanes)))
+        {
+            buffer_destroy(buff);
+            return NULL;
+        }
+        buff->size += buff->lanes[i]->size;
+    }
+    return buff;
+}
+
+/* Makes lane the calling thread's own (threads that never join one use lane 0) */
+void buffer_join_lane(Buffer* buff, int lane)
+{
+    buffer_lane = buff->nlanes > 0 ? lane % buff->nlanes : 0;
+}
+
+/* Frees the buffer (any items still inside are not freed) */
+void buffer_destroy(Buffer* buff)
+{
+    int i;
+    for(i = 0; i < buff->nlanes; i++)
+        free(buff->lanes[i]);
+    free(buff->lanes);
+    free(buff);
+}
+
+/* The ring the calling thread pushes to, sleeps on & pops from first */
+static inline Buffer* own_lane(Buffer* buff)
+{
+    return buff->nlanes > 0 ? buff->lanes[buffer_lane] : buff;
+}
+
+/* Claims up to n consecutive free slots with one CAS & publishes items into them, returns # pushed (0 if full) */
+static size_t ring_push_many(Buffer* buff, const Name* items, size_t n)
+{
+    size_t pos = __atomic_load_n(&buff->head, __ATOMIC_RELAXED);
+    size_t k, i;
+    while(1)
+    {
+        for(k = 0; k < n; k++)                      // free slots for this lap from pos on (a wrap stops it at size)
+        {
+            if(__atomic_load_n(&buff->arr[(pos + k) & buff->mask].seq, __ATOMIC_ACQUIRE) != pos + k)
+                break;
+        }
+        if(k > 0)
+        {
+            if(__atomic_compare_exchange_n(&buff->head, &pos, pos + k, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;                              // pos is refreshed on failure
+            continue;
+        }
+        size_t seq = __atomic_load_n(&buff->arr[pos & buff->mask].seq, __ATOMIC_ACQUIRE);
+        if((intptr_t) seq - (intptr_t) pos < 0)     // consumer has not emptied the slot from the last lap
+            return 0;
+        pos = __atomic_load_n(&buff->head, __ATOMIC_RELAXED); // another producer took pos, catch up
+    }
+    for(i = 0; i < k; i++)
+    {
+        Slot* slot = &buff->arr[(pos + i) & buff->mask];
+        slot->data = items[i];
+        __atomic_store_n(&slot->seq, pos + i + 1, __ATOMIC_RELEASE); // publish to consumers
+    }
+    return k;
+}
+
+/* Claims up to max consecutive filled slots with one CAS & copies them out, returns # popped (0 if empty) */
+static size_t ring_pop_many(Buffer* buff, Name* items, size_t max)
+{
+    size_t pos = __atomic_load_n(&buff->tail, __ATOMIC_RELAXED);
+    size_t k, i;
+    while(1)
+    {
+        for(k = 0; k < max; k++)                    // slots holding the items for pos on
+        {
+            if(__atomic_load_n(&buff->arr[(pos + k) & buff->mask].seq, __ATOMIC_ACQUIRE) != pos + k + 1)
+                break;
+        }
+        if(k > 0)
+        {
+            if(__atomic_compare_exchange_n(&buff->tail, &pos, pos + k, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+            continue;
+        }
+        size_t seq = __atomic_load_n(&buff->arr[pos & buff->mask].seq, __ATOMIC_ACQUIRE);
+        if((intptr_t) seq - (intptr_t) (pos + 1) < 0) // producer has not filled this slot yet
+            return 0;
+        pos = __atomic_load_n(&buff->tail, __ATOMIC_RELAXED);
+    }
+    for(i = 0; i < k; i++)
+    {
+        Slot* slot = &buff->arr[(pos + i) & buff->mask];
+        items[i] = slot->data;
+        __atomic_store_n(&slot->seq, pos + i + buff->mask + 1, __ATOMIC_RELEASE); // free the slot for the next lap
+    }
+    return k;
+}
+
+/* Pops from the own ring, else steals from the other lanes in turn; tells producers of the ring it took from
+ * there is room & returns # popped (0 if everything was empty) */
+static size_t ring_take(Buffer* buff, Buffer* own, Name* items, size_t max)
+{
+    size_t k = ring_pop_many(own, items, max);
+    int i;
+    for(i = 1; k == 0 && i < buff->nlanes; i++)     // own lane ran dry: balance by stealing
+    {
+        own = buff->lanes[(buffer_lane + i) % buff->nlanes];
+        k = ring_pop_many(own, items, max);
+    }
+    if(k > 0)
+        waitpoint_signal(&own->notfull, k);         // producers may be sleeping on the full ring
+    return k;
+}
+
+/* Own lane more than half full: wakes one consumer asleep on another lane so it comes to steal */
+static void lane_nudge(Buffer* buff, Buffer* own)
+{
+    int i;
+    if(buff->nlanes == 0 || buffer_count(own) <= own->size / 2)
+        return;
+    for(i = 1; i < buff->nlanes; i++)
+    {
+        Buffer* other = buff->lanes[(buffer_lane + i) % buff->nlanes];
+        if(__atomic_load_n(&other->notempty.waiters, __ATOMIC_RELAXED) > 0)
+        {
+            waitpoint_signal(&other->notempty, 1);
+            return;
+        }
+    }
+}
+
+/* Pushes without blocking, returns 0 on success or -1 if the buffer is full */
+int buffer_trypush(Buffer* buff, const Name* item)
+{
+    Buffer* own = own_lane(buff);
+    if(ring_push_many(own, item, 1) != 1)
+        return -1;
+    waitpoint_signal(&own->notempty, 1);
+    lane_nudge(buff, own);
+    return 0;
+}
+
+/* Pops without blocking, returns 0 on success or -1 if the buffer is empty */
+int buffer_trypop(Buffer* buff, Name* item)
+{
+    return buffer_trypop_many(buff, item, 1) == 1 ? 0 : -1;
+}
+
+/* Pops up to max items without blocking, returns # popped (0 if the buffer is empty) */
+size_t buffer_trypop_many(Buffer* buff, Name* items, size_t max)
+{
+    return ring_take(buff, own_lane(buff), items, max);
+}
+
+/* Pushes an item, sleeping only while the buffer is full */
+void buffer_push(Buffer* buff, const Name* item)
+{
+    buffer_push_many(buff, item, 1);
+}
+
+/* Pushes n items in order, as many per CAS as there is room for, sleeping only while the buffer is full */
+void buffer_push_many(Buffer* buff, const Name* items, size_t n)
+{
+    Buffer* group = buff;
+    int spins = 0;
+    buff = own_lane(buff);                          // from here on only the thread's own ring
+    while(n > 0)
+    {
+        size_t k = ring_push_many(buff, items, n);
+        if(k == 0 && spins < BUFFER_SPINS)          // the ring rarely stays full for long
+        {
+            spins++;
+            cpu_relax();
+            continue;
+        }
+        if(k == 0)
+        {
+            uint32_t epoch = __atomic_load_n(&buff->notfull.seq, __ATOMIC_ACQUIRE);
+            __atomic_fetch_add(&buff->notfull.waiters, 1, __ATOMIC_SEQ_CST); // register before the final check
+            k = ring_push_many(buff, items, n);
+            if(k == 0)
+                futex_wait(&buff->notfull.seq, epoch); // returns at once if a consumer bumped seq meanwhile
+            __atomic_fetch_sub(&buff->notfull.waiters, 1, __ATOMIC_RELAXED);
+            if(k == 0)
+                continue;
+        }
+        waitpoint_signal(&buff->notempty, k);       // one sleeping consumer per item at most
+        lane_nudge(group, buff);
+        items += k;
+        n -= k;
+        spins = 0;
+    }
+}
+
+/* Pops the oldest item, sleeping while empty; returns 0 or -1 once empty & closed */
+int buffer_pop(Buffer* buff, Name* item)
+{
+    return buffer_pop_cancel(buff, item, NULL);
+}
+
+/* Like buffer_pop but also gives up (-2) once *cancel is set & buffer_wake() is called */
+int buffer_pop_cancel(Buffer* buff, Name* item, const int* cancel)
+{
+    int n = buffer_pop_many(buff, item, 1, cancel);
+    return n > 0 ? 0 : n;
+}
+
+/* Pops up to max of the oldest items at once, sleeping while empty; returns # popped, -1 once empty & closed
+ * or -2 once *cancel is set (cancel may be NULL) */
+int buffer_pop_many(Buffer* buff, Name* items, size_t max, const int* cancel)
+{
+    Buffer* own = own_lane(buff);                   // sleeps on its own lane, steals from the others when awake
+    size_t k;
+    int i;
+    for(i = 0; i < BUFFER_SPINS; i++)
+    {
+        if((k = ring_take(buff, own, items, max)) > 0)
+            return (int) k;
+        if(__atomic_load_n(&own->reqsdone, __ATOMIC_ACQUIRE))
+            break;                                  // no point spinning once requesters are done
+        cpu_relax();
+    }
+    while(1)
+    {
+        uint32_t epoch = __atomic_load_n(&own->notempty.seq, __ATOMIC_ACQUIRE);
+        __atomic_fetch_add(&own->notempty.waiters, 1, __ATOMIC_SEQ_CST);
+        if((k = ring_take(buff, own, items, max)) > 0) // tells sleeping producers there is room
+        {
+            __atomic_fetch_sub(&own->notempty.waiters, 1, __ATOMIC_RELAXED);
+            return (int) k;
+        }
+        if(__atomic_load_n(&own->reqsdone, __ATOMIC_ACQUIRE)) // empty & requesters done, we are done!
+        {
+            __atomic_fetch_sub(&own->notempty.waiters, 1, __ATOMIC_RELAXED);
+            return -1;
+        }
+        if(cancel && __atomic_load_n(cancel, __ATOMIC_ACQUIRE)) // this consumer was asked to stop
+        {
+            __atomic_fetch_sub(&own->notempty.waiters, 1, __ATOMIC_RELAXED);
+            return -2;
+        }
+        futex_wait(&own->notempty.seq, epoch);
+        __atomic_fetch_sub(&own->notempty.waiters, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/* Marks the requesters as done and wakes every sleeping consumer */
+void buffer_close(Buffer* buff)
+{
+    int i;
+    for(i = 0; i < buff->nlanes; i++)               // every lane first, so a woken consumer finds them all closed
+        __atomic_store_n(&buff->lanes[i]->reqsdone, 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&buff->reqsdone, 1, __ATOMIC_SEQ_CST);
+    buffer_wake(buff);                              // every consumer must see the shutdown
+}
+
+/* Wakes every sleeping consumer so it rechecks its cancel flag */
+void buffer_wake(Buffer* buff)
+{
+    int i;
+    for(i = 0; i < buff->nlanes; i++)
+        buffer_wake(buff->lanes[i]);
+    __atomic_fetch_add(&buff->notempty.seq, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&buff->notempty.seq, INT_MAX);
+}
+
+/* Approximate number of items currently queued */
+size_t buffer_count(Buffer* buff)
+{
+    size_t head, tail, n = 0;
+    int i;
+    for(i = 0; i < buff->nlanes; i++)
+        n += buffer_count(buff->lanes[i]);
+    if(buff->nlanes > 0)
+        return n;
+    head = __atomic_load_n(&buff->head, __ATOMIC_RELAXED);
+    tail = __atomic_load_n(&buff->tail, __ATOMIC_RELAXED);
+    return head > tail ? head - tail : 0;
+}
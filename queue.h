@@ -0,0 +1,105 @@
+// Connor Humiston
+// Shared Queue Header
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <stdint.h>                                 // fixed width integer types
+
+#define CACHE_LINE              64                  // bytes per cache line (keeps hot fields apart)
+#define BUFFER_SPINS            64                  // attempts before a thread sleeps on the futex
+#define DEFAULT_BATCH           16                  // names moved per queue operation
+#define MAX_BATCH               1024
+#define DEFAULT_LINGER          5                   // ms a partly filled requester batch may wait before it is pushed
+#define MAX_LINGER              10000
+
+
+/* Queued Hostname: a slice that is either heap owned or points into a mapped input file */
+typedef struct Name
+{
+    const char* str;                                // first character (not necessarily null terminated)
+    uint32_t len;                                   // characters in the name
+    uint32_t flags;                                 // NAME_POOLED when the consumer must slab_free(str)
+    uint64_t hash;                                  // cache hash of the already normalized str, 0 if not computed
+} Name;
+
+#define NAME_POOLED             1                   // str is a slot from the requester's slab cache
+
+/* Futex-backed Wait Point: threads sleep on seq, wakers bump it only if someone is waiting */
+typedef struct WaitPoint
+{
+    uint32_t seq;                                   // futex word, incremented on every wakeup
+    uint32_t waiters;                               // number of threads about to sleep or sleeping
+} __attribute__((aligned(CACHE_LINE))) WaitPoint;
+
+/* Ring Slot: sequence number tells producers & consumers whose turn the slot is */
+typedef struct Slot
+{
+    size_t seq;                                     // == pos when free, == pos+1 when holding an item
+    Name data;                                      // hostname stored in the slot
+} Slot;
+
+/* Shared Buffer: bounded lock-free multi-producer/multi-consumer FIFO ring, or a set of lanes (one ring each)
+ * that threads push to & pop from their own lane of, stealing from the others only when theirs runs dry */
+typedef struct Buffer
+{
+    size_t size;                                    // total buffer size (power of two per ring)
+    size_t mask;                                    // size - 1, maps positions onto slots
+    int nlanes;                                     // > 0: the rings are lanes[], this one has no slots
+    struct Buffer** lanes;
+    size_t head __attribute__((aligned(CACHE_LINE))); // next position to push into (producers)
+    size_t tail __attribute__((aligned(CACHE_LINE))); // next position to pop from (consumers)
+    WaitPoint notempty;                             // consumers sleep here when the ring is empty
+    WaitPoint notfull;                              // producers sleep here when the ring is full
+    int reqsdone __attribute__((aligned(CACHE_LINE))); // indicates when the requester threads are finished
+    Slot arr[] __attribute__((aligned(CACHE_LINE))); // shared buffer array
+} Buffer;
+
+
+/* Allocates a buffer with capacity rounded up to a power of two, NULL on failure */
+Buffer* buffer_create(size_t size);
+
+/* Allocates nlanes rings sharing size between them, NULL on failure */
+Buffer* buffer_create_lanes(size_t size, int nlanes);
+
+/* Makes lane the calling thread's own (threads that never join one use lane 0) */
+void buffer_join_lane(Buffer* buff, int lane);
+
+/* Frees the buffer (any items still inside are not freed) */
+void buffer_destroy(Buffer* buff);
+
+/* Pushes without blocking, returns 0 on success or -1 if the buffer is full */
+int buffer_trypush(Buffer* buff, const Name* item);
+
+/* Pops without blocking, returns 0 on success or -1 if the buffer is empty */
+int buffer_trypop(Buffer* buff, Name* item);
+
+/* Pops up to max items without blocking, returns # popped (0 if the buffer is empty) */
+size_t buffer_trypop_many(Buffer* buff, Name* items, size_t max);
+
+/* Pushes an item, sleeping only while the buffer is full */
+void buffer_push(Buffer* buff, const Name* item);
+
+/* Pushes n items in order, as many per CAS as there is room for, sleeping only while the buffer is full */
+void buffer_push_many(Buffer* buff, const Name* items, size_t n);
+
+/* Pops the oldest item, sleeping while empty; returns 0 or -1 once empty & closed */
+int buffer_pop(Buffer* buff, Name* item);
+
+/* Like buffer_pop but also gives up (-2) once *cancel is set & buffer_wake() is called */
+int buffer_pop_cancel(Buffer* buff, Name* item, const int* cancel);
+
+/* Pops up to max of the oldest items at once, sleeping while empty; returns # popped, -1 once empty & closed
+ * or -2 once *cancel is set (cancel may be NULL) */
+int buffer_pop_many(Buffer* buff, Name* items, size_t max, const int* cancel);
+
+/* Wakes every sleeping consumer so it rechecks its cancel flag */
+void buffer_wake(Buffer* buff);
+
+/* Marks the requesters as done and wakes every sleeping consumer */
+void buffer_close(Buffer* buff);
+
+/* Approximate number of items currently queued */
+size_t buffer_count(Buffer* buff);
+
+#endif
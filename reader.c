@@ -0,0 +1,243 @@
+// Connor Humiston
+// Read-Ahead Line Reader Implementation
+#include "reader.h"
+
+#include <stdio.h>                                  // error messages
+#include <string.h>                                 // memchr(), memcpy()
+#include <errno.h>                                  // EINTR
+#include <fcntl.h>                                  // open()
+#include <unistd.h>                                 // pread(), close()
+#include <sys/stat.h>                               // fstat()
+
+
+/* Allocates the blocks & sets up a ring when io is IO_URING (falling back to pread()), returns 0 or -1 */
+int reader_init(Reader* r, int io)
+{
+    struct iovec iov[READER_DEPTH];
+    int i;
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+    r->ring.fd = -1;
+    if(posix_memalign((void**) &r->mem, 4096, (size_t) READER_DEPTH * READER_BLOCK) != 0)
+        return -1;
+    r->io = IO_SYNC;
+    if(io == IO_URING && uring_init(&r->ring, READER_DEPTH) == 0)
+    {
+        r->io = IO_URING;
+        for(i = 0; i < READER_DEPTH; i++)
+        {
+            iov[i].iov_base = r->mem + (size_t) i * READER_BLOCK;
+            iov[i].iov_len = READER_BLOCK;
+        }
+        uring_register(&r->ring, iov, READER_DEPTH); // pinned once, so the kernel doesn't map them per read
+    }
+    return 0;
+}
+
+/* Reads whatever part of the block a short read left out, ends it early at the end of the file */
+static void block_complete(Reader* r, ReadBlock* b, char* buf)
+{
+    while(b->got >= 0 && (size_t) b->got < b->len)
+    {
+        ssize_t n = pread(r->fd, buf + b->got, b->len - b->got, b->off + b->got);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)                                  // the file shrank, or an error reported by the caller
+        {
+            if(n < 0)
+                b->got = -1;
+            break;
+        }
+        b->got += n;
+    }
+}
+
+/* Issues reads for the next blocks: as many as fit ahead of end with io_uring, one when empty with pread() */
+static void reader_fill(Reader* r)
+{
+    while(r->count < READER_DEPTH && r->next < r->size && (r->next < r->end || r->count == 0) &&
+          (r->io == IO_URING || r->count == 0))
+    {
+        int idx = (r->first + r->count) % READER_DEPTH;
+        ReadBlock* b = &r->blocks[idx];
+        char* buf = r->mem + (size_t) idx * READER_BLOCK;
+        b->off = r->next;
+        b->len = r->size - r->next < READER_BLOCK ? (size_t) (r->size - r->next) : READER_BLOCK;
+        b->got = -1;
+        if(r->io == IO_URING)
+        {
+            if(uring_prep(&r->ring, 0, r->fd, buf, (unsigned) b->len, b->off, idx, (uint64_t) idx) != 0)
+                break;
+            r->inflight++;
+        }
+        else
+        {
+            b->got = 0;
+            block_complete(r, b, buf);
+        }
+        r->next += b->len;
+        r->count++;
+    }
+}
+
+/* Takes one finished read off the ring (waiting for it when wait is set), returns 1 or 0 */
+static int reader_reap(Reader* r, int wait)
+{
+    uint64_t idx;
+    int res;
+    if(!uring_reap(&r->ring, &idx, &res, wait))
+        return 0;
+    r->inflight--;
+    r->blocks[idx].got = res < 0 ? -1 : res;
+    if(res >= 0)
+        block_complete(r, &r->blocks[idx], r->mem + (size_t) idx * READER_BLOCK);
+    else
+        r->blocks[idx].len = 0;                     // marks the error for reader_advance()
+    return 1;
+}
+
+/* Makes p point at an unread byte, moving on to the next block (& reading more) as needed; returns 0 or -1
+ * at the end of the file or on a read error */
+static int reader_advance(Reader* r)
+{
+    while(r->p == r->stop)
+    {
+        ReadBlock* b;
+        if(r->failed)
+            return -1;
+        if(r->p)                                    // first block used up: its buffer takes the next read
+        {
+            r->first = (r->first + 1) % READER_DEPTH;
+            r->count--;
+            r->p = r->stop = NULL;
+        }
+        reader_fill(r);
+        if(r->count == 0)
+            return -1;
+        b = &r->blocks[r->first];
+        if(r->io == IO_URING)
+        {
+            if(uring_submit(&r->ring, b->got < 0 ? 1 : 0) != 0) // submit the read-ahead & wait, one system call
+            {
+                fprintf(stderr, "Unable to read %s: io_uring submission failed.\n", r->name);
+                r->failed = 1;
+                return -1;
+            }
+            while(reader_reap(r, 0))                // everything already done, without a system call
+                ;
+            while(b->got < 0 && b->len > 0 && reader_reap(r, 1))
+                ;
+        }
+        if(b->got < 0)
+        {
+            fprintf(stderr, "Unable to read %s.\n", r->name);
+            r->failed = 1;
+            return -1;
+        }
+        r->p = r->mem + (size_t) r->first * READER_BLOCK;
+        r->stop = r->p + b->got;                    // an empty block (file shrank) is skipped by the loop
+    }
+    return 0;
+}
+
+/* Starts reading name at start, reading ahead up to end; returns 0 or -1 if the file can't be opened */
+int reader_start(Reader* r, const char* name, off_t start, off_t end)
+{
+    struct stat st;
+    if(r->name != name)                             // ranges of the same file share the descriptor
+    {
+        if(r->fd >= 0)
+            close(r->fd);
+        r->name = NULL;
+        if((r->fd = open(name, O_RDONLY | O_CLOEXEC)) < 0)
+            return -1;
+        if(fstat(r->fd, &st) != 0)
+        {
+            close(r->fd);
+            r->fd = -1;
+            return -1;
+        }
+        r->name = name;
+        r->size = st.st_size;
+    }
+    r->first = r->count = 0;
+    r->failed = 0;
+    r->next = r->pos = start;
+    r->end = end;
+    r->p = r->stop = NULL;
+    reader_fill(r);                                 // queued now, submitted with the first wait
+    return 0;
+}
+
+/* Copies the next line like fgets(out, max): at most max - 1 bytes, '\n' included if it fits, null terminated;
+ * the rest of a longer line is dropped & *cut tells if it held more than '\r'. Returns the length or -1 at the end */
+int reader_line(Reader* r, char* out, size_t max, int* cut)
+{
+    size_t n = 0;
+    *cut = 0;
+    while(n < max - 1 && reader_advance(r) == 0)
+    {
+        size_t take = (size_t) (r->stop - r->p);
+        const char* nl;
+        if(take > max - 1 - n)
+            take = max - 1 - n;
+        if((nl = memchr(r->p, '\n', take)))
+            take = (size_t) (nl - r->p) + 1;
+        memcpy(out + n, r->p, take);
+        n += take;
+        r->p += take;
+        r->pos += take;
+        if(nl)
+            break;
+    }
+    if(n == 0)
+        return -1;
+    out[n] = '\0';
+    if(n == max - 1 && out[n-1] != '\n')           // slot full: drop the rest of the line with it
+        *cut = reader_skip(r);
+    return (int) n;
+}
+
+/* Drops the rest of the current line through its '\n', returns 1 if it held more than '\r' */
+int reader_skip(Reader* r)
+{
+    int cut = 0;
+    while(reader_advance(r) == 0)
+    {
+        const char* nl = memchr(r->p, '\n', (size_t) (r->stop - r->p));
+        const char* e = nl ? nl : r->stop;
+        const char* q;
+        for(q = r->p; q < e && !cut; q++)
+            cut = *q != '\r';                       // longer than any name can be
+        r->pos += (e - r->p) + (nl != NULL);
+        r->p = nl ? nl + 1 : e;
+        if(nl)
+            break;
+    }
+    return cut;
+}
+
+/* Waits for the range's reads still in flight (before another range or reader_destroy) */
+void reader_finish(Reader* r)
+{
+    if(r->io == IO_URING)
+    {
+        uring_submit(&r->ring, 0);                  // a read only queued still has to come back
+        while(r->inflight > 0 && reader_reap(r, 1))
+            ;
+    }
+    r->count = 0;
+    r->p = r->stop = NULL;
+}
+
+/* Closes the file & frees the blocks & ring */
+void reader_destroy(Reader* r)
+{
+    reader_finish(r);
+    if(r->io == IO_URING)
+        uring_exit(&r->ring);
+    if(r->fd >= 0)
+        close(r->fd);
+    free(r->mem);
+    r->mem = NULL;
+}
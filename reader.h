@@ -0,0 +1,64 @@
+// Connor Humiston
+// Read-Ahead Line Reader Header
+#ifndef READER_H
+#define READER_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <sys/types.h>                              // off_t, ssize_t
+
+#include "uring.h"                                  // asynchronous reads
+
+#define READER_BLOCK            (256 * 1024)        // bytes per read
+#define READER_DEPTH            4                   // reads kept in flight ahead of the requester (io_uring)
+
+
+/* One Read: a block-sized slice of the file */
+typedef struct ReadBlock
+{
+    off_t off;                                      // file offset of its first byte
+    size_t len;                                     // bytes asked for
+    ssize_t got;                                    // bytes read, -1 while in flight
+} ReadBlock;
+
+/* Per-Requester Reader: hands out lines of a byte range while the next blocks are already being read */
+typedef struct Reader
+{
+    int io;                                         // IO_URING or IO_SYNC (one pread() per block)
+    Uring ring;
+    char* mem;                                      // READER_DEPTH blocks of READER_BLOCK bytes (registered)
+    ReadBlock blocks[READER_DEPTH];                 // circular, oldest first
+    int first;                                      // block lines are taken from
+    int count;                                      // blocks issued, in flight or read
+    int inflight;                                   // reads submitted & not reaped
+    int failed;                                     // a read failed, the range ends there
+    const char* name;                               // file open in fd (NULL: none), kept across its ranges
+    int fd;
+    off_t size;                                     // its size when opened
+    off_t next;                                     // offset the next block is read from
+    off_t end;                                      // blocks are read ahead only below this, one at a time past it
+    off_t pos;                                      // file offset of the next byte handed out
+    const char* p;                                  // that byte in the first block
+    const char* stop;                               // end of the first block's data
+} Reader;
+
+
+/* Allocates the blocks & sets up a ring when io is IO_URING (falling back to pread()), returns 0 or -1 */
+int reader_init(Reader* r, int io);
+
+/* Starts reading name at start, reading ahead up to end; returns 0 or -1 if the file can't be opened */
+int reader_start(Reader* r, const char* name, off_t start, off_t end);
+
+/* Copies the next line like fgets(out, max): at most max - 1 bytes, '\n' included if it fits, null terminated;
+ * the rest of a longer line is dropped & *cut tells if it held more than '\r'. Returns the length or -1 at the end */
+int reader_line(Reader* r, char* out, size_t max, int* cut);
+
+/* Drops the rest of the current line through its '\n', returns 1 if it held more than '\r' */
+int reader_skip(Reader* r);
+
+/* Waits for the range's reads still in flight (before another range or reader_destroy) */
+void reader_finish(Reader* r);
+
+/* Closes the file & frees the blocks & ring */
+void reader_destroy(Reader* r);
+
+#endif
@@ -0,0 +1,364 @@
+// Connor Humiston
+// Binary Result File Implementation
+#include "resfile.h"
+
+#include <stddef.h>                                 // offsetof()
+#include <string.h>                                 // C string library
+#include <errno.h>                                  // EINTR
+#include <fcntl.h>                                  // open()
+#include <unistd.h>                                 // write(), close(), lseek()
+#include <sys/mman.h>                               // mmap()
+#include <sys/stat.h>                               // fstat()
+
+#include "util.h"                                   // UTIL_SUCCESS/UTIL_FAILURE
+#include "backend.h"                                // LOOKUP_TIMEOUT & LOOKUP_INVALID
+#include "cache.h"                                  // cache_normalize()
+
+#define RECORD_HEAD             offsetof(ResRecord, data)
+#define OFFSET_MASK             ((1ull << RESFILE_OFFSET_BITS) - 1)
+
+/* Address bytes stored in a record: 4 per IPv4 address, 16 per IPv6 one */
+static size_t addr_bytes(const ResRecord* r)
+{
+    return (size_t) r->naddrs * 4 + (size_t) __builtin_popcount(r->v6mask) * 12;
+}
+
+/* Whole record length */
+static size_t record_size(const ResRecord* r)
+{
+    return RECORD_HEAD + addr_bytes(r) + r->namelen;
+}
+
+
+/* FNV-1a over a block's records */
+static uint32_t block_check(const char* p, size_t len)
+{
+    uint32_t h = 2166136261u;
+    size_t i;
+    for(i = 0; i < len; i++)
+        h = (h ^ (uint8_t) p[i]) * 16777619u;
+    return h;
+}
+
+/* LogFile seal hook: fills the block header in front of a buffer of records */
+static void resfile_seal(char* block, size_t len)
+{
+    ResBlock b;
+    size_t off = sizeof(ResBlock);
+    b.magic = RESFILE_BLOCK_MAGIC;
+    b.bytes = (uint32_t) (len - sizeof(ResBlock));
+    b.count = 0;
+    while(off < len)                                // records are length prefixed, so counting is a skip list walk
+    {
+        off += record_size((const ResRecord*) (block + off));
+        b.count++;
+    }
+    b.check = block_check(block + sizeof(ResBlock), b.bytes);
+    memcpy(block, &b, sizeof(b));
+}
+
+/* Writes all of buf, returns -1 on failure */
+static int write_all(int fd, const void* buf, size_t len)
+{
+    size_t off = 0;
+    while(off < len)
+    {
+        ssize_t n = write(fd, (const char*) buf + off, len - off);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return -1;
+        off += (size_t) n;
+    }
+    return 0;
+}
+
+/* Writes the file header (unless a resumed log already has it) & makes every buffer flush a sealed block,
+ * returns -1 on failure */
+int resfile_begin(LogFile* log)
+{
+    ResHeader h;
+    off_t size = lseek(log->fd, 0, SEEK_END);       // -1 for a pipe, which is always new
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, RESFILE_MAGIC, sizeof(h.magic));
+    h.version = RESFILE_VERSION;
+    if(size <= 0 && write_all(log->fd, &h, sizeof(h)) != 0)
+        return -1;
+    log->header = sizeof(ResBlock);
+    log->seal = resfile_seal;
+    return 0;
+}
+
+/* Appends one result record to a thread's buffer */
+void resfile_put(LogBuf* lb, const char* hostname, size_t len, int status, const char* ip)
+{
+    struct in6_addr addr;
+    ResRecord* r;
+    size_t off = 0;
+    int family;
+
+    if(len > 255)
+        len = 255;
+    r = (ResRecord*) logbuf_reserve(lb, RECORD_HEAD + 16 * LOOKUP_MAX_ADDRS + len); // room for the widest list
+    r->namelen = (uint8_t) len;
+    if(status == UTIL_SUCCESS)
+        r->status = RES_RESOLVED;
+    else if(status == LOOKUP_TIMEOUT)
+        r->status = RES_TIMEOUT;
+    else
+        r->status = status == LOOKUP_INVALID ? RES_INVALID : RES_NOT_RESOLVED;
+    r->naddrs = r->v6mask = 0;
+    while(status == UTIL_SUCCESS && ip && r->naddrs < LOOKUP_MAX_ADDRS)
+    {
+        if(!(ip = lookup_next(ip, &family, &addr)))
+            break;
+        if(family == AF_INET6)
+            r->v6mask |= (uint8_t) (1 << r->naddrs);
+        memcpy(r->data + off, &addr, family == AF_INET6 ? 16 : 4);
+        off += family == AF_INET6 ? 16 : 4;
+        r->naddrs++;
+    }
+    memcpy(r->data + off, hostname, len);
+    lb->len += record_size(r);
+    lb->records++;
+}
+
+/* Decodes the record at off (inside the blocks), returns 0 or -1 if it doesn't fit before end */
+static int record_decode(const ResultFile* rf, size_t off, size_t end, ResResult* out)
+{
+    const ResRecord* r = (const ResRecord*) (rf->map + off);
+    if(off + RECORD_HEAD > end || off + record_size(r) > end)
+        return -1;
+    const uint8_t* a = r->data;
+    int i;
+
+    out->name = (const char*) r->data + addr_bytes(r);
+    out->namelen = r->namelen;
+    out->ip[0] = '\0';
+    if(r->status == RES_RESOLVED)
+        out->status = UTIL_SUCCESS;
+    else if(r->status == RES_TIMEOUT)
+        out->status = LOOKUP_TIMEOUT;
+    else
+        out->status = r->status == RES_INVALID ? LOOKUP_INVALID : UTIL_FAILURE;
+    for(i = 0; i < r->naddrs; i++)                  // in the order the backend returned them
+    {
+        int v6 = (r->v6mask >> i) & 1;
+        lookup_append(out->ip, sizeof(out->ip), v6 ? AF_INET6 : AF_INET, a);
+        a += v6 ? 16 : 4;
+    }
+    return 0;
+}
+
+/* Decodes the record after cursor (zeroed to start), returns 1 or 0 at the end or at a torn block */
+int resfile_next(ResultFile* rf, ResCursor* cursor, ResResult* out)
+{
+    if(cursor->pos == 0)
+        cursor->pos = cursor->block_end = sizeof(ResHeader);
+    while(cursor->pos >= cursor->block_end)         // step into the next block, checking it whole
+    {
+        ResBlock b;
+        size_t start = cursor->block_end;
+        if(start + sizeof(b) > rf->end)
+            return 0;
+        memcpy(&b, rf->map + start, sizeof(b));     // blocks follow packed records, so they aren't aligned
+        if(b.magic != RESFILE_BLOCK_MAGIC || b.bytes > rf->end - start - sizeof(b) ||
+           block_check((const char*) rf->map + start + sizeof(b), b.bytes) != b.check)
+            return 0;                               // torn by a failed write: nothing after it is trusted
+        cursor->pos = start + sizeof(b);
+        cursor->block_end = cursor->pos + b.bytes;
+    }
+    if(record_decode(rf, cursor->pos, cursor->block_end, out) != 0)
+        return 0;
+    cursor->last = cursor->pos;
+    cursor->pos += record_size((const ResRecord*) (rf->map + cursor->pos));
+    return 1;
+}
+
+/* Normalizes a record's unterminated name into key, returns its hash */
+static uint64_t record_key(const ResResult* r, char* key)
+{
+    char name[CACHE_KEY_LENGTH + 1];
+    memcpy(name, r->name, r->namelen);
+    name[r->namelen] = '\0';
+    return cache_normalize(name, key);
+}
+
+/* Indexes the finished blocks & appends the index (skipped for pipes), returns -1 on failure */
+int resfile_finish(LogFile* log)
+{
+    ResultFile rf;
+    ResCursor cursor = {0, 0, 0};
+    ResResult r;
+    ResTrailer t;
+    ResSlot* slots;
+    struct stat st;
+    char key[CACHE_KEY_LENGTH];
+    uint64_t count = 0, nslots = RESFILE_MIN_SLOTS;
+    size_t pad;
+    int fd, rc;
+
+    if(fstat(log->fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < (off_t) sizeof(ResHeader) ||
+       (uint64_t) st.st_size > OFFSET_MASK)
+        return 0;                                   // stdout, a pipe or too big for a slot: readers scan the blocks instead
+    if((fd = open(log->name, O_RDONLY | O_CLOEXEC)) < 0)
+        return -1;
+    rf.size = rf.end = (size_t) st.st_size;
+    rf.map = mmap(NULL, rf.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(rf.map == MAP_FAILED)
+        return -1;
+    rf.trailer = NULL;
+    rf.slots = NULL;
+
+    // Size the Index: at least twice the records so probes stay short
+    while(resfile_next(&rf, &cursor, &r))
+        count++;
+    while(nslots < count * 2)
+        nslots *= 2;
+    if(!(slots = calloc(nslots, sizeof(ResSlot))))
+    {
+        munmap((void*) rf.map, rf.size);
+        return -1;
+    }
+
+    // Insert in File Order, so a probe meets a name's first record first
+    memset(&cursor, 0, sizeof(cursor));
+    while(resfile_next(&rf, &cursor, &r))
+    {
+        uint64_t hash = record_key(&r, key);
+        uint64_t i = hash & (nslots - 1);
+        while(slots[i])
+            i = (i + 1) & (nslots - 1);
+        slots[i] = (hash & ~OFFSET_MASK) | cursor.last;
+    }
+    munmap((void*) rf.map, rf.size);
+
+    // Append: padding to 8 bytes so the slots can be read in place, the slots, then the trailer
+    pad = (8 - rf.size % 8) % 8;
+    memset(&t, 0, sizeof(t));
+    memcpy(t.magic, RESFILE_INDEX_MAGIC, sizeof(t.magic));
+    t.index = rf.size + pad;
+    t.nslots = nslots;
+    t.count = count;
+    rc = write_all(log->fd, "\0\0\0\0\0\0\0", pad) == 0 && write_all(log->fd, slots, sizeof(ResSlot) * nslots) == 0 &&
+         write_all(log->fd, &t, sizeof(t)) == 0 ? 0 : -1;
+    free(slots);
+    return rc;
+}
+
+/* Maps a binary resolver log, NULL if it can't be read or isn't one */
+ResultFile* resfile_open(const char* path)
+{
+    ResultFile* rf;
+    const ResHeader* h;
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if(fd < 0)
+        return NULL;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(ResHeader) || !(rf = calloc(1, sizeof(*rf))))
+    {
+        close(fd);
+        return NULL;
+    }
+    rf->size = rf->end = (size_t) st.st_size;
+    rf->map = mmap(NULL, rf->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    h = (const ResHeader*) rf->map;
+    if(rf->map == MAP_FAILED || memcmp(h->magic, RESFILE_MAGIC, sizeof(h->magic)) != 0 || h->version != RESFILE_VERSION)
+    {
+        if(rf->map != MAP_FAILED)
+            munmap((void*) rf->map, rf->size);
+        free(rf);
+        return NULL;
+    }
+
+    // Index: trusted only if the trailer's numbers describe exactly the end of the file
+    if(rf->size >= sizeof(ResHeader) + sizeof(ResTrailer))
+    {
+        const ResTrailer* t = (const ResTrailer*) (rf->map + rf->size - sizeof(ResTrailer));
+        if(rf->size % 8 == 0 && memcmp(t->magic, RESFILE_INDEX_MAGIC, sizeof(t->magic)) == 0 &&
+           t->nslots > 0 && (t->nslots & (t->nslots - 1)) == 0 && t->index >= sizeof(ResHeader) && t->index % 8 == 0 &&
+           t->nslots <= (rf->size - t->index) / sizeof(ResSlot) &&
+           t->index + t->nslots * sizeof(ResSlot) + sizeof(ResTrailer) == rf->size)
+        {
+            rf->trailer = t;
+            rf->slots = (const ResSlot*) (rf->map + t->index);
+            rf->end = t->index;
+        }
+    }
+    return rf;
+}
+
+/* Unmaps the file */
+void resfile_close(ResultFile* rf)
+{
+    munmap((void*) rf->map, rf->size);
+    free(rf);
+}
+
+/* Finds the first record for hostname (case & trailing dots ignored), returns 1 if found */
+int resfile_find(ResultFile* rf, const char* hostname, ResResult* out)
+{
+    char key[CACHE_KEY_LENGTH];
+    char other[CACHE_KEY_LENGTH];
+    uint64_t hash = cache_normalize(hostname, key);
+
+    if(!rf->trailer)                                // no index: scan every block
+    {
+        ResCursor cursor = {0, 0, 0};
+        while(resfile_next(rf, &cursor, out))
+        {
+            if(record_key(out, other) == hash && strcmp(other, key) == 0)
+                return 1;
+        }
+        return 0;
+    }
+    uint64_t mask = rf->trailer->nslots - 1;
+    uint64_t i;
+    for(i = hash & mask; rf->slots[i]; i = (i + 1) & mask)
+    {
+        uint64_t off = rf->slots[i] & OFFSET_MASK;
+        if((rf->slots[i] & ~OFFSET_MASK) != (hash & ~OFFSET_MASK) || off < sizeof(ResHeader) ||
+           record_decode(rf, off, rf->end, out) != 0)
+            continue;
+        record_key(out, other);
+        if(strcmp(other, key) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/* Writes one record as the text resolver log line */
+static void dump_line(const ResResult* r, FILE* out)
+{
+    fprintf(out, "%.*s, %s\n", (int) r->namelen, r->name, r->status == UTIL_SUCCESS ? r->ip : lookup_status_name(r->status));
+}
+
+/* Writes "hostname, ip" lines for every record, or only for the given names, returns # names not found */
+int resfile_dump(ResultFile* rf, char** names, int n, FILE* out)
+{
+    ResResult r;
+    int missing = 0;
+    int i;
+
+    if(n == 0)
+    {
+        ResCursor cursor = {0, 0, 0};
+        while(resfile_next(rf, &cursor, &r))
+            dump_line(&r, out);
+        return 0;
+    }
+    for(i = 0; i < n; i++)
+    {
+        if(resfile_find(rf, names[i], &r))
+            dump_line(&r, out);
+        else
+        {
+            fprintf(stderr, "%s: not in the log.\n", names[i]);
+            missing++;
+        }
+    }
+    return missing;
+}
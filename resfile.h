@@ -0,0 +1,123 @@
+// Connor Humiston
+// Binary Result File Header
+#ifndef RESFILE_H
+#define RESFILE_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <stdint.h>                                 // fixed width integer types
+#include <stdio.h>                                  // FILE for the text converter
+#include <arpa/inet.h>                              // INET6_ADDRSTRLEN
+
+#include "logwriter.h"                              // log files & per-thread buffers
+#include "backend.h"                                // LOOKUP_IP_LENGTH
+
+#define RESFILE_MAGIC           "MLRESLT1"          // first 8 bytes of a binary resolver log
+#define RESFILE_INDEX_MAGIC     "MLRINDX1"          // last 32 bytes: the index trailer
+#define RESFILE_BLOCK_MAGIC     0x4B4C4252u         // "RBLK" little endian, starts every block
+#define RESFILE_VERSION         3                   // 3: hostname_fold() index hashes, 2: address lists
+#define RESFILE_MIN_SLOTS       16                  // smallest index (power of two, at least twice the records)
+#define RESFILE_OFFSET_BITS     40                  // slot = 24 bit hash tag | 40 bit record offset (1 TB of records)
+
+#define LOG_TEXT                0                   // --log-format values
+#define LOG_BINARY              1
+
+/* Record Status Byte */
+#define RES_RESOLVED            0
+#define RES_NOT_RESOLVED        1
+#define RES_TIMEOUT             2
+#define RES_INVALID             3
+
+
+/* File Header */
+typedef struct ResHeader
+{
+    char magic[8];                                  // RESFILE_MAGIC
+    uint32_t version;                               // RESFILE_VERSION
+    uint32_t reserved;
+} ResHeader;
+
+/* Block Header: every flush of a resolver's buffer is one block, written whole with O_APPEND */
+typedef struct ResBlock
+{
+    uint32_t magic;                                 // RESFILE_BLOCK_MAGIC
+    uint32_t bytes;                                 // records after this header
+    uint32_t count;                                 // records in the block
+    uint32_t check;                                 // FNV-1a of the records, a torn block fails it
+} ResBlock;
+
+/* Record: 4 byte head, the addresses (4 bytes per IPv4 one, 16 per IPv6 one) then the name; records are packed */
+typedef struct ResRecord
+{
+    uint8_t namelen;                                // length prefix (no terminator)
+    uint8_t status;                                 // RES_RESOLVED, RES_NOT_RESOLVED, RES_TIMEOUT or RES_INVALID
+    uint8_t naddrs;                                 // addresses stored, up to LOOKUP_MAX_ADDRS
+    uint8_t v6mask;                                 // bit i set if address i is IPv6
+    uint8_t data[];                                 // addresses in network byte order, then the name
+} ResRecord;
+
+/* Index Slot: the top bits of the normalized name's hash over the record's offset, 0 marks an empty slot */
+typedef uint64_t ResSlot;
+
+/* Index Trailer: the last bytes of a finished file */
+typedef struct ResTrailer
+{
+    char magic[8];                                  // RESFILE_INDEX_MAGIC
+    uint64_t index;                                 // offset of the first slot (where the blocks end)
+    uint64_t nslots;                                // slots (power of two, linear probing from the hash)
+    uint64_t count;                                 // records indexed
+} ResTrailer;
+
+/* Decoded Record */
+typedef struct ResResult
+{
+    const char* name;                               // points into the mapping, not terminated
+    size_t namelen;
+    int status;                                     // UTIL_SUCCESS, UTIL_FAILURE, LOOKUP_TIMEOUT or LOOKUP_INVALID
+    char ip[LOOKUP_IP_LENGTH];                      // ", " separated addresses, empty without any
+} ResResult;
+
+/* Mapped Result File */
+typedef struct ResultFile
+{
+    const uint8_t* map;                             // whole file, read-only
+    size_t size;
+    size_t end;                                     // where the blocks end (index start, or size without one)
+    const ResTrailer* trailer;                      // NULL if the file has no index (run killed, or a pipe)
+    const ResSlot* slots;
+} ResultFile;
+
+/* Position in the blocks for resfile_next() */
+typedef struct ResCursor
+{
+    size_t pos;                                     // next record (0: before the first block)
+    size_t block_end;                               // end of the current block
+    size_t last;                                    // offset of the record returned last
+} ResCursor;
+
+
+/* Writes the file header (unless a resumed log already has it) & makes every buffer flush a sealed block,
+ * returns -1 on failure */
+int resfile_begin(LogFile* log);
+
+/* Appends one result record to a thread's buffer */
+void resfile_put(LogBuf* lb, const char* hostname, size_t len, int status, const char* ip);
+
+/* Indexes the finished blocks & appends the index (skipped for pipes), returns -1 on failure */
+int resfile_finish(LogFile* log);
+
+/* Maps a binary resolver log, NULL if it can't be read or isn't one */
+ResultFile* resfile_open(const char* path);
+
+/* Unmaps the file */
+void resfile_close(ResultFile* rf);
+
+/* Decodes the record after cursor (zeroed to start), returns 1 or 0 at the end or at a torn block */
+int resfile_next(ResultFile* rf, ResCursor* cursor, ResResult* out);
+
+/* Finds the first record for hostname (case & trailing dots ignored), returns 1 if found */
+int resfile_find(ResultFile* rf, const char* hostname, ResResult* out);
+
+/* Writes "hostname, ip" lines for every record, or only for the given names, returns # names not found */
+int resfile_dump(ResultFile* rf, char** names, int n, FILE* out);
+
+#endif
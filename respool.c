@@ -0,0 +1,223 @@
+// Connor Humiston
+// Adaptive Resolver Pool Implementation
+#include "respool.h"
+
+#include <stdio.h>                                  // decision log
+#include <errno.h>                                  // ETIMEDOUT
+
+
+/* Runs the worker body then marks the slot joinable */
+static void* respool_thread(void* arg)
+{
+    PoolWorker* w = (PoolWorker*) arg;
+    w->pool->fn(w);
+    __atomic_store_n(&w->state, POOL_EXITED, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Starts a worker in slot i, returns 0 or -1 */
+static int respool_spawn(ResPool* pool, int i)
+{
+    PoolWorker* w = &pool->workers[i];
+    if(__atomic_load_n(&w->state, __ATOMIC_ACQUIRE) == POOL_EXITED) // slot's previous thread has already drained
+        pthread_join(w->id, NULL);
+    w->state = POOL_RUNNING;
+    w->retire = 0;
+    w->interrupt = 0;
+    if(pthread_create(&w->id, NULL, respool_thread, w) != 0)
+    {
+        w->state = POOL_IDLE;
+        return -1;
+    }
+    return 0;
+}
+
+/* Creates a pool (max > min makes it adaptive), NULL on failure */
+ResPool* respool_create(void* (*fn)(void*), void* packet, Buffer* buff, int min, int max, int interval_ms)
+{
+    ResPool* pool;
+    int i;
+    if(max < min)
+        max = min;
+    if(posix_memalign((void**) &pool, CACHE_LINE, sizeof(*pool) + sizeof(PoolWorker) * max) != 0)
+        return NULL;
+    pool->fn = fn;
+    pool->packet = packet;
+    pool->buff = buff;
+    pool->min = min;
+    pool->max = max;
+    pool->active = 0;
+    pool->interval_ms = interval_ms;
+    pool->stop = 0;
+    pool->baseline_ms = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    for(i = 0; i < max; i++)
+    {
+        pool->workers[i].pool = pool;
+        pool->workers[i].state = POOL_IDLE;
+        pool->workers[i].retire = 0;
+        pool->workers[i].interrupt = 0;
+        pool->workers[i].lookups = 0;
+        pool->workers[i].busy_ns = 0;
+        pool->workers[i].local = NULL;
+    }
+    return pool;
+}
+
+/* Grows or shrinks the pool from the queue occupancy & lookup latency since the last decision */
+static void respool_decide(ResPool* pool)
+{
+    uint64_t now = pool_clock_ns();
+    uint64_t lookups = 0, busy = 0;
+    double occupancy = (double) buffer_count(pool->buff) / pool->buff->size;
+    double elapsed = (now - pool->last_ns) / 1e9;
+    double rate, latency, utilisation, baseline = pool->baseline_ms;
+    int slower, target = pool->active;
+    int i, n;
+
+    for(i = 0; i < pool->max; i++)                  // counters only grow, so exited workers still count
+    {
+        lookups += __atomic_load_n(&pool->workers[i].lookups, __ATOMIC_RELAXED);
+        busy += __atomic_load_n(&pool->workers[i].busy_ns, __ATOMIC_RELAXED);
+    }
+    rate = (lookups - pool->lookups) / elapsed;
+    latency = lookups > pool->lookups ? (busy - pool->busy_ns) / 1e6 / (lookups - pool->lookups) : 0;
+    utilisation = (busy - pool->busy_ns) / 1e9 / (elapsed * pool->active); // above 1 when a thread overlaps lookups
+    pool->lookups = lookups;
+    pool->busy_ns = busy;
+    pool->last_ns = now;
+    if(latency > 0)                                 // intervals without lookups say nothing about latency
+        pool->baseline_ms = baseline > 0 ? baseline + (latency - baseline) * POOL_LATENCY_WEIGHT : latency;
+    slower = baseline > 0 && latency > baseline * POOL_GROW_LATENCY; // each thread now gets through fewer names
+
+    // Additive Increase While the Queue Backs Up or Lookups Slow Down with Names Waiting,
+    // Multiplicative Decrease While Resolvers Sit Idle (& lookups aren't slowing down)
+    if(occupancy >= POOL_GROW_OCCUPANCY || (slower && buffer_count(pool->buff) > 0))
+        target = pool->active + POOL_INCREASE;
+    else if(occupancy <= POOL_SHRINK_OCCUPANCY && utilisation < POOL_SHRINK_BUSY && !slower)
+    {
+        target = (int) (pool->active * POOL_DECREASE);
+        if(target == pool->active)
+            target--;
+    }
+    if(target > pool->max)
+        target = pool->max;
+    if(target < pool->min)
+        target = pool->min;
+    if(target == pool->active)
+        return;
+
+    printf("resolver pool: queue %.0f%% full, %.0f lookups/s, mean lookup %.2f ms (baseline %.2f), busy %.0f%% -> %s %d -> %d resolvers\n",
+           occupancy * 100, rate, latency, baseline, utilisation * 100, target > pool->active ? "grow" : "shrink", pool->active, target);
+    if(target > pool->active)
+    {
+        for(i = 0, n = target - pool->active; i < pool->max && n > 0; i++)
+        {
+            if(__atomic_load_n(&pool->workers[i].state, __ATOMIC_ACQUIRE) == POOL_RUNNING)
+                continue;                           // busy or still draining after a retire
+            if(respool_spawn(pool, i) != 0)
+            {
+                fprintf(stderr, "Error creating a resolver thread.\n");
+                break;
+            }
+            pool->active++;
+            n--;
+        }
+    }
+    else
+    {
+        for(i = pool->max - 1, n = pool->active - target; i >= 0 && n > 0; i--)
+        {
+            PoolWorker* w = &pool->workers[i];
+            if(__atomic_load_n(&w->state, __ATOMIC_ACQUIRE) != POOL_RUNNING || w->retire)
+                continue;
+            __atomic_store_n(&w->retire, 1, __ATOMIC_RELEASE);
+            __atomic_store_n(&w->interrupt, 1, __ATOMIC_SEQ_CST);
+            pool->active--;
+            n--;
+        }
+        buffer_wake(pool->buff);                    // retired resolvers asleep on an empty queue must notice
+    }
+}
+
+/* Controller: one decision per interval until told to stop */
+static void* respool_controller(void* arg)
+{
+    ResPool* pool = (ResPool*) arg;
+    struct timespec deadline;
+
+    pthread_mutex_lock(&pool->lock);
+    while(!pool->stop)
+    {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += pool->interval_ms / 1000;
+        deadline.tv_nsec += (long) (pool->interval_ms % 1000) * 1000000;
+        if(deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        if(pthread_cond_timedwait(&pool->wake, &pool->lock, &deadline) == ETIMEDOUT && !pool->stop)
+            respool_decide(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/* Starts min workers & the controller when adaptive, returns 0 or -1 */
+int respool_start(ResPool* pool)
+{
+    int i;
+    for(i = 0; i < pool->min; i++)
+    {
+        if(respool_spawn(pool, i) != 0)
+            return -1;
+        pool->active++;
+    }
+    pool->last_ns = pool_clock_ns();
+    pool->lookups = pool->busy_ns = 0;
+    if(pool->max > pool->min && pthread_create(&pool->controller, NULL, respool_controller, pool) != 0)
+        return -1;
+    return 0;
+}
+
+/* Stops the controller & joins every worker (call after buffer_close) */
+void respool_join(ResPool* pool)
+{
+    int i;
+    if(pool->max > pool->min)
+    {
+        pthread_mutex_lock(&pool->lock);
+        pool->stop = 1;
+        pthread_cond_signal(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+        pthread_join(pool->controller, NULL);       // no more spawns after this
+    }
+    for(i = 0; i < pool->max; i++)
+    {
+        if(pool->workers[i].state != POOL_IDLE && pthread_join(pool->workers[i].id, NULL) != 0)
+            fprintf(stderr, "Error joining resolver thread %d.\n", i);
+        pool->workers[i].state = POOL_IDLE;
+    }
+}
+
+/* Frees the pool */
+void respool_destroy(ResPool* pool)
+{
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    free(pool);
+}
+
+/* Wakes every running worker asleep on an empty queue so it rechecks its flags */
+void respool_interrupt(ResPool* pool)
+{
+    int i;
+    for(i = 0; i < pool->max; i++)
+    {
+        if(__atomic_load_n(&pool->workers[i].state, __ATOMIC_ACQUIRE) == POOL_RUNNING)
+            __atomic_store_n(&pool->workers[i].interrupt, 1, __ATOMIC_SEQ_CST);
+    }
+    buffer_wake(pool->buff);
+}
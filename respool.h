@@ -0,0 +1,95 @@
+// Connor Humiston
+// Adaptive Resolver Pool Header
+#ifndef RESPOOL_H
+#define RESPOOL_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <stdint.h>                                 // fixed width integer types
+#include <pthread.h>                                // worker & controller threads
+#include <time.h>                                   // clock_gettime()
+
+#include "queue.h"                                  // occupancy & waking retired consumers
+
+#define MAX_POOL_RESOLVERS      256                 // ceiling for --max-resolvers
+#define DEFAULT_SCALE_INTERVAL  100                 // ms between controller decisions
+#define MIN_SCALE_INTERVAL      10
+#define MAX_SCALE_INTERVAL      60000
+#define POOL_GROW_OCCUPANCY     0.5                 // queue at least this full: resolvers are behind
+#define POOL_SHRINK_OCCUPANCY   0.125               // queue at most this full ...
+#define POOL_SHRINK_BUSY        0.5                 // ... & resolvers spend less than this in lookups
+#define POOL_GROW_LATENCY       1.5                 // names queued & mean lookup this many times the baseline: grow
+#define POOL_LATENCY_WEIGHT     0.25                // weight of each interval's mean in the baseline latency
+#define POOL_INCREASE           2                   // resolvers added per grow decision
+#define POOL_DECREASE           0.75                // fraction of resolvers kept per shrink decision
+
+#define POOL_IDLE               0                   // slot never used
+#define POOL_RUNNING            1
+#define POOL_EXITED             2                   // thread finished, not yet joined
+
+
+/* One Resolver Thread Slot */
+typedef struct PoolWorker
+{
+    struct ResPool* pool;                           // owning pool (worker reads pool->packet)
+    pthread_t id;
+    int state;                                      // POOL_IDLE, POOL_RUNNING or POOL_EXITED
+    int retire;                                     // set by the controller: take no new names, drain & exit
+    int interrupt;                                  // wakes the worker from an empty queue (retire or checkpoint)
+    uint64_t lookups;                               // backend lookups finished (written by the worker)
+    uint64_t busy_ns;                               // sum of their latencies
+    void* local;                                    // worker body's state kept across respawns (NULL at first)
+} __attribute__((aligned(CACHE_LINE))) PoolWorker;
+
+/* Resolver Pool: a fixed size, or min..max resolvers steered by a controller thread */
+typedef struct ResPool
+{
+    void* (*fn)(void*);                             // worker body, called with its PoolWorker*
+    void* packet;                                   // shared worker arguments
+    Buffer* buff;                                   // queue whose occupancy drives the decisions
+    int min;                                        // resolvers started & never retired
+    int max;                                        // ceiling (== min for a fixed pool)
+    int active;                                     // running & not retiring
+    int interval_ms;                                // time between decisions
+    pthread_t controller;
+    int stop;                                       // tells the controller to finish
+    pthread_mutex_t lock;                           // guards stop (controller sleeps on wake)
+    pthread_cond_t wake;
+    uint64_t lookups;                               // worker totals seen at the last decision
+    uint64_t busy_ns;
+    uint64_t last_ns;                               // time of the last decision
+    double baseline_ms;                             // smoothed mean lookup latency (0 until the first lookups)
+    PoolWorker workers[];                           // max slots
+} ResPool;
+
+
+/* Monotonic clock in nanoseconds */
+static inline uint64_t pool_clock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/* Creates a pool (max > min makes it adaptive), NULL on failure */
+ResPool* respool_create(void* (*fn)(void*), void* packet, Buffer* buff, int min, int max, int interval_ms);
+
+/* Starts min workers & the controller when adaptive, returns 0 or -1 */
+int respool_start(ResPool* pool);
+
+/* Stops the controller & joins every worker (call after buffer_close) */
+void respool_join(ResPool* pool);
+
+/* Frees the pool */
+void respool_destroy(ResPool* pool);
+
+/* Wakes every running worker asleep on an empty queue so it rechecks its flags */
+void respool_interrupt(ResPool* pool);
+
+/* Adds one finished backend lookup to the worker's counters */
+static inline void respool_record(PoolWorker* w, uint64_t ns)
+{
+    __atomic_store_n(&w->lookups, w->lookups + 1, __ATOMIC_RELAXED); // only the worker writes, the controller reads
+    __atomic_store_n(&w->busy_ns, w->busy_ns + ns, __ATOMIC_RELAXED);
+}
+
+#endif
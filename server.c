@@ -0,0 +1,412 @@
+// Connor Humiston
+// UDP DNS Server Implementation
+#define _GNU_SOURCE                                 // recvmmsg() & sendmmsg()
+#include "server.h"
+
+#include <stdio.h>                                  // standard i/o
+#include <string.h>                                 // C string library
+#include <errno.h>                                  // EAGAIN, EINTR
+#include <poll.h>                                   // poll()
+#include <unistd.h>                                 // close(), write()
+#include <arpa/inet.h>                              // inet_pton()
+#include <netinet/in.h>                             // sockaddr_in
+#include <sys/eventfd.h>                            // eventfd()
+
+#include "dnsasync.h"                               // dnsasync_parse_server()
+#include "metrics.h"                                // push wait & names in
+#include "hostname.h"                               // hostname_normalize() of every question
+
+
+/* FNV-1a over the (already lowercase) question name */
+static uint64_t server_hash(const char* name)
+{
+    uint64_t h = 1469598103934665603ull;
+    while(*name)
+    {
+        h ^= (unsigned char) *name++;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+/* Shard holding the name's pending entry */
+static ServerShard* server_shard(Server* srv, uint64_t hash)
+{
+    return &srv->shards[hash >> 58];                // top bits pick the shard, low bits the bucket
+}
+
+/* Parses "PORT" (127.0.0.1) or "ADDR:PORT" for --serve, returns 0 or -1 */
+int server_parse_listen(const char* spec, struct sockaddr_storage* addr, socklen_t* len)
+{
+    char* end;
+    long port = strtol(spec, &end, 10);
+    if(*spec != '\0' && *end == '\0')               // bare port: local only
+    {
+        struct sockaddr_in* sin = (struct sockaddr_in*) addr;
+        if(port < 1 || port > 65535)
+            return -1;
+        memset(addr, 0, sizeof(*addr));
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons((uint16_t) port);
+        sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        *len = sizeof(*sin);
+        return 0;
+    }
+    return dnsasync_parse_server(spec, addr, len);  // same IP[:PORT] / [v6]:PORT syntax as --nameserver
+}
+
+/* Binds nworkers SO_REUSEPORT sockets, NULL on failure */
+Server* server_create(const struct sockaddr_storage* addr, socklen_t addrlen, int nworkers, int batch, uint32_t ttl,
+                      Buffer* buff, Cache* cache, Slab* names, LogFile* reqlog, size_t log_buffer)
+{
+    Server* srv;
+    int i, one = 1;
+
+    if(posix_memalign((void**) &srv, CACHE_LINE, sizeof(*srv)) != 0)
+        return NULL;
+    memset(srv, 0, sizeof(*srv));
+    srv->addr = *addr;
+    srv->addrlen = addrlen;
+    srv->nworkers = nworkers;
+    srv->batch = batch;
+    srv->ttl = ttl;
+    srv->buff = buff;
+    srv->cache = cache;
+    srv->names = names;
+    srv->reqlog = reqlog;
+    srv->log_buffer = log_buffer;
+    for(i = 0; i < SERVER_PENDING_SHARDS; i++)
+        pthread_mutex_init(&srv->shards[i].lock, NULL);
+    srv->workers = calloc(nworkers, sizeof(ServerWorker));
+    srv->stopfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if(!srv->workers || srv->stopfd < 0)
+    {
+        if(srv->stopfd >= 0)
+            close(srv->stopfd);
+        free(srv->workers);
+        free(srv);
+        return NULL;
+    }
+    for(i = 0; i < nworkers; i++)
+    {
+        ServerWorker* w = &srv->workers[i];
+        w->srv = srv;
+        w->fd = socket(addr->ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if(w->fd < 0 || setsockopt(w->fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0 ||
+           bind(w->fd, (const struct sockaddr*) addr, addrlen) != 0)
+        {
+            fprintf(stderr, "Unable to bind server socket %d: %s.\n", i, strerror(errno));
+            srv->nworkers = i + (w->fd >= 0);       // close what was opened
+            server_destroy(srv);
+            return NULL;
+        }
+    }
+    return srv;
+}
+
+/* Fills the answer for a finished lookup (every address of the asked family), returns its length or -1 */
+static int server_answer(Server* srv, uint8_t* buf, const uint8_t* msg, const DnsQuery* q, int status, const char* ip)
+{
+    DnsAddr addrs[LOOKUP_MAX_ADDRS];
+    int naddrs = 0;
+    int want = q->qtype == DNS_TYPE_AAAA ? AF_INET6 : AF_INET;
+
+    if(status != UTIL_SUCCESS)
+        return dnswire_build_answer(buf, DNS_MAX_UDP, msg, q, DNS_RCODE_SERVFAIL, NULL, 0, 0);
+    while(ip && naddrs < LOOKUP_MAX_ADDRS)
+    {
+        ip = lookup_next(ip, &addrs[naddrs].family, &addrs[naddrs].addr);
+        if(ip && addrs[naddrs].family == want)
+            naddrs++;
+    }
+    return dnswire_build_answer(buf, DNS_MAX_UDP, msg, q, DNS_RCODE_NOERROR, addrs, naddrs, srv->ttl); // wrong family: empty NOERROR
+}
+
+/* Parks a query until a resolver finishes its name, returns 1 if the name must be queued, 0 if already queued, -1 if dropped */
+static int server_wait(Server* srv, int fd, const struct sockaddr_storage* from, socklen_t fromlen,
+                       const uint8_t* msg, const DnsQuery* q)
+{
+    uint64_t hash = server_hash(q->qname);
+    ServerShard* shard = server_shard(srv, hash);
+    ServerPending** bucket = &shard->table[hash & (SERVER_PENDING_BUCKETS - 1)];
+    ServerPending* pend;
+    ServerWaiter* w;
+    int first = 0, n = 0;
+
+    pthread_mutex_lock(&shard->lock);
+    for(pend = *bucket; pend; pend = pend->next)
+    {
+        if(pend->hash == hash && strcmp(pend->name, q->qname) == 0)
+            break;
+    }
+    if(pend)
+    {
+        for(w = pend->waiters; w; w = w->next)
+            n++;
+    }
+    else if((pend = malloc(sizeof(*pend))))         // first query for this name: the caller queues it
+    {
+        pend->hash = hash;
+        pend->waiters = NULL;
+        strcpy(pend->name, q->qname);
+        pend->next = *bucket;
+        *bucket = pend;
+        first = 1;
+    }
+    if(!pend || n >= SERVER_MAX_WAITERS || !(w = malloc(sizeof(*w))))
+    {
+        pthread_mutex_unlock(&shard->lock);         // the client will retry
+        return first ? 1 : -1;
+    }
+    w->fd = fd;
+    w->addr = *from;
+    w->addrlen = fromlen;
+    w->query = *q;
+    memcpy(w->msg, msg, q->end);
+    w->next = pend->waiters;
+    pend->waiters = w;
+    pthread_mutex_unlock(&shard->lock);
+    return first;
+}
+
+/* Answers every query waiting on hostname (called by resolvers after each result) */
+void server_complete(Server* srv, const char* hostname, int status, const char* ip)
+{
+    uint64_t hash = server_hash(hostname);
+    ServerShard* shard = server_shard(srv, hash);
+    ServerPending** link = &shard->table[hash & (SERVER_PENDING_BUCKETS - 1)];
+    ServerPending* pend;
+    uint8_t buf[DNS_MAX_UDP];
+
+    pthread_mutex_lock(&shard->lock);
+    while((pend = *link) && !(pend->hash == hash && strcmp(pend->name, hostname) == 0))
+        link = &pend->next;
+    if(pend)
+        *link = pend->next;                         // later queries start a new lookup (& will hit the cache)
+    pthread_mutex_unlock(&shard->lock);
+    if(!pend)
+        return;
+    while(pend->waiters)
+    {
+        ServerWaiter* w = pend->waiters;
+        int len = server_answer(srv, buf, w->msg, &w->query, status, ip);
+        if(len > 0 && sendto(w->fd, buf, (size_t) len, 0, (struct sockaddr*) &w->addr, w->addrlen) == len)
+            __atomic_fetch_add(&srv->answered, 1, __ATOMIC_RELAXED);
+        pend->waiters = w->next;
+        free(w);
+    }
+    free(pend);
+}
+
+/* Receives, answers & queues batches of queries until the server stops */
+static void* server_worker(void* arg)
+{
+    ServerWorker* wk = (ServerWorker*) arg;
+    Server* srv = wk->srv;
+    int batch = srv->batch;
+    struct mmsghdr* in = calloc(batch, sizeof(*in));
+    struct mmsghdr* out = calloc(batch, sizeof(*out));
+    struct iovec* iov = calloc(batch * 2, sizeof(*iov));
+    struct sockaddr_storage* from = calloc(batch, sizeof(*from));
+    uint8_t* rbuf = malloc((size_t) batch * DNS_MAX_UDP);
+    uint8_t* wbuf = malloc((size_t) batch * DNS_MAX_UDP);
+    Name* missed = malloc(sizeof(Name) * batch);    // names of one receive batch queued together
+    SlabCache* pool = slab_cache(srv->names);
+    metrics_attach();
+    LogBuf log;
+    struct pollfd fds[2];
+    int i, n;
+
+    if(!in || !out || !iov || !from || !rbuf || !wbuf || !missed || !pool || logbuf_init(&log, srv->reqlog, srv->log_buffer) != 0)
+    {
+        fprintf(stderr, "Unable to allocate server worker state.\n");
+        exit(EXIT_FAILURE);
+    }
+    fds[0].fd = wk->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = srv->stopfd;
+    fds[1].events = POLLIN;
+    while(!__atomic_load_n(&srv->stopping, __ATOMIC_ACQUIRE))
+    {
+        int nout = 0;
+        int nmissed = 0;
+        for(i = 0; i < batch; i++)                  // recvmmsg() overwrites lengths, so rearm every slot
+        {
+            iov[i].iov_base = rbuf + (size_t) i * DNS_MAX_UDP;
+            iov[i].iov_len = DNS_MAX_UDP;
+            in[i].msg_hdr.msg_iov = &iov[i];
+            in[i].msg_hdr.msg_iovlen = 1;
+            in[i].msg_hdr.msg_name = &from[i];
+            in[i].msg_hdr.msg_namelen = sizeof(from[i]);
+        }
+        n = recvmmsg(wk->fd, in, batch, MSG_DONTWAIT, NULL);
+        if(n < 0)
+        {
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                fprintf(stderr, "Error receiving DNS queries: %s.\n", strerror(errno));
+                break;
+            }
+            if(poll(fds, 2, -1) < 0 && errno != EINTR)
+                break;
+            continue;
+        }
+        __atomic_fetch_add(&srv->queries, n, __ATOMIC_RELAXED);
+        for(i = 0; i < n; i++)
+        {
+            const uint8_t* msg = rbuf + (size_t) i * DNS_MAX_UDP;
+            uint8_t* ans = wbuf + (size_t) nout * DNS_MAX_UDP;
+            char ip[LOOKUP_IP_LENGTH];
+            int status, valid, len = -1;
+            size_t nlen;
+            uint64_t hash = 0;
+            DnsQuery q;
+
+            if(dnswire_parse_query(msg, in[i].msg_len, &q) != 0)
+            {
+                __atomic_fetch_add(&srv->dropped, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+            nlen = strlen(q.qname);                 // checked like a line of a data file, then null terminated again
+            valid = !q.oddname && hostname_normalize(q.qname, &nlen, q.qname, &hash) == HOSTNAME_OK;
+            q.qname[nlen] = '\0';
+            if(q.flags & DNS_OPCODE_MASK)           // only standard queries
+                len = dnswire_build_answer(ans, DNS_MAX_UDP, msg, &q, DNS_RCODE_NOTIMP, NULL, 0, 0);
+            else if(q.qclass != DNS_CLASS_IN || (q.qtype != DNS_TYPE_A && q.qtype != DNS_TYPE_AAAA) || !q.qname[0])
+                len = dnswire_build_answer(ans, DNS_MAX_UDP, msg, &q, DNS_RCODE_NOERROR, NULL, 0, 0);
+            else if(!valid)
+            {
+                __atomic_fetch_add(&srv->invalid, 1, __ATOMIC_RELAXED); // never queued or logged: the bytes came off the network
+                len = dnswire_build_answer(ans, DNS_MAX_UDP, msg, &q, DNS_RCODE_FORMERR, NULL, 0, 0);
+            }
+            else if(srv->cache && cache_peek(srv->cache, q.qname, &status, ip, LOOKUP_IP_LENGTH) == CACHE_HIT)
+            {
+                __atomic_fetch_add(&srv->hits, 1, __ATOMIC_RELAXED);
+                len = server_answer(srv, ans, msg, &q, status, ip);
+            }
+            else
+            {
+                int queue = server_wait(srv, wk->fd, &from[i], in[i].msg_hdr.msg_namelen, msg, &q);
+                __atomic_fetch_add(&srv->misses, 1, __ATOMIC_RELAXED);
+                if(queue < 0)
+                    __atomic_fetch_add(&srv->dropped, 1, __ATOMIC_RELAXED);
+                else if(queue > 0)                  // one resolver lookup per name, however many clients ask
+                {
+                    char* hostname = slab_alloc(pool);
+                    if(!hostname)
+                    {
+                        fprintf(stderr, "Unable to allocate a hostname.\n");
+                        exit(EXIT_FAILURE);
+                    }
+                    memcpy(hostname, q.qname, nlen + 1);
+                    logbuf_name(&log, hostname, nlen);
+                    Name name = {hostname, (uint32_t) nlen, NAME_POOLED, hash}; // normalized above, like a requester's
+                    missed[nmissed++] = name;
+                }
+            }
+            if(len > 0)
+            {
+                iov[batch + nout].iov_base = ans;
+                iov[batch + nout].iov_len = (size_t) len;
+                memset(&out[nout].msg_hdr, 0, sizeof(out[nout].msg_hdr));
+                out[nout].msg_hdr.msg_iov = &iov[batch + nout];
+                out[nout].msg_hdr.msg_iovlen = 1;
+                out[nout].msg_hdr.msg_name = &from[i];
+                out[nout].msg_hdr.msg_namelen = in[i].msg_hdr.msg_namelen;
+                nout++;
+            }
+        }
+        for(i = 0; i < nout; )                      // one system call for every answer in the batch
+        {
+            int sent = sendmmsg(wk->fd, out + i, nout - i, 0);
+            if(sent < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                break;                              // UDP: unsendable answers are just lost
+            }
+            __atomic_fetch_add(&srv->answered, sent, __ATOMIC_RELAXED);
+            i += sent;
+        }
+        if(nmissed > 0)                             // cached answers went out first, now queue the misses in one go
+        {
+            uint64_t t0 = metrics_start();
+            buffer_push_many(srv->buff, missed, nmissed); // a full queue slows receiving, the kernel drops the excess
+            metrics_stop(METRIC_PUSH, t0);
+            metrics_count(METRIC_NAMES_IN, nmissed);
+        }
+        logbuf_flush(&log);                         // long-running: keep the log current
+    }
+    logbuf_destroy(&log);
+    free(in);
+    free(out);
+    free(iov);
+    free(from);
+    free(rbuf);
+    free(wbuf);
+    free(missed);
+    return NULL;
+}
+
+/* Starts the worker threads, returns 0 or -1 */
+int server_start(Server* srv)
+{
+    int i;
+    for(i = 0; i < srv->nworkers; i++)
+    {
+        if(pthread_create(&srv->workers[i].id, NULL, server_worker, &srv->workers[i]) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* Tells the workers to stop receiving (async-signal-safe) */
+void server_stop(Server* srv)
+{
+    uint64_t one = 1;
+    __atomic_store_n(&srv->stopping, 1, __ATOMIC_RELEASE);
+    if(write(srv->stopfd, &one, sizeof(one)) < 0)
+        return;
+}
+
+/* Waits for every worker to exit */
+void server_join(Server* srv)
+{
+    int i;
+    for(i = 0; i < srv->nworkers; i++)
+        pthread_join(srv->workers[i].id, NULL);
+}
+
+/* Closes the sockets & frees the server (resolvers must be done) */
+void server_destroy(Server* srv)
+{
+    int i;
+    for(i = 0; i < srv->nworkers; i++)
+    {
+        if(srv->workers[i].fd >= 0)
+            close(srv->workers[i].fd);
+    }
+    for(i = 0; i < SERVER_PENDING_SHARDS; i++)
+    {
+        int b;
+        for(b = 0; b < SERVER_PENDING_BUCKETS; b++)
+        {
+            while(srv->shards[i].table[b])          // only left if a resolver never got the name
+            {
+                ServerPending* pend = srv->shards[i].table[b];
+                srv->shards[i].table[b] = pend->next;
+                while(pend->waiters)
+                {
+                    ServerWaiter* w = pend->waiters;
+                    pend->waiters = w->next;
+                    free(w);
+                }
+                free(pend);
+            }
+        }
+        pthread_mutex_destroy(&srv->shards[i].lock);
+    }
+    close(srv->stopfd);
+    free(srv->workers);
+    free(srv);
+}
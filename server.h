@@ -0,0 +1,107 @@
+// Connor Humiston
+// UDP DNS Server Header
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <stdint.h>                                 // fixed width integer types
+#include <pthread.h>                                // worker threads
+#include <sys/socket.h>                             // sockaddr_storage
+
+#include "queue.h"                                  // hands misses to the resolvers
+#include "cache.h"                                  // answers hits directly
+#include "slab.h"                                   // hostname slots for queued misses
+#include "logwriter.h"                              // requester log
+#include "dnswire.h"                                // query parsing & answers
+
+#define DEFAULT_SERVER_BATCH    32                  // datagrams per recvmmsg()/sendmmsg()
+#define MAX_SERVER_BATCH        1024
+#define SERVER_PENDING_SHARDS   64                  // independently locked tables of waiting queries
+#define SERVER_PENDING_BUCKETS  256                 // buckets per table
+#define SERVER_MAX_WAITERS      64                  // queries kept per hostname being resolved
+
+
+/* Query Waiting for a Resolver: everything needed to answer it later */
+typedef struct ServerWaiter
+{
+    struct ServerWaiter* next;
+    int fd;                                         // worker socket the query came in on
+    struct sockaddr_storage addr;                   // client
+    socklen_t addrlen;
+    DnsQuery query;                                 // parsed question
+    uint8_t msg[DNS_MAX_UDP];                       // header + question bytes echoed in the answer
+} ServerWaiter;
+
+/* Hostname Being Resolved with the Queries Waiting on It */
+typedef struct ServerPending
+{
+    struct ServerPending* next;                     // bucket chain
+    uint64_t hash;
+    ServerWaiter* waiters;
+    char name[DNS_MAX_NAME + 1];                    // lowercase, no trailing dot
+} ServerPending;
+
+/* One Locked Table of Pending Hostnames */
+typedef struct ServerShard
+{
+    pthread_mutex_t lock;
+    ServerPending* table[SERVER_PENDING_BUCKETS];
+} __attribute__((aligned(CACHE_LINE))) ServerShard;
+
+/* One Receive Thread with its Own SO_REUSEPORT Socket */
+typedef struct ServerWorker
+{
+    struct Server* srv;
+    int fd;                                         // kernel spreads clients across the sockets
+    pthread_t id;
+} ServerWorker;
+
+/* DNS Server: answers hits itself, queues misses for the resolver pool */
+typedef struct Server
+{
+    struct sockaddr_storage addr;                   // bind address
+    socklen_t addrlen;
+    int nworkers;
+    ServerWorker* workers;
+    int stopfd;                                     // eventfd that wakes workers on shutdown
+    int stopping;
+    int batch;                                      // datagrams per system call
+    uint32_t ttl;                                   // TTL put on answers
+    Buffer* buff;                                   // resolver queue
+    Cache* cache;                                   // NULL when caching is disabled
+    Slab* names;                                    // hostname slots pushed to the resolvers
+    LogFile* reqlog;                                // names handed to the resolvers
+    size_t log_buffer;                              // per-worker log buffer size
+    unsigned long queries __attribute__((aligned(CACHE_LINE))); // receive thread counters (atomic), off the read-mostly fields
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long dropped;                          // malformed datagrams & waiters over the limit
+    unsigned long invalid;                          // questions that aren't valid hostnames, answered FORMERR
+    unsigned long answered __attribute__((aligned(CACHE_LINE))); // bumped by resolvers, on a line of its own
+    ServerShard shards[SERVER_PENDING_SHARDS];
+} Server;
+
+
+/* Parses "PORT" (127.0.0.1) or "ADDR:PORT" for --serve, returns 0 or -1 */
+int server_parse_listen(const char* spec, struct sockaddr_storage* addr, socklen_t* len);
+
+/* Binds nworkers SO_REUSEPORT sockets, NULL on failure */
+Server* server_create(const struct sockaddr_storage* addr, socklen_t addrlen, int nworkers, int batch, uint32_t ttl,
+                      Buffer* buff, Cache* cache, Slab* names, LogFile* reqlog, size_t log_buffer);
+
+/* Starts the worker threads, returns 0 or -1 */
+int server_start(Server* srv);
+
+/* Tells the workers to stop receiving (async-signal-safe) */
+void server_stop(Server* srv);
+
+/* Waits for every worker to exit */
+void server_join(Server* srv);
+
+/* Answers every query waiting on hostname (called by resolvers after each result) */
+void server_complete(Server* srv, const char* hostname, int status, const char* ip);
+
+/* Closes the sockets & frees the server (resolvers must be done) */
+void server_destroy(Server* srv);
+
+#endif
@@ -0,0 +1,177 @@
+// Connor Humiston
+// Fixed-Size Slot Pool Implementation
+#include "slab.h"
+
+#include <stdint.h>                                 // uintptr_t
+
+
+/* Creates a pool of size byte slots, NULL on failure */
+Slab* slab_create(size_t size)
+{
+    Slab* slab = malloc(sizeof(*slab));
+    if(!slab)
+        return NULL;
+    slab->stride = (sizeof(SlabSlot) + size + 15) & ~(size_t) 15;
+    pthread_mutex_init(&slab->lock, NULL);
+    slab->blocks = NULL;
+    slab->caches = NULL;
+    slab->nblocks = 0;
+    return slab;
+}
+
+/* Frees every block & cache (all threads using the pool must be done) */
+void slab_destroy(Slab* slab)
+{
+    while(slab->blocks)
+    {
+        void* next = *(void**) slab->blocks;
+        free(slab->blocks);
+        slab->blocks = next;
+    }
+    while(slab->caches)
+    {
+        SlabCache* next = slab->caches->next;
+        free(slab->caches);
+        slab->caches = next;
+    }
+    pthread_mutex_destroy(&slab->lock);
+    free(slab);
+}
+
+/* Creates the calling thread's cache, NULL on failure */
+SlabCache* slab_cache(Slab* slab)
+{
+    SlabCache* sc;
+    int i;
+    if(posix_memalign((void**) &sc, CACHE_LINE, sizeof(*sc)) != 0)
+        return NULL;
+    sc->slab = slab;
+    sc->free = NULL;
+    sc->returned = NULL;
+    for(i = 0; i < SLAB_OWNERS; i++)
+        sc->batches[i].owner = NULL;
+    pthread_mutex_lock(&slab->lock);
+    sc->next = slab->caches;
+    slab->caches = sc;
+    pthread_mutex_unlock(&slab->lock);
+    return sc;
+}
+
+/* Carves a new block into sc's free list, returns -1 on failure */
+static int slab_grow(SlabCache* sc)
+{
+    Slab* slab = sc->slab;
+    size_t head = (sizeof(void*) + 15) & ~(size_t) 15; // block link, keeps slots 16-byte aligned
+    char* block = malloc(head + slab->stride * SLAB_BLOCK_SLOTS);
+    int i;
+    if(!block)
+        return -1;
+    for(i = SLAB_BLOCK_SLOTS - 1; i >= 0; i--)
+    {
+        SlabSlot* slot = (SlabSlot*) (block + head + slab->stride * i);
+        slot->owner = sc;
+        slot->next = sc->free;
+        sc->free = slot;
+    }
+    pthread_mutex_lock(&slab->lock);
+    *(void**) block = slab->blocks;
+    slab->blocks = block;
+    slab->nblocks++;
+    pthread_mutex_unlock(&slab->lock);
+    return 0;
+}
+
+/* Returns a slot from the thread's cache, carving a new block only when nothing came back, NULL on failure */
+void* slab_alloc(SlabCache* sc)
+{
+    SlabSlot* slot = sc->free;
+    if(!slot)
+    {
+        // Take Back Everything Other Threads Returned (exchange, so no ABA on the shared stack)
+        slot = __atomic_exchange_n(&sc->returned, NULL, __ATOMIC_ACQUIRE);
+        if(!slot)
+        {
+            if(slab_grow(sc) != 0)
+                return NULL;
+            slot = sc->free;
+        }
+    }
+    sc->free = slot->next;
+    return slot + 1;
+}
+
+/* Pushes a whole chain onto its owner's returned stack */
+static void slab_return(SlabBatch* b)
+{
+    SlabCache* owner = b->owner;
+    SlabSlot* top = __atomic_load_n(&owner->returned, __ATOMIC_RELAXED);
+    do
+        b->tail->next = top;
+    while(!__atomic_compare_exchange_n(&owner->returned, &top, b->head, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    b->owner = NULL;
+}
+
+/* Frees a slot: straight onto the list if sc owns it, otherwise into a batch for its owner */
+void slab_free(SlabCache* sc, void* ptr)
+{
+    SlabSlot* slot = (SlabSlot*) ptr - 1;
+    SlabBatch* b = NULL;
+    int i;
+
+    if(slot->owner == sc)
+    {
+        slot->next = sc->free;
+        sc->free = slot;
+        return;
+    }
+    // Find the Owner's Batch, Else an Empty One, Else Evict a Slot by Address
+    for(i = 0; i < SLAB_OWNERS; i++)
+    {
+        if(sc->batches[i].owner == slot->owner)
+        {
+            b = &sc->batches[i];
+            break;
+        }
+        if(!b && !sc->batches[i].owner)
+            b = &sc->batches[i];
+    }
+    if(!b)
+    {
+        b = &sc->batches[((uintptr_t) slot->owner / CACHE_LINE) % SLAB_OWNERS];
+        slab_return(b);                             // more owners than batches: hand this one back early
+    }
+    if(!b->owner)
+    {
+        b->owner = slot->owner;
+        b->head = b->tail = slot;
+        b->count = 0;
+    }
+    else
+    {
+        slot->next = b->head;
+        b->head = slot;
+    }
+    if(++b->count == SLAB_BATCH)
+        slab_return(b);                             // one atomic per batch instead of one per slot
+}
+
+/* Hands every partial batch back to its owner (call before the thread exits) */
+void slab_flush(SlabCache* sc)
+{
+    int i;
+    for(i = 0; i < SLAB_OWNERS; i++)
+    {
+        if(sc->batches[i].owner)
+            slab_return(&sc->batches[i]);
+    }
+}
+
+/* Heap allocations the pool has made so far */
+unsigned long slab_allocations(Slab* slab)
+{
+    unsigned long n;
+    pthread_mutex_lock(&slab->lock);
+    n = slab->nblocks;
+    pthread_mutex_unlock(&slab->lock);
+    return n;
+}
@@ -0,0 +1,74 @@
+// Connor Humiston
+// Fixed-Size Slot Pool Header
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <pthread.h>                                // block list lock
+
+#include "queue.h"                                  // CACHE_LINE
+
+#define SLAB_BLOCK_SLOTS        256                 // slots carved from each heap allocation
+#define SLAB_BATCH              32                  // foreign frees gathered before handing them back
+#define SLAB_OWNERS             16                  // owners a thread can hold partial batches for
+
+
+/* Slot Header: sits just before the bytes handed out */
+typedef struct SlabSlot
+{
+    struct SlabCache* owner;                        // cache whose free list the slot belongs to
+    struct SlabSlot* next;                          // free list / batch link
+} SlabSlot;
+
+/* Slots Freed for Another Thread, Returned as One Chain */
+typedef struct SlabBatch
+{
+    struct SlabCache* owner;                        // NULL when unused
+    SlabSlot* head;
+    SlabSlot* tail;
+    int count;
+} SlabBatch;
+
+/* Per-Thread Cache: allocates from its own list, frees foreign slots in batches */
+typedef struct SlabCache
+{
+    struct Slab* slab;                              // shared block source
+    SlabSlot* free;                                 // slots only this thread touches
+    SlabBatch batches[SLAB_OWNERS];                 // partial batches bound for other owners
+    struct SlabCache* next;                         // every cache of the slab (freed with it)
+    SlabSlot* returned __attribute__((aligned(CACHE_LINE))); // chains pushed back by other threads
+} SlabCache;
+
+/* Slot Pool: owns every block & cache so slots can outlive the thread that allocated them */
+typedef struct Slab
+{
+    size_t stride;                                  // header + payload, rounded up for alignment
+    pthread_mutex_t lock;                           // guards blocks & caches (taken per block, not per slot)
+    void* blocks;                                   // singly linked through each block's first word
+    SlabCache* caches;
+    unsigned long nblocks;                          // heap allocations made for slots
+} Slab;
+
+
+/* Creates a pool of size byte slots, NULL on failure */
+Slab* slab_create(size_t size);
+
+/* Frees every block & cache (all threads using the pool must be done) */
+void slab_destroy(Slab* slab);
+
+/* Creates the calling thread's cache, NULL on failure */
+SlabCache* slab_cache(Slab* slab);
+
+/* Returns a slot from the thread's cache, carving a new block only when nothing came back, NULL on failure */
+void* slab_alloc(SlabCache* sc);
+
+/* Frees a slot: straight onto the list if sc owns it, otherwise into a batch for its owner */
+void slab_free(SlabCache* sc, void* ptr);
+
+/* Hands every partial batch back to its owner (call before the thread exits) */
+void slab_flush(SlabCache* sc);
+
+/* Heap allocations the pool has made so far */
+unsigned long slab_allocations(Slab* slab);
+
+#endif
@@ -0,0 +1,215 @@
+// Connor Humiston
+// Streaming Input Implementation
+#include "stream.h"
+
+#include <stdio.h>                                  // standard i/o
+#include <string.h>                                 // memchr(), memmove()
+#include <errno.h>                                  // EINTR
+#include <fcntl.h>                                  // open()
+#include <poll.h>                                   // poll()
+#include <unistd.h>                                 // read(), close()
+#include <stdint.h>                                 // uint64_t
+#include <sys/eventfd.h>                            // eventfd()
+#include <sys/socket.h>                             // socket(), accept()
+#include <sys/un.h>                                 // sockaddr_un
+
+
+/* Creates a listening Unix stream socket at path, -1 on failure */
+static int listen_unix(const char* path)
+{
+    struct sockaddr_un addr;
+    int fd;
+    if(strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+        return -1;
+    unlink(path);                                   // a stale socket from an earlier run would block bind()
+    if(bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(fd, STREAM_BACKLOG) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Opens "-" (stdin), "unix:PATH" (listens on a Unix stream socket) or a path (e.g. a FIFO), NULL on failure */
+Stream* stream_open(const char* spec)
+{
+    Stream* s = malloc(sizeof(*s));
+    if(!s)
+        return NULL;
+    s->fd = s->listenfd = -1;
+    s->stopping = 0;
+    s->drained = 0;
+    s->path = NULL;
+    pthread_mutex_init(&s->lock, NULL);
+    if((s->stopfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0)
+    {
+        free(s);
+        return NULL;
+    }
+    if(strcmp(spec, "-") == 0)
+        s->fd = STDIN_FILENO;
+    else if(strncmp(spec, "unix:", 5) == 0)
+    {
+        s->path = strdup(spec + 5);
+        if(s->path)
+            s->listenfd = listen_unix(s->path);
+    }
+    else
+        s->fd = open(spec, O_RDONLY | O_CLOEXEC);   // blocks until a FIFO has a writer
+    if(s->fd < 0 && s->listenfd < 0)
+    {
+        free(s->path);
+        close(s->stopfd);
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+/* Wakes every blocked reader & makes further reads fail; lines already read are still handed out (async-signal-safe) */
+void stream_stop(Stream* s)
+{
+    uint64_t one = 1;
+    __atomic_store_n(&s->stopping, 1, __ATOMIC_RELEASE);
+    if(write(s->stopfd, &one, sizeof(one)) < 0)     // stays readable, so every poll() returns
+        return;
+}
+
+/* Closes the source (removes a Unix socket path) & frees it */
+void stream_close(Stream* s)
+{
+    if(s->listenfd >= 0)
+    {
+        close(s->listenfd);
+        unlink(s->path);
+    }
+    else if(s->fd != STDIN_FILENO)
+        close(s->fd);
+    close(s->stopfd);
+    pthread_mutex_destroy(&s->lock);
+    free(s->path);
+    free(s);
+}
+
+/* Sleeps until fd is readable, returns -1 if the stream was stopped first */
+static int stream_wait(Stream* s, int fd)
+{
+    struct pollfd fds[2];
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = s->stopfd;
+    fds[1].events = POLLIN;
+    while(!__atomic_load_n(&s->stopping, __ATOMIC_ACQUIRE))
+    {
+        if(poll(fds, 2, -1) < 0 && errno != EINTR)
+            return -1;
+        if(fds[1].revents)
+            return -1;
+        if(fds[0].revents)                          // data, EOF or an error: read() tells which
+            return 0;
+    }
+    return -1;
+}
+
+/* Waits for the next connection (or hands out the shared fd once), -1 on stop or error */
+int stream_attach(Stream* s, LineReader* rd)
+{
+    rd->start = rd->len = 0;
+    if(s->listenfd < 0)
+    {
+        pthread_mutex_lock(&s->lock);               // a pipe's lines can't be split between readers
+        if(s->drained || __atomic_load_n(&s->stopping, __ATOMIC_ACQUIRE))
+        {
+            pthread_mutex_unlock(&s->lock);
+            return -1;                              // another requester already read it to the end
+        }
+        rd->fd = s->fd;
+        return 0;
+    }
+    while(stream_wait(s, s->listenfd) == 0)
+    {
+        if((rd->fd = accept(s->listenfd, NULL, NULL)) >= 0)
+        {
+            fcntl(rd->fd, F_SETFD, FD_CLOEXEC);
+            return 0;
+        }
+        if(errno != EINTR && errno != EAGAIN && errno != ECONNABORTED)
+        {
+            fprintf(stderr, "Error accepting a stream connection.\n");
+            return -1;
+        }
+    }
+    return -1;
+}
+
+/* Ends the reader's turn: closes a connection or releases the shared fd */
+void stream_detach(Stream* s, LineReader* rd)
+{
+    if(s->listenfd >= 0)
+        close(rd->fd);
+    else
+    {
+        s->drained = 1;                             // read to EOF (or stopped): nobody else should try
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+/* Next line without its newline, pointing into rd->buf until the next call; -1 on EOF, or on stop once the
+ * complete lines already read are used up */
+int stream_readline(Stream* s, LineReader* rd, Name* name)
+{
+    while(1)
+    {
+        char* nl = memchr(rd->buf + rd->start, '\n', rd->len - rd->start);
+        size_t end;
+        ssize_t n;
+        if(nl || (rd->start < rd->len && rd->len == STREAM_READ_SIZE && rd->start == 0))
+        {
+            end = nl ? (size_t) (nl - rd->buf) : rd->len; // a line filling the whole buffer is cut here
+            name->str = rd->buf + rd->start;
+            name->len = (uint32_t) (end - rd->start);
+            name->flags = 0;
+            name->hash = 0;
+            if(name->len > 0 && name->str[name->len - 1] == '\r')
+                name->len--;
+            rd->start = nl ? end + 1 : end;
+            return 0;
+        }
+        if(rd->start > 0)                           // keep the partial line, make room behind it
+        {
+            memmove(rd->buf, rd->buf + rd->start, rd->len - rd->start);
+            rd->len -= rd->start;
+            rd->start = 0;
+        }
+        if(stream_wait(s, rd->fd) != 0)             // stopped: no more reads (a partial line was never finished)
+            return -1;
+        n = read(rd->fd, rd->buf + rd->len, STREAM_READ_SIZE - rd->len);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+        {
+            if(rd->len > 0)                         // last line without a newline
+            {
+                name->str = rd->buf;
+                name->len = (uint32_t) rd->len;
+                name->flags = 0;
+                name->hash = 0;
+                rd->len = rd->start = 0;
+                return 0;
+            }
+            return -1;
+        }
+        rd->len += (size_t) n;
+    }
+}
+
+/* 1 if another line can be returned without reading from the descriptor */
+int stream_buffered(const LineReader* rd)
+{
+    return memchr(rd->buf + rd->start, '\n', rd->len - rd->start) != NULL;
+}
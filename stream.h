@@ -0,0 +1,59 @@
+// Connor Humiston
+// Streaming Input Header
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <pthread.h>                                // shared fd reader lock
+
+#include "queue.h"                                  // Name slices
+
+#define STREAM_READ_SIZE        (64 * 1024)         // bytes per read() from a stream
+#define STREAM_BACKLOG          16                  // pending connections on a Unix socket
+
+
+/* Streaming Source: stdin, a named pipe or a listening Unix socket, read until EOF or stop */
+typedef struct Stream
+{
+    int fd;                                         // stdin/FIFO descriptor (-1 when listening)
+    int listenfd;                                   // Unix socket listener (-1 otherwise)
+    int stopfd;                                     // eventfd that wakes every blocked reader on shutdown
+    int stopping;                                   // set once stream_stop() was called
+    int drained;                                    // shared fd already read to the end
+    pthread_mutex_t lock;                           // one requester at a time owns a shared fd
+    char* path;                                     // socket path to unlink (NULL otherwise)
+} Stream;
+
+/* One Requester's Line Splitter over a Descriptor */
+typedef struct LineReader
+{
+    int fd;                                         // descriptor being read
+    size_t start;                                   // first unconsumed byte
+    size_t len;                                     // bytes in buf
+    char buf[STREAM_READ_SIZE];
+} LineReader;
+
+
+/* Opens "-" (stdin), "unix:PATH" (listens on a Unix stream socket) or a path (e.g. a FIFO), NULL on failure */
+Stream* stream_open(const char* spec);
+
+/* Wakes every blocked reader & makes further reads fail; lines already read are still handed out (async-signal-safe) */
+void stream_stop(Stream* s);
+
+/* Closes the source (removes a Unix socket path) & frees it */
+void stream_close(Stream* s);
+
+/* Waits for the next connection (or hands out the shared fd once), -1 on stop or error */
+int stream_attach(Stream* s, LineReader* rd);
+
+/* Ends the reader's turn: closes a connection or releases the shared fd */
+void stream_detach(Stream* s, LineReader* rd);
+
+/* Next line without its newline, pointing into rd->buf until the next call; -1 on EOF, or on stop once the
+ * complete lines already read are used up */
+int stream_readline(Stream* s, LineReader* rd, Name* name);
+
+/* 1 if another line can be returned without reading from the descriptor */
+int stream_buffered(const LineReader* rd);
+
+#endif
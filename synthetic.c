@@ -0,0 +1,247 @@
+// Connor Humiston
+// Synthetic Resolver Backend Implementation
+#include "synthetic.h"
+
+#include <stdio.h>                                  // snprintf()
+#include <string.h>                                 // C string library
+#include <ctype.h>                                  // tolower()
+#include <math.h>                                   // exp(), log(), sqrt(), cos()
+#include <time.h>                                   // clock_gettime(), nanosleep()
+#include <pthread.h>                                // pthread_self() for per-thread seeds
+
+#include "util.h"                                   // UTIL_SUCCESS/UTIL_FAILURE
+#include "options.h"                                // synthetic settings
+
+
+/* Lookup Waiting for its Modelled Latency */
+typedef struct SynthPending
+{
+    double due;                                     // monotonic time the answer is released
+    void* user;                                     // caller's handle
+    int status;                                     // precomputed outcome
+    char ip[INET6_ADDRSTRLEN];                      // precomputed address(es), both fit in this too
+} SynthPending;
+
+/* Per-Thread State: a min-heap of pending lookups ordered by due time */
+typedef struct SynthState
+{
+    const Options* opts;                            // latency model, failure rate & capacity
+    uint64_t rng;                                   // xorshift state for latency draws
+    int cap;                                        // heap capacity
+    int n;                                          // pending lookups
+    SynthPending heap[];
+} SynthState;
+
+
+/* Current monotonic time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* Uniform double in (0, 1] from the thread's xorshift64* stream */
+static double next_unit(SynthState* s)
+{
+    s->rng ^= s->rng >> 12;
+    s->rng ^= s->rng << 25;
+    s->rng ^= s->rng >> 27;
+    return ((s->rng * 2685821657736338717ULL >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+/* Draws one latency in seconds from the configured distribution */
+static double draw_latency(SynthState* s)
+{
+    const SynthLatency* l = &s->opts->synth_latency;
+    double ms;
+    switch(l->dist)
+    {
+        case SYNTH_UNIFORM:
+            ms = l->a + (l->b - l->a) * next_unit(s);
+            break;
+        case SYNTH_LOGNORMAL:                       // median * e^(sigma * N(0,1)), Box-Muller for the normal
+            ms = l->a * exp(l->b * sqrt(-2.0 * log(next_unit(s))) * cos(2.0 * M_PI * next_unit(s)));
+            break;
+        default:
+            ms = l->a;
+    }
+    return ms / 1000.0;
+}
+
+/* Restores the heap order upwards from slot i */
+static void sift_up(SynthState* s, int i)
+{
+    SynthPending tmp = s->heap[i];
+    while(i > 0 && s->heap[(i - 1) / 2].due > tmp.due)
+    {
+        s->heap[i] = s->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    s->heap[i] = tmp;
+}
+
+/* Restores the heap order downwards from slot i */
+static void sift_down(SynthState* s, int i)
+{
+    SynthPending tmp = s->heap[i];
+    while(2 * i + 1 < s->n)
+    {
+        int c = 2 * i + 1;                          // earlier-due child
+        if(c + 1 < s->n && s->heap[c+1].due < s->heap[c].due)
+            c++;
+        if(s->heap[c].due >= tmp.due)
+            break;
+        s->heap[i] = s->heap[c];
+        i = c;
+    }
+    s->heap[i] = tmp;
+}
+
+/* Parses fixed:MS, uniform:MIN:MAX or lognormal:MEDIAN:SIGMA, returns 0 or -1 if malformed */
+int synthetic_parse_latency(const char* spec, SynthLatency* out)
+{
+    char extra;                                     // catches trailing garbage
+    if(sscanf(spec, "fixed:%lf%c", &out->a, &extra) == 1 && out->a >= 0)
+    {
+        out->dist = SYNTH_FIXED;
+        out->b = 0;
+        return 0;
+    }
+    if(sscanf(spec, "uniform:%lf:%lf%c", &out->a, &out->b, &extra) == 2 && out->a >= 0 && out->b >= out->a)
+    {
+        out->dist = SYNTH_UNIFORM;
+        return 0;
+    }
+    if(sscanf(spec, "lognormal:%lf:%lf%c", &out->a, &out->b, &extra) == 2 && out->a >= 0 && out->b >= 0)
+    {
+        out->dist = SYNTH_LOGNORMAL;
+        return 0;
+    }
+    return -1;
+}
+
+/* Address & outcome for a name: fills ip with a 10/8 address, an fd00::/8 one or with all set both (family AF_UNSPEC)
+ * & returns UTIL_SUCCESS, or UTIL_FAILURE for ~fail_rate of names */
+int synthetic_answer(const char* hostname, double fail_rate, int family, int all, char* ip, int maxSize)
+{
+    uint64_t hash = 14695981039346656037ULL;        // FNV-1a of the lowercased name, trailing dot ignored
+    size_t len = strlen(hostname);
+    size_t i;
+
+    while(len > 0 && hostname[len-1] == '.')
+        len--;
+    for(i = 0; i < len; i++)
+        hash = (hash ^ (unsigned char) tolower((unsigned char) hostname[i])) * 1099511628211ULL;
+    hash ^= hash >> 33;                             // mix so low & high bits both depend on every byte
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    if(len == 0 || (double) (hash >> 40) / (double) (1 << 24) < fail_rate) // same names fail on every run
+        return UTIL_FAILURE;
+    unsigned a = (unsigned) (hash >> 16) & 0xFF, b = (unsigned) (hash >> 8) & 0xFF, c = (unsigned) (hash & 0xFF);
+    if(family == AF_INET6)
+        snprintf(ip, maxSize, "fd00::10:%x:%x:%x", a, b, c);
+    else if(family == AF_UNSPEC && all)             // a dual-stack name: both families, IPv4 first like getaddrinfo
+        snprintf(ip, maxSize, "10.%u.%u.%u, fd00::10:%x:%x:%x", a, b, c, a, b, c);
+    else
+        snprintf(ip, maxSize, "10.%u.%u.%u", a, b, c);
+    return UTIL_SUCCESS;
+}
+
+static void* synth_init(const Options* opts)
+{
+    int cap = opts->synth_inflight * (opts->hedge > 0 ? 2 : 1); // room for a hedge per name
+    SynthState* s = malloc(sizeof(*s) + sizeof(SynthPending) * cap);
+    if(!s)
+        return NULL;
+    s->opts = opts;
+    s->cap = cap;
+    s->n = 0;
+    s->rng = (opts->synth_seed + 1) * 0x9E3779B97F4A7C15ULL ^ (uint64_t) pthread_self(); // per-thread stream
+    if(s->rng == 0)
+        s->rng = 1;
+    return s;
+}
+
+static int synth_submit(void* state, const char* hostname, void* user)
+{
+    SynthState* s = (SynthState*) state;
+    SynthPending* p;
+    if(s->n == s->cap)
+        return BACKEND_FULL;
+    p = &s->heap[s->n];
+    p->user = user;
+    p->status = synthetic_answer(hostname, s->opts->synth_fail, s->opts->family, s->opts->all_addrs,
+                                 p->ip, INET6_ADDRSTRLEN);
+    p->due = now() + draw_latency(s);
+    sift_up(s, s->n++);
+    return 0;
+}
+
+/* Sleeps until the earliest lookup is due (at most timeout_ms), then releases every due lookup */
+static int synth_complete(void* state, int timeout_ms, LookupResult* out, int max)
+{
+    SynthState* s = (SynthState*) state;
+    int n = 0;
+    double t;
+
+    if(s->n == 0)
+        return 0;
+    t = now();
+    if(s->heap[0].due > t)
+    {
+        double wait = s->heap[0].due - t;
+        if(timeout_ms >= 0 && wait > timeout_ms / 1000.0)
+            wait = timeout_ms / 1000.0;
+        struct timespec ts = { (time_t) wait, (long) ((wait - (time_t) wait) * 1e9) };
+        nanosleep(&ts, NULL);
+        t = now();
+    }
+    while(s->n > 0 && s->heap[0].due <= t && n < max)
+    {
+        out[n].user = s->heap[0].user;
+        out[n].status = s->heap[0].status;
+        memcpy(out[n].ip, s->heap[0].ip, INET6_ADDRSTRLEN);
+        n++;
+        s->heap[0] = s->heap[--s->n];               // pop the root
+        if(s->n > 0)
+            sift_down(s, 0);
+    }
+    return n;
+}
+
+/* Removes the lookup submitted with user from the heap */
+static void synth_cancel(void* state, void* user)
+{
+    SynthState* s = (SynthState*) state;
+    int i;
+    for(i = 0; i < s->n; i++)
+    {
+        if(s->heap[i].user != user)
+            continue;
+        s->heap[i] = s->heap[--s->n];               // fill the hole with the last lookup & re-sort it
+        if(i < s->n)
+        {
+            if(i > 0 && s->heap[(i - 1) / 2].due > s->heap[i].due)
+                sift_up(s, i);
+            else
+                sift_down(s, i);
+        }
+        return;
+    }
+}
+
+static int synth_pending(void* state)
+{
+    return ((SynthState*) state)->n;
+}
+
+static int synth_capacity(const Options* opts)
+{
+    return opts->synth_inflight;
+}
+
+const Backend synthetic_backend =
+{
+    "synthetic", synth_init, synth_submit, synth_complete, synth_cancel, synth_pending, synth_capacity, free
+};
@@ -0,0 +1,37 @@
+// Connor Humiston
+// Synthetic Resolver Backend Header
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include <stdint.h>                                 // fixed width integer types
+
+#include "backend.h"                                // Backend interface
+
+/* Latency Distributions (--synth-latency) */
+#define SYNTH_FIXED             0                   // fixed:MS
+#define SYNTH_UNIFORM           1                   // uniform:MIN_MS:MAX_MS
+#define SYNTH_LOGNORMAL         2                   // lognormal:MEDIAN_MS:SIGMA (long tail)
+
+#define DEFAULT_SYNTH_INFLIGHT  1                   // behaves like a blocking lookup by default
+
+
+/* Latency Model */
+typedef struct SynthLatency
+{
+    int dist;                                       // SYNTH_FIXED, SYNTH_UNIFORM or SYNTH_LOGNORMAL
+    double a;                                       // fixed ms, uniform min, lognormal median
+    double b;                                       // uniform max, lognormal sigma
+} SynthLatency;
+
+/* In-process backend: deterministic answers from a hash of the name after a modelled delay */
+extern const Backend synthetic_backend;
+
+
+/* Parses fixed:MS, uniform:MIN:MAX or lognormal:MEDIAN:SIGMA, returns 0 or -1 if malformed */
+int synthetic_parse_latency(const char* spec, SynthLatency* out);
+
+/* Address & outcome for a name: fills ip with a 10/8 address, an fd00::/8 one or with all set both (family AF_UNSPEC)
+ * & returns UTIL_SUCCESS, or UTIL_FAILURE for ~fail_rate of names */
+int synthetic_answer(const char* hostname, double fail_rate, int family, int all, char* ip, int maxSize);
+
+#endif
@@ -0,0 +1,46 @@
+#!/bin/sh
+# Connor Humiston
+# Async Engine Test: answers, NXDOMAIN, a dropped query (timeout & retry) and a truncated reply from a stub
+# nameserver on 127.0.0.1
+#
+# usage: sh tests/async.sh [PORT]   (run from the directory holding multi-lookup & dnsquery; make check does both)
+
+port=${1:-15354}
+dir=$(mktemp -d "${TMPDIR:-/tmp}/async.XXXXXX") || exit 1
+failed=0
+
+./dnsquery --respond "$port" > "$dir/asked.txt" &
+stub=$!
+trap 'kill "$stub" 2> /dev/null; rm -rf "$dir"' EXIT
+sleep 0.5
+
+printf '%s\n' ok.example.com nx.example.com drop.example.com drop1.example.com tc.example.com > "$dir/names.txt"
+if ! ./multi-lookup --engine=async --nameserver="127.0.0.1:$port" --dns-timeout=300 --dns-retries=1 1 1 \
+        "$dir/serviced.txt" "$dir/resolved.txt" "$dir/names.txt" > "$dir/out.txt" 2>&1; then
+    echo "FAIL: multi-lookup exited with an error:" >&2
+    cat "$dir/out.txt" >&2
+    exit 1
+fi
+
+# expect NAME LOGLINE TRIES : compares the name's resolver log line & how often the stub was asked
+expect()
+{
+    got=$(grep "^$1," "$dir/resolved.txt")
+    if [ "$got" != "$1, $2" ]; then
+        echo "FAIL: $1 logged \"$got\", expected \"$1, $2\"" >&2
+        failed=1
+    fi
+    tries=$(grep -c "^${1%%.*}\$" "$dir/asked.txt")
+    if [ "$tries" -ne "$3" ]; then
+        echo "FAIL: $1 was asked $tries times, expected $3" >&2
+        failed=1
+    fi
+}
+
+expect ok.example.com 10.0.0.1 1
+expect nx.example.com NOT_RESOLVED 1
+expect drop.example.com NOT_RESOLVED 2                  # first try & one retransmission, both unanswered
+expect drop1.example.com 10.0.0.1 2                     # the retransmission is answered
+expect tc.example.com NOT_RESOLVED 1                    # truncated: finished at once, no retry
+[ "$failed" -eq 0 ] && echo "async: all checks passed"
+exit "$failed"
@@ -0,0 +1,166 @@
+// Connor Humiston
+// Raw DNS Query Sender: asks 127.0.0.1:PORT one question whose labels are taken byte for byte from the arguments;
+// with --respond it is instead a stub nameserver on 127.0.0.1:PORT whose answer depends on the first label
+#include <stdio.h>                                  // standard i/o
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <stdint.h>                                 // fixed width integer types
+#include <string.h>                                 // C string library
+#include <unistd.h>                                 // close()
+#include <poll.h>                                   // poll()
+#include <arpa/inet.h>                              // htons(), htonl()
+#include <netinet/in.h>                             // sockaddr_in
+
+#define QUERY_TIMEOUT_MS        2000
+#define STUB_SEEN               1024                // names remembered for "drop1"
+
+
+/* Builds the stub's reply to the query in msg[0..len) into ans, returns its length or 0 to stay silent:
+ * first label "nx" is NXDOMAIN, "tc" truncated with no answer, "drop" never answered, "drop1" answered from
+ * the second try on & anything else one address (10.0.0.1 or ::1) */
+static size_t stub_answer(const uint8_t* msg, size_t len, uint8_t* ans, char seen[][256], int* nseen)
+{
+    char name[256];
+    size_t pos = 12, first;
+    int i, qtype;
+
+    if(len < 17 || (msg[2] & 0x80) || msg[4] != 0 || msg[5] != 1)
+        return 0;                                   // not a query with one question
+    while(pos < len && msg[pos] != 0 && msg[pos] < 64)
+        pos += msg[pos] + 1;
+    if(pos + 5 > len || msg[pos] != 0 || pos - 12 >= sizeof(name))
+        return 0;
+    first = msg[12];
+    memcpy(name, msg + 12, pos - 12);               // the encoded name is enough to tell repeats apart
+    name[pos - 12] = '\0';
+    pos += 5;                                       // root label, qtype & qclass
+    qtype = msg[pos - 3];
+
+    if(first == 4 && memcmp(msg + 13, "drop", 4) == 0)
+        return 0;
+    if(first == 5 && memcmp(msg + 13, "drop1", 5) == 0)
+    {
+        for(i = 0; i < *nseen && strcmp(seen[i], name) != 0; i++)
+            ;
+        if(i == *nseen)                             // first try: remember it & stay silent
+        {
+            if(*nseen < STUB_SEEN)
+                strcpy(seen[(*nseen)++], name);
+            return 0;
+        }
+    }
+
+    memcpy(ans, msg, pos);                          // header & question echoed
+    ans[2] = (uint8_t) (0x80 | (msg[2] & 0x79));    // QR, opcode & RD kept
+    ans[3] = 0x80;                                  // RA, NOERROR
+    memset(ans + 6, 0, 6);                          // no records yet
+    if(first == 2 && memcmp(msg + 13, "nx", 2) == 0)
+        ans[3] |= 3;
+    else if(first == 2 && memcmp(msg + 13, "tc", 2) == 0)
+        ans[2] |= 0x02;                             // TC, and the answer that didn't fit is left out
+    else
+    {
+        static const uint8_t v4[4] = { 10, 0, 0, 1 };
+        static const uint8_t v6[16] = { [15] = 1 };
+        size_t rdlen = qtype == 28 ? 16 : 4;
+        uint8_t rr[12] = { 0xC0, 12, 0, (uint8_t) qtype, 0, 1, 0, 0, 0, 60, 0, (uint8_t) rdlen };
+        memcpy(ans + pos, rr, sizeof(rr));          // pointer to the question's name, type, IN, ttl 60
+        memcpy(ans + pos + sizeof(rr), qtype == 28 ? v6 : v4, rdlen);
+        pos += sizeof(rr) + rdlen;
+        ans[7] = 1;
+    }
+    return pos;
+}
+
+/* Runs the stub nameserver until killed, printing each question's first label as it arrives */
+static int respond(int port)
+{
+    static char seen[STUB_SEEN][256];
+    uint8_t msg[512], ans[512];
+    struct sockaddr_in at, from;
+    int fd, nseen = 0;
+
+    memset(&at, 0, sizeof(at));
+    at.sin_family = AF_INET;
+    at.sin_port = htons((uint16_t) port);
+    at.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0 || bind(fd, (struct sockaddr*) &at, sizeof(at)) != 0)
+    {
+        perror("dnsquery");
+        return EXIT_FAILURE;
+    }
+    while(1)
+    {
+        socklen_t fromlen = sizeof(from);
+        ssize_t n = recvfrom(fd, msg, sizeof(msg), 0, (struct sockaddr*) &from, &fromlen);
+        size_t len;
+        if(n < 13)
+            continue;
+        printf("%.*s\n", msg[12] < 64 && (ssize_t) msg[12] + 13 <= n ? msg[12] : 0, (const char*) msg + 13);
+        fflush(stdout);
+        if((len = stub_answer(msg, (size_t) n, ans, seen, &nseen)) > 0)
+            sendto(fd, ans, len, 0, (struct sockaddr*) &from, fromlen);
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    uint8_t msg[512], ans[512];
+    struct sockaddr_in to;
+    struct pollfd pfd;
+    size_t pos = 12;
+    ssize_t n;
+    int i, fd, qtype;
+
+    if(argc == 3 && strcmp(argv[1], "--respond") == 0)
+        return respond(atoi(argv[2]));
+    if(argc < 4 || (qtype = strcmp(argv[2], "AAAA") == 0 ? 28 : strcmp(argv[2], "A") == 0 ? 1 : 0) == 0)
+    {
+        fprintf(stderr, "usage: dnsquery PORT A|AAAA LABEL...\n");
+        fprintf(stderr, "  prints the answer's rcode & answer count, or \"timeout\"\n");
+        fprintf(stderr, "       dnsquery --respond PORT\n");
+        fprintf(stderr, "  stub nameserver: first label nx, tc, drop, drop1 (answered on retry) or anything (an address)\n");
+        return EXIT_FAILURE;
+    }
+    memset(msg, 0, 12);
+    msg[0] = 0x12;                                  // ID
+    msg[1] = 0x34;
+    msg[2] = 0x01;                                  // RD
+    msg[5] = 1;                                     // one question
+    for(i = 3; i < argc; i++)                       // no checks on purpose: any byte may go into a label
+    {
+        size_t len = strlen(argv[i]);
+        if(len > 63 || pos + len + 6 > sizeof(msg))
+            return EXIT_FAILURE;
+        msg[pos++] = (uint8_t) len;
+        memcpy(msg + pos, argv[i], len);
+        pos += len;
+    }
+    msg[pos++] = 0;
+    msg[pos++] = 0;
+    msg[pos++] = (uint8_t) qtype;
+    msg[pos++] = 0;
+    msg[pos++] = 1;                                 // IN
+
+    memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_port = htons((uint16_t) atoi(argv[1]));
+    to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ||
+       sendto(fd, msg, pos, 0, (struct sockaddr*) &to, sizeof(to)) != (ssize_t) pos)
+    {
+        perror("dnsquery");
+        return EXIT_FAILURE;
+    }
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if(poll(&pfd, 1, QUERY_TIMEOUT_MS) <= 0 || (n = recv(fd, ans, sizeof(ans), 0)) < 12)
+    {
+        printf("timeout\n");
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    printf("rcode=%d answers=%d\n", ans[3] & 0x0F, (ans[6] << 8) | ans[7]);
+    close(fd);
+    return 0;
+}
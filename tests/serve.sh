@@ -0,0 +1,51 @@
+#!/bin/sh
+# Connor Humiston
+# Server Mode Test: questions that aren't valid hostnames are answered FORMERR and never reach the logs
+#
+# usage: sh tests/serve.sh [PORT]   (run from the directory holding multi-lookup & dnsquery; make check does both)
+
+port=${1:-15353}
+dir=$(mktemp -d "${TMPDIR:-/tmp}/serve.XXXXXX") || exit 1
+failed=0
+
+./multi-lookup --serve="$port" --engine=synthetic 1 1 "$dir/queried.txt" "$dir/resolved.txt" > "$dir/out.txt" 2>&1 &
+server=$!
+trap 'kill "$server" 2> /dev/null; rm -rf "$dir"' EXIT
+sleep 0.5
+
+# expect LABEL... : sends the question & compares the printed rcode/answers
+expect()
+{
+    want="$1"
+    shift
+    got=$(./dnsquery "$port" A "$@")
+    if [ "$got" != "$want" ]; then
+        echo "FAIL: query $* answered \"$got\", expected \"$want\"" >&2
+        failed=1
+    fi
+}
+
+expect "rcode=0 answers=1" valid example com
+expect "rcode=1 answers=0" "$(printf 'bad\nname')" com
+expect "rcode=1 answers=0" "$(printf 'tab\tname')" com
+expect "rcode=1 answers=0" "$(printf 'bell\007')" com
+expect "rcode=1 answers=0" "a.b" com
+expect "rcode=1 answers=0" "bad name" com
+expect "rcode=0 answers=1" UPPER Example COM
+
+kill -TERM "$server"
+wait "$server"
+for log in queried.txt resolved.txt; do
+    if grep -qv -e '^valid\.example\.com' -e '^upper\.example\.com' "$dir/$log"; then
+        echo "FAIL: $log holds lines that weren't asked for:" >&2
+        cat "$dir/$log" >&2
+        failed=1
+    fi
+done
+if ! grep -q "5 invalid" "$dir/out.txt"; then
+    echo "FAIL: expected 5 invalid queries in the counters:" >&2
+    cat "$dir/out.txt" >&2
+    failed=1
+fi
+[ "$failed" -eq 0 ] && echo "serve: all checks passed"
+exit "$failed"
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Connor Humiston
+# Stream Mode Test: SIGTERM mid-stream still resolves & logs every line the program already read from the pipe
+#
+# usage: sh tests/stream.sh   (run from the directory holding multi-lookup; make check does both)
+
+names=600
+dir=$(mktemp -d "${TMPDIR:-/tmp}/stream.XXXXXX") || exit 1
+failed=0
+mkfifo "$dir/names" || exit 1
+
+# The writer sends every name in one write (well under the pipe & read buffer sizes) and keeps the pipe open, so
+# one read takes them all & the run can only end by the signal. With 1 resolver at 5 ms a name and a small queue,
+# most names are still in the reader's buffer when it comes
+seq "$names" | sed 's/^/host/; s/$/.example.com/' > "$dir/list.txt"
+{ cat "$dir/list.txt"; sleep 10; } > "$dir/names" &
+writer=$!
+./multi-lookup --stream="$dir/names" --engine=synthetic --synth-latency=fixed:5 --queue-size=16 1 1 \
+        "$dir/serviced.txt" "$dir/resolved.txt" > "$dir/out.txt" 2>&1 &
+run=$!
+trap 'kill "$run" "$writer" 2> /dev/null; rm -rf "$dir"' EXIT
+sleep 1
+
+early=$(wc -l < "$dir/resolved.txt")
+kill -TERM "$run"
+wait "$run"
+if [ "$early" -ge "$names" ]; then
+    echo "FAIL: all $names names were resolved before SIGTERM, the test proves nothing" >&2
+    failed=1
+fi
+for log in serviced.txt resolved.txt; do
+    got=$(wc -l < "$dir/$log")
+    if [ "$got" -ne "$names" ]; then
+        echo "FAIL: $log holds $got lines after SIGTERM, expected all $names names read before it" >&2
+        failed=1
+    fi
+done
+[ "$failed" -eq 0 ] && echo "stream: all checks passed ($early of $names resolved before SIGTERM)"
+exit "$failed"
@@ -0,0 +1,221 @@
+// Connor Humiston
+// CPU Topology & Thread Placement Implementation
+#define _GNU_SOURCE                                 // cpu_set_t & pthread_setaffinity_np()
+#include "topology.h"
+
+#include <string.h>                                 // C string library
+#include <pthread.h>                                // pthread_setaffinity_np()
+#include <sched.h>                                  // sched_getaffinity(), CPU_* macros
+#include <dirent.h>                                 // opendir()
+
+
+/* Parses a sysfs CPU list ("0-3,8,10-11") into set, returns 0 or -1 if it isn't one */
+static int parse_cpulist(const char* s, cpu_set_t* set)
+{
+    CPU_ZERO(set);
+    while(*s && *s != '\n')
+    {
+        char* end;
+        long lo = strtol(s, &end, 10), hi = lo, c;
+        if(end == s || lo < 0)
+            return -1;
+        if(*end == '-')
+        {
+            s = end + 1;
+            hi = strtol(s, &end, 10);
+            if(end == s || hi < lo)
+                return -1;
+        }
+        for(c = lo; c <= hi && c < CPU_SETSIZE; c++)
+            CPU_SET(c, set);
+        s = *end == ',' ? end + 1 : end;
+    }
+    return 0;
+}
+
+/* Marks the NUMA node (numbered in directory order) of every CPU in nodeof, returns the number of nodes */
+static int read_nodes(int* nodeof)
+{
+    DIR* dir = opendir(TOPOLOGY_NODE_DIR);
+    struct dirent* e;
+    int nnodes = 0;
+    if(!dir)
+        return 0;
+    while((e = readdir(dir)))
+    {
+        char path[300], line[4096];
+        cpu_set_t set;
+        FILE* fp;
+        int c, id;
+        if(sscanf(e->d_name, "node%d", &id) != 1)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s/cpulist", TOPOLOGY_NODE_DIR, e->d_name);
+        if(!(fp = fopen(path, "r")))
+            continue;
+        if(fgets(line, sizeof(line), fp) && parse_cpulist(line, &set) == 0)
+        {
+            for(c = 0; c < CPU_SETSIZE; c++)
+            {
+                if(CPU_ISSET(c, &set))
+                    nodeof[c] = nnodes;
+            }
+            nnodes++;
+        }
+        fclose(fp);
+    }
+    closedir(dir);
+    return nnodes;
+}
+
+/* Reads the NUMA nodes & allowed CPUs & splits them into lanes, never more than there are requesters or
+ * resolvers; NULL on failure */
+Topology* topology_create(int mode, int requesters, int resolvers)
+{
+    cpu_set_t allowed;
+    Topology* t;
+    int* nodeof;                                    // dense node index of each CPU
+    int cap = requesters < resolvers ? requesters : resolvers; // a lane needs a resolver, & one without a requester is idle
+    int used, l, c, n;
+
+    if(cap < 1)
+        cap = 1;
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+        return NULL;
+    t = calloc(1, sizeof(*t) + sizeof(TopoLane) * cap);
+    nodeof = calloc(CPU_SETSIZE, sizeof(int));
+    if(!t || !nodeof || !(t->cpus = malloc(sizeof(int) * CPU_COUNT(&allowed))))
+    {
+        free(nodeof);
+        topology_destroy(t);
+        return NULL;
+    }
+    t->mode = mode;
+    t->requesters = requesters;
+    t->ncpus = CPU_COUNT(&allowed);
+
+    // Nodes: Merge Them Round Robin When There Are More Than Lanes
+    if(mode == AFFINITY_NODE)
+    {
+        int* lane_of = calloc(CPU_SETSIZE, sizeof(int)); // node -> 1 + its index among the nodes we may run on
+        if(!lane_of)
+        {
+            free(nodeof);
+            topology_destroy(t);
+            return NULL;
+        }
+        read_nodes(nodeof);                         // CPUs in no node (or no sysfs at all) stay on node 0
+        for(c = used = 0; c < CPU_SETSIZE; c++)
+        {
+            if(CPU_ISSET(c, &allowed) && !lane_of[nodeof[c]])
+                lane_of[nodeof[c]] = ++used;        // nodes with none of our CPUs are skipped
+        }
+        for(c = 0; c < CPU_SETSIZE; c++)
+            nodeof[c] = lane_of[nodeof[c]] - 1;
+        free(lane_of);
+        t->nlanes = used < cap ? used : cap;
+        if(t->nlanes < 1)
+            t->nlanes = 1;
+        for(l = n = 0; l < t->nlanes; l++)
+        {
+            t->lanes[l].first = n;
+            t->lanes[l].nodes = (used - l + t->nlanes - 1) / t->nlanes;
+            for(c = 0; c < CPU_SETSIZE; c++)
+            {
+                if(CPU_ISSET(c, &allowed) && nodeof[c] % t->nlanes == l)
+                    t->cpus[n++] = c;
+            }
+            t->lanes[l].ncpus = n - t->lanes[l].first;
+        }
+    }
+    // Cores: Contiguous Groups of the Allowed CPUs
+    else
+    {
+        t->nlanes = t->ncpus < cap ? t->ncpus : cap;
+        for(c = n = 0; c < CPU_SETSIZE; c++)
+        {
+            if(CPU_ISSET(c, &allowed))
+                t->cpus[n++] = c;
+        }
+        for(l = 0; l < t->nlanes; l++)
+        {
+            t->lanes[l].first = (int) ((long) l * t->ncpus / t->nlanes);
+            t->lanes[l].ncpus = (int) ((long) (l + 1) * t->ncpus / t->nlanes) - t->lanes[l].first;
+            t->lanes[l].nodes = 0;
+        }
+    }
+    free(nodeof);
+    return t;
+}
+
+/* Frees the topology */
+void topology_destroy(Topology* t)
+{
+    if(!t)
+        return;
+    free(t->cpus);
+    free(t);
+}
+
+/* Pins the calling thread to the lane's CPUs (AFFINITY_NODE) or to its k-th CPU (AFFINITY_CORE), returns the lane */
+static int topology_pin(const Topology* t, int lane, int k)
+{
+    const TopoLane* ln = &t->lanes[lane];
+    cpu_set_t set;
+    int i;
+    CPU_ZERO(&set);
+    if(t->mode == AFFINITY_NODE)                    // the scheduler may still move it within the node
+    {
+        for(i = 0; i < ln->ncpus; i++)
+            CPU_SET(t->cpus[ln->first + i], &set);
+    }
+    else
+        CPU_SET(t->cpus[ln->first + k % ln->ncpus], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set); // a CPU going offline just leaves the thread floating
+    return lane;
+}
+
+/* Requesters in a lane (they take its first CPUs) */
+static int lane_requesters(const Topology* t, int lane)
+{
+    return t->requesters / t->nlanes + (lane < t->requesters % t->nlanes);
+}
+
+/* Pins the calling requester (the next one to join) to its lane's CPUs, returns the lane */
+int topology_join_requester(Topology* t)
+{
+    int r = __atomic_fetch_add(&t->joined, 1, __ATOMIC_RELAXED);
+    return topology_pin(t, r % t->nlanes, r / t->nlanes);
+}
+
+/* Pins the calling resolver in pool slot to its lane's CPUs, returns the lane (a respawned slot keeps it) */
+int topology_join_resolver(Topology* t, int slot)
+{
+    int lane = slot % t->nlanes;
+    return topology_pin(t, lane, lane_requesters(t, lane) + slot / t->nlanes); // cores after the lane's requesters
+}
+
+/* Prints one line per lane: its CPUs & thread counts */
+void topology_print(const Topology* t, int resolvers, FILE* out)
+{
+    int l, i;
+    for(l = 0; l < t->nlanes; l++)
+    {
+        const TopoLane* ln = &t->lanes[l];
+        fprintf(out, "lane %d: %d requesters, %d resolvers on", l, lane_requesters(t, l),
+                resolvers / t->nlanes + (l < resolvers % t->nlanes));
+        if(t->mode == AFFINITY_NODE)
+            fprintf(out, " %d node%s,", ln->nodes, ln->nodes == 1 ? "" : "s");
+        fprintf(out, " cpus");
+        for(i = 0; i < ln->ncpus; i++)              // ranges, as in sysfs
+        {
+            int lo = t->cpus[ln->first + i];
+            while(i + 1 < ln->ncpus && t->cpus[ln->first + i + 1] == t->cpus[ln->first + i] + 1)
+                i++;
+            if(t->cpus[ln->first + i] > lo)
+                fprintf(out, "%s%d-%d", lo == t->cpus[ln->first] ? " " : ",", lo, t->cpus[ln->first + i]);
+            else
+                fprintf(out, "%s%d", lo == t->cpus[ln->first] ? " " : ",", lo);
+        }
+        fprintf(out, "\n");
+    }
+}
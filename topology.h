@@ -0,0 +1,52 @@
+// Connor Humiston
+// CPU Topology & Thread Placement Header
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <stdio.h>                                  // placement summary
+
+#define AFFINITY_NONE           0                   // threads float, one shared queue (default)
+#define AFFINITY_NODE           1                   // one lane per NUMA node, threads kept on its CPUs
+#define AFFINITY_CORE           2                   // one lane per group of cores, each thread on one core
+#define TOPOLOGY_NODE_DIR       "/sys/devices/system/node"
+
+
+/* Lane: the CPUs its requesters & resolvers run on, a slice of Topology.cpus */
+typedef struct TopoLane
+{
+    int first;                                      // index of the lane's first CPU in Topology.cpus
+    int ncpus;
+    int nodes;                                      // NUMA nodes merged into the lane (AFFINITY_NODE)
+} TopoLane;
+
+/* Thread Placement: which lane & CPU each requester & resolver gets */
+typedef struct Topology
+{
+    int mode;                                       // AFFINITY_NODE or AFFINITY_CORE
+    int requesters;                                 // requesters spread over the lanes
+    int joined;                                     // requesters placed so far (atomic)
+    int ncpus;                                      // CPUs this process may run on
+    int* cpus;                                      // those CPUs, lane by lane
+    int nlanes;
+    TopoLane lanes[];
+} Topology;
+
+
+/* Reads the NUMA nodes & allowed CPUs & splits them into lanes, never more than there are requesters or
+ * resolvers; NULL on failure */
+Topology* topology_create(int mode, int requesters, int resolvers);
+
+/* Frees the topology */
+void topology_destroy(Topology* t);
+
+/* Pins the calling requester (the next one to join) to its lane's CPUs, returns the lane */
+int topology_join_requester(Topology* t);
+
+/* Pins the calling resolver in pool slot to its lane's CPUs, returns the lane (a respawned slot keeps it) */
+int topology_join_resolver(Topology* t, int slot);
+
+/* Prints one line per lane: its CPUs & thread counts */
+void topology_print(const Topology* t, int resolvers, FILE* out);
+
+#endif
@@ -0,0 +1,191 @@
+// Connor Humiston
+// io_uring Submission & Completion Rings Implementation
+#include "uring.h"
+
+#include <string.h>                                 // memset()
+#include <errno.h>                                  // EINTR
+#include <unistd.h>                                 // syscall(), close()
+#include <sys/mman.h>                               // mmap() of the rings
+#include <sys/syscall.h>                            // __NR_io_uring_*
+
+static unsigned long uring_calls;                   // io_uring_enter() calls (atomic)
+static unsigned long uring_ops;                     // completions reaped (atomic)
+
+
+/* io_uring_enter(): submits to_submit & waits for min_complete when flags has IORING_ENTER_GETEVENTS */
+static int uring_enter(Uring* u, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    __atomic_fetch_add(&uring_calls, 1, __ATOMIC_RELAXED);
+    return (int) syscall(__NR_io_uring_enter, u->fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+/* Returns 1 if this kernel can read & write files through io_uring (checked once), else 0 */
+int uring_available(void)
+{
+    static int available = -1;                      // first call comes from main before any thread starts
+    struct io_uring_probe* probe;
+    size_t size = sizeof(*probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    Uring u;
+
+    if(available >= 0)
+        return available;
+    available = 0;
+    if(uring_init(&u, 2) != 0)                      // ENOSYS, or disabled by sysctl/seccomp
+        return 0;
+    if((probe = calloc(1, size)))                   // READ/WRITE arrived in 5.6 together with the probe
+    {
+        if(syscall(__NR_io_uring_register, u.fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0 &&
+           probe->last_op >= IORING_OP_WRITE &&
+           (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) &&
+           (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED))
+            available = 1;
+        free(probe);
+    }
+    uring_exit(&u);
+    return available;
+}
+
+/* Sets up a ring with room for entries operations in flight, returns 0 or -1 */
+int uring_init(Uring* u, unsigned entries)
+{
+    struct io_uring_params p;
+    char* sq;
+    char* cq;
+
+    memset(u, 0, sizeof(*u));
+    memset(&p, 0, sizeof(p));
+    u->fd = (int) syscall(__NR_io_uring_setup, entries, &p);
+    if(u->fd < 0)
+        return -1;
+    u->entries = p.sq_entries;
+    u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP)        // one mapping holds both rings
+    {
+        if(u->cq_ring_size > u->sq_ring_size)
+            u->sq_ring_size = u->cq_ring_size;
+        u->cq_ring_size = u->sq_ring_size;
+    }
+    u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                      IORING_OFF_SQ_RING);
+    u->cq_ring = u->sq_ring;
+    if(u->sq_ring != MAP_FAILED && !(p.features & IORING_FEAT_SINGLE_MMAP))
+        u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                          IORING_OFF_CQ_RING);
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if(u->sq_ring == MAP_FAILED || u->cq_ring == MAP_FAILED || u->sqes == MAP_FAILED)
+    {
+        uring_exit(u);
+        return -1;
+    }
+    sq = u->sq_ring;
+    cq = u->cq_ring;
+    u->sq_head = (unsigned*) (sq + p.sq_off.head);
+    u->sq_tail = (unsigned*) (sq + p.sq_off.tail);
+    u->sq_mask = (unsigned*) (sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned*) (sq + p.sq_off.array);
+    u->cq_head = (unsigned*) (cq + p.cq_off.head);
+    u->cq_tail = (unsigned*) (cq + p.cq_off.tail);
+    u->cq_mask = (unsigned*) (cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+    return 0;
+}
+
+/* Tears the ring down (waits for nothing: callers reap their operations first) */
+void uring_exit(Uring* u)
+{
+    if(u->sqes && u->sqes != MAP_FAILED)
+        munmap(u->sqes, u->sqes_size);
+    if(u->cq_ring && u->cq_ring != MAP_FAILED && u->cq_ring != u->sq_ring)
+        munmap(u->cq_ring, u->cq_ring_size);
+    if(u->sq_ring && u->sq_ring != MAP_FAILED)
+        munmap(u->sq_ring, u->sq_ring_size);
+    if(u->fd >= 0)
+        close(u->fd);                               // also drops the registered buffers
+    memset(u, 0, sizeof(*u));
+    u->fd = -1;
+}
+
+/* Registers n buffers for IORING_OP_READ_FIXED/WRITE_FIXED, returns 0 or -1 (plain opcodes still work) */
+int uring_register(Uring* u, const struct iovec* iov, unsigned n)
+{
+    if(syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_BUFFERS, iov, n) != 0)
+        return -1;                                  // e.g. over RLIMIT_MEMLOCK on older kernels
+    u->fixed = 1;
+    return 0;
+}
+
+/* Prepares a read or write of len bytes at off (-1: the file position) into buffer index (-1: unregistered),
+ * returns 0 or -1 if the submission ring is full */
+int uring_prep(Uring* u, int write, int fd, void* buf, unsigned len, off_t off, int index, uint64_t data)
+{
+    unsigned tail = *u->sq_tail;                    // only this thread moves the tail
+    unsigned idx = tail & *u->sq_mask;
+    struct io_uring_sqe* sqe = &u->sqes[idx];
+    if(tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->entries)
+        return -1;
+    memset(sqe, 0, sizeof(*sqe));
+    if(index >= 0 && u->fixed)
+    {
+        sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->buf_index = (uint16_t) index;
+    }
+    else
+        sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) (uintptr_t) buf;
+    sqe->len = len;
+    sqe->off = (uint64_t) off;
+    sqe->user_data = data;
+    u->sq_array[idx] = idx;
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE); // the kernel may read the entry from now on
+    u->queued++;
+    return 0;
+}
+
+/* Passes the prepared operations to the kernel & waits for wait completions, one system call; returns 0 or -1 */
+int uring_submit(Uring* u, unsigned wait)
+{
+    while(u->queued > 0 || wait > 0)
+    {
+        int n = uring_enter(u, u->queued, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n < 0 || (n == 0 && u->queued > 0))     // a ring that takes nothing would spin here
+            return -1;
+        u->queued -= (unsigned) n < u->queued ? (unsigned) n : u->queued;
+        if(u->queued == 0)                          // waited too, unless the kernel took only part of the batch
+            break;
+    }
+    return 0;
+}
+
+/* Takes one completion if there is one (waiting for it when wait is set), returns 1 or 0 */
+int uring_reap(Uring* u, uint64_t* data, int* res, int wait)
+{
+    while(1)
+    {
+        unsigned head = *u->cq_head;                // only this thread moves the head
+        if(head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+        {
+            struct io_uring_cqe* cqe = &u->cqes[head & *u->cq_mask];
+            *data = cqe->user_data;
+            *res = cqe->res;
+            __atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE); // the kernel may reuse the entry
+            __atomic_fetch_add(&uring_ops, 1, __ATOMIC_RELAXED);
+            return 1;
+        }
+        if(!wait)
+            return 0;
+        if(uring_enter(u, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+            return 0;
+    }
+}
+
+/* System calls made & operations completed through every ring so far */
+void uring_stats(unsigned long* calls, unsigned long* ops)
+{
+    *calls = __atomic_load_n(&uring_calls, __ATOMIC_RELAXED);
+    *ops = __atomic_load_n(&uring_ops, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,66 @@
+// Connor Humiston
+// io_uring Submission & Completion Rings Header
+#ifndef URING_H
+#define URING_H
+
+#include <stdlib.h>                                 // standard vars, macros & functions
+#include <stdint.h>                                 // fixed width integer types
+#include <sys/types.h>                              // off_t
+#include <sys/uio.h>                                // struct iovec
+#include <linux/io_uring.h>                         // ring layout, opcodes & setup parameters
+
+#define IO_AUTO                 0                   // io_uring when the kernel has it, else read()/write() (default)
+#define IO_URING                1                   // io_uring or refuse to run
+#define IO_SYNC                 2                   // plain read()/write() system calls
+
+
+/* One Thread's Ring: submissions & completions shared with the kernel through mmap()ed memory */
+typedef struct Uring
+{
+    int fd;                                         // ring file descriptor, -1 when not set up
+    unsigned entries;                               // submission slots
+    unsigned* sq_head;                              // consumed by the kernel
+    unsigned* sq_tail;                              // advanced by us
+    unsigned* sq_mask;
+    unsigned* sq_array;                             // indexes into sqes, kept the identity
+    struct io_uring_sqe* sqes;
+    unsigned* cq_head;                              // advanced by us
+    unsigned* cq_tail;                              // advanced by the kernel
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;                                  // mappings, unmapped by uring_exit()
+    size_t sq_ring_size;
+    void* cq_ring;                                  // == sq_ring with IORING_FEAT_SINGLE_MMAP
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned queued;                                // prepared but not yet passed to the kernel
+    int fixed;                                      // buffers registered, *_FIXED opcodes may be used
+} Uring;
+
+
+/* Returns 1 if this kernel can read & write files through io_uring (checked once), else 0 */
+int uring_available(void);
+
+/* Sets up a ring with room for entries operations in flight, returns 0 or -1 */
+int uring_init(Uring* u, unsigned entries);
+
+/* Tears the ring down (waits for nothing: callers reap their operations first) */
+void uring_exit(Uring* u);
+
+/* Registers n buffers for IORING_OP_READ_FIXED/WRITE_FIXED, returns 0 or -1 (plain opcodes still work) */
+int uring_register(Uring* u, const struct iovec* iov, unsigned n);
+
+/* Prepares a read or write of len bytes at off (-1: the file position) into buffer index (-1: unregistered),
+ * returns 0 or -1 if the submission ring is full */
+int uring_prep(Uring* u, int write, int fd, void* buf, unsigned len, off_t off, int index, uint64_t data);
+
+/* Passes the prepared operations to the kernel & waits for wait completions, one system call; returns 0 or -1 */
+int uring_submit(Uring* u, unsigned wait);
+
+/* Takes one completion if there is one (waiting for it when wait is set), returns 1 or 0 */
+int uring_reap(Uring* u, uint64_t* data, int* res, int wait);
+
+/* System calls made & operations completed through every ring so far */
+void uring_stats(unsigned long* calls, unsigned long* ops);
+
+#endif
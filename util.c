@@ -17,69 +17,85 @@
 int dnslookup(const char* hostname, char* firstIPstr, int maxSize){
 
     /* Local vars */
+    UtilAddr addr;
+
+    /* Lookup Hostname: first address of either family */
+    if(dnslookup_all(hostname, AF_UNSPEC, &addr, 1) < 1){
+	return UTIL_FAILURE;
+    }
+    /* Convert to String */
+    if(!inet_ntop(addr.family, &addr.addr, firstIPstr, maxSize)){
+	perror("Error Converting IP to String");
+	return UTIL_FAILURE;
+    }
+#ifdef UTIL_DEBUG
+    fprintf(stdout, "%s\n", firstIPstr);
+#endif
+
+    return UTIL_SUCCESS;
+}
+
+int dnslookup_all(const char* hostname, int family, UtilAddr* addrs, int max){
+
+    /* Local vars */
+    struct addrinfo hints;
     struct addrinfo* headresult = NULL;
     struct addrinfo* result = NULL;
-    struct sockaddr_in* ipv4sock = NULL;
-    struct in_addr* ipv4addr = NULL;
-    char ipv4str[INET_ADDRSTRLEN];
-    char ipstr[INET6_ADDRSTRLEN];
     int addrError = 0;
+    int n = 0;
+    int i;
 
     /* DEBUG: Print Hostname*/
 #ifdef UTIL_DEBUG
     fprintf(stderr, "%s\n", hostname);
 #endif
-   
+
+    /* Hints: one socket type, so each address is listed once instead of per SOCK_STREAM/DGRAM/RAW */
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = family;
+    hints.ai_socktype = SOCK_DGRAM;
+
     /* Lookup Hostname */
-    addrError = getaddrinfo(hostname, NULL, NULL, &headresult);
+    addrError = getaddrinfo(hostname, NULL, &hints, &headresult);
     if(addrError){
 	fprintf(stderr, "Error looking up Address: %s\n",
 		gai_strerror(addrError));
 	return UTIL_FAILURE;
     }
-    /* Loop Through result Linked List */
-    for(result=headresult; result != NULL; result = result->ai_next){
-	/* Extract IP Address and Convert to String */
+    /* Loop Through result Linked List, Keeping Each Distinct Address */
+    for(result=headresult; result != NULL && n < max; result = result->ai_next){
+	UtilAddr* a = &addrs[n];
+	memset(a, 0, sizeof(*a));
 	if(result->ai_addr->sa_family == AF_INET){
 	    /* IPv4 Address Handling */
-	    ipv4sock = (struct sockaddr_in*)(result->ai_addr);
-	    ipv4addr = &(ipv4sock->sin_addr);
-	    if(!inet_ntop(result->ai_family, ipv4addr,
-			  ipv4str, sizeof(ipv4str))){
-		perror("Error Converting IP to String");
-		return UTIL_FAILURE;
-	    }
-#ifdef UTIL_DEBUG
-	    fprintf(stdout, "%s\n", ipv4str);
-#endif
-	    strncpy(ipstr, ipv4str, sizeof(ipstr));
-	    ipstr[sizeof(ipstr)-1] = '\0';
+	    a->family = AF_INET;
+	    memcpy(&a->addr, &((struct sockaddr_in*) result->ai_addr)->sin_addr, sizeof(struct in_addr));
 	}
 	else if(result->ai_addr->sa_family == AF_INET6){
 	    /* IPv6 Handling */
-#ifdef UTIL_DEBUG
-	    fprintf(stdout, "IPv6 Address: Not Handled\n");
-#endif
-	    strncpy(ipstr, "UNHANDELED", sizeof(ipstr));
-	    ipstr[sizeof(ipstr)-1] = '\0';
+	    a->family = AF_INET6;
+	    a->addr = ((struct sockaddr_in6*) result->ai_addr)->sin6_addr;
 	}
 	else{
 	    /* Unhandlded Protocol Handling */
 #ifdef UTIL_DEBUG
 	    fprintf(stdout, "Unknown Protocol: Not Handled\n");
 #endif
-	    strncpy(ipstr, "UNHANDELED", sizeof(ipstr));
-	    ipstr[sizeof(ipstr)-1] = '\0';
+	    continue;
 	}
-	/* Save First IP Address */
-	if(result==headresult){
-	    strncpy(firstIPstr, ipstr, maxSize);
-	    firstIPstr[maxSize-1] = '\0';
+	/* Skip Duplicates (resolvers may still repeat an address) */
+	for(i = 0; i < n; i++){
+	    if(addrs[i].family == a->family && memcmp(&addrs[i].addr, &a->addr, sizeof(a->addr)) == 0){
+		break;
+	    }
+	}
+	if(i == n){
+	    n++;
 	}
     }
 
     /* Cleanup */
     freeaddrinfo(headresult);
 
-    return UTIL_SUCCESS;
+    return n > 0 ? n : UTIL_FAILURE;
 }
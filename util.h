@@ -31,6 +31,14 @@
 #define UTIL_FAILURE -1
 #define UTIL_SUCCESS 0
 
+#define UTIL_MAX_ADDRS 8
+
+/* One address from a lookup */
+typedef struct UtilAddr {
+    int family;                 /* AF_INET or AF_INET6 */
+    struct in6_addr addr;       /* 4 or 16 significant bytes */
+} UtilAddr;
+
 /* Fuction to return the first IP address found
  * for hostname. IP address returned as string
  * firstIPstr of size maxsize
@@ -39,4 +47,14 @@ int dnslookup(const char* hostname,
 	      char* firstIPstr,
 	      int maxSize);
 
+/* Function to return every distinct address found
+ * for hostname (family AF_INET, AF_INET6 or AF_UNSPEC
+ * for both) in the caller's array of max addresses.
+ * Returns the number found or UTIL_FAILURE
+ */
+int dnslookup_all(const char* hostname,
+		  int family,
+		  UtilAddr* addrs,
+		  int max);
+
 #endif